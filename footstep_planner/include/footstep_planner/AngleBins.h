@@ -0,0 +1,81 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FOOTSTEP_PLANNER_ANGLEBINS_H_
+#define FOOTSTEP_PLANNER_ANGLEBINS_H_
+
+
+namespace footstep_planner
+{
+/**
+ * @brief Wrap-around arithmetic of discretized angles for a number of angle
+ * bins N fixed at compile time (has to be a power of two), reducing the
+ * wrap-around to a bit mask.
+ *
+ * AngleBins<0> is the fallback for a number of bins only known at runtime
+ * (passed as 'num_angle_bins'; ignored by the fixed variants).
+ */
+template <int N>
+struct AngleBins
+{
+  static int size(int /*num_angle_bins*/) { return N; }
+
+  /// @return 'theta' in [-N..2N) wrapped into [0..N).
+  static int wrap(int theta, int /*num_angle_bins*/)
+  {
+    return theta & (N - 1);
+  }
+
+  /// @return The difference 'diff' in (-N..N) wrapped into [-N/2..N/2).
+  static int wrapDiff(int diff, int /*num_angle_bins*/)
+  {
+    return ((diff + N / 2) & (N - 1)) - N / 2;
+  }
+};
+
+
+template <>
+struct AngleBins<0>
+{
+  static int size(int num_angle_bins) { return num_angle_bins; }
+
+  static int wrap(int theta, int num_angle_bins)
+  {
+    if (theta < 0)
+      return theta + num_angle_bins;
+    if (theta >= num_angle_bins)
+      return theta - num_angle_bins;
+    return theta;
+  }
+
+  static int wrapDiff(int diff, int num_angle_bins)
+  {
+    int num_angle_bins_half = num_angle_bins / 2;
+    if (diff >= num_angle_bins_half)
+      return diff - num_angle_bins;
+    if (diff < -num_angle_bins_half)
+      return diff + num_angle_bins;
+    return diff;
+  }
+};
+}
+
+#endif  // FOOTSTEP_PLANNER_ANGLEBINS_H_
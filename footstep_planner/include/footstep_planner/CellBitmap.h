@@ -0,0 +1,162 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FOOTSTEP_PLANNER_CELLBITMAP_H_
+#define FOOTSTEP_PLANNER_CELLBITMAP_H_
+
+#include <iterator>
+#include <utility>
+#include <vector>
+
+
+namespace footstep_planner
+{
+/**
+ * @brief A dense set of 2D planning cells, stored as one bit per cell of
+ * a fixed area [min_x, min_x + size_x) x [min_y, min_y + size_y).
+ *
+ * Used to track the (x, y) cells of the expanded states without allocating
+ * a node per cell. Iterating the set visits the set bits in row major order.
+ */
+class CellBitmap
+{
+public:
+  typedef std::pair<int, int> cell_t;
+
+  /// @brief Forward iterator over the (x, y) cells in the set.
+  class const_iterator
+  : public std::iterator<std::forward_iterator_tag, cell_t>
+  {
+  public:
+    const_iterator() : ivBitmap(NULL), ivBit(0) {}
+
+    const cell_t& operator*() const { return ivCell; }
+    const cell_t* operator->() const { return &ivCell; }
+
+    const_iterator& operator++()
+    {
+      ivBit = ivBitmap->nextBit(ivBit + 1);
+      updateCell();
+      return *this;
+    }
+
+    const_iterator operator++(int)
+    {
+      const_iterator tmp(*this);
+      ++(*this);
+      return tmp;
+    }
+
+    bool operator==(const const_iterator& other) const
+    {
+      return ivBit == other.ivBit;
+    }
+    bool operator!=(const const_iterator& other) const
+    {
+      return ivBit != other.ivBit;
+    }
+
+  private:
+    friend class CellBitmap;
+
+    const_iterator(const CellBitmap* bitmap, size_t bit)
+    : ivBitmap(bitmap), ivBit(bit)
+    {
+      updateCell();
+    }
+
+    void updateCell()
+    {
+      if (ivBit < ivBitmap->ivNumBits)
+      {
+        ivCell.first = ivBitmap->ivMinX + int(ivBit % ivBitmap->ivSizeX);
+        ivCell.second = ivBitmap->ivMinY + int(ivBit / ivBitmap->ivSizeX);
+      }
+    }
+
+    const CellBitmap* ivBitmap;
+    size_t ivBit;
+    cell_t ivCell;
+  };
+
+  CellBitmap();
+
+  /**
+   * @brief Empties the set and sets the covered area to
+   * [min_x, min_x + size_x) x [min_y, min_y + size_y).
+   */
+  void resize(int min_x, int min_y, int size_x, int size_y);
+
+  /// @brief Empties the set (keeping the covered area).
+  void clear();
+
+  /// @brief Adds a cell to the set (ignored if not covered).
+  void insert(int x, int y)
+  {
+    x -= ivMinX;
+    y -= ivMinY;
+    if (x < 0 || y < 0 || x >= ivSizeX || y >= ivSizeY)
+      return;
+    size_t bit = size_t(y) * ivSizeX + x;
+    ivWords[bit >> 5] |= 1u << (bit & 31);
+  }
+
+  /// @return True iff the cell is in the set.
+  bool contains(int x, int y) const
+  {
+    x -= ivMinX;
+    y -= ivMinY;
+    if (x < 0 || y < 0 || x >= ivSizeX || y >= ivSizeY)
+      return false;
+    size_t bit = size_t(y) * ivSizeX + x;
+    return (ivWords[bit >> 5] >> (bit & 31)) & 1u;
+  }
+
+  /// @return The number of cells in the set.
+  size_t count() const;
+
+  /// @brief Exchanges the contents in O(1).
+  void swap(CellBitmap& other);
+
+  /// @return The number of bytes allocated for the bitmap.
+  size_t bytesAllocated() const
+  {
+    return ivWords.capacity() * sizeof(unsigned int);
+  }
+
+  const_iterator begin() const { return const_iterator(this, nextBit(0)); }
+  const_iterator end() const { return const_iterator(this, ivNumBits); }
+
+private:
+  /// @return The index of the first set bit >= 'bit' (ivNumBits if none).
+  size_t nextBit(size_t bit) const;
+
+  int ivMinX;
+  int ivMinY;
+  int ivSizeX;
+  int ivSizeY;
+  size_t ivNumBits;
+
+  std::vector<unsigned int> ivWords;
+};
+}
+
+#endif  // FOOTSTEP_PLANNER_CELLBITMAP_H_
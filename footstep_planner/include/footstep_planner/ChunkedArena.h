@@ -0,0 +1,133 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FOOTSTEP_PLANNER_CHUNKEDARENA_H_
+#define FOOTSTEP_PLANNER_CHUNKEDARENA_H_
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+
+namespace footstep_planner
+{
+/**
+ * @brief A simple bump allocator handing out storage for objects of type T
+ * from a list of fixed size chunks.
+ *
+ * Chunks are never returned to the system before the arena is destroyed;
+ * ChunkedArena::clear() only rewinds the allocation cursor so that the
+ * memory is reused by the next planning task. Destructors of the objects
+ * constructed in the arena are NOT called, i.e. T has to be a type whose
+ * destructor has no side effects (like PlanningState or plain ints).
+ */
+template <typename T>
+class ChunkedArena
+{
+public:
+  /**
+   * @param chunk_size The number of objects of type T fitting into one
+   * chunk.
+   */
+  explicit ChunkedArena(size_t chunk_size)
+  : ivChunkSize(chunk_size),
+    ivCurrentChunk(0),
+    ivChunkOffset(0),
+    ivNumAllocated(0),
+    ivHighWaterMark(0)
+  {
+    assert(ivChunkSize > 0);
+  }
+
+  ~ChunkedArena()
+  {
+    for (size_t i = 0; i < ivChunks.size(); ++i)
+      ::operator delete(ivChunks[i]);
+    ivChunks.clear();
+  }
+
+  /**
+   * @return Uninitialized, contiguous storage for n objects of type T.
+   * Use placement new to construct the objects.
+   */
+  T* allocate(size_t n = 1)
+  {
+    assert(n > 0 && n <= ivChunkSize);
+
+    if (ivChunkOffset + n > ivChunkSize || ivChunks.empty())
+    {
+      // move on to the next chunk (allocating it if necessary); the tail
+      // of the current chunk is left unused
+      if (!ivChunks.empty())
+        ++ivCurrentChunk;
+      if (ivCurrentChunk == ivChunks.size())
+        ivChunks.push_back(
+          static_cast<T*>(::operator new(ivChunkSize * sizeof(T))));
+      ivChunkOffset = 0;
+    }
+
+    T* p = ivChunks[ivCurrentChunk] + ivChunkOffset;
+    ivChunkOffset += n;
+    ivNumAllocated += n;
+    if (ivNumAllocated > ivHighWaterMark)
+      ivHighWaterMark = ivNumAllocated;
+
+    return p;
+  }
+
+  /**
+   * @brief Releases all objects at once in O(1). The chunks are kept for
+   * subsequent allocations.
+   */
+  void clear()
+  {
+    ivCurrentChunk = 0;
+    ivChunkOffset = 0;
+    ivNumAllocated = 0;
+  }
+
+  /// @return The number of objects currently allocated.
+  size_t size() const { return ivNumAllocated; }
+
+  /// @return The maximal number of objects allocated at the same time.
+  size_t highWaterMark() const { return ivHighWaterMark; }
+
+  /// @return The number of bytes reserved by the arena.
+  size_t bytesReserved() const
+  {
+    return ivChunks.size() * ivChunkSize * sizeof(T);
+  }
+
+private:
+  // non-copyable
+  ChunkedArena(const ChunkedArena&);
+  ChunkedArena& operator=(const ChunkedArena&);
+
+  const size_t ivChunkSize;
+  std::vector<T*> ivChunks;
+  size_t ivCurrentChunk;
+  size_t ivChunkOffset;
+  size_t ivNumAllocated;
+  size_t ivHighWaterMark;
+};
+}
+
+#endif  // FOOTSTEP_PLANNER_CHUNKEDARENA_H_
@@ -0,0 +1,134 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FOOTSTEP_PLANNER_COLLISIONCACHE_H_
+#define FOOTSTEP_PLANNER_COLLISIONCACHE_H_
+
+#include <footstep_planner/helper.h>
+
+#include <vector>
+
+
+namespace footstep_planner
+{
+/**
+ * @brief A lazily filled cache of collision check results for discrete
+ * foot poses (x, y, theta, leg).
+ *
+ * Each entry takes two bits (unknown, free, occupied). The covered area of
+ * the planning grid is split into square tiles which are only allocated
+ * when a result inside of them is stored, so the memory consumption scales
+ * with the area actually explored by the planner.
+ */
+class CollisionCache
+{
+public:
+  enum Status
+  {
+    UNKNOWN = 0,
+    FREE = 1,
+    OCCUPIED = 2
+  };
+
+  /// @param num_angle_bins The number of bins used to discretize the
+  /// robot orientations.
+  explicit CollisionCache(int num_angle_bins);
+
+  ~CollisionCache();
+
+  /**
+   * @brief Frees all tiles and sets the covered area of the planning grid
+   * to [min_x, min_x + size_x) x [min_y, min_y + size_y).
+   */
+  void resize(int min_x, int min_y, int size_x, int size_y);
+
+  /// @brief Invalidates all entries (keeping the covered area).
+  void clear();
+
+  /**
+   * @brief Invalidates all entries within the (inclusive) area of planning
+   * cells [min_x, max_x] x [min_y, max_y].
+   */
+  void clear(int min_x, int min_y, int max_x, int max_y);
+
+  /// @return The cached status of the foot pose (UNKNOWN if not covered).
+  Status get(int x, int y, int theta, Leg leg) const
+  {
+    const unsigned int* tile;
+    unsigned int bit;
+    if (!locate(x, y, theta, leg, &tile, &bit) || tile == NULL)
+      return UNKNOWN;
+    return Status((tile[bit >> 5] >> (bit & 31)) & 3u);
+  }
+
+  /// @brief Stores the collision status of a foot pose (ignored if not
+  /// covered).
+  void set(int x, int y, int theta, Leg leg, bool occupied);
+
+  /// @return The number of bytes currently allocated for tiles.
+  size_t bytesAllocated() const;
+
+  /// Side length of each tile (in planning cells).
+  static const int cvTileSize = 16;
+
+private:
+  // non-copyable
+  CollisionCache(const CollisionCache&);
+  CollisionCache& operator=(const CollisionCache&);
+
+  /**
+   * @brief Determines the tile and the bit offset within the tile of an
+   * entry.
+   * @return False iff the foot pose is not covered by the cache.
+   */
+  bool locate(int x, int y, int theta, Leg leg, const unsigned int** tile,
+              unsigned int* bit) const
+  {
+    x -= ivMinX;
+    y -= ivMinY;
+    if (x < 0 || y < 0 || x >= ivSizeX || y >= ivSizeY || leg == NOLEG)
+      return false;
+    *tile = ivTiles[(y / cvTileSize) * ivNumTilesX + (x / cvTileSize)];
+    unsigned int cell = (y % cvTileSize) * cvTileSize + (x % cvTileSize);
+    *bit = cell * ivBitsPerCell + 2 * (2 * theta + leg);
+    return true;
+  }
+
+  void freeTiles();
+
+  const int ivNumAngleBins;
+  /// Number of bits used per planning cell (two per angle bin and leg).
+  const unsigned int ivBitsPerCell;
+  /// Number of words of each tile.
+  const unsigned int ivTileWords;
+
+  int ivMinX;
+  int ivMinY;
+  int ivSizeX;
+  int ivSizeY;
+  int ivNumTilesX;
+  int ivNumTilesY;
+
+  /// The tiles (row major); NULL if not yet allocated.
+  std::vector<unsigned int*> ivTiles;
+};
+}
+
+#endif  // FOOTSTEP_PLANNER_COLLISIONCACHE_H_
@@ -22,6 +22,7 @@
 #ifndef FOOTSTEP_PLANNER_FOOTSTEP_H_
 #define FOOTSTEP_PLANNER_FOOTSTEP_H_
 
+#include <footstep_planner/AngleBins.h>
 #include <footstep_planner/PlanningState.h>
 
 
@@ -66,6 +67,36 @@ public:
    */
   PlanningState performMeOnThisState(const PlanningState& current) const;
 
+  /**
+   * @brief Variant of performMeOnThisState() for a number of angle bins N
+   * fixed at compile time (see AngleBins; N = 0 for the runtime number of
+   * bins).
+   */
+  template <int N>
+  PlanningState performMeOnThisState(const PlanningState& current) const
+  {
+    const int num_angle_bins = AngleBins<N>::size(ivNumAngleBins);
+    const int theta = current.getTheta();
+    if (current.getLeg() == RIGHT)
+    {
+      const footstep_xy& xy =
+        ivDiscSteps[SUCCESSOR_RIGHT * num_angle_bins + theta];
+      return PlanningState(current.getX() + xy.first,
+                           current.getY() + xy.second,
+                           AngleBins<N>::wrap(theta + ivTheta, ivNumAngleBins),
+                           LEFT, ivMaxHashSize);
+    }
+    else // leg == LEFT
+    {
+      const footstep_xy& xy =
+        ivDiscSteps[SUCCESSOR_LEFT * num_angle_bins + theta];
+      return PlanningState(current.getX() + xy.first,
+                           current.getY() + xy.second,
+                           AngleBins<N>::wrap(theta - ivTheta, ivNumAngleBins),
+                           RIGHT, ivMaxHashSize);
+    }
+  }
+
   /**
    * @brief Reverse this footstep on a given planning state.
    *
@@ -76,10 +107,53 @@ public:
    */
   PlanningState reverseMeOnThisState(const PlanningState& current) const;
 
+  /**
+   * @brief Variant of reverseMeOnThisState() for a number of angle bins N
+   * fixed at compile time (see AngleBins; N = 0 for the runtime number of
+   * bins).
+   */
+  template <int N>
+  PlanningState reverseMeOnThisState(const PlanningState& current) const
+  {
+    const int num_angle_bins = AngleBins<N>::size(ivNumAngleBins);
+    const int theta = current.getTheta();
+    if (current.getLeg() == LEFT)
+    {
+      const footstep_xy& xy =
+        ivDiscSteps[PREDECESSOR_LEFT * num_angle_bins + theta];
+      return PlanningState(current.getX() + xy.first,
+                           current.getY() + xy.second,
+                           AngleBins<N>::wrap(theta - ivTheta, ivNumAngleBins),
+                           RIGHT, ivMaxHashSize);
+    }
+    else // leg == RIGHT
+    {
+      const footstep_xy& xy =
+        ivDiscSteps[PREDECESSOR_RIGHT * num_angle_bins + theta];
+      return PlanningState(current.getX() + xy.first,
+                           current.getY() + xy.second,
+                           AngleBins<N>::wrap(theta + ivTheta, ivNumAngleBins),
+                           LEFT, ivMaxHashSize);
+    }
+  }
+
 private:
   /// Typedef representing the (discretized) translation of the footstep.
   typedef std::pair<int, int> footstep_xy;
 
+  /// The tables of (discretized) translations within ivDiscSteps.
+  enum StepTable
+  {
+    /// The translations for a left supporting foot.
+    SUCCESSOR_LEFT = 0,
+    /// The translations for a right supporting foot.
+    SUCCESSOR_RIGHT = 1,
+    /// The reversed translations for a left supporting foot.
+    PREDECESSOR_LEFT = 2,
+    /// The reversed translations for a right supporting foot.
+    PREDECESSOR_RIGHT = 3
+  };
+
   /// Initialization method called within the constructor.
   void init(double x, double y);
 
@@ -115,14 +189,13 @@ private:
   /// The maximal hash size.
   int ivMaxHashSize;
 
-  /// The (discretized) translation(s) for a left supporting foot.
-  std::vector<footstep_xy> ivDiscSuccessorLeft;
-  /// The (discretized) translation(s) for a right supporting foot.
-  std::vector<footstep_xy> ivDiscSuccessorRight;
-  /// The reversed (discretized) translation(s) for a left supporting foot.
-  std::vector<footstep_xy> ivDiscPredecessorLeft;
-  /// The reversed (discretized) translation(s) for a right supporting foot.
-  std::vector<footstep_xy> ivDiscPredecessorRight;
+  /**
+   * @brief The (discretized) translations for each orientation of the
+   * supporting foot, stored contiguously as the four StepTable tables of
+   * ivNumAngleBins entries each (i.e. indexed by
+   * table * ivNumAngleBins + theta).
+   */
+  std::vector<footstep_xy> ivDiscSteps;
 };
 } // end of namespace
 
@@ -38,6 +38,12 @@
 #include <tf/tf.h>
 #include <tf/transform_listener.h>
 
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 #include <assert.h>
 
 
@@ -50,6 +56,8 @@ namespace footstep_planner
 class FootstepNavigation
 {
 public:
+  typedef boost::shared_ptr<const std::vector<State> > path_ptr_t;
+
   FootstepNavigation();
   virtual ~FootstepNavigation();
 
@@ -89,13 +97,83 @@ protected:
    * FootstepPlanner::plan() is called to plan from scratch. Otherwise
    * the planning task is unsuccessful.
    *
+   * With warm start replanning the robot's feet are first reconnected to
+   * the remaining path (FootstepPlanner::replanFromPath()) and a path is
+   * planned from scratch only if this fails.
+   *
    * @return Success of the planning.
    */
   bool replan();
 
-  /// @brief Starts the execution of the calculated path.
+  /**
+   * @brief Starts the execution of the calculated path (i.e. copies the
+   * planner's path into the executed path).
+   */
   void startExecution();
 
+  /**
+   * @brief Stops a running execution and waits until the execution thread
+   * has finished (unless called from within this thread).
+   */
+  void stopExecution();
+
+  /// @return The path that is currently executed (thread-safe).
+  path_ptr_t getExecutionPath();
+
+  /**
+   * @brief Requests a planning task from the background planning thread.
+   *
+   * @param restart Whether to plan from the robot's current feet (and to
+   * restart the execution) instead of continuing the executed path.
+   */
+  void requestPlanning(bool restart);
+
+  /**
+   * @brief Main loop of the background planning thread: applies the
+   * received goals and maps and plans continuations of the executed path
+   * (or new paths if the robot is not walking).
+   */
+  void backgroundPlanning();
+
+  /**
+   * @brief Plans from the feet reached after the state 'connection' of the
+   * executed path 'path' to the goal. On success the continued path is
+   * stored as the next path to execute (see takePlannedPath()).
+   */
+  bool planContinuation(const std::vector<State>& path, int connection);
+
+  /**
+   * @brief Swaps the path planned in the background in as the executed
+   * path if the robot has not yet passed its connection.
+   *
+   * @param current_idx Index of the last state of the executed path the
+   * robot has reached.
+   * @return True iff the executed path has been swapped.
+   */
+  bool takePlannedPath(int current_idx);
+
+  /**
+   * @brief Updates the index of the state the robot currently executes.
+   * Once the execution has finished the planning postponed until then is
+   * requested.
+   */
+  void setExecutionProgress(int idx);
+
+  /**
+   * @brief Starts the execution as soon as the planner found its first
+   * solution (used as solution callback of the planner).
+   *
+   * @return False, i.e. the search stops at the first solution since the
+   * executed path must not change.
+   */
+  bool firstSolutionCallback(const FootstepPlanner& planner);
+
+  /**
+   * @brief Starts the execution of the calculated path unless it has
+   * already been started by firstSolutionCallback().
+   */
+  void startExecutionOnce();
+
   /**
    * @brief Obtains the pose of the robot's foot from tf.
    *
@@ -215,7 +293,7 @@ protected:
   bool ivForwardSearch;
 
   /// Used to lock the calculation and execution of footsteps.
-  bool ivExecutingFootsteps;
+  boost::atomic<bool> ivExecutingFootsteps;
 
   /// The rate the action server sends its feedback.
   double ivFeedbackFrequency;
@@ -242,6 +320,46 @@ protected:
   /// Whether to use the slower but more cautious execution or not.
   bool ivSafeExecution;
 
+  /// Whether to start the execution with the first solution of the planner.
+  bool ivStartOnFirstSolution;
+
+  /// Whether the execution of the current planning task has been started
+  /// (shared by the execution and the background planning thread).
+  boost::atomic<bool> ivExecutionStarted;
+
+  /// Whether to replan by reconnecting to the remaining path first.
+  bool ivWarmStartReplanning;
+
+  /**
+   * The path that is executed (front buffer). It is never modified but
+   * replaced under ivBackgroundMutex, i.e. the execution keeps its own
+   * reference to the path it walks (see getExecutionPath()).
+   */
+  path_ptr_t ivExecutionPath;
+  /// Index of the state of ivExecutionPath currently executed.
+  int ivExecutionProgress;
+
+  /// Whether planning is done by a background thread during the execution.
+  bool ivBackgroundPlanning;
+  /// Number of steps between the executed state and a continuation.
+  int ivBackgroundLookahead;
+  /// Period (in s) of continuous replanning while walking (0: none).
+  double ivBackgroundPeriod;
+  boost::shared_ptr<boost::thread> ivBackgroundPlanningPtr;
+  /// Protects the following members and ivExecutionPath.
+  boost::mutex ivBackgroundMutex;
+  boost::condition_variable ivBackgroundCondition;
+  bool ivBackgroundShutdown;
+  geometry_msgs::PoseStampedConstPtr ivPendingGoal;
+  gridmap_2d::GridMap2DPtr ivPendingMap;
+  bool ivRestartRequested;
+  bool ivContinuationRequested;
+  /// Whether to plan from the robot's feet once the execution has finished.
+  bool ivPlanAfterExecution;
+  /// The path planned in the background (back buffer) and its connection.
+  std::vector<State> ivPlannedPath;
+  int ivPlannedPathConnection;
+
   double ivMaxStepX;
   double ivMaxStepY;
   double ivMaxStepTheta;
@@ -25,11 +25,16 @@
 #include <geometry_msgs/Pose.h>
 #include <geometry_msgs/PoseStamped.h>
 #include <geometry_msgs/PoseWithCovarianceStamped.h>
+#include <humanoid_nav_msgs/FootstepSolution.h>
+#include <humanoid_nav_msgs/PlanningStats.h>
 #include <humanoid_nav_msgs/PlanFootsteps.h>
+#include <humanoid_nav_msgs/PlanFootstepsBatch.h>
 #include <humanoid_nav_msgs/PlanFootstepsBetweenFeet.h>
 #include <footstep_planner/helper.h>
 #include <footstep_planner/PathCostHeuristic.h>
 #include <footstep_planner/FootstepPlannerEnvironment.h>
+#include <footstep_planner/FootstepPlannerPool.h>
+#include <footstep_planner/FootstepPlannerPortfolio.h>
 #include <footstep_planner/PlanningStateChangeQuery.h>
 #include <footstep_planner/State.h>
 #include <nav_msgs/Path.h>
@@ -42,6 +47,11 @@
 #include <XmlRpcValue.h>
 #include <XmlRpcException.h>
 
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 #include <assert.h>
 #include <time.h>
 
@@ -57,6 +67,16 @@ typedef std::vector<State>::const_iterator state_iter_t;
 class FootstepPlanner
 {
 public:
+  /**
+   * @brief Called for each improved solution while streaming solutions
+   * (see setSolutionCallback()). The path of the solution can be accessed
+   * via the planner.
+   *
+   * @return False to stop the search (the current solution is the result of
+   * the planning task).
+   */
+  typedef boost::function<bool (const FootstepPlanner&)> solution_callback_t;
+
   FootstepPlanner();
   virtual ~FootstepPlanner();
 
@@ -86,6 +106,22 @@ public:
    */
   bool replan();
 
+  /**
+   * @brief Replans by reconnecting the (new) start feet to the remaining
+   * suffix of the current path instead of planning to the goal again: a
+   * short local search (limited to warm_start/time) is run to a pair of
+   * feet of the suffix, starting warm_start/lookahead steps after the foot
+   * pose closest to the start. Map, goal and the current path have to be
+   * set up; the goal must not have changed since the path was planned.
+   *
+   * getPathCosts() afterwards only refers to the reconnecting part of the
+   * path. The next plan() / replan() starts from scratch.
+   *
+   * @return Success of the reconnection (the current path is kept if
+   * unsuccessful).
+   */
+  bool replanFromPath();
+
   /// @brief Service handle to plan footsteps.
   bool planService(humanoid_nav_msgs::PlanFootsteps::Request &req,
                    humanoid_nav_msgs::PlanFootsteps::Response &resp);
@@ -94,6 +130,13 @@ public:
   bool planFeetService(humanoid_nav_msgs::PlanFootstepsBetweenFeet::Request &req,
                    humanoid_nav_msgs::PlanFootstepsBetweenFeet::Response &resp);
 
+  /**
+   * @brief Service handle to plan footsteps for several start / goal pairs
+   * (in parallel if planning workers are used).
+   */
+  bool planBatchService(humanoid_nav_msgs::PlanFootstepsBatch::Request &req,
+                        humanoid_nav_msgs::PlanFootstepsBatch::Response &resp);
+
   /**
    * @brief Sets the goal pose as two feet (left / right)
    *
@@ -144,17 +187,47 @@ public:
    */
   bool updateMap(const gridmap_2d::GridMap2DPtr map);
 
+  /**
+   * @return A new GridMap2D of the occupancy map, reused from the cache file
+   * map_cache_file if that has been created from the same map, or stored in
+   * tiles of map_tile_size cells (thread-safe). A converted map is written
+   * to the cache once no other map has been created for map_cache_delay
+   * seconds.
+   */
+  gridmap_2d::GridMap2DPtr createMap(
+      const nav_msgs::OccupancyGridConstPtr& occupancy_map) const;
+
   void setMarkerNamespace(const std::string& ns)
   {
     ivMarkerNamespace = ns;
   }
 
+  /**
+   * @brief Sets the 2D path (e.g. of humanoid_planner_2d's SBPLPlanner2D on
+   * the same map) the next planning tasks are restricted to a corridor
+   * around (if corridor_width > 0). With an empty path the 2D path of the
+   * path cost heuristic is used instead.
+   */
+  void setCorridorPath(const nav_msgs::Path& path)
+  {
+    ivCorridorPath = path;
+  }
+
   /// @brief Set the maximal search time.
   void setMaxSearchTime(int search_time)
   {
     ivMaxSearchTime = search_time;
   }
 
+  /**
+   * @brief Sets the callback invoked for each improved solution found while
+   * streaming solutions (only used with stream_solutions enabled).
+   */
+  void setSolutionCallback(const solution_callback_t& callback)
+  {
+    ivSolutionCallback = callback;
+  }
+
   /**
    * @brief Callback to set the goal pose as a robot pose centered between
    * two feet. If the start pose has been set previously the planning is
@@ -191,6 +264,15 @@ public:
    */
   void clearFootstepPathVis(unsigned num_footsteps=0);
 
+  /**
+   * @return The number of planning workers, i.e. service calls that can be
+   * planned concurrently (0 if all planning is done by this planner).
+   */
+  unsigned int getNumPlanningWorkers() const
+  {
+    return ivPlannerPool ? ivPlannerPool->size() : 0;
+  }
+
   /// @return Costs of the planned footstep path.
   double getPathCosts() const { return ivPathCost; }
 
@@ -200,6 +282,12 @@ public:
     return ivPlannerPtr->get_n_expands();
   }
 
+  /**
+   * @return Time (in s) the last planning task needed to find its first
+   * solution (negative if no solution has been found).
+   */
+  double getTimeToFirstSolution() const { return ivTimeToFirstSolution; }
+
   /// @return Number of planned foot poses.
   size_t getNumFootPoses() const { return ivPath.size(); }
 
@@ -221,10 +309,51 @@ public:
   /// @return True if for the current start and goal pose a path exists.
   bool pathExists() { return (bool)ivPath.size(); }
 
+  /**
+   * @return True iff one of the feet in [begin, end) collides with an
+   * obstacle of the current map.
+   */
+  bool pathOccupied(state_iter_t begin, state_iter_t end);
+
   /// @brief Planning parameters.
   environment_params ivEnvironmentParams;
 
 protected:
+  /**
+   * @brief Copy of the data of the visualization topics, published by
+   * publishVisualization() (the has_* flags mark the parts to publish).
+   */
+  struct visualization_t
+  {
+    visualization_t()
+    : has_expanded_states(false), has_random_states(false),
+      has_footsteps(false), has_path(false)
+    {}
+
+    /// @brief Exchanges the contents (without copying the buffers).
+    void swap(visualization_t& other);
+
+    std::string frame_id;
+    /// The namespace of the footstep markers.
+    std::string marker_ns;
+    bool has_expanded_states;
+    CellBitmap expanded_states;
+    bool has_random_states;
+    std::vector<State> random_states;
+    /// The footstep markers (of path and the start feet).
+    bool has_footsteps;
+    /// The nav_msgs::Path (of path).
+    bool has_path;
+    std::vector<State> path;
+    State start_foot_left;
+    State start_foot_right;
+  };
+
+  /**
+   * @brief The broadcast*Vis() methods copy the data of topics with
+   * subscribers into a visualization_t which is published by the
+   * visualization thread (or immediately if visualization/async is off).
+   */
   void broadcastExpandedNodesVis();
   void broadcastRandomNodesVis();
   void broadcastFootstepPathVis();
@@ -233,6 +362,16 @@ protected:
 
   /// helper to create service response
   void extractFootstepsSrv(std::vector<humanoid_nav_msgs::StepTarget> & footsteps) const;
+  void extractFootstepsSrv(const std::vector<State>& path,
+                           std::vector<humanoid_nav_msgs::StepTarget> & footsteps) const;
+
+  /**
+   * @brief Plans a query with the pool of planning workers (thread-safe, does
+   * not touch the state of this planner).
+   */
+  void planConcurrently(const State& start_left, const State& start_right,
+                        const State& goal_left, const State& goal_right,
+                        humanoid_nav_msgs::FootstepPlan* plan);
 
   /**
    * @return True if the newly calculated path is different from the existing
@@ -246,17 +385,75 @@ protected:
    */
   bool extractPath(const std::vector<int>& state_ids);
 
-  /// @brief Generates a visualization msgs for a foot pose.
+  /// @brief Generates a visualization msgs for a foot pose (the header and
+  /// the namespace of the marker are not touched).
   void footPoseToMarker(const State& footstep,
                         visualization_msgs::Marker* marker);
 
+  /**
+   * @brief Hands the visualization over to the visualization thread
+   * (replacing the parts of a pending one) or publishes it directly.
+   */
+  void queueVisualization(visualization_t& vis);
+
+  /// @brief Builds and publishes the messages of a visualization.
+  void publishVisualization(const visualization_t& vis);
+
+  void publishExpandedStates(const visualization_t& vis);
+  void publishRandomStates(const visualization_t& vis);
+  void publishFootstepPath(const visualization_t& vis);
+  void publishPath(const visualization_t& vis);
+
+  /// @brief Deletes the footstep markers in the given frame and namespace.
+  void clearFootstepPathVis(const std::string& frame_id,
+                            const std::string& marker_ns,
+                            unsigned num_footsteps);
+
+  /// @brief Main loop of the visualization thread.
+  void visualizationThread();
+
   /**
    * @brief Starts the planning task in the underlying SBPL.
    *
    * NOTE: Never call this directly. Always use either plan() or replan() to
    * invoke this method.
+   *
+   * @param restrict_to_corridor Whether a new search is restricted to the
+   * corridor around the 2D path (if corridor_width > 0). A restricted
+   * search gets corridor_time_fraction of the time limit.
+   */
+  bool run(bool restrict_to_corridor=true);
+
+  /**
+   * @brief Runs the search (restricted to the corridor if configured) and,
+   * if there is no solution within the corridor, the unrestricted search
+   * with the rest of the time limit.
+   */
+  bool runWithCorridorFallback();
+
+  /**
+   * @brief Restricts the environment's expansions to the corridor around
+   * ivCorridorPath or the 2D path of the path cost heuristic.
+   *
+   * @return False if there is no 2D path (the search is not restricted).
+   */
+  bool setupCorridor();
+
+  /**
+   * @brief Runs the anytime search of the SBPL in time slices of
+   * ivStreamTimeSlice and publishes each improved solution as soon as it
+   * is found.
+   *
+   * @return The result of the last successful SBPL replan() call.
    */
-  bool run();
+  int replanStreaming(const ros::WallTime& start_time, double max_search_time,
+                      std::vector<int>* solution_state_ids, int* path_cost);
+
+  /// @brief Publishes the currently extracted path as a FootstepSolution.
+  void publishSolution(double eps, double planning_time);
+
+  /// @brief Publishes the statistics of the last planning task.
+  void publishPlanningStats(double planning_time);
 
   /// @brief Returns the foot pose of a leg for a given robot pose.
   State getFootPose(const State& robot, Leg side);
@@ -264,8 +461,47 @@ protected:
   /// @brief Sets the planning algorithm used by SBPL.
   void setPlanner();
 
-  /// @brief Updates the environment in case of a changed map.
-  void updateEnvironment(const gridmap_2d::GridMap2DPtr old_map);
+  /// @return A new SBPL planner (of type ivPlannerType) for the environment.
+  boost::shared_ptr<SBPLPlanner> createPlanner(
+      FootstepPlannerEnvironment* env) const;
+
+  /// @return A new SBPL planner of type 'planner_type' for the environment
+  /// (NULL if unknown).
+  boost::shared_ptr<SBPLPlanner> createPlannerOfType(
+      const std::string& planner_type, FootstepPlannerEnvironment* env) const;
+
+  /**
+   * @brief Plans from scratch with the planner portfolio (instead of the
+   * own environment and planner).
+   */
+  bool planWithPortfolio();
+
+  /**
+   * @brief Repeats a search that used up the state budget of the
+   * environment from scratch with an initial epsilon increased by
+   * state_budget/epsilon_factor (at most state_budget/retries times).
+   */
+  bool retryWithinStateBudget();
+
+  /// @return The final epsilon of the last planning task.
+  double lastFinalEpsilon() const;
+
+  /// @return The number of states expanded by the last planning task.
+  int lastExpandedStates() const;
+
+  /// @return A new heuristic (of type ivHeuristicType); NULL if unknown.
+  boost::shared_ptr<Heuristic> createHeuristic() const;
+
+  /**
+   * @brief Updates the environment in case of a changed map.
+   *
+   * @return False if the map equals old_map (which is kept as ivMapPtr),
+   * i.e. no replanning is necessary.
+   */
+  bool updateEnvironment(const gridmap_2d::GridMap2DPtr old_map);
+
+  /// @brief Writes the map pending since createMap() to ivMapCacheFile.
+  void mapCacheTimerCallback(const ros::WallTimerEvent& event);
 
   boost::shared_ptr<FootstepPlannerEnvironment> ivPlannerEnvironmentPtr;
   gridmap_2d::GridMap2DPtr ivMapPtr;
@@ -273,6 +509,17 @@ protected:
 
   boost::shared_ptr<const PathCostHeuristic> ivPathCostHeuristicPtr;
 
+  /// @brief Planning instances for concurrent service calls (NULL if unused).
+  boost::shared_ptr<FootstepPlannerPool> ivPlannerPool;
+
+  /**
+   * @brief Planners racing on each planning task (only used with the
+   * planner type PortfolioPlanner; NULL otherwise).
+   */
+  boost::shared_ptr<FootstepPlannerPortfolio> ivPlannerPortfolio;
+  /// @brief Result of the last planning task of the portfolio.
+  FootstepPlannerPortfolio::result_t ivPortfolioResult;
+
   std::vector<State> ivPath;
 
   State ivStartFootLeft;
@@ -287,6 +534,8 @@ protected:
   ros::Publisher  ivHeuristicPathVisPub;
   ros::Publisher  ivPathVisPub;
   ros::Publisher  ivStartPoseVisPub;
+  ros::Publisher  ivSolutionPub;
+  ros::Publisher  ivPlanningStatsPub;
   ros::ServiceServer ivFootstepPlanService;
   ros::ServiceServer ivFootstepPlanFeetService;
 
@@ -295,7 +544,19 @@ protected:
   int    ivCollisionCheckAccuracy;
 
   bool   ivStartPoseSetUp, ivGoalPoseSetUp;
+  /// @brief Number of published footstep markers (guarded by
+  /// ivVisualizationMutex).
   int    ivLastMarkerMsgSize;
+
+  /// @brief Only every n-th expanded cell is published.
+  int ivExpandedStatesDecimation;
+  /// @brief Visualization thread (NULL if visualization/async is off).
+  boost::shared_ptr<boost::thread> ivVisualizationThreadPtr;
+  boost::mutex ivVisualizationMutex;
+  boost::condition_variable ivVisualizationCondition;
+  bool ivVisualizationShutdown;
+  /// @brief The visualization to be published next by the thread.
+  visualization_t ivPendingVisualization;
   double ivPathCost;
   bool   ivSearchUntilFirstSolution;
   double ivMaxSearchTime;
@@ -307,9 +568,67 @@ protected:
    */
    int ivChangedCellsLimit;
 
+  /**
+   * @brief Whether to keep the planning information of the ADPlanner when
+   * the map changes (only the states affected by the change are updated).
+   */
+  bool ivIncrementalReplanning;
+
+  /// @brief Whether to publish every improved solution of the anytime search.
+  bool ivStreamSolutions;
+  /// @brief Time (in s) the search runs before checking for a better solution.
+  double ivStreamTimeSlice;
+  double ivTimeToFirstSolution;
+  solution_callback_t ivSolutionCallback;
+
   std::string ivPlannerType;
+  std::string ivHeuristicType;
+  double ivDiffAngleCost;
+  int    ivHeuristicCacheSize;
+  bool   ivHeuristicEarlyTermination;
+  double ivHeuristicTerminationMargin;
   std::string ivMarkerNamespace;
 
+  /// @brief Cache file of the GridMap2D (see createMap(); empty: none).
+  std::string ivMapCacheFile;
+  /// @brief Time (in s) a new map has to be kept before it is cached.
+  double ivMapCacheDelay;
+  /// @brief Guards the pending map of the cache (createMap() is const and
+  /// thread-safe).
+  mutable boost::mutex ivMapCacheMutex;
+  mutable ros::WallTimer ivMapCacheTimer;
+  /// @brief The map to write to the cache (NULL: none), the hash of its
+  /// message and its revision when created.
+  mutable gridmap_2d::GridMap2DPtr ivPendingCacheMap;
+  mutable boost::uint64_t ivPendingCacheHash;
+  mutable unsigned long ivPendingCacheRevision;
+  /// @brief Tile size (in cells) of the GridMap2D (0: dense, see GridMap2D::setMapTiled()).
+  int ivMapTileSize;
+  /// @brief Radius (in m) up to which distances in a tiled GridMap2D are exact.
+  double ivMapTileHalo;
+
+  /// @brief Width of the corridor the search is restricted to (0: none).
+  double ivCorridorWidth;
+  /// @brief Fraction of the time limit of a corridor-restricted search.
+  double ivCorridorTimeFraction;
+  /// @brief External 2D path of the corridor (see setCorridorPath()).
+  nav_msgs::Path ivCorridorPath;
+
+  /// @brief Factor of the initial epsilon of retryWithinStateBudget().
+  double ivStateBudgetEpsilonFactor;
+  int ivStateBudgetRetries;
+
+  /// @brief Time limit (in s) of the local searches of replanFromPath(),
+  /// split evenly among the remaining connection candidates.
+  double ivWarmStartTime;
+  /// @brief Steps skipped along the path suffix by replanFromPath().
+  int ivWarmStartLookahead;
+  /**
+   * @brief Whether ivPath has been stitched together by replanFromPath(),
+   * i.e. the planning information of the search does not refer to it.
+   */
+  bool ivPathStitched;
+
   std::vector<int> ivPlanningStatesIds;
 };
 }
@@ -22,15 +22,24 @@
 #define FOOTSTEP_PLANNER_FOOTSTEPPLANNERENVIRONMENT_H_
 
 #include <footstep_planner/helper.h>
+#include <footstep_planner/AngleBins.h>
+#include <footstep_planner/CellBitmap.h>
+#include <footstep_planner/ChunkedArena.h>
+#include <footstep_planner/CollisionCache.h>
 #include <footstep_planner/PathCostHeuristic.h>
 #include <footstep_planner/Heuristic.h>
 #include <footstep_planner/Footstep.h>
 #include <footstep_planner/PlanningState.h>
+#include <footstep_planner/PlanningStats.h>
 #include <footstep_planner/State.h>
+#include <footstep_planner/StateHashTable.h>
 #include <humanoid_nav_msgs/ClipFootstep.h>
+#include <nav_msgs/Path.h>
 #include <sbpl/headers.h>
+#include <boost/atomic.hpp>
 
 #include <math.h>
+#include <algorithm>
 #include <vector>
 #include <tr1/unordered_set>
 #include <tr1/hashtable.h>
@@ -53,6 +62,9 @@ struct environment_params
          max_inverse_footstep_theta;
   double step_cost;
   int    collision_check_accuracy;
+  bool   collision_cache;
+  /// Whether to keep track of the expanded (x, y) cells (for visualization).
+  bool   track_expanded_states;
   int    hash_table_size;
   double cell_size;
   int    num_angle_bins;
@@ -61,6 +73,13 @@ struct environment_params
   int    num_random_nodes;
   double random_node_distance;
   double heuristic_scale;
+  bool   batched_expansion;
+  int    num_expansion_threads;
+  /// Maximal number of created states per planning task (0: unlimited).
+  int    max_states;
+  /// Maximal memory (MB) of the states, index mappings and hash table per
+  /// planning task (0: unlimited).
+  double max_memory;
 };
 
 
@@ -87,6 +106,7 @@ public:
   typedef exp_states_t::const_iterator exp_states_iter_t;
   typedef std::tr1::unordered_set<std::pair<int,int>, IntPairHash > exp_states_2d_t;
   typedef exp_states_2d_t::const_iterator exp_states_2d_iter_t;
+  typedef CellBitmap::const_iterator exp_cells_iter_t;
 
   /**
    * @param footstep_set The set of footsteps used for the path planning.
@@ -113,14 +133,20 @@ public:
    * @param collision_check_accuracy Whether to check just the foot's
    * circumcircle (0), the incircle (1) or recursively the circumcircle
    * and the incircle for the whole foot (2) for collision.
-   * @param hash_table_size Size of the hash table storing the planning
-   * states expanded during the search.
+   * @param collision_cache Whether to cache the collision check results
+   * for each discrete foot pose (until the map changes).
+   * @param hash_table_size Initial size of the hash table storing the
+   * planning states expanded during the search.
    * @param cell_size The size of each grid cell used to discretize the
    * robot positions.
    * @param num_angle_bins The number of bins used to discretize the
    * robot orientations.
    * @param forward_search Whether to use forward search (1) or backward
    * search (0).
+   * @param batched_expansion Whether to collision check all successors
+   * (predecessors) of an expanded state as one batch in parallel.
+   * @param num_expansion_threads Number of threads used for the batched
+   * expansion (0: OpenMP default).
    */
   FootstepPlannerEnvironment(const environment_params& params);
 
@@ -142,8 +168,36 @@ public:
   std::pair<int, int> updateStart(const State& foot_left,
                                   const State& right_right);
 
+  /**
+   * @brief Sets the map used for collision checking (invalidating all
+   * cached collision check results).
+   */
   void updateMap(gridmap_2d::GridMap2DPtr map);
 
+  /**
+   * @brief Sets a map of the same geometry as the current one which only
+   * differs from it in 'changed_cells' (map cell coordinates). Only the
+   * cached collision check results and the heuristic around the changed
+   * cells are updated and the state area is revalidated.
+   *
+   * @param affected_ids The IDs of all existing planning states within the
+   * bounding box of the changed cells (dilated by the largest distance of a
+   * foot touching a cell) together with their existing neighbors, i.e. a
+   * superset of the states whose edge costs might have changed.
+   */
+  void updateMapIncrementally(
+      gridmap_2d::GridMap2DPtr map,
+      const std::vector<std::pair<unsigned int, unsigned int> >& changed_cells,
+      std::vector<int>* affected_ids);
+
+  /**
+   * @brief Invalidates the cached collision check results of all foot poses
+   * that might touch the (world) area [min_x, max_x] x [min_y, max_y]. Has
+   * to be called when the map has been changed in place.
+   */
+  void invalidateCollisionCache(double min_x, double min_y,
+                                double max_x, double max_y);
+
   /**
    * @return True iff the foot in State s is colliding with an
    * obstacle.
@@ -157,6 +211,19 @@ public:
    */
   bool getState(unsigned int id, State* s);
 
+  /**
+   * @brief Extracts the path (list of foot poses) from a list of state IDs
+   * calculated by the SBPL. The path starts with one of the start feet and
+   * ends with the neutral goal step (i.e. 'goal_left' or 'goal_right').
+   *
+   * @return False iff one of the state IDs is unknown ('path' is empty
+   * then).
+   */
+  bool extractPath(const std::vector<int>& state_ids,
+                   const State& start_right,
+                   const State& goal_left, const State& goal_right,
+                   std::vector<State>* path);
+
   /**
    * @brief Resets the current planning task (i.e. the start and goal
    * poses).
@@ -166,12 +233,87 @@ public:
   /// @return The number of expanded states during the search.
   int getNumExpandedStates() { return ivNumExpandedStates; }
 
-  exp_states_2d_iter_t getExpandedStatesStart()
+  /// @return The profiling counters since the last call of resetStats().
+  const planning_stats_t& getStats() const { return ivStats; }
+
+  /// @return The profiling counters accumulated over all planning tasks.
+  planning_stats_t getCumulativeStats() const
+  {
+    planning_stats_t stats = ivCumulativeStats;
+    stats += ivStats;
+    return stats;
+  }
+
+  /// @brief Starts a new period of the (per planning task) counters.
+  void resetStats()
+  {
+    ivCumulativeStats += ivStats;
+    ivStats = planning_stats_t();
+  }
+
+  /// @return The state hash table (e.g. for statistics).
+  const StateHashTable& getStateHashTable() const { return ivStateHash; }
+
+  /**
+   * @brief Restricts the expansions to the planning cells within
+   * width / 2 of a 2D path (e.g. the one of a 2D planner on the same map).
+   * Takes effect with the next expansion; the map has to be set.
+   *
+   * @return False (and no restriction) if the path is empty.
+   */
+  bool setCorridor(const nav_msgs::Path& path, double width);
+
+  /// @brief Removes the restriction of setCorridor().
+  void clearCorridor() { ivUseCorridor = false; }
+
+  /// @return True iff the expansions are restricted to a corridor.
+  bool hasCorridor() const { return ivUseCorridor; }
+
+  /**
+   * @brief Lets all following expansions return no neighbors, so that a
+   * running search terminates quickly. May be called from another thread;
+   * revoked by reset().
+   */
+  void cancel() { ivCancelled = true; }
+
+  /// @return True iff the expansions are cancelled.
+  bool cancelled() const { return ivCancelled; }
+
+  /**
+   * @return True iff the state budget (environment_params::max_states,
+   * environment_params::max_memory) has been used up. All following
+   * expansions return no neighbors, so that the search terminates with
+   * the best solution found so far (if any). Revoked by reset().
+   */
+  bool stateBudgetExceeded() const { return ivStateBudgetExceeded; }
+
+  /// @return The bytes currently allocated by the environment.
+  memory_usage_t getMemoryUsage() const;
+
+  /**
+   * @brief Sets the bytes the SBPL planner of the environment allocates per
+   * planning state (its search state and heap element). The planner's
+   * memory is estimated by assuming such an allocation for each created
+   * state; data the planner frees during the search (e.g. R*'s local
+   * searches) is not included.
+   */
+  void setSearchStateSize(size_t bytes) { ivSearchStateSize = bytes; }
+
+  /// @return True iff the expanded (x, y) cells are kept track of.
+  bool tracksExpandedStates() const { return ivTrackExpandedStates; }
+
+  /// @return The (x, y) cells of the expanded states (empty unless
+  /// tracksExpandedStates()).
+  const CellBitmap& getExpandedStates() const { return ivExpandedStates; }
+
+  /// @return Iterator over the (x, y) cells of the expanded states (empty
+  /// unless tracksExpandedStates()).
+  exp_cells_iter_t getExpandedStatesStart() const
   {
     return ivExpandedStates.begin();
   }
 
-  exp_states_2d_iter_t getExpandedStatesEnd()
+  exp_cells_iter_t getExpandedStatesEnd() const
   {
     return ivExpandedStates.end();
   }
@@ -257,6 +399,10 @@ public:
 
   void SetAllPreds(CMDPSTATE *state);
 
+  /**
+   * @return The maximal number of planning states held by the environment
+   * at the same time (i.e. the high-water mark of the state arena).
+   */
   int SizeofCreatedEnv();
 
   /**
@@ -283,6 +429,12 @@ public:
   /// Used to scale continuous values in meter to discrete values in mm.
   static const int cvMmScale = 1000;
 
+  /// Number of planning states allocated at once by the state arena.
+  static const size_t cvArenaChunkSize = 4096;
+
+  /// Number of created states between two checks of max_memory.
+  static const size_t cvMemoryCheckInterval = 1024;
+
 protected:
   /**
    * @return The costs (in mm, truncated as int) to reach the
@@ -294,10 +446,108 @@ protected:
   int  stepCost(const PlanningState& a, const PlanningState& b);
 
   /**
-   * @return True iff the foot in 's' is colliding with an obstacle.
+   * @return True iff the foot in 's' is colliding with an obstacle. (Uses
+   * the collision cache if enabled.)
    */
   bool occupied(const PlanningState& s);
 
+  /// @return False iff the expansions are restricted to a corridor and s
+  /// is outside of it.
+  bool inCorridor(const PlanningState& s) const
+  {
+    return !ivUseCorridor || ivCorridor.contains(s.getX(), s.getY());
+  }
+
+  /// @brief Performs the actual collision check of occupied().
+  bool collisionCheck(const PlanningState& s) const;
+
+  /// @brief Updates the heuristic (if map-based) after the map has changed.
+  void updateHeuristicMap();
+
+  /**
+   * @brief Generates the successors (forward == true) or predecessors of
+   * 'current' by applying the whole footstep set at once: The candidates
+   * not yet known by the collision cache are checked in parallel, the
+   * hash entries are created afterwards in the order of the footstep set.
+   */
+  template <int N>
+  void getNeighborsBatched(const PlanningState& current, bool forward,
+                           std::vector<int>* NeighIDV,
+                           std::vector<int>* CostV);
+
+  /// @brief Signature of the expansion kernels GetSuccs() / GetPreds().
+  typedef void (FootstepPlannerEnvironment::*expansion_kernel_t)(
+      int, std::vector<int>*, std::vector<int>*);
+
+  /**
+   * @brief Selects the expansion kernels specialized for the number of angle
+   * bins (64 or 128; all others use the runtime number of bins).
+   */
+  void selectKernels();
+
+  /**
+   * @brief The expansion kernels for a number of angle bins N fixed at
+   * compile time (see AngleBins; N = 0 for the runtime number of bins).
+   */
+  template <int N>
+  void getSuccs(int SourceStateID, std::vector<int> *SuccIDV,
+                std::vector<int> *CostV);
+  template <int N>
+  void getPreds(int TargetStateID, std::vector<int> *PredIDV,
+                std::vector<int> *CostV);
+  template <int N>
+  bool reachable(const PlanningState& from, const PlanningState& to);
+  template <int N>
+  bool closeToGoal(const PlanningState& from);
+  template <int N>
+  bool closeToStart(const PlanningState& from);
+
+  /// Precomputed, orientation dependent footprint data (one per angle bin).
+  struct footprint_t
+  {
+    double cos_theta, sin_theta;
+    /// Shift from the planning state to the foot's center (left foot).
+    double shift_x_left, shift_y_left;
+    /// Shift from the planning state to the foot's center (right foot).
+    double shift_x_right, shift_y_right;
+    /// Centers of the circles covering the foot (relative to its center).
+    std::vector<std::pair<double, double> > circles;
+  };
+
+  /// @brief Fills FootstepPlannerEnvironment::ivFootprints.
+  void initFootprints();
+
+  /**
+   * @return True iff the foot centered at (x, y) with the orientation of
+   * 'fp' collides with an obstacle. (Used for collision_check_accuracy 2.)
+   */
+  bool footprintOccupied(double x, double y, const footprint_t& fp) const;
+
+  /**
+   * @brief Decides the candidates of getNeighborsBatched() listed in
+   * ivBatchUncached whose collision check only depends on the distance at
+   * the foot center; the others are added to ivBatchUnresolved.
+   */
+  void prefilterBatch();
+
+  /// A discrete step of the start / goal state area.
+  struct area_step_t
+  {
+    /// Translation relative to the start / goal foot.
+    int x, y;
+    /// Absolute orientation of the reached state.
+    int theta;
+    /// Whether the step is within the executable range (see reachable()).
+    bool reachable;
+  };
+
+  /**
+   * @brief Fills FootstepPlannerEnvironment::ivStateAreaSteps with all
+   * discrete steps for each orientation and leg of the start / goal foot,
+   * marking the ones within the executable range (see reachable()).
+   */
+  void initStateAreaSteps();
+
   void GetRandomNeighs(const PlanningState* currentState,
                        std::vector<int>* NeighIDV,
                        std::vector<int>* CLowV,
@@ -310,19 +560,25 @@ protected:
 
   /**
    * @brief Creates a new planning state for 's' and inserts it into the
-   * maps (PlanningState::ivStateId2State,
-   * PlanningState::ivpStateHash2State)
+   * maps (FootstepPlannerEnvironment::ivStateId2State,
+   * FootstepPlannerEnvironment::ivStateHash)
    *
    * @return A pointer to the newly created PlanningState.
    */
   const PlanningState* createNewHashEntry(const PlanningState& s);
 
+  /**
+   * @brief Creates the planning state for 's' with the next free ID
+   * without touching FootstepPlannerEnvironment::ivStateHash.
+   */
+  const PlanningState* createNewState(const PlanningState& s);
+
   /// Wrapper for FootstepPlannerEnvironment::getHashEntry(PlanningState).
   const PlanningState* getHashEntry(const State& s);
 
   /**
    * @return The pointer to the planning state 's' stored in
-   * FootstepPlannerEnvironment::ivpStateHash2State.
+   * FootstepPlannerEnvironment::ivStateHash (NULL if there is none).
    */
   const PlanningState* getHashEntry(const PlanningState& s);
 
@@ -364,6 +620,10 @@ protected:
 
   std::vector<int> ivStateArea;
 
+  /// The kernels called by GetSuccs() / GetPreds() (see selectKernels()).
+  expansion_kernel_t ivGetSuccsKernel;
+  expansion_kernel_t ivGetPredsKernel;
+
   /**
    * @brief Maps from an ID to the corresponding PlanningState. (Used in
    * the SBPL to access a certain PlanningState.)
@@ -371,11 +631,20 @@ protected:
   std::vector<const PlanningState*> ivStateId2State;
 
   /**
-   * @brief Maps from a hash tag to a list of corresponding planning
-   * states. (Used in FootstepPlannerEnvironment to identify a certain
-   * PlanningState.)
+   * @brief Maps from the discrete pose of a planning state to its ID. (Used
+   * in FootstepPlannerEnvironment to identify a certain PlanningState.)
+   */
+  StateHashTable ivStateHash;
+
+  /// Storage of all planning states (released at once on reset()).
+  ChunkedArena<PlanningState> ivStateArena;
+
+  /**
+   * @brief Storage of the SBPL index arrays pointed to by
+   * DiscreteSpaceInformation::StateID2IndexMapping (released at once on
+   * reset()).
    */
-  std::vector<const PlanningState*>* ivpStateHash2State;
+  ChunkedArena<int> ivStateIndexArena;
 
   /// The set of footsteps used for the path planning.
   const std::vector<Footstep>& ivFootstepSet;
@@ -420,9 +689,12 @@ protected:
    */
   const int ivCollisionCheckAccuracy;
 
+  /// Whether to cache the collision check results.
+  const bool ivUseCollisionCache;
+
   /**
-   * @brief Size of the hash table storing the planning states expanded
-   * during the search. (Also referred to by max_hash_size.)
+   * @brief Initial size of the hash table storing the planning states
+   * expanded during the search. (Also referred to by max_hash_size.)
    */
   const int ivHashTableSize;
 
@@ -434,6 +706,12 @@ protected:
   /// Whether to use forward search (1) or backward search (0).
   const bool ivForwardSearch;
 
+  /// Whether to expand the footstep set as one batch (see
+  /// getNeighborsBatched()).
+  const bool ivBatchedExpansion;
+  /// Number of threads used for the batched expansion.
+  int ivNumExpansionThreads;
+
   double ivMaxStepWidth;
 
   /// number of random neighbors for R*
@@ -453,11 +731,60 @@ protected:
   /// Pointer to the map.
   boost::shared_ptr<gridmap_2d::GridMap2D> ivMapPtr;
 
-  exp_states_2d_t ivExpandedStates;
+  const bool ivTrackExpandedStates;
+  /// (x, y) cells of the expanded states (covering the map).
+  CellBitmap ivExpandedStates;
   exp_states_t ivRandomStates;  ///< random intermediate states for R*
+
+  bool ivUseCorridor;
+  /// Set by cancel() from another thread.
+  boost::atomic<bool> ivCancelled;
+  bool ivStateBudgetExceeded;
+  const size_t ivMaxStates;
+  /// Bytes of the planner per state (see setSearchStateSize()).
+  size_t ivSearchStateSize;
+  /// Budget of memory_usage_t::search() in bytes (0: unlimited).
+  const size_t ivMaxMemory;
+  /// (x, y) cells the expansions are restricted to (see setCorridor()).
+  CellBitmap ivCorridor;
   size_t ivNumExpandedStates;
 
   bool* ivpStepRange;
+
+  /// Cached results of occupied() for the current map.
+  CollisionCache ivCollisionCache;
+
+  /// Buffers of getNeighborsBatched() (kept to avoid reallocations).
+  std::vector<PlanningState> ivBatchStates;
+  std::vector<char> ivBatchOccupied;
+  std::vector<int> ivBatchUncached;
+  /// Candidates not decided by prefilterBatch().
+  std::vector<int> ivBatchUnresolved;
+  std::vector<double> ivBatchPositions;
+  std::vector<unsigned char> ivBatchStateOccupied;
+  std::vector<float> ivBatchDistances;
+
+  /// Profiling counters of the current period (see resetStats()).
+  planning_stats_t ivStats;
+  planning_stats_t ivCumulativeStats;
+
+  /// Footprint data indexed by the angle bin.
+  std::vector<footprint_t> ivFootprints;
+
+  /**
+   * Steps of the state area used by setStateArea() indexed by
+   * 2 * theta + leg of the start (goal for the forward search) foot; all
+   * tables list the same discrete steps in the same order.
+   */
+  std::vector<std::vector<area_step_t> > ivStateAreaSteps;
+  /// Radius of the foot's circumcircle.
+  double ivFootOuterRadius;
+  /// Radius of the foot's incircle.
+  double ivFootInnerRadius;
+  /// Radius of the circles covering the foot.
+  double ivCoverCircleRadius;
+  /// Radius of the incircles of the foot segments covered by each circle.
+  double ivCoverCircleInnerRadius;
 };
 }
 
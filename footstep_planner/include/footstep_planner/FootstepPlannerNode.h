@@ -23,11 +23,14 @@
 
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 
 #include <geometry_msgs/PoseStamped.h>
 #include <geometry_msgs/PoseWithCovarianceStamped.h>
 #include <footstep_planner/FootstepPlanner.h>
 
+#include <boost/shared_ptr.hpp>
+
 
 namespace footstep_planner
 {
@@ -51,6 +54,11 @@ protected:
 
   ros::ServiceServer ivFootstepPlanService;
   ros::ServiceServer ivFootstepPlanFeetService;
+  ros::ServiceServer ivFootstepPlanBatchService;
+
+  /// Queue and threads of the service calls when using planning workers.
+  ros::CallbackQueue ivServiceQueue;
+  boost::shared_ptr<ros::AsyncSpinner> ivServiceSpinner;
 };
 }
 #endif  // FOOTSTEP_PLANNER_FOOTSTEPPLANNERNODE_H_
@@ -0,0 +1,175 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FOOTSTEP_PLANNER_FOOTSTEPPLANNERPOOL_H_
+#define FOOTSTEP_PLANNER_FOOTSTEPPLANNERPOOL_H_
+
+#include <footstep_planner/FootstepPlannerEnvironment.h>
+#include <footstep_planner/State.h>
+#include <gridmap_2d/GridMap2D.h>
+#include <sbpl/headers.h>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <vector>
+
+
+namespace footstep_planner
+{
+/**
+ * @brief A pool of independent planning environments and SBPL planners to
+ * answer several planning queries on the same map concurrently.
+ *
+ * All instances share the (read-only) map and are set up from the same
+ * environment parameters (i.e. footstep set). Each query is planned from
+ * scratch on an instance exclusively held by the calling thread; instances
+ * are created lazily up to the size of the pool.
+ */
+class FootstepPlannerPool
+{
+public:
+  /// @brief Creates a new heuristic for each instance.
+  typedef boost::function<boost::shared_ptr<Heuristic> ()> heuristic_factory_t;
+  /// @brief Creates the SBPL planner of an instance.
+  typedef boost::function<boost::shared_ptr<SBPLPlanner> (
+      FootstepPlannerEnvironment*)> planner_factory_t;
+
+  /// @brief A planning query between two pairs of feet.
+  struct query_t
+  {
+    State start_left;
+    State start_right;
+    State goal_left;
+    State goal_right;
+  };
+
+  /// @brief The result of a planning query.
+  struct result_t
+  {
+    result_t()
+    : success(false), costs(0.0), final_eps(0.0), planning_time(0.0),
+      expanded_states(0)
+    {}
+
+    bool success;
+    std::vector<State> path;
+    double costs;
+    double final_eps;
+    /// Wall time (in s) of the planning (not including waiting for a free
+    /// instance).
+    double planning_time;
+    int expanded_states;
+  };
+
+  /**
+   * @param size Maximal number of instances (i.e. concurrent queries).
+   * @param params Parameters of the environments (the heuristic is ignored;
+   * each instance gets its own one from 'create_heuristic').
+   */
+  FootstepPlannerPool(unsigned int size,
+                      const environment_params& params,
+                      const heuristic_factory_t& create_heuristic,
+                      const planner_factory_t& create_planner,
+                      double max_search_time, double initial_epsilon,
+                      bool search_until_first_solution);
+  virtual ~FootstepPlannerPool();
+
+  /**
+   * @brief Sets the map used by all following queries (queries already
+   * running keep the previous map).
+   */
+  void updateMap(const gridmap_2d::GridMap2DPtr& map);
+
+  /**
+   * @brief Plans a query from scratch. Blocks until an instance of the pool
+   * is available. Thread-safe.
+   *
+   * @return Success of planning.
+   */
+  bool plan(const query_t& query, result_t* result);
+
+  /**
+   * @brief Plans all queries in parallel (using at most size() threads).
+   * Thread-safe.
+   */
+  void planBatch(const std::vector<query_t>& queries,
+                 std::vector<result_t>* results);
+
+  /// @return The maximal number of concurrent queries.
+  unsigned int size() const { return ivSize; }
+
+private:
+  /// @brief A planning environment with its planner.
+  struct instance_t
+  {
+    boost::shared_ptr<FootstepPlannerEnvironment> environment;
+    boost::shared_ptr<SBPLPlanner> planner;
+    /// The map the environment is currently set to.
+    gridmap_2d::GridMap2DPtr map;
+  };
+
+  // non-copyable
+  FootstepPlannerPool(const FootstepPlannerPool&);
+  FootstepPlannerPool& operator=(const FootstepPlannerPool&);
+
+  /**
+   * @brief Waits for a free instance (creating a new one if the pool is not
+   * exhausted yet) and reserves it for the calling thread.
+   *
+   * @param map Set to the current map.
+   */
+  instance_t* acquire(gridmap_2d::GridMap2DPtr* map);
+
+  /// @brief Returns an instance to the pool.
+  void release(instance_t* instance);
+
+  /// @brief Plans a query on a reserved instance.
+  bool plan(instance_t* instance, const gridmap_2d::GridMap2DPtr& map,
+            const query_t& query, result_t* result);
+
+  /// @brief Worker of planBatch(), processing queries until none is left.
+  void planBatchWorker(const std::vector<query_t>* queries,
+                       std::vector<result_t>* results,
+                       unsigned int* next_query, boost::mutex* next_mutex);
+
+  const unsigned int ivSize;
+  /// Parameters of the instances (the environments refer to its footstep
+  /// set).
+  environment_params ivEnvironmentParams;
+  heuristic_factory_t ivCreateHeuristic;
+  planner_factory_t ivCreatePlanner;
+  const double ivMaxSearchTime;
+  const double ivInitialEpsilon;
+  const bool ivSearchUntilFirstSolution;
+
+  /// Guards all of the following members.
+  boost::mutex ivMutex;
+  boost::condition_variable ivInstanceReleased;
+  gridmap_2d::GridMap2DPtr ivMapPtr;
+  std::vector<boost::shared_ptr<instance_t> > ivInstances;
+  std::vector<instance_t*> ivFreeInstances;
+};
+}
+
+#endif  // FOOTSTEP_PLANNER_FOOTSTEPPLANNERPOOL_H_
@@ -0,0 +1,156 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FOOTSTEP_PLANNER_FOOTSTEPPLANNERPORTFOLIO_H_
+#define FOOTSTEP_PLANNER_FOOTSTEPPLANNERPORTFOLIO_H_
+
+#include <footstep_planner/FootstepPlannerEnvironment.h>
+#include <footstep_planner/FootstepPlannerPool.h>
+#include <footstep_planner/State.h>
+#include <gridmap_2d/GridMap2D.h>
+#include <sbpl/headers.h>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <string>
+#include <vector>
+
+
+namespace footstep_planner
+{
+/**
+ * @brief Races several SBPL planners (e.g. ARA*, AD* and R*) on the same
+ * planning query.
+ *
+ * Each planner searches concurrently on its own FootstepPlannerEnvironment
+ * over the shared (read-only) map. The first solution that reaches the
+ * target epsilon wins and the other searches are cancelled; if no planner
+ * reaches it within the time limit, the solution with the smallest epsilon
+ * is returned.
+ */
+class FootstepPlannerPortfolio
+{
+public:
+  typedef FootstepPlannerPool::heuristic_factory_t heuristic_factory_t;
+  /// @brief Creates an SBPL planner of the given type.
+  typedef boost::function<boost::shared_ptr<SBPLPlanner> (
+      const std::string&, FootstepPlannerEnvironment*)> planner_factory_t;
+  typedef FootstepPlannerPool::query_t query_t;
+  typedef FootstepPlannerPool::result_t result_t;
+
+  /**
+   * @param planner_types The SBPL planners of the portfolio.
+   * @param params Parameters of the environments (the heuristic is ignored;
+   * each planner gets its own one from 'create_heuristic').
+   * @param target_epsilon A solution with an epsilon of at most this value
+   * ends the race (ignored for search_until_first_solution).
+   * @param time_slice Time (in s) an anytime planner searches before its
+   * current solution is checked.
+   */
+  FootstepPlannerPortfolio(const std::vector<std::string>& planner_types,
+                           const environment_params& params,
+                           const heuristic_factory_t& create_heuristic,
+                           const planner_factory_t& create_planner,
+                           double max_search_time, double initial_epsilon,
+                           bool search_until_first_solution,
+                           double target_epsilon, double time_slice);
+  virtual ~FootstepPlannerPortfolio();
+
+  /// @brief Sets the map used by the following queries.
+  void updateMap(const gridmap_2d::GridMap2DPtr& map);
+
+  /**
+   * @brief Plans a query from scratch with all planners of the portfolio.
+   * Not thread-safe.
+   *
+   * @param winner Set to the type of the planner whose solution is
+   * returned (empty if there is none).
+   * @param max_search_time Time limit (in s) of the query; the one of the
+   * portfolio if <= 0.
+   * @param search_until_first_solution If true, the first solution ends the
+   * race (as configured for the portfolio otherwise).
+   * @return Success of planning.
+   */
+  bool plan(const query_t& query, result_t* result, std::string* winner,
+            double max_search_time = 0.0,
+            bool search_until_first_solution = false);
+
+  /// @return The SBPL planners of the portfolio.
+  const std::vector<std::string>& getPlannerTypes() const
+  {
+    return ivPlannerTypes;
+  }
+
+private:
+  /// @brief A planning environment with its planner.
+  struct member_t
+  {
+    std::string planner_type;
+    boost::shared_ptr<FootstepPlannerEnvironment> environment;
+    boost::shared_ptr<SBPLPlanner> planner;
+    /// The map the environment is currently set to.
+    gridmap_2d::GridMap2DPtr map;
+    result_t result;
+  };
+
+  // non-copyable
+  FootstepPlannerPortfolio(const FootstepPlannerPortfolio&);
+  FootstepPlannerPortfolio& operator=(const FootstepPlannerPortfolio&);
+
+  /// @brief Runs the search of one member (one thread per member).
+  void search(unsigned int member, const query_t* query,
+              ros::WallTime deadline);
+
+  /// @return True iff the race has been decided (i.e. the search stops).
+  bool decided();
+
+  /**
+   * @brief Ends the search of a member (if its solution reaches the target,
+   * it wins and the other searches are cancelled).
+   */
+  void finish(unsigned int member);
+
+  std::vector<std::string> ivPlannerTypes;
+  environment_params ivEnvironmentParams;
+  planner_factory_t ivCreatePlanner;
+  const double ivMaxSearchTime;
+  const double ivInitialEpsilon;
+  const bool ivSearchUntilFirstSolution;
+  const double ivTargetEpsilon;
+  const double ivTimeSlice;
+
+  gridmap_2d::GridMap2DPtr ivMapPtr;
+  std::vector<member_t> ivMembers;
+
+  /// Search mode and target epsilon of the current race.
+  bool ivRaceUntilFirstSolution;
+  double ivRaceTargetEpsilon;
+
+  /// Guards ivWinner.
+  boost::mutex ivMutex;
+  /// The member that won the current race (-1 if not decided yet).
+  int ivWinner;
+};
+}
+
+#endif  // FOOTSTEP_PLANNER_FOOTSTEPPLANNERPORTFOLIO_H_
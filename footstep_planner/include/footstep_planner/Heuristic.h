@@ -21,6 +21,7 @@
 #ifndef FOOTSTEP_PLANNER_HEURISTIC_H_
 #define FOOTSTEP_PLANNER_HEURISTIC_H_
 
+#include <footstep_planner/AngleBins.h>
 #include <footstep_planner/helper.h>
 #include <footstep_planner/PlanningState.h>
 
@@ -22,8 +22,9 @@
 #define FOOTSTEP_PLANNER_PATHCOSTHEURISTIC_H_
 
 #include <footstep_planner/Heuristic.h>
+#include <gridmap_2d/CostToGo2D.h>
 #include <gridmap_2d/GridMap2D.h>
-#include <sbpl/headers.h>
+#include <nav_msgs/Path.h>
 
 
 namespace footstep_planner
@@ -45,9 +46,22 @@ namespace footstep_planner
 class PathCostHeuristic : public Heuristic
 {
 public:
+  /**
+   * @param cache_size The number of 2D distance fields (for different goal
+   * cells / maps) kept for reuse. The fields are kept in
+   * gridmap_2d::CostToGo2D::shared(), i.e. shared with the other footstep
+   * planners of the process (e.g. of a FootstepPlannerPool).
+   * @param early_termination Whether to stop the 2D search as soon as the
+   * start cell is settled (plus a margin) instead of searching all cells.
+   * @param termination_margin The margin used for the early termination
+   * (relative to the optimal 2D path cost).
+   */
   PathCostHeuristic(double cell_size, int num_angle_bins,
                     double step_cost, double diff_angle_cost,
-                    double max_step_width, double inflation_radius);
+                    double max_step_width, double inflation_radius,
+                    unsigned int cache_size = 1,
+                    bool early_termination = false,
+                    double termination_margin = 0.2);
   virtual ~PathCostHeuristic();
 
   /**
@@ -62,15 +76,48 @@ public:
    * cell (to.x, to.y).
    * For forward planning 'to' is supposed to be the goal state, for backward
    * planning 'to' is supposed to be the start state.
+   *
+   * Distance fields computed before for the same map and goal cell are
+   * reused.
    */
   bool calculateDistances(const PlanningState& from, const PlanningState& to);
 
+  /**
+   * @brief Sets the map the 2D paths are planned on. The distance fields
+   * are only invalidated if the inflated map actually changed.
+   */
   void updateMap(gridmap_2d::GridMap2DPtr map);
 
+  /**
+   * @brief Sets a map of the same geometry as the current one which only
+   * differs from it within 'changed_cells' (x: mx, y: my). Only the
+   * inflated cells around them are compared; the distance fields are kept
+   * if none of these changed.
+   */
+  void updateMapIncrementally(gridmap_2d::GridMap2DPtr map,
+                              const cv::Rect& changed_cells);
+
+  /**
+   * @brief Extracts the 2D path from the cell of 'from' to the goal cell of
+   * the last calculateDistances() call from the distance field.
+   *
+   * @return False if there is no (settled) 2D path from 'from'.
+   */
+  bool extractPath2D(const PlanningState& from, nav_msgs::Path* path) const;
+
+  /// @return The revision of the inflated map (incremented on each change).
+  unsigned int getMapRevision() const { return ivMapRevision; }
+
 private:
-  static const int cvObstacleThreshold = 200;
+  /**
+   * @return True iff a cell within the inflation radius of 'cells'
+   * (x: mx, y: my) is blocked in exactly one of 'map' and the current map
+   * (both of the same geometry).
+   */
+  bool inflationChanged(const gridmap_2d::GridMap2D& map,
+                        const cv::Rect& cells) const;
 
-  unsigned char** ivpGrid;
+  unsigned int ivMapRevision;
 
   double ivStepCost;
   double ivDiffAngleCost;
@@ -80,10 +127,12 @@ private:
   int ivGoalX;
   int ivGoalY;
 
-  gridmap_2d::GridMap2DPtr ivMapPtr;
-  boost::shared_ptr<SBPL2DGridSearch> ivGridSearchPtr;
+  /// Relative margin of the early termination (negative: search all cells).
+  const double ivTerminationMargin;
+  /// The distance field (in mm) of the current goal (NULL if not computed).
+  gridmap_2d::CostToGoFieldConstPtr ivDistanceField;
 
-  void resetGrid();
+  gridmap_2d::GridMap2DPtr ivMapPtr;
 };
 }
 #endif  // FOOTSTEP_PLANNER_PATHCOSTHEURISTIC_H_
@@ -0,0 +1,154 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FOOTSTEP_PLANNER_PLANNINGSTATS_H_
+#define FOOTSTEP_PLANNER_PLANNINGSTATS_H_
+
+#include <ros/ros.h>
+
+
+namespace footstep_planner
+{
+/// @brief Number of calls and accumulated wall time of a function.
+struct profile_counter_t
+{
+  profile_counter_t() : calls(0), time(0.0) {}
+
+  profile_counter_t& operator+=(const profile_counter_t& other)
+  {
+    calls += other.calls;
+    time += other.time;
+    return *this;
+  }
+
+  unsigned long calls;
+  /// Accumulated (inclusive) wall time in s.
+  double time;
+};
+
+
+/**
+ * @brief Profiling counters of the hot paths of the
+ * FootstepPlannerEnvironment.
+ *
+ * The counters are only collected if the planner is compiled with
+ * FOOTSTEP_PLANNER_PROFILING defined (CMake option of the same name).
+ */
+struct planning_stats_t
+{
+  planning_stats_t& operator+=(const planning_stats_t& other)
+  {
+    get_succs += other.get_succs;
+    get_preds += other.get_preds;
+    occupied += other.occupied;
+    collision_check += other.collision_check;
+    hash_lookup += other.hash_lookup;
+    hash_insert += other.hash_insert;
+    heuristic += other.heuristic;
+    set_state_area += other.set_state_area;
+    return *this;
+  }
+
+  profile_counter_t get_succs;
+  profile_counter_t get_preds;
+  /// Collision queries (including the ones answered by the cache).
+  profile_counter_t occupied;
+  /// Actual collision checks.
+  profile_counter_t collision_check;
+  profile_counter_t hash_lookup;
+  /// Insertions (or lookups of already existing states).
+  profile_counter_t hash_insert;
+  profile_counter_t heuristic;
+  profile_counter_t set_state_area;
+};
+
+
+/**
+ * @brief Bytes allocated by the data structures of the
+ * FootstepPlannerEnvironment (including reserved but currently unused
+ * capacity).
+ */
+struct memory_usage_t
+{
+  memory_usage_t()
+  : states(0), index_mappings(0), hash_table(0), planner_states(0),
+    collision_cache(0), bitmaps(0)
+  {}
+
+  /// @return The bytes growing with the number of created states.
+  size_t search() const
+  {
+    return states + index_mappings + hash_table + planner_states;
+  }
+
+  size_t total() const { return search() + collision_cache + bitmaps; }
+
+  /// PlanningStates and the ID -> state map.
+  size_t states;
+  /// SBPL index arrays and DiscreteSpaceInformation::StateID2IndexMapping.
+  size_t index_mappings;
+  size_t hash_table;
+  /// Search states and heap elements of the SBPL planner (estimated, see
+  /// FootstepPlannerEnvironment::setSearchStateSize()).
+  size_t planner_states;
+  size_t collision_cache;
+  /// Expanded cells and corridor.
+  size_t bitmaps;
+};
+
+
+/// @brief Adds the wall time of its scope to a profile counter.
+class ScopedProfileTimer
+{
+public:
+  explicit ScopedProfileTimer(profile_counter_t& counter,
+                              unsigned long calls = 1)
+  : ivCounter(counter),
+    ivCalls(calls),
+    ivStart(ros::WallTime::now())
+  {}
+
+  ~ScopedProfileTimer()
+  {
+    ivCounter.calls += ivCalls;
+    ivCounter.time += (ros::WallTime::now() - ivStart).toSec();
+  }
+
+private:
+  profile_counter_t& ivCounter;
+  const unsigned long ivCalls;
+  const ros::WallTime ivStart;
+};
+}
+
+
+#ifdef FOOTSTEP_PLANNER_PROFILING
+/// Profiles the enclosing scope as 'calls' calls.
+#define FOOTSTEP_PLANNER_PROFILE_CALLS(counter, calls) \
+  footstep_planner::ScopedProfileTimer profile_timer_(counter, calls)
+#else
+#define FOOTSTEP_PLANNER_PROFILE_CALLS(counter, calls)
+#endif
+
+/// Profiles the enclosing scope as one call.
+#define FOOTSTEP_PLANNER_PROFILE(counter) \
+  FOOTSTEP_PLANNER_PROFILE_CALLS(counter, 1)
+
+#endif  // FOOTSTEP_PLANNER_PLANNINGSTATS_H_
@@ -0,0 +1,118 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FOOTSTEP_PLANNER_STATEHASHTABLE_H_
+#define FOOTSTEP_PLANNER_STATEHASHTABLE_H_
+
+#include <footstep_planner/helper.h>
+
+#include <vector>
+
+
+namespace footstep_planner
+{
+/**
+ * @brief An open addressing hash table (with linear probing) mapping the
+ * discrete key (x, y, theta, leg) of a planning state to its ID.
+ *
+ * The keys are stored inline next to the IDs in one contiguous array so a
+ * lookup does not need to dereference any PlanningState.  The capacity is
+ * always a power of two and is doubled whenever the load factor exceeds
+ * cvMaxLoadFactor.
+ */
+class StateHashTable
+{
+public:
+  /**
+   * @param initial_capacity The number of slots initially reserved (rounded
+   * up to the next power of two).
+   */
+  explicit StateHashTable(unsigned int initial_capacity);
+
+  ~StateHashTable();
+
+  /// @return The ID stored for the key or -1 if there is no such entry.
+  int find(int x, int y, int theta, Leg leg) const;
+
+  /**
+   * @brief Inserts 'id' for the key if the key is not yet contained in the
+   * table.
+   *
+   * @return The ID stored for the key, i.e. 'id' iff the key has been
+   * inserted.
+   */
+  int insert(int x, int y, int theta, Leg leg, int id);
+
+  /// @brief Removes all entries (the capacity is kept).
+  void clear();
+
+  /// @return The number of stored entries.
+  unsigned int size() const { return ivSize; }
+
+  /// @return The number of slots.
+  unsigned int capacity() const { return ivSlots.size(); }
+
+  /// @return The number of bytes allocated for the slots.
+  size_t bytesAllocated() const
+  {
+    return ivSlots.capacity() * sizeof(Slot);
+  }
+
+  /**
+   * @brief Determines the mean and the maximal number of slots probed to
+   * find a stored key (linear in the capacity).
+   */
+  void getProbeLengths(double* mean, unsigned int* max) const;
+
+  /// Maximal ratio of used slots before the table is grown.
+  static const double cvMaxLoadFactor;
+
+private:
+  struct Slot
+  {
+    int x;
+    int y;
+    int theta_leg;
+    /// The ID of the planning state; -1 marks an empty slot.
+    int id;
+  };
+
+  static int packThetaLeg(int theta, Leg leg) { return theta * 4 + leg; }
+
+  static unsigned int hash(int x, int y, int theta_leg)
+  {
+    return int_hash((int_hash(x) << 3) + (int_hash(y) << 2) +
+                    int_hash(theta_leg));
+  }
+
+  /// @return The index of the slot holding the key or the empty slot
+  /// where it would have to be inserted.
+  unsigned int probe(int x, int y, int theta_leg) const;
+
+  void grow();
+
+  std::vector<Slot> ivSlots;
+  unsigned int ivMask;
+  unsigned int ivSize;
+  unsigned int ivMaxSize;
+};
+}
+
+#endif  // FOOTSTEP_PLANNER_STATEHASHTABLE_H_
@@ -201,6 +201,15 @@ bool collision_check(double x, double y, double theta,
                      double height, double width, int accuracy,
                      const gridmap_2d::GridMap2D& distance_map);
 
+/**
+ * @brief Same as collision_check() above but with the foot's orientation
+ * given by its (precomputed) cosine and sine, i.e. without any
+ * trigonometric function calls.
+ */
+bool collision_check(double x, double y, double theta_cos, double theta_sin,
+                     double height, double width, int accuracy,
+                     const gridmap_2d::GridMap2D& distance_map);
+
 
 /**
  * @brief Crossing number method to determine whether a point lies within a
@@ -0,0 +1,101 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <footstep_planner/CellBitmap.h>
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace footstep_planner
+{
+CellBitmap::CellBitmap()
+: ivMinX(0),
+  ivMinY(0),
+  ivSizeX(0),
+  ivSizeY(0),
+  ivNumBits(0)
+{}
+
+
+void
+CellBitmap::resize(int min_x, int min_y, int size_x, int size_y)
+{
+  ivMinX = min_x;
+  ivMinY = min_y;
+  ivSizeX = std::max(0, size_x);
+  ivSizeY = std::max(0, size_y);
+  ivNumBits = size_t(ivSizeX) * ivSizeY;
+  ivWords.assign((ivNumBits + 31) / 32, 0u);
+}
+
+
+void
+CellBitmap::clear()
+{
+  if (!ivWords.empty())
+    memset(&ivWords[0], 0, ivWords.size() * sizeof(unsigned int));
+}
+
+
+void
+CellBitmap::swap(CellBitmap& other)
+{
+  std::swap(ivMinX, other.ivMinX);
+  std::swap(ivMinY, other.ivMinY);
+  std::swap(ivSizeX, other.ivSizeX);
+  std::swap(ivSizeY, other.ivSizeY);
+  std::swap(ivNumBits, other.ivNumBits);
+  ivWords.swap(other.ivWords);
+}
+
+
+size_t
+CellBitmap::count()
+const
+{
+  size_t num_cells = 0;
+  for (unsigned int i = 0; i < ivWords.size(); ++i)
+    num_cells += __builtin_popcount(ivWords[i]);
+  return num_cells;
+}
+
+
+size_t
+CellBitmap::nextBit(size_t bit)
+const
+{
+  if (bit >= ivNumBits)
+    return ivNumBits;
+
+  size_t word_index = bit >> 5;
+  // ignore the bits before 'bit' in its word
+  unsigned int word = ivWords[word_index] & (~0u << (bit & 31));
+  while (word == 0)
+  {
+    ++word_index;
+    if (word_index >= ivWords.size())
+      return ivNumBits;
+    word = ivWords[word_index];
+  }
+  return std::min(ivNumBits, (word_index << 5) + __builtin_ctz(word));
+}
+}
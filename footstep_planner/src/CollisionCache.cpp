@@ -0,0 +1,174 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <footstep_planner/CollisionCache.h>
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace footstep_planner
+{
+CollisionCache::CollisionCache(int num_angle_bins)
+: ivNumAngleBins(num_angle_bins),
+  ivBitsPerCell(4 * num_angle_bins),
+  ivTileWords((cvTileSize * cvTileSize * 4 * num_angle_bins + 31) / 32),
+  ivMinX(0),
+  ivMinY(0),
+  ivSizeX(0),
+  ivSizeY(0),
+  ivNumTilesX(0),
+  ivNumTilesY(0)
+{}
+
+
+CollisionCache::~CollisionCache()
+{
+  freeTiles();
+}
+
+
+void
+CollisionCache::freeTiles()
+{
+  for (unsigned int i = 0; i < ivTiles.size(); ++i)
+  {
+    if (ivTiles[i])
+      delete[] ivTiles[i];
+  }
+  ivTiles.clear();
+}
+
+
+void
+CollisionCache::resize(int min_x, int min_y, int size_x, int size_y)
+{
+  freeTiles();
+
+  ivMinX = min_x;
+  ivMinY = min_y;
+  ivSizeX = std::max(0, size_x);
+  ivSizeY = std::max(0, size_y);
+  ivNumTilesX = (ivSizeX + cvTileSize - 1) / cvTileSize;
+  ivNumTilesY = (ivSizeY + cvTileSize - 1) / cvTileSize;
+  ivTiles.assign(ivNumTilesX * ivNumTilesY, (unsigned int*)NULL);
+}
+
+
+void
+CollisionCache::clear()
+{
+  for (unsigned int i = 0; i < ivTiles.size(); ++i)
+  {
+    if (ivTiles[i])
+      memset(ivTiles[i], 0, ivTileWords * sizeof(unsigned int));
+  }
+}
+
+
+void
+CollisionCache::clear(int min_x, int min_y, int max_x, int max_y)
+{
+  min_x = std::max(min_x - ivMinX, 0);
+  min_y = std::max(min_y - ivMinY, 0);
+  max_x = std::min(max_x - ivMinX, ivSizeX - 1);
+  max_y = std::min(max_y - ivMinY, ivSizeY - 1);
+  if (min_x > max_x || min_y > max_y)
+    return;
+
+  const unsigned int words_per_cell = ivBitsPerCell / 32;
+  for (int ty = min_y / cvTileSize; ty <= max_y / cvTileSize; ++ty)
+  {
+    for (int tx = min_x / cvTileSize; tx <= max_x / cvTileSize; ++tx)
+    {
+      unsigned int* tile = ivTiles[ty * ivNumTilesX + tx];
+      if (tile == NULL)
+        continue;
+
+      int x0 = std::max(min_x - tx * cvTileSize, 0);
+      int x1 = std::min(max_x - tx * cvTileSize, cvTileSize - 1);
+      int y0 = std::max(min_y - ty * cvTileSize, 0);
+      int y1 = std::min(max_y - ty * cvTileSize, cvTileSize - 1);
+      if (x0 == 0 && y0 == 0 &&
+          x1 == cvTileSize - 1 && y1 == cvTileSize - 1)
+      {
+        memset(tile, 0, ivTileWords * sizeof(unsigned int));
+        continue;
+      }
+
+      for (int y = y0; y <= y1; ++y)
+      {
+        for (int x = x0; x <= x1; ++x)
+        {
+          unsigned int first_bit = (y * cvTileSize + x) * ivBitsPerCell;
+          if (ivBitsPerCell % 32 == 0)
+          {
+            memset(tile + first_bit / 32, 0,
+                   words_per_cell * sizeof(unsigned int));
+          }
+          else
+          {
+            for (unsigned int b = first_bit; b < first_bit + ivBitsPerCell;
+                 b += 2)
+              tile[b >> 5] &= ~(3u << (b & 31));
+          }
+        }
+      }
+    }
+  }
+}
+
+
+void
+CollisionCache::set(int x, int y, int theta, Leg leg, bool occupied)
+{
+  const unsigned int* const_tile;
+  unsigned int bit;
+  if (!locate(x, y, theta, leg, &const_tile, &bit))
+    return;
+
+  unsigned int*& tile =
+    ivTiles[((y - ivMinY) / cvTileSize) * ivNumTilesX +
+            ((x - ivMinX) / cvTileSize)];
+  if (tile == NULL)
+  {
+    tile = new unsigned int[ivTileWords];
+    memset(tile, 0, ivTileWords * sizeof(unsigned int));
+  }
+
+  unsigned int status = occupied ? OCCUPIED : FREE;
+  unsigned int& word = tile[bit >> 5];
+  word = (word & ~(3u << (bit & 31))) | (status << (bit & 31));
+}
+
+
+size_t
+CollisionCache::bytesAllocated()
+const
+{
+  size_t num_tiles = 0;
+  for (unsigned int i = 0; i < ivTiles.size(); ++i)
+  {
+    if (ivTiles[i])
+      ++num_tiles;
+  }
+  return num_tiles * ivTileWords * sizeof(unsigned int);
+}
+}
@@ -29,10 +29,7 @@ Footstep::Footstep(double x, double y, double theta, double cell_size,
   ivCellSize(cell_size),
   ivNumAngleBins(num_angle_bins),
   ivMaxHashSize(max_hash_size),
-  ivDiscSuccessorLeft(num_angle_bins),
-  ivDiscSuccessorRight(num_angle_bins),
-  ivDiscPredecessorLeft(num_angle_bins),
-  ivDiscPredecessorRight(num_angle_bins)
+  ivDiscSteps(4 * num_angle_bins)
 {
   init(x, y);
 }
@@ -53,14 +50,16 @@ Footstep::init(double x, double y)
   {
     backward_angle = calculateForwardStep(RIGHT, a, x, y,
                                           &footstep_x, &footstep_y);
-    ivDiscSuccessorRight[a] = footstep_xy(footstep_x, footstep_y);
-    ivDiscPredecessorLeft[backward_angle] = footstep_xy(-footstep_x,
-                                                        -footstep_y);
+    ivDiscSteps[SUCCESSOR_RIGHT * ivNumAngleBins + a] =
+      footstep_xy(footstep_x, footstep_y);
+    ivDiscSteps[PREDECESSOR_LEFT * ivNumAngleBins + backward_angle] =
+      footstep_xy(-footstep_x, -footstep_y);
     backward_angle = calculateForwardStep(LEFT, a, x, y,
                                           &footstep_x, &footstep_y);
-    ivDiscSuccessorLeft[a] = footstep_xy(footstep_x, footstep_y);
-    ivDiscPredecessorRight[backward_angle] = footstep_xy(-footstep_x,
-                                                         -footstep_y);
+    ivDiscSteps[SUCCESSOR_LEFT * ivNumAngleBins + a] =
+      footstep_xy(footstep_x, footstep_y);
+    ivDiscSteps[PREDECESSOR_RIGHT * ivNumAngleBins + backward_angle] =
+      footstep_xy(-footstep_x, -footstep_y);
   }
 }
 
@@ -69,36 +68,7 @@ PlanningState
 Footstep::performMeOnThisState(const PlanningState& current)
 const
 {
-  Leg leg;
-
-  int x = current.getX();
-  int y = current.getY();
-  int theta = current.getTheta();
-
-  if (current.getLeg() == RIGHT)
-  {
-    footstep_xy xy = ivDiscSuccessorRight[theta];
-    x += xy.first;
-    y += xy.second;
-    theta += ivTheta;
-    leg = LEFT;
-  }
-  else // leg == LEFT
-  {
-    footstep_xy xy = ivDiscSuccessorLeft[theta];
-    x += xy.first;
-    y += xy.second;
-    theta -= ivTheta;
-    leg = RIGHT;
-  }
-
-  // theta has to be in [0..ivNumAngleBins)
-  if (theta < 0)
-    theta += ivNumAngleBins;
-  else if (theta >= ivNumAngleBins)
-    theta -= ivNumAngleBins;
-
-  return PlanningState(x, y, theta, leg, ivMaxHashSize);
+  return performMeOnThisState<0>(current);
 }
 
 
@@ -106,35 +76,7 @@ PlanningState
 Footstep::reverseMeOnThisState(const PlanningState& current)
 const
 {
-  Leg leg;
-
-  int x = current.getX();
-  int y = current.getY();
-  int theta = current.getTheta();
-
-  if (current.getLeg() == LEFT)
-  {
-    footstep_xy xy = ivDiscPredecessorLeft[theta];
-    x += xy.first;
-    y += xy.second;
-    theta -= ivTheta;
-    leg = RIGHT;
-  }
-  else // leg == RIGHT
-  {
-    footstep_xy xy = ivDiscPredecessorRight[theta];
-    x += xy.first;
-    y += xy.second;
-    theta += ivTheta;
-    leg = LEFT;
-  }
-  // theta has to be in [0..ivNumAngleBins)
-  if (theta < 0)
-    theta += ivNumAngleBins;
-  else if (theta >= ivNumAngleBins)
-    theta -= ivNumAngleBins;
-
-  return PlanningState(x, y, theta, leg, ivMaxHashSize);
+  return reverseMeOnThisState<0>(current);
 }
 
 
@@ -167,10 +109,6 @@ const
   *footstep_y = disc_val(cont_footstep_y, ivCellSize);
 
   // theta has to be in [0..ivNumAngleBins)
-  if (global_theta < 0)
-    global_theta += ivNumAngleBins;
-  else if (global_theta >= ivNumAngleBins)
-    global_theta -= ivNumAngleBins;
-  return global_theta;
+  return AngleBins<0>::wrap(global_theta, ivNumAngleBins);
 }
 } // end of namespace
@@ -31,7 +31,14 @@ FootstepNavigation::FootstepNavigation()
   ivFootstepsExecution("footsteps_execution", true),
   ivExecutionShift(2),
   ivControlStepIdx(-1),
-  ivResetStepIdx(0)
+  ivResetStepIdx(0),
+  ivExecutionStarted(false),
+  ivExecutionProgress(0),
+  ivBackgroundShutdown(false),
+  ivRestartRequested(false),
+  ivContinuationRequested(false),
+  ivPlanAfterExecution(false),
+  ivPlannedPathConnection(-1)
 {
   // private NodeHandle for parameters and private messages (debug / info)
   ros::NodeHandle nh_private("~");
@@ -68,6 +75,19 @@ FootstepNavigation::FootstepNavigation()
 
   nh_private.param("feedback_frequency", ivFeedbackFrequency, 5.0);
   nh_private.param("safe_execution", ivSafeExecution, true);
+  nh_private.param("start_on_first_solution", ivStartOnFirstSolution, false);
+  nh_private.param("warm_start_replanning", ivWarmStartReplanning, false);
+  nh_private.param("background_planning/enabled", ivBackgroundPlanning,
+                   false);
+  nh_private.param("background_planning/lookahead", ivBackgroundLookahead,
+                   4);
+  ivBackgroundLookahead = std::max(1, ivBackgroundLookahead);
+  nh_private.param("background_planning/period", ivBackgroundPeriod, 0.0);
+  if (ivStartOnFirstSolution)
+  {
+    ivPlanner.setSolutionCallback(
+      boost::bind(&FootstepNavigation::firstSolutionCallback, this, _1));
+  }
 
   nh_private.param("foot/max/step/x", ivMaxStepX, 0.07);
   nh_private.param("foot/max/step/y", ivMaxStepY, 0.15);
@@ -102,11 +122,28 @@ FootstepNavigation::FootstepNavigation()
   }
   // insert first point again at the end!
   ivStepRange.push_back(ivStepRange[0]);
+
+  if (ivBackgroundPlanning)
+  {
+    ivBackgroundPlanningPtr.reset(
+      new boost::thread(
+        boost::bind(&FootstepNavigation::backgroundPlanning, this)));
+  }
 }
 
 
 FootstepNavigation::~FootstepNavigation()
-{}
+{
+  if (ivBackgroundPlanningPtr)
+  {
+    {
+      boost::mutex::scoped_lock lock(ivBackgroundMutex);
+      ivBackgroundShutdown = true;
+    }
+    ivBackgroundCondition.notify_all();
+    ivBackgroundPlanningPtr->join();
+  }
+}
 
 
 bool
@@ -118,9 +155,10 @@ FootstepNavigation::plan()
     return false;
   }
 
+  ivExecutionStarted = false;
   if (ivPlanner.plan())
   {
-    startExecution();
+    startExecutionOnce();
     return true;
   }
   // path planning unsuccessful
@@ -131,6 +169,14 @@ FootstepNavigation::plan()
 bool
 FootstepNavigation::replan()
 {
+  // the planning thread plans (and restarts the execution) from the robot's
+  // current feet
+  if (ivBackgroundPlanning)
+  {
+    requestPlanning(true);
+    return true;
+  }
+
   if (!updateStart())
   {
     ROS_ERROR("Start pose not accessible!");
@@ -139,20 +185,44 @@ FootstepNavigation::replan()
 
   bool path_existed = ivPlanner.pathExists();
 
+  // reconnect to the remaining path with a short local search and plan from
+  // scratch only if this fails
+  if (ivWarmStartReplanning && path_existed)
+  {
+    ivExecutionStarted = false;
+    if (ivPlanner.replanFromPath())
+    {
+      startExecutionOnce();
+      return true;
+    }
+    // (replanFromPath() does not stream, i.e. no execution was started)
+    ROS_INFO("Reconnecting to the previous path unsuccessful. Planning from "
+             "scratch.");
+    if (ivPlanner.plan())
+    {
+      startExecutionOnce();
+      return true;
+    }
+    ivExecutingFootsteps = false;
+    return false;
+  }
+
   // calculate path by replanning (if no planning information exists
   // this call is equal to ivPlanner.plan())
+  ivExecutionStarted = false;
   if (ivPlanner.replan())
   {
-    startExecution();
+    startExecutionOnce();
     return true;
   }
   else if (path_existed)
   {
     ROS_INFO("Replanning unsuccessful. Reseting previous planning "
              "information.");
+    ivExecutionStarted = false;
     if (ivPlanner.plan())
     {
-      startExecution();
+      startExecutionOnce();
       return true;
     }
   }
@@ -162,9 +232,215 @@ FootstepNavigation::replan()
 }
 
 
+void
+FootstepNavigation::requestPlanning(bool restart)
+{
+  {
+    boost::mutex::scoped_lock lock(ivBackgroundMutex);
+    if (restart)
+      ivRestartRequested = true;
+    else
+      ivContinuationRequested = true;
+  }
+  ivBackgroundCondition.notify_all();
+}
+
+
+void
+FootstepNavigation::backgroundPlanning()
+{
+  while (true)
+  {
+    geometry_msgs::PoseStampedConstPtr goal;
+    gridmap_2d::GridMap2DPtr map;
+    bool restart;
+    bool continuation;
+    path_ptr_t path;
+    int progress;
+    {
+      boost::unique_lock<boost::mutex> lock(ivBackgroundMutex);
+      if (!ivBackgroundShutdown && !ivPendingGoal && !ivPendingMap &&
+          !ivRestartRequested && !ivContinuationRequested)
+      {
+        if (ivBackgroundPeriod > 0.0 && ivExecutingFootsteps)
+        {
+          ivBackgroundCondition.timed_wait(
+            lock,
+            boost::posix_time::milliseconds(int(ivBackgroundPeriod * 1000)));
+        }
+        else
+          ivBackgroundCondition.wait(lock);
+      }
+      if (ivBackgroundShutdown)
+        return;
+
+      goal.swap(ivPendingGoal);
+      map.swap(ivPendingMap);
+      restart = ivRestartRequested;
+      continuation = ivContinuationRequested;
+      ivRestartRequested = false;
+      ivContinuationRequested = false;
+      path = ivExecutionPath;
+      progress = ivExecutionProgress;
+    }
+
+    // without any request the path is continued periodically (e.g. to use
+    // an improved localization)
+    bool periodic = !goal && !map && !restart && !continuation;
+    if (periodic && !(ivBackgroundPeriod > 0.0 && ivExecutingFootsteps))
+      continue;
+
+    bool must_plan = restart || continuation || periodic;
+    if (map)
+      must_plan = ivPlanner.updateMap(map) || must_plan;
+    if (goal)
+    {
+      if (!setGoal(goal))
+        continue;
+      must_plan = true;
+    }
+
+    // the robot walks the executed path at least up to the connection of a
+    // continuation: stop if the new map blocks these steps
+    bool executing = ivExecutingFootsteps && path && !path->empty();
+    if (map && executing)
+    {
+      int first = std::max(0, std::min(progress, int(path->size()) - 1));
+      int last = std::min(progress + ivBackgroundLookahead,
+                          int(path->size()) - 1);
+      if (ivPlanner.pathOccupied(path->begin() + first,
+                                 path->begin() + last + 1))
+      {
+        ROS_INFO("The executed path is blocked in the new map. Stopping "
+                 "the execution.");
+        stopExecution();
+        restart = true;
+        must_plan = true;
+      }
+    }
+    if (!must_plan)
+      continue;
+
+    if (restart || !ivExecutingFootsteps || !path || path->empty())
+    {
+      // a failed plan() must not leave a stale execution behind, otherwise
+      // all further goals would be planned as continuations
+      stopExecution();
+      plan();
+      continue;
+    }
+
+    // continue the executed path a few steps ahead of the robot, i.e. the
+    // robot keeps walking while the continuation is planned
+    int connection = progress + ivBackgroundLookahead;
+    if (connection >= int(path->size()) - 1)
+    {
+      ROS_INFO("Too close to the end of the executed path, planning once "
+               "the robot stands.");
+      boost::mutex::scoped_lock lock(ivBackgroundMutex);
+      ivPlanAfterExecution = true;
+      continue;
+    }
+    if (!planContinuation(*path, connection))
+    {
+      // the executed path may be invalid (e.g. after a map change)
+      ROS_WARN("Planning a continuation of the executed path failed. "
+               "Stopping the execution.");
+      stopExecution();
+      plan();
+    }
+  }
+}
+
+
+bool
+FootstepNavigation::planContinuation(const std::vector<State>& path,
+                                     int connection)
+{
+  const State& a = path[connection - 1];
+  const State& b = path[connection];
+  if (!ivPlanner.setStart(a.getLeg() == LEFT ? a : b,
+                          a.getLeg() == LEFT ? b : a))
+    return false;
+
+  // the solution callback must not start another execution
+  ivExecutionStarted = true;
+  if (!ivPlanner.replan() && !ivPlanner.plan())
+    return false;
+
+  // the planned path starts with one of the connecting feet
+  std::vector<State> continued(path.begin(), path.begin() + connection + 1);
+  state_iter_t planned = ivPlanner.getPathBegin();
+  if (planned != ivPlanner.getPathEnd() && *planned == b)
+    ++planned;
+  continued.insert(continued.end(), planned, ivPlanner.getPathEnd());
+
+  boost::mutex::scoped_lock lock(ivBackgroundMutex);
+  ivPlannedPath.swap(continued);
+  ivPlannedPathConnection = connection;
+  return true;
+}
+
+
+bool
+FootstepNavigation::takePlannedPath(int current_idx)
+{
+  boost::mutex::scoped_lock lock(ivBackgroundMutex);
+  if (ivPlannedPathConnection < 0)
+    return false;
+
+  int connection = ivPlannedPathConnection;
+  ivPlannedPathConnection = -1;
+  if (current_idx > connection)
+  {
+    // the robot already walked past the connection
+    ivPlannedPath.clear();
+    ivContinuationRequested = true;
+    ivBackgroundCondition.notify_all();
+    return false;
+  }
+
+  ROS_INFO("Continuing with the path planned in the background at state %i.",
+           connection);
+  boost::shared_ptr<std::vector<State> > path(new std::vector<State>());
+  path->swap(ivPlannedPath);
+  ivExecutionPath = path;
+  return true;
+}
+
+
+void
+FootstepNavigation::setExecutionProgress(int idx)
+{
+  boost::mutex::scoped_lock lock(ivBackgroundMutex);
+  ivExecutionProgress = idx;
+
+  if (!ivExecutingFootsteps && ivPlanAfterExecution)
+  {
+    ivPlanAfterExecution = false;
+    ivRestartRequested = true;
+    ivBackgroundCondition.notify_all();
+  }
+}
+
+
 void
 FootstepNavigation::startExecution()
 {
+  // only one execution at a time
+  stopExecution();
+
+  {
+    boost::mutex::scoped_lock lock(ivBackgroundMutex);
+    ivExecutionPath.reset(new std::vector<State>(ivPlanner.getPathBegin(),
+                                                 ivPlanner.getPathEnd()));
+    ivExecutionProgress = 0;
+    ivPlannedPathConnection = -1;
+    ivPlannedPath.clear();
+    if (ivExecutionPath->size() > 1)
+      ivExecutingFootsteps = true;
+  }
+
   if (ivSafeExecution)
   {
     ivFootstepExecutionPtr.reset(
@@ -179,10 +455,60 @@ FootstepNavigation::startExecution()
 }
 
 
+void
+FootstepNavigation::stopExecution()
+{
+  if (ivSafeExecution)
+  {
+    // the execution thread itself restarts the execution on failures (see
+    // executeFootsteps()) and leaves afterwards
+    if (ivFootstepExecutionPtr &&
+        ivFootstepExecutionPtr->get_id() != boost::this_thread::get_id())
+    {
+      ivFootstepExecutionPtr->interrupt();
+      ivFootstepExecutionPtr->join();
+    }
+  }
+  else if (ivExecutingFootsteps)
+  {
+    ivFootstepsExecution.cancelAllGoals();
+  }
+  ivExecutingFootsteps = false;
+}
+
+
+FootstepNavigation::path_ptr_t
+FootstepNavigation::getExecutionPath()
+{
+  boost::mutex::scoped_lock lock(ivBackgroundMutex);
+  return ivExecutionPath;
+}
+
+
+void
+FootstepNavigation::startExecutionOnce()
+{
+  if (!ivExecutionStarted)
+    startExecution();
+  ivExecutionStarted = true;
+}
+
+
+bool
+FootstepNavigation::firstSolutionCallback(const FootstepPlanner& planner)
+{
+  ROS_INFO("Starting execution with first solution (found after %f s).",
+           planner.getTimeToFirstSolution());
+  startExecutionOnce();
+  return false;
+}
+
+
 void
 FootstepNavigation::executeFootsteps()
 {
-  if (ivPlanner.getPathSize() <= 1)
+  path_ptr_t path = getExecutionPath();
+  if (!path || path->size() <= 1)
     return;
 
   // lock this thread
@@ -197,16 +523,8 @@ FootstepNavigation::executeFootsteps()
   std::string support_foot_id;
 
   // calculate and perform relative footsteps until goal is reached
-  state_iter_t to_planned = ivPlanner.getPathBegin();
-  if (to_planned == ivPlanner.getPathEnd())
-  {
-    ROS_ERROR("No plan available. Return.");
-    return;
-  }
-
-  const State* from_planned = to_planned.base();
-  to_planned++;
-  while (to_planned != ivPlanner.getPathEnd())
+  unsigned int to_idx = 1;
+  while (to_idx < path->size())
   {
     try
     {
@@ -218,6 +536,16 @@ FootstepNavigation::executeFootsteps()
       return;
     }
 
+    // swap in the path planned in the background at a step boundary
+    if (ivBackgroundPlanning)
+    {
+      if (takePlannedPath(to_idx - 1))
+        path = getExecutionPath();
+      setExecutionProgress(to_idx);
+    }
+    const State* from_planned = &(*path)[to_idx - 1];
+    const State* to_planned = &(*path)[to_idx];
+
     if (from_planned->getLeg() == RIGHT)
       support_foot_id = ivIdFootRight;
     else // support_foot = LLEG
@@ -238,6 +566,9 @@ FootstepNavigation::executeFootsteps()
       {
         ROS_INFO("Footstep cannot be performed. Replanning necessary.");
 
+        // this execution ends here (in background mode replan() only
+        // requests the planning thread to restart it)
+        ivExecutingFootsteps = false;
         replan();
         // leave the thread
         return;
@@ -250,20 +581,22 @@ FootstepNavigation::executeFootsteps()
       continue;
     }
 
-    from_planned = to_planned.base();
-    to_planned++;
+    ++to_idx;
   }
   ROS_INFO("Succeeded walking to the goal.\n");
 
   // free the lock
   ivExecutingFootsteps = false;
+  if (ivBackgroundPlanning)
+    setExecutionProgress(to_idx - 1);
 }
 
 
 void
 FootstepNavigation::executeFootstepsFast()
 {
-  if (ivPlanner.getPathSize() <= 1)
+  path_ptr_t path = getExecutionPath();
+  if (!path || path->size() <= 1)
 	return;
 
   // lock the planning and execution process
@@ -273,11 +606,8 @@ FootstepNavigation::executeFootstepsFast()
   ivFootstepsExecution.waitForServer();
 
   humanoid_nav_msgs::ExecFootstepsGoal goal;
-  State support_leg;
-  if (ivPlanner.getPathBegin()->getLeg() == RIGHT)
-    support_leg = ivPlanner.getStartFootRight();
-  else // leg == LEFT
-    support_leg = ivPlanner.getStartFootLeft();
+  // the path starts with the current support leg
+  State support_leg = path->front();
   if (getFootstepsFromPath(support_leg, 1, goal.footsteps))
   {
     goal.feedback_frequency = ivFeedbackFrequency;
@@ -327,6 +657,9 @@ FootstepNavigation::doneCallback(
 
 	// free the lock
 	ivExecutingFootsteps = false;
+	if (ivBackgroundPlanning &&
+	    state == actionlib::SimpleClientGoalState::SUCCEEDED)
+	  setExecutionProgress(getExecutionPath()->size() - 1);
 }
 
 
@@ -343,9 +676,14 @@ FootstepNavigation::feedbackCallback(
 	if (executed_steps_idx == ivControlStepIdx)
     return;
 
-	// get planned foot placement
-  const State& planned = *(ivPlanner.getPathBegin() + ivControlStepIdx + 1 +
-                           ivResetStepIdx);
+	// get planned foot placement (the path is kept alive by 'path' if it is
+	// replaced meanwhile)
+  path_ptr_t path = getExecutionPath();
+  const State& planned = (*path)[ivControlStepIdx + 1 + ivResetStepIdx];
+  // the steps sent to the robot are executed with a fixed delay
+  if (ivBackgroundPlanning)
+    setExecutionProgress(ivControlStepIdx + 1 + ivResetStepIdx +
+                         ivExecutionShift);
   // get executed foot placement
   tf::Transform executed_tf;
   std::string foot_id;
@@ -437,7 +775,36 @@ FootstepNavigation::feedbackCallback(
     // performed correctly; otherwise check in the next iteration if
     // the step really has been incorrect
     if (performanceValid(planned, executed))
+    {
+      int current_idx = ivControlStepIdx + 1 + ivResetStepIdx;
       ivControlStepIdx++;
+
+      // continue with the path planned in the background from the foot
+      // just placed
+      if (ivBackgroundPlanning && takePlannedPath(current_idx))
+      {
+        ivFootstepsExecution.cancelGoal();
+        humanoid_nav_msgs::ExecFootstepsGoal goal;
+        if (getFootstepsFromPath(executed, current_idx + 1, goal.footsteps))
+        {
+          goal.feedback_frequency = ivFeedbackFrequency;
+          // adjust the internal counters
+          ivResetStepIdx = current_idx;
+          ivControlStepIdx = 0;
+
+          // restart the footstep execution
+          ivFootstepsExecution.sendGoal(
+            goal,
+            boost::bind(&FootstepNavigation::doneCallback, this, _1, _2),
+            boost::bind(&FootstepNavigation::activeCallback, this),
+            boost::bind(&FootstepNavigation::feedbackCallback, this, _1));
+        }
+        else
+        {
+          replan();
+        }
+      }
+    }
     else
       ROS_DEBUG("Invalid step. Wait next step update before declaring"
                 " step incorrect.");
@@ -449,6 +816,17 @@ void
 FootstepNavigation::goalPoseCallback(
   const geometry_msgs::PoseStampedConstPtr& goal_pose)
 {
+  // the planning thread continues the executed path towards the new goal
+  if (ivBackgroundPlanning)
+  {
+    {
+      boost::mutex::scoped_lock lock(ivBackgroundMutex);
+      ivPendingGoal = goal_pose;
+    }
+    ivBackgroundCondition.notify_all();
+    return;
+  }
+
   // check if the execution is locked
   if (ivExecutingFootsteps)
   {
@@ -473,22 +851,25 @@ void
 FootstepNavigation::mapCallback(
   const nav_msgs::OccupancyGridConstPtr& occupancy_map)
 {
-  // stop execution if an execution was performed
-  if (ivExecutingFootsteps)
+  // the planning thread updates the map (and continues the executed path
+  // if necessary) while the robot keeps walking
+  if (ivBackgroundPlanning)
   {
-    if (ivSafeExecution)
-    {
-      // interrupt the thread and wait until it has finished its execution
-  	  ivFootstepExecutionPtr->interrupt();
-      ivFootstepExecutionPtr->join();
-    }
-    else
+    gridmap_2d::GridMap2DPtr map = ivPlanner.createMap(occupancy_map);
+    ivIdMapFrame = map->getFrameID();
     {
-  		ivFootstepsExecution.cancelAllGoals();
+      boost::mutex::scoped_lock lock(ivBackgroundMutex);
+      ivPendingMap = map;
     }
+    ivBackgroundCondition.notify_all();
+    return;
   }
 
-  gridmap_2d::GridMap2DPtr map(new gridmap_2d::GridMap2D(occupancy_map));
+  // stop execution if an execution was performed
+  if (ivExecutingFootsteps)
+    stopExecution();
+
+  gridmap_2d::GridMap2DPtr map = ivPlanner.createMap(occupancy_map);
   ivIdMapFrame = map->getFrameID();
 
   // updates the map and starts replanning if necessary
@@ -639,13 +1020,14 @@ FootstepNavigation::getFootstepsFromPath(
 {
   humanoid_nav_msgs::StepTarget footstep;
 
-  state_iter_t to_planned = ivPlanner.getPathBegin() + starting_step_num - 1;
+  path_ptr_t path = getExecutionPath();
+  state_iter_t to_planned = path->begin() + starting_step_num - 1;
   tf::Pose last(tf::createQuaternionFromYaw(current_support_leg.getTheta()),
                 tf::Point(current_support_leg.getX(), current_support_leg.getY(),
                           0.0));
   const State* from_planned = to_planned.base();
   to_planned++;
-  for (; to_planned != ivPlanner.getPathEnd(); to_planned++)
+  for (; to_planned != path->end(); to_planned++)
   {
     if (getFootstep(last, *from_planned, *to_planned, &footstep))
     {
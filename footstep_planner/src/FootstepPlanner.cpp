@@ -21,6 +21,10 @@
 #include <footstep_planner/FootstepPlanner.h>
 #include <humanoid_nav_msgs/ClipFootstep.h>
 
+#include <boost/bind.hpp>
+
+#include <limits>
+
 
 using gridmap_2d::GridMap2D;
 using gridmap_2d::GridMap2DPtr;
@@ -32,8 +36,13 @@ FootstepPlanner::FootstepPlanner()
 : ivStartPoseSetUp(false),
   ivGoalPoseSetUp(false),
   ivLastMarkerMsgSize(0),
+  ivVisualizationShutdown(false),
   ivPathCost(0),
-  ivMarkerNamespace("")
+  ivTimeToFirstSolution(-1.0),
+  ivMarkerNamespace(""),
+  ivPendingCacheHash(0),
+  ivPendingCacheRevision(0),
+  ivPathStitched(false)
 {
   // private NodeHandle for parameters and private messages (debug / info)
   ros::NodeHandle nh_private("~");
@@ -51,25 +60,41 @@ FootstepPlanner::FootstepPlanner()
   ivPathVisPub = nh_private.advertise<nav_msgs::Path>("path", 1);
   ivStartPoseVisPub = nh_private.advertise<
       geometry_msgs::PoseStamped>("start", 1);
-
-  std::string heuristic_type;
-  double diff_angle_cost;
+  ivSolutionPub = nh_private.advertise<
+      humanoid_nav_msgs::FootstepSolution>("footstep_solutions", 1);
+  ivPlanningStatsPub = nh_private.advertise<
+      humanoid_nav_msgs::PlanningStats>("planning_stats", 1);
 
   // read parameters from config file:
   // planner environment settings
-  nh_private.param("heuristic_type", heuristic_type,
+  nh_private.param("heuristic_type", ivHeuristicType,
                    std::string("EuclideanHeuristic"));
   nh_private.param("heuristic_scale", ivEnvironmentParams.heuristic_scale, 1.0);
   nh_private.param("max_hash_size", ivEnvironmentParams.hash_table_size, 65536);
   nh_private.param("accuracy/collision_check",
                    ivEnvironmentParams.collision_check_accuracy,
                    2);
+  nh_private.param("accuracy/collision_cache",
+                   ivEnvironmentParams.collision_cache, true);
+  nh_private.param("track_expanded_states",
+                   ivEnvironmentParams.track_expanded_states, true);
+  nh_private.param("batched_expansion",
+                   ivEnvironmentParams.batched_expansion, false);
+  nh_private.param("num_expansion_threads",
+                   ivEnvironmentParams.num_expansion_threads, 0);
+  nh_private.param("state_budget/max_states",
+                   ivEnvironmentParams.max_states, 0);
+  nh_private.param("state_budget/max_memory",
+                   ivEnvironmentParams.max_memory, 0.0);
+  nh_private.param("state_budget/epsilon_factor",
+                   ivStateBudgetEpsilonFactor, 2.0);
+  nh_private.param("state_budget/retries", ivStateBudgetRetries, 2);
   nh_private.param("accuracy/cell_size", ivEnvironmentParams.cell_size, 0.01);
   nh_private.param("accuracy/num_angle_bins",
                    ivEnvironmentParams.num_angle_bins,
                    64);
   nh_private.param("step_cost", ivEnvironmentParams.step_cost, 0.05);
-  nh_private.param("diff_angle_cost", diff_angle_cost, 0.0);
+  nh_private.param("diff_angle_cost", ivDiffAngleCost, 0.0);
 
   nh_private.param("planner_type", ivPlannerType, std::string("ARAPlanner"));
   nh_private.param("search_until_first_solution", ivSearchUntilFirstSolution,
@@ -78,6 +103,16 @@ FootstepPlanner::FootstepPlanner()
   nh_private.param("forward_search", ivEnvironmentParams.forward_search, false);
   nh_private.param("initial_epsilon", ivInitialEpsilon, 3.0);
   nh_private.param("changed_cells_limit", ivChangedCellsLimit, 20000);
+  nh_private.param("map_cache_file", ivMapCacheFile, std::string(""));
+  nh_private.param("map_cache_delay", ivMapCacheDelay, 10.0);
+  ivMapCacheTimer = nh_private.createWallTimer(
+      ros::WallDuration(std::max(ivMapCacheDelay, 0.001)),
+      &FootstepPlanner::mapCacheTimerCallback, this, true, false);
+  nh_private.param("map_tile_size", ivMapTileSize, 0);
+  nh_private.param("map_tile_halo", ivMapTileHalo, 1.0);
+  nh_private.param("incremental_replanning", ivIncrementalReplanning, false);
+  nh_private.param("stream_solutions", ivStreamSolutions, false);
+  nh_private.param("stream_time_slice", ivStreamTimeSlice, 0.1);
   nh_private.param("num_random_nodes", ivEnvironmentParams.num_random_nodes,
                    20);
   nh_private.param("random_node_dist", ivEnvironmentParams.random_node_distance,
@@ -189,59 +224,83 @@ FootstepPlanner::FootstepPlanner()
   ivEnvironmentParams.max_step_width = sqrt(max_x*max_x + max_y*max_y) * 1.5;
 
   // initialize the heuristic
-  boost::shared_ptr<Heuristic> h;
-  if (heuristic_type == "EuclideanHeuristic")
+  ivMaxStepWidth = max_step_width;
+  nh_private.param("heuristic_cache_size", ivHeuristicCacheSize, 4);
+  nh_private.param("heuristic_early_termination", ivHeuristicEarlyTermination,
+                   false);
+  nh_private.param("heuristic_termination_margin",
+                   ivHeuristicTerminationMargin, 0.2);
+  nh_private.param("corridor_width", ivCorridorWidth, 0.0);
+  nh_private.param("corridor_time_fraction", ivCorridorTimeFraction, 0.5);
+  ivCorridorTimeFraction = std::min(std::max(ivCorridorTimeFraction, 0.01),
+                                    1.0);
+  nh_private.param("warm_start/time", ivWarmStartTime, 0.5);
+  nh_private.param("warm_start/lookahead", ivWarmStartLookahead, 2);
+  boost::shared_ptr<Heuristic> h = createHeuristic();
+  if (!h)
   {
-    h.reset(
-        new EuclideanHeuristic(ivEnvironmentParams.cell_size,
-                               ivEnvironmentParams.num_angle_bins));
-    ROS_INFO("FootstepPlanner heuristic: euclidean distance");
+    ROS_ERROR_STREAM("Heuristic " << ivHeuristicType << " not available, "
+                     "exiting.");
+    exit(1);
   }
-  else if(heuristic_type == "EuclStepCostHeuristic")
-  {
-    h.reset(
-        new EuclStepCostHeuristic(ivEnvironmentParams.cell_size,
-                                  ivEnvironmentParams.num_angle_bins,
-                                  ivEnvironmentParams.step_cost,
-                                  diff_angle_cost,
-                                  max_step_width));
+  if (ivHeuristicType == "EuclideanHeuristic")
+    ROS_INFO("FootstepPlanner heuristic: euclidean distance");
+  else if (ivHeuristicType == "EuclStepCostHeuristic")
     ROS_INFO("FootstepPlanner heuristic: euclidean distance with step costs");
-  }
-  else if (heuristic_type == "PathCostHeuristic")
+  else
   {
-    // for heuristic inflation
-    double foot_incircle =
-      std::min((ivEnvironmentParams.footsize_x / 2.0 -
-                std::abs(ivEnvironmentParams.foot_origin_shift_x)),
-               (ivEnvironmentParams.footsize_y / 2.0 -
-                std::abs(ivEnvironmentParams.foot_origin_shift_y)));
-    assert(foot_incircle > 0.0);
-
-    h.reset(
-        new PathCostHeuristic(ivEnvironmentParams.cell_size,
-                              ivEnvironmentParams.num_angle_bins,
-                              ivEnvironmentParams.step_cost,
-                              diff_angle_cost,
-                              max_step_width,
-                              foot_incircle));
     ROS_INFO("FootstepPlanner heuristic: 2D path euclidean distance with step "
              "costs");
-
     // keep a local ptr for visualization
     ivPathCostHeuristicPtr = boost::dynamic_pointer_cast<PathCostHeuristic>(h);
   }
-  else
-  {
-    ROS_ERROR_STREAM("Heuristic " << heuristic_type << " not available, "
-                     "exiting.");
-    exit(1);
-  }
   ivEnvironmentParams.heuristic = h;
 
   // initialize the planner environment
   ivPlannerEnvironmentPtr.reset(
     new FootstepPlannerEnvironment(ivEnvironmentParams));
 
+  // set up the planner portfolio; all searches (including the ones of
+  // FootstepPlanner::replanFromPath()) run on the portfolio, the own
+  // environment merely keeps a planner of its first type
+  if (ivPlannerType == "PortfolioPlanner")
+  {
+    std::vector<std::string> planner_types;
+    XmlRpc::XmlRpcValue portfolio_planners;
+    nh_private.getParam("portfolio/planners", portfolio_planners);
+    if (portfolio_planners.getType() == XmlRpc::XmlRpcValue::TypeArray)
+    {
+      for (int i = 0; i < portfolio_planners.size(); ++i)
+        planner_types.push_back((std::string)portfolio_planners[i]);
+    }
+    else
+    {
+      planner_types.push_back("ARAPlanner");
+      planner_types.push_back("RSTARPlanner");
+    }
+    for (unsigned int i = 0; i < planner_types.size(); ++i)
+    {
+      if (!createPlannerOfType(planner_types[i],
+                               ivPlannerEnvironmentPtr.get()))
+      {
+        ROS_ERROR_STREAM("Planner "<< planner_types[i] <<" of the portfolio "
+                         "not available / untested.");
+        exit(1);
+      }
+    }
+    double target_epsilon;
+    nh_private.param("portfolio/target_epsilon", target_epsilon, 1.0);
+    ivPlannerPortfolio.reset(new FootstepPlannerPortfolio(
+        planner_types, ivEnvironmentParams,
+        boost::bind(&FootstepPlanner::createHeuristic, this),
+        boost::bind(&FootstepPlanner::createPlannerOfType, this, _1, _2),
+        ivMaxSearchTime, ivInitialEpsilon, ivSearchUntilFirstSolution,
+        target_epsilon, ivStreamTimeSlice));
+    ivPlannerType = planner_types[0];
+    ROS_INFO("Planning with a portfolio of %zu planners",
+             planner_types.size());
+  }
+
   // set up planner
   if (ivPlannerType == "ARAPlanner" ||
       ivPlannerType == "ADPlanner"  ||
@@ -264,46 +323,172 @@ FootstepPlanner::FootstepPlanner()
     ROS_INFO_STREAM("Search direction: backward planning");
   }
   setPlanner();
+
+  // set up the planning workers for concurrent service calls
+  int num_planning_workers;
+  nh_private.param("num_planning_workers", num_planning_workers, 0);
+  if (num_planning_workers > 0)
+  {
+    ivPlannerPool.reset(new FootstepPlannerPool(
+        num_planning_workers, ivEnvironmentParams,
+        boost::bind(&FootstepPlanner::createHeuristic, this),
+        boost::bind(&FootstepPlanner::createPlanner, this, _1),
+        ivMaxSearchTime, ivInitialEpsilon, ivSearchUntilFirstSolution));
+    ROS_INFO("Planning service calls with %i workers", num_planning_workers);
+  }
+
+  // build and publish the visualization off the planning thread
+  bool async_visualization;
+  nh_private.param("visualization/async", async_visualization, true);
+  nh_private.param("visualization/expanded_states_decimation",
+                   ivExpandedStatesDecimation, 1);
+  ivExpandedStatesDecimation = std::max(ivExpandedStatesDecimation, 1);
+  if (async_visualization)
+  {
+    ivVisualizationThreadPtr.reset(new boost::thread(
+        boost::bind(&FootstepPlanner::visualizationThread, this)));
+  }
 }
 
 
 FootstepPlanner::~FootstepPlanner()
-{}
+{
+  if (ivVisualizationThreadPtr)
+  {
+    {
+      boost::mutex::scoped_lock lock(ivVisualizationMutex);
+      ivVisualizationShutdown = true;
+    }
+    ivVisualizationCondition.notify_all();
+    ivVisualizationThreadPtr->join();
+  }
+}
 
 
 void
 FootstepPlanner::setPlanner()
 {
-  if (ivPlannerType == "ARAPlanner")
+  ivPlannerPtr = createPlanner(ivPlannerEnvironmentPtr.get());
+}
+
+
+boost::shared_ptr<SBPLPlanner>
+FootstepPlanner::createPlanner(FootstepPlannerEnvironment* env)
+const
+{
+  return createPlannerOfType(ivPlannerType, env);
+}
+
+
+boost::shared_ptr<SBPLPlanner>
+FootstepPlanner::createPlannerOfType(const std::string& planner_type,
+                                     FootstepPlannerEnvironment* env)
+const
+{
+  boost::shared_ptr<SBPLPlanner> planner;
+  if (planner_type == "ARAPlanner")
   {
-    ivPlannerPtr.reset(
-        new ARAPlanner(ivPlannerEnvironmentPtr.get(),
-                       ivEnvironmentParams.forward_search));
+    planner.reset(new ARAPlanner(env, ivEnvironmentParams.forward_search));
+    env->setSearchStateSize(sizeof(ARAState) + sizeof(heapelement));
   }
-  else if (ivPlannerType == "ADPlanner")
+  else if (planner_type == "ADPlanner")
   {
-    ivPlannerPtr.reset(
-        new ADPlanner(ivPlannerEnvironmentPtr.get(),
-                      ivEnvironmentParams.forward_search));
+    planner.reset(new ADPlanner(env, ivEnvironmentParams.forward_search));
+    env->setSearchStateSize(sizeof(ADState) + sizeof(heapelement));
   }
-  else if (ivPlannerType == "RSTARPlanner")
+  else if (planner_type == "RSTARPlanner")
   {
     RSTARPlanner* p =
-        new RSTARPlanner(ivPlannerEnvironmentPtr.get(),
-                         ivEnvironmentParams.forward_search);
+        new RSTARPlanner(env, ivEnvironmentParams.forward_search);
     // new options, require patched SBPL
     //          p->set_local_expand_thres(500);
     //          p->set_eps_step(1.0);
-    ivPlannerPtr.reset(p);
+    planner.reset(p);
+    env->setSearchStateSize(sizeof(RSTARState) + sizeof(heapelement));
   }
   //        else if (ivPlannerType == "ANAPlanner")
-  //        	ivPlannerPtr.reset(new anaPlanner(ivPlannerEnvironmentPtr.get(),
-  //        	                                  ivForwardSearch));
+  //        	planner.reset(new anaPlanner(env, ivForwardSearch));
+  return planner;
+}
+
+
+boost::shared_ptr<Heuristic>
+FootstepPlanner::createHeuristic()
+const
+{
+  boost::shared_ptr<Heuristic> h;
+  if (ivHeuristicType == "EuclideanHeuristic")
+  {
+    h.reset(
+        new EuclideanHeuristic(ivEnvironmentParams.cell_size,
+                               ivEnvironmentParams.num_angle_bins));
+  }
+  else if(ivHeuristicType == "EuclStepCostHeuristic")
+  {
+    h.reset(
+        new EuclStepCostHeuristic(ivEnvironmentParams.cell_size,
+                                  ivEnvironmentParams.num_angle_bins,
+                                  ivEnvironmentParams.step_cost,
+                                  ivDiffAngleCost,
+                                  ivMaxStepWidth));
+  }
+  else if (ivHeuristicType == "PathCostHeuristic")
+  {
+    // for heuristic inflation
+    double foot_incircle =
+      std::min((ivEnvironmentParams.footsize_x / 2.0 -
+                std::abs(ivEnvironmentParams.foot_origin_shift_x)),
+               (ivEnvironmentParams.footsize_y / 2.0 -
+                std::abs(ivEnvironmentParams.foot_origin_shift_y)));
+    assert(foot_incircle > 0.0);
+
+    h.reset(
+        new PathCostHeuristic(ivEnvironmentParams.cell_size,
+                              ivEnvironmentParams.num_angle_bins,
+                              ivEnvironmentParams.step_cost,
+                              ivDiffAngleCost,
+                              ivMaxStepWidth,
+                              foot_incircle,
+                              std::max(1, ivHeuristicCacheSize),
+                              ivHeuristicEarlyTermination,
+                              ivHeuristicTerminationMargin));
+  }
+  return h;
+}
+
+
+bool
+FootstepPlanner::setupCorridor()
+{
+  nav_msgs::Path path;
+  if (!ivCorridorPath.poses.empty())
+    path = ivCorridorPath;
+  else if (ivPathCostHeuristicPtr)
+  {
+    // the distances of the heuristic are settled from the search's start
+    const State& from =
+      ivEnvironmentParams.forward_search ? ivStartFootLeft : ivGoalFootLeft;
+    PlanningState s(from, ivEnvironmentParams.cell_size,
+                    ivEnvironmentParams.num_angle_bins,
+                    ivEnvironmentParams.hash_table_size);
+    if (!ivPathCostHeuristicPtr->extractPath2D(s, &path))
+      ROS_WARN("No 2D path for the search corridor found.");
+  }
+  else
+    ROS_WARN("No 2D path for the search corridor set (or computed by the "
+             "PathCostHeuristic).");
+
+  if (path.poses.empty())
+    return false;
+
+  if (ivHeuristicPathVisPub.getNumSubscribers() > 0)
+    ivHeuristicPathVisPub.publish(path);
+  return ivPlannerEnvironmentPtr->setCorridor(path, ivCorridorWidth);
 }
 
 
 bool
-FootstepPlanner::run()
+FootstepPlanner::run(bool restrict_to_corridor)
 {
   bool path_existed = (bool)ivPath.size();
   int ret = 0;
@@ -314,8 +499,17 @@ FootstepPlanner::run()
   ivPlannerEnvironmentPtr->updateStart(ivStartFootLeft, ivStartFootRight);
   ivPlannerEnvironmentPtr->updateGoal(ivGoalFootLeft, ivGoalFootRight);
   ivPlannerEnvironmentPtr->updateHeuristicValues();
+
+  // a reused search tree (AD*) keeps its corridor
+  if (!path_existed)
+  {
+    ivPlannerEnvironmentPtr->clearCorridor();
+    if (restrict_to_corridor && ivCorridorWidth > 0.0)
+      setupCorridor();
+  }
   ivPlannerEnvironmentPtr->InitializeEnv(NULL);
   ivPlannerEnvironmentPtr->InitializeMDPCfg(&mdp_config);
+  ivPlannerEnvironmentPtr->resetStats();
 
   // inform AD planner about changed (start) states for replanning
   if (path_existed &&
@@ -345,21 +539,35 @@ FootstepPlanner::run()
   ivPlannerPtr->set_initialsolution_eps(ivInitialEpsilon);
   ivPlannerPtr->set_search_mode(ivSearchUntilFirstSolution);
 
+  // leave time for the unrestricted search in case the corridor is too
+  // narrow (see runWithCorridorFallback())
+  const double max_search_time = ivPlannerEnvironmentPtr->hasCorridor() ?
+      ivCorridorTimeFraction * ivMaxSearchTime : ivMaxSearchTime;
+
   ROS_INFO("Start planning (max time: %f, initial eps: %f (%f))\n",
-           ivMaxSearchTime, ivInitialEpsilon,
+           max_search_time, ivInitialEpsilon,
            ivPlannerPtr->get_initial_eps());
   int path_cost;
   ros::WallTime startTime = ros::WallTime::now();
+  ivTimeToFirstSolution = -1.0;
+  // the R* planner does not provide intermediate solutions
+  bool stream_solutions = ivStreamSolutions && ivPlannerType != "RSTARPlanner";
   try
   {
-    ret = ivPlannerPtr->replan(ivMaxSearchTime, &solution_state_ids,
-                               &path_cost);
+    if (stream_solutions)
+      ret = replanStreaming(startTime, max_search_time, &solution_state_ids,
+                            &path_cost);
+    else
+      ret = ivPlannerPtr->replan(max_search_time, &solution_state_ids,
+                                 &path_cost);
   }
   catch (const SBPL_Exception& e)
   {
     // ROS_ERROR("SBPL planning failed (%s)", e.what());
+    publishPlanningStats((ros::WallTime::now()-startTime).toSec());
     return false;
   }
+  publishPlanningStats((ros::WallTime::now()-startTime).toSec());
   ivPathCost = double(path_cost) / FootstepPlannerEnvironment::cvMmScale;
 
   bool path_is_new = pathIsNew(solution_state_ids);
@@ -368,16 +576,30 @@ FootstepPlanner::run()
     if (!path_is_new)
       ROS_WARN("Solution found by SBPL is the same as the old solution. This could indicate that replanning failed.");
 
+    double planning_time = (ros::WallTime::now()-startTime).toSec();
     ROS_INFO("Solution of size %zu found after %f s",
-             solution_state_ids.size(),
-             (ros::WallTime::now()-startTime).toSec());
-
-    if (extractPath(solution_state_ids))
+             solution_state_ids.size(), planning_time);
+    if (ivTimeToFirstSolution < 0.0)
+      ivTimeToFirstSolution = planning_time;
+    ROS_INFO("Time to first solution: %f s", ivTimeToFirstSolution);
+
+    // a streamed solution has already been extracted (and may already be
+    // used by the caller)
+    if (stream_solutions || extractPath(solution_state_ids))
     {
       ROS_INFO("Expanded states: %i total / %i new",
                ivPlannerEnvironmentPtr->getNumExpandedStates(),
                ivPlannerPtr->get_n_expands());
+      if (planning_time > 0.0)
+        ROS_INFO("Expansion rate: %.0f states/s",
+                 ivPlannerEnvironmentPtr->getNumExpandedStates() /
+                 planning_time);
       ROS_INFO("Final eps: %f", ivPlannerPtr->get_final_epsilon());
+      ROS_INFO("Memory: %.2f MB (search), %.2f MB (total)",
+               ivPlannerEnvironmentPtr->getMemoryUsage().search() /
+               (1024.0 * 1024.0),
+               ivPlannerEnvironmentPtr->getMemoryUsage().total() /
+               (1024.0 * 1024.0));
       ROS_INFO("Path cost: %f (%i)\n", ivPathCost, path_cost);
 
       ivPlanningStatesIds = solution_state_ids;
@@ -406,54 +628,165 @@ FootstepPlanner::run()
 }
 
 
-bool
-FootstepPlanner::extractPath(const std::vector<int>& state_ids)
+int
+FootstepPlanner::replanStreaming(const ros::WallTime& start_time,
+                                 double max_search_time,
+                                 std::vector<int>* solution_state_ids,
+                                 int* path_cost)
 {
-  ivPath.clear();
-
-  State s;
-  State start_left;
-  std::vector<int>::const_iterator state_ids_iter = state_ids.begin();
+  // SBPL never improves a solution in the "until first solution" mode;
+  // instead the search stops below after the first solution
+  ivPlannerPtr->set_search_mode(false);
 
-  // first state is always the robot's left foot
-  if (!ivPlannerEnvironmentPtr->getState(*state_ids_iter, &start_left))
-  {
-    ivPath.clear();
-    return false;
-  }
-  ++state_ids_iter;
-  if (!ivPlannerEnvironmentPtr->getState(*state_ids_iter, &s))
+  int ret = 0;
+  double solution_eps = 0.0;
+  std::vector<int> state_ids;
+  int cost;
+  while (true)
   {
-    ivPath.clear();
-    return false;
+    double remaining_time =
+      max_search_time - (ros::WallTime::now() - start_time).toSec();
+    if (remaining_time <= 0.0)
+      break;
+
+    // ARA* and AD* resume their search from the previous time slice
+    state_ids.clear();
+    int found = ivPlannerPtr->replan(
+      std::min(ivStreamTimeSlice, remaining_time), &state_ids, &cost);
+    if (!found || state_ids.empty())
+    {
+      // the search cannot continue without creating new states
+      if (ivPlannerEnvironmentPtr->stateBudgetExceeded())
+        break;
+      continue;
+    }
+
+    double eps = ivPlannerPtr->get_solution_eps();
+    if (!ret || eps < solution_eps)
+    {
+      ret = found;
+      solution_eps = eps;
+      *solution_state_ids = state_ids;
+      *path_cost = cost;
+
+      double planning_time = (ros::WallTime::now() - start_time).toSec();
+      if (ivTimeToFirstSolution < 0.0)
+        ivTimeToFirstSolution = planning_time;
+      ROS_INFO("Solution with eps %f found after %f s", eps, planning_time);
+
+      if (!extractPath(state_ids))
+      {
+        ROS_ERROR("extracting path failed\n\n");
+        return 0;
+      }
+      ivPathCost = double(cost) / FootstepPlannerEnvironment::cvMmScale;
+      broadcastFootstepPathVis();
+      broadcastPathVis();
+      publishSolution(eps, planning_time);
+
+      if (ivSolutionCallback && !ivSolutionCallback(*this))
+      {
+        ROS_INFO("Search stopped by solution callback");
+        break;
+      }
+    }
+
+    // the solution cannot be improved any further
+    if (ivSearchUntilFirstSolution || eps <= 1.0 ||
+        ivPlannerEnvironmentPtr->stateBudgetExceeded())
+      break;
   }
-  ++state_ids_iter;
 
-  // check if the robot's left foot can be ommited as first state in the path,
-  // i.e. the robot's right foot is appended first to the path
-  if (s.getLeg() == LEFT)
-    ivPath.push_back(ivStartFootRight);
-  else
-    ivPath.push_back(start_left);
-  ivPath.push_back(s);
+  return ret;
+}
+
+
+void
+FootstepPlanner::publishSolution(double eps, double planning_time)
+{
+  if (ivSolutionPub.getNumSubscribers() == 0)
+    return;
+
+  humanoid_nav_msgs::FootstepSolution solution;
+  solution.header.stamp = ros::Time::now();
+  solution.header.frame_id = ivMapPtr->getFrameID();
+  extractFootstepsSrv(solution.footsteps);
+  solution.costs = ivPathCost;
+  solution.eps = eps;
+  solution.planning_time = planning_time;
+  solution.time_to_first_solution = ivTimeToFirstSolution;
+  solution.expanded_states = ivPlannerEnvironmentPtr->getNumExpandedStates();
+  ivSolutionPub.publish(solution);
+}
+
+
+void
+FootstepPlanner::publishPlanningStats(double planning_time)
+{
+  if (ivPlanningStatsPub.getNumSubscribers() == 0)
+    return;
 
-  for(; state_ids_iter < state_ids.end(); ++state_ids_iter)
+  humanoid_nav_msgs::PlanningStats stats;
+  stats.header.stamp = ros::Time::now();
+  stats.planning_time = planning_time;
+  stats.expanded_states = ivPlannerEnvironmentPtr->getNumExpandedStates();
+  stats.created_states = ivPlannerEnvironmentPtr->SizeofCreatedEnv();
+
+  const StateHashTable& hash = ivPlannerEnvironmentPtr->getStateHashTable();
+  stats.hash_size = hash.size();
+  stats.hash_capacity = hash.capacity();
+  hash.getProbeLengths(&stats.hash_mean_probe_length,
+                       &stats.hash_max_probe_length);
+
+  const memory_usage_t memory = ivPlannerEnvironmentPtr->getMemoryUsage();
+  stats.memory_states = memory.states;
+  stats.memory_index_mappings = memory.index_mappings;
+  stats.memory_hash_table = memory.hash_table;
+  stats.memory_planner_states = memory.planner_states;
+  stats.memory_collision_cache = memory.collision_cache;
+  stats.memory_bitmaps = memory.bitmaps;
+  stats.state_budget_exceeded =
+    ivPlannerEnvironmentPtr->stateBudgetExceeded();
+
+#ifdef FOOTSTEP_PLANNER_PROFILING
+  const planning_stats_t& current = ivPlannerEnvironmentPtr->getStats();
+  const planning_stats_t cumulative =
+    ivPlannerEnvironmentPtr->getCumulativeStats();
+  const char* names[] = { "GetSuccs", "GetPreds", "occupied",
+                          "collision_check", "hash_lookup", "hash_insert",
+                          "heuristic", "setStateArea" };
+  const profile_counter_t* counters[] = {
+    &current.get_succs, &current.get_preds, &current.occupied,
+    &current.collision_check, &current.hash_lookup, &current.hash_insert,
+    &current.heuristic, &current.set_state_area };
+  const profile_counter_t* cumulative_counters[] = {
+    &cumulative.get_succs, &cumulative.get_preds, &cumulative.occupied,
+    &cumulative.collision_check, &cumulative.hash_lookup,
+    &cumulative.hash_insert, &cumulative.heuristic,
+    &cumulative.set_state_area };
+
+  const int num_counters = sizeof(names) / sizeof(names[0]);
+  stats.counters.resize(num_counters);
+  for (int i = 0; i < num_counters; ++i)
   {
-    if (!ivPlannerEnvironmentPtr->getState(*state_ids_iter, &s))
-    {
-      ivPath.clear();
-      return false;
-    }
-    ivPath.push_back(s);
+    stats.counters[i].name = names[i];
+    stats.counters[i].calls = counters[i]->calls;
+    stats.counters[i].time = counters[i]->time;
+    stats.counters[i].cumulative_calls = cumulative_counters[i]->calls;
+    stats.counters[i].cumulative_time = cumulative_counters[i]->time;
   }
+#endif
 
-  // add last neutral step
-  if (ivPath.back().getLeg() == RIGHT)
-    ivPath.push_back(ivGoalFootLeft);
-  else // last_leg == LEFT
-    ivPath.push_back(ivGoalFootRight);
+  ivPlanningStatsPub.publish(stats);
+}
 
-  return true;
+
+bool
+FootstepPlanner::extractPath(const std::vector<int>& state_ids)
+{
+  return ivPlannerEnvironmentPtr->extractPath(state_ids, ivStartFootRight,
+                                              ivGoalFootLeft, ivGoalFootRight,
+                                              &ivPath);
 }
 
 
@@ -464,6 +797,7 @@ FootstepPlanner::reset()
   // reset the previously calculated paths
   ivPath.clear();
   ivPlanningStatesIds.clear();
+  ivPathStitched = false;
   // reset the planner
   // INFO: force_planning_from_scratch was not working properly the last time
   // checked; therefore instead of using this function the planner is manually
@@ -481,6 +815,7 @@ FootstepPlanner::resetTotally()
   // reset the previously calculated paths
   ivPath.clear();
   ivPlanningStatesIds.clear();
+  ivPathStitched = false;
   // reinitialize the planner environment
   ivPlannerEnvironmentPtr.reset(
       new FootstepPlannerEnvironment(ivEnvironmentParams));
@@ -503,13 +838,67 @@ FootstepPlanner::plan(bool force_new_plan)
     return false;
   }
 
-  if (force_new_plan
+  if (force_new_plan || ivPathStitched
       || ivPlannerType == "RSTARPlanner" || ivPlannerType == "ARAPlanner" )
   {
     reset();
   }
+  if (ivPlannerPortfolio)
+    return planWithPortfolio();
+
   // start the planning and return success
-  return run();
+  if (runWithCorridorFallback())
+    return true;
+  return retryWithinStateBudget();
+}
+
+
+bool
+FootstepPlanner::runWithCorridorFallback()
+{
+  ros::WallTime start_time = ros::WallTime::now();
+  if (run())
+    return true;
+
+  // the corridor may have been too narrow
+  if (!ivPlannerEnvironmentPtr->hasCorridor() ||
+      ivPlannerEnvironmentPtr->stateBudgetExceeded())
+    return false;
+
+  const double max_search_time = ivMaxSearchTime;
+  ivMaxSearchTime -= (ros::WallTime::now() - start_time).toSec();
+  bool success = false;
+  if (ivMaxSearchTime > 0.0)
+  {
+    ROS_INFO("No solution within the corridor, planning without it");
+    reset();
+    success = run(false);
+  }
+  ivMaxSearchTime = max_search_time;
+  return success;
+}
+
+
+bool
+FootstepPlanner::retryWithinStateBudget()
+{
+  if (ivStateBudgetEpsilonFactor <= 1.0)
+    return false;
+
+  const double initial_epsilon = ivInitialEpsilon;
+  bool success = false;
+  for (int i = 0; i < ivStateBudgetRetries && !success &&
+                  ivPlannerEnvironmentPtr->stateBudgetExceeded(); ++i)
+  {
+    ivInitialEpsilon *= ivStateBudgetEpsilonFactor;
+    ROS_INFO("State budget exceeded without a solution, replanning with "
+             "initial eps %f", ivInitialEpsilon);
+    reset();
+    success = runWithCorridorFallback();
+  }
+  ivInitialEpsilon = initial_epsilon;
+
+  return success;
 }
 
 
@@ -520,6 +909,179 @@ FootstepPlanner::replan()
 }
 
 
+bool
+FootstepPlanner::planWithPortfolio()
+{
+  // the own planning information does not refer to the portfolio's path
+  reset();
+
+  FootstepPlannerPortfolio::query_t query;
+  query.start_left = ivStartFootLeft;
+  query.start_right = ivStartFootRight;
+  query.goal_left = ivGoalFootLeft;
+  query.goal_right = ivGoalFootRight;
+
+  std::string winner;
+  bool success = ivPlannerPortfolio->plan(query, &ivPortfolioResult, &winner,
+                                         ivMaxSearchTime,
+                                         ivSearchUntilFirstSolution);
+  if (!success)
+  {
+    ROS_ERROR("No solution found");
+    return false;
+  }
+
+  ivPath = ivPortfolioResult.path;
+  ivPathCost = ivPortfolioResult.costs;
+  ivTimeToFirstSolution = ivPortfolioResult.planning_time;
+  ROS_INFO("Solution of size %zu found by %s after %f s", ivPath.size(),
+           winner.c_str(), ivPortfolioResult.planning_time);
+
+  broadcastFootstepPathVis();
+  broadcastPathVis();
+  return true;
+}
+
+
+double
+FootstepPlanner::lastFinalEpsilon()
+const
+{
+  if (ivPlannerPortfolio)
+    return ivPortfolioResult.final_eps;
+  return ivPlannerPtr->get_final_epsilon();
+}
+
+
+int
+FootstepPlanner::lastExpandedStates()
+const
+{
+  if (ivPlannerPortfolio)
+    return ivPortfolioResult.expanded_states;
+  return ivPlannerEnvironmentPtr->getNumExpandedStates();
+}
+
+
+bool
+FootstepPlanner::replanFromPath()
+{
+  if (!ivMapPtr || !ivGoalPoseSetUp || !ivStartPoseSetUp || ivPath.size() < 4)
+    return false;
+
+  // the path has to end in the current goal
+  const State& last = ivPath.back();
+  const State& goal = (last.getLeg() == LEFT) ? ivGoalFootLeft :
+                                                ivGoalFootRight;
+  if (last != goal)
+    return false;
+
+  // the foot pose of the path closest to the start (of the same leg)...
+  int closest = -1;
+  double closest_dist = std::numeric_limits<double>::max();
+  for (unsigned int i = 0; i < ivPath.size(); ++i)
+  {
+    const State& start = (ivPath[i].getLeg() == LEFT) ? ivStartFootLeft :
+                                                        ivStartFootRight;
+    double dist = euclidean_distance_sq(ivPath[i].getX(), ivPath[i].getY(),
+                                        start.getX(), start.getY());
+    if (dist < closest_dist)
+    {
+      closest = i;
+      closest_dist = dist;
+    }
+  }
+  // ...and the first candidate after which the suffix is still free
+  int first = closest + ivWarmStartLookahead;
+  for (int i = ivPath.size() - 1; i >= std::max(first, 0); --i)
+  {
+    if (ivPlannerEnvironmentPtr->occupied(ivPath[i]))
+    {
+      first = i + 1;
+      break;
+    }
+  }
+  if (first > int(ivPath.size()) - 2)
+    return false;
+
+  ROS_INFO("Reconnecting to the path (%zu states) after state %i",
+           ivPath.size(), first);
+
+  // run time bounded local searches to the feet (first, first + 1),
+  // (first + 1, first + 2), ... without streaming the partial paths; the
+  // searches share the environment (states, collision checks and, for the
+  // backward search, the heuristic towards the start), only the planner
+  // reinitializes its search for each new goal
+  std::vector<State> old_path = ivPath;
+  const State goal_left = ivGoalFootLeft;
+  const State goal_right = ivGoalFootRight;
+  const double max_search_time = ivMaxSearchTime;
+  const bool search_until_first_solution = ivSearchUntilFirstSolution;
+  const bool stream_solutions = ivStreamSolutions;
+  ivSearchUntilFirstSolution = true;
+  ivStreamSolutions = false;
+
+  bool success = false;
+  int connection = first;
+  ros::WallTime deadline = ros::WallTime::now() +
+                           ros::WallDuration(ivWarmStartTime);
+  if (!ivPlannerPortfolio)
+    reset();
+  for (; connection < int(old_path.size()) - 1 && !success; ++connection)
+  {
+    // each remaining candidate gets its share of the remaining time, so a
+    // failing search cannot use up the time of all later candidates (time
+    // left over by a candidate goes to the following ones)
+    double remaining_time = (deadline - ros::WallTime::now()).toSec();
+    if (remaining_time <= 0.0)
+      break;
+    int remaining_candidates = int(old_path.size()) - 1 - connection;
+    ivMaxSearchTime = remaining_time / remaining_candidates;
+
+    const State& a = old_path[connection];
+    const State& b = old_path[connection + 1];
+    if (!setGoal(a.getLeg() == LEFT ? a : b, a.getLeg() == LEFT ? b : a))
+      continue;
+    if (ivPlannerPortfolio)
+      success = planWithPortfolio();
+    else
+      success = run(false);
+  }
+
+  ivMaxSearchTime = max_search_time;
+  ivSearchUntilFirstSolution = search_until_first_solution;
+  ivStreamSolutions = stream_solutions;
+  setGoal(goal_left, goal_right);
+
+  if (!success)
+  {
+    ROS_INFO("Reconnecting to the path failed");
+    reset();
+    ivPath = old_path;
+    ivPathStitched = true;
+    return false;
+  }
+
+  // the local path ends with both feet of the connection; continue with the
+  // suffix from the last foot placed at its pose of the old path
+  --connection;
+  if (connection + 2 < int(old_path.size()))
+  {
+    if (ivPath.back().getLeg() != old_path[connection + 1].getLeg())
+      ivPath.pop_back();
+    ivPath.insert(ivPath.end(), old_path.begin() + connection + 2,
+                  old_path.end());
+  }
+  ivPathStitched = true;
+
+  broadcastFootstepPathVis();
+  broadcastPathVis();
+  ROS_INFO("Reconnected to the path at state %i (new path: %zu states)",
+           connection, ivPath.size());
+  return true;
+}
+
+
 bool
 FootstepPlanner::plan(const geometry_msgs::PoseStampedConstPtr start,
                       const geometry_msgs::PoseStampedConstPtr goal)
@@ -549,13 +1111,30 @@ bool
 FootstepPlanner::planService(humanoid_nav_msgs::PlanFootsteps::Request &req,
                              humanoid_nav_msgs::PlanFootsteps::Response &resp)
 {
+  if (ivPlannerPool)
+  {
+    State start(req.start.x, req.start.y, req.start.theta, NOLEG);
+    State goal(req.goal.x, req.goal.y, req.goal.theta, NOLEG);
+    humanoid_nav_msgs::FootstepPlan plan;
+    planConcurrently(getFootPose(start, LEFT), getFootPose(start, RIGHT),
+                     getFootPose(goal, LEFT), getFootPose(goal, RIGHT),
+                     &plan);
+    resp.result = plan.result;
+    resp.footsteps.swap(plan.footsteps);
+    resp.costs = plan.costs;
+    resp.final_eps = plan.final_eps;
+    resp.planning_time = plan.planning_time;
+    resp.expanded_states = plan.expanded_states;
+    return true;
+  }
+
   bool result = plan(req.start.x, req.start.y, req.start.theta,
                      req.goal.x, req.goal.y, req.goal.theta);
 
   resp.costs = getPathCosts();
   resp.footsteps.reserve(getPathSize());
-  resp.final_eps = ivPlannerPtr->get_final_epsilon();
-  resp.expanded_states = ivPlannerEnvironmentPtr->getNumExpandedStates();
+  resp.final_eps = lastFinalEpsilon();
+  resp.expanded_states = lastExpandedStates();
   extractFootstepsSrv(resp.footsteps);
 
   resp.result = result;
@@ -570,6 +1149,24 @@ bool
 FootstepPlanner::planFeetService(humanoid_nav_msgs::PlanFootstepsBetweenFeet::Request &req,
                              humanoid_nav_msgs::PlanFootstepsBetweenFeet::Response &resp)
 {
+  if (ivPlannerPool)
+  {
+    humanoid_nav_msgs::FootstepPlan plan;
+    planConcurrently(
+        State(req.start_left.pose.x, req.start_left.pose.y, req.start_left.pose.theta, LEFT),
+        State(req.start_right.pose.x, req.start_right.pose.y, req.start_right.pose.theta, RIGHT),
+        State(req.goal_left.pose.x, req.goal_left.pose.y, req.goal_left.pose.theta, LEFT),
+        State(req.goal_right.pose.x, req.goal_right.pose.y, req.goal_right.pose.theta, RIGHT),
+        &plan);
+    resp.result = plan.result;
+    resp.footsteps.swap(plan.footsteps);
+    resp.costs = plan.costs;
+    resp.final_eps = plan.final_eps;
+    resp.planning_time = plan.planning_time;
+    resp.expanded_states = plan.expanded_states;
+    return true;
+  }
+
   // TODO check direction and change of states, force planning from scratch if does not fit
   setStart(State(req.start_left.pose.x, req.start_left.pose.y, req.start_left.pose.theta, LEFT),
            State(req.start_right.pose.x, req.start_right.pose.y, req.start_right.pose.theta, RIGHT));
@@ -580,8 +1177,8 @@ FootstepPlanner::planFeetService(humanoid_nav_msgs::PlanFootstepsBetweenFeet::Re
 
   resp.costs = getPathCosts();
   resp.footsteps.reserve(getPathSize());
-  resp.final_eps = ivPlannerPtr->get_final_epsilon();
-  resp.expanded_states = ivPlannerEnvironmentPtr->getNumExpandedStates();
+  resp.final_eps = lastFinalEpsilon();
+  resp.expanded_states = lastExpandedStates();
   extractFootstepsSrv(resp.footsteps);
 
   resp.result = result;
@@ -591,11 +1188,111 @@ FootstepPlanner::planFeetService(humanoid_nav_msgs::PlanFootstepsBetweenFeet::Re
   return true;
 }
 
+
+bool
+FootstepPlanner::planBatchService(
+    humanoid_nav_msgs::PlanFootstepsBatch::Request &req,
+    humanoid_nav_msgs::PlanFootstepsBatch::Response &resp)
+{
+  resp.plans.clear();
+  if (req.starts.size() != req.goals.size())
+  {
+    ROS_ERROR("Batch planning request with %zu start but %zu goal poses.",
+              req.starts.size(), req.goals.size());
+    resp.result = false;
+    return true;
+  }
+  resp.result = true;
+  resp.plans.resize(req.starts.size());
+
+  if (ivPlannerPool)
+  {
+    std::vector<FootstepPlannerPool::query_t> queries(req.starts.size());
+    for (unsigned int i = 0; i < req.starts.size(); ++i)
+    {
+      State start(req.starts[i].x, req.starts[i].y, req.starts[i].theta,
+                  NOLEG);
+      State goal(req.goals[i].x, req.goals[i].y, req.goals[i].theta, NOLEG);
+      queries[i].start_left = getFootPose(start, LEFT);
+      queries[i].start_right = getFootPose(start, RIGHT);
+      queries[i].goal_left = getFootPose(goal, LEFT);
+      queries[i].goal_right = getFootPose(goal, RIGHT);
+    }
+    std::vector<FootstepPlannerPool::result_t> results;
+    ivPlannerPool->planBatch(queries, &results);
+    for (unsigned int i = 0; i < results.size(); ++i)
+    {
+      humanoid_nav_msgs::FootstepPlan& plan = resp.plans[i];
+      plan.result = results[i].success;
+      plan.costs = results[i].costs;
+      plan.final_eps = results[i].final_eps;
+      plan.planning_time = results[i].planning_time;
+      plan.expanded_states = results[i].expanded_states;
+      extractFootstepsSrv(results[i].path, plan.footsteps);
+    }
+    return true;
+  }
+
+  // no workers: plan the queries one after another
+  for (unsigned int i = 0; i < req.starts.size(); ++i)
+  {
+    humanoid_nav_msgs::FootstepPlan& result = resp.plans[i];
+    ros::WallTime start_time = ros::WallTime::now();
+    result.result = plan(req.starts[i].x, req.starts[i].y,
+                         req.starts[i].theta,
+                         req.goals[i].x, req.goals[i].y, req.goals[i].theta);
+    result.planning_time = (ros::WallTime::now() - start_time).toSec();
+    result.costs = getPathCosts();
+    result.final_eps = lastFinalEpsilon();
+    result.expanded_states = lastExpandedStates();
+    if (result.result)
+      extractFootstepsSrv(result.footsteps);
+  }
+
+  return true;
+}
+
+
+void
+FootstepPlanner::planConcurrently(const State& start_left,
+                                  const State& start_right,
+                                  const State& goal_left,
+                                  const State& goal_right,
+                                  humanoid_nav_msgs::FootstepPlan* plan)
+{
+  FootstepPlannerPool::query_t query;
+  query.start_left = start_left;
+  query.start_right = start_right;
+  query.goal_left = goal_left;
+  query.goal_right = goal_right;
+
+  FootstepPlannerPool::result_t result;
+  ivPlannerPool->plan(query, &result);
+
+  plan->result = result.success;
+  plan->costs = result.costs;
+  plan->final_eps = result.final_eps;
+  plan->planning_time = result.planning_time;
+  plan->expanded_states = result.expanded_states;
+  plan->footsteps.clear();
+  extractFootstepsSrv(result.path, plan->footsteps);
+}
+
+
 void
 FootstepPlanner::extractFootstepsSrv(std::vector<humanoid_nav_msgs::StepTarget> & footsteps) const{
+  extractFootstepsSrv(ivPath, footsteps);
+}
+
+
+void
+FootstepPlanner::extractFootstepsSrv(const std::vector<State>& path,
+                                     std::vector<humanoid_nav_msgs::StepTarget> & footsteps) const
+{
   humanoid_nav_msgs::StepTarget foot;
   state_iter_t path_iter;
-  for (path_iter = getPathBegin(); path_iter != getPathEnd(); ++path_iter)
+  footsteps.reserve(footsteps.size() + path.size());
+  for (path_iter = path.begin(); path_iter != path.end(); ++path_iter)
   {
     foot.pose.x = path_iter->getX();
     foot.pose.y = path_iter->getY();
@@ -655,13 +1352,14 @@ void
 FootstepPlanner::mapCallback(
     const nav_msgs::OccupancyGridConstPtr& occupancy_map)
 {
-  GridMap2DPtr map(new GridMap2D(occupancy_map));
+  GridMap2DPtr map = createMap(occupancy_map);
 
   // new map: update the map information
   if (updateMap(map))
   {
-    // NOTE: update map currently simply resets the planner, i.e. replanning
-    // here is in fact a planning from the scratch
+    // NOTE: unless incremental_replanning is used with the ADPlanner, update
+    // map simply resets the planner, i.e. replanning here is in fact a
+    // planning from the scratch
     plan(false);
   }
 }
@@ -783,6 +1481,59 @@ FootstepPlanner::setStart(float x, float y, float theta)
 }
 
 
+GridMap2DPtr
+FootstepPlanner::createMap(const nav_msgs::OccupancyGridConstPtr& occupancy_map)
+const
+{
+  GridMap2DPtr map(new GridMap2D());
+  if (ivMapTileSize > 0)
+    map->setMapTiled(occupancy_map, false, ivMapTileSize, ivMapTileHalo);
+  else if (!ivMapCacheFile.empty())
+  {
+    bool cached = map->setMapCached(occupancy_map, false, ivMapCacheFile);
+
+    // a new map is only written to the cache once it has not been replaced
+    // for map_cache_delay seconds (instead of for each changing map)
+    boost::mutex::scoped_lock lock(ivMapCacheMutex);
+    ivMapCacheTimer.stop();
+    ivPendingCacheMap.reset();
+    if (!cached)
+    {
+      ivPendingCacheMap = map;
+      ivPendingCacheHash = GridMap2D::contentHash(*occupancy_map, false);
+      ivPendingCacheRevision = map->revision();
+      ivMapCacheTimer.start();
+    }
+  }
+  else
+    map->setMap(occupancy_map, false);
+  return map;
+}
+
+
+void
+FootstepPlanner::mapCacheTimerCallback(const ros::WallTimerEvent& event)
+{
+  GridMap2DPtr map;
+  boost::uint64_t hash;
+  unsigned long revision;
+  {
+    boost::mutex::scoped_lock lock(ivMapCacheMutex);
+    map.swap(ivPendingCacheMap);
+    hash = ivPendingCacheHash;
+    revision = ivPendingCacheRevision;
+  }
+  // (a map changed in place does not match its message any more)
+  if (!map || map->revision() != revision)
+    return;
+
+  if (map->saveCache(ivMapCacheFile, hash))
+    ROS_INFO("Map written to the cache %s", ivMapCacheFile.c_str());
+  else
+    ROS_WARN("Could not write the map cache %s", ivMapCacheFile.c_str());
+}
+
+
 bool
 FootstepPlanner::updateMap(const GridMap2DPtr map)
 {
@@ -793,131 +1544,105 @@ FootstepPlanner::updateMap(const GridMap2DPtr map)
   ivMapPtr = map;
 
   // check if a previous map and a path existed
+  bool replanning_necessary = false;
   if (old_map && (bool)ivPath.size())
   {
-    updateEnvironment(old_map);
-    return true;
+    replanning_necessary = updateEnvironment(old_map);
+    // an identical map keeps the old one (and its revision)
+    if (ivMapPtr == old_map)
+      return false;
+  }
+  else
+  {
+    // ..otherwise the environment's map can simply be updated
+    ivPlannerEnvironmentPtr->updateMap(map);
   }
 
-  // ..otherwise the environment's map can simply be updated
-  ivPlannerEnvironmentPtr->updateMap(map);
-  return false;
+  // the planning workers simply use the new map for their next query
+  if (ivPlannerPool)
+    ivPlannerPool->updateMap(ivMapPtr);
+  if (ivPlannerPortfolio)
+    ivPlannerPortfolio->updateMap(ivMapPtr);
+  return replanning_necessary;
 }
 
 
-void
+bool
 FootstepPlanner::updateEnvironment(const GridMap2DPtr old_map)
 {
-  ROS_INFO("Reseting the planning environment.");
-  // reset environment
-  resetTotally();
-  // set the new map
-  ivPlannerEnvironmentPtr->updateMap(ivMapPtr);
-
-
-  // The following is not used any more
-
-  // Replanning based on old planning info currently disabled
-  //        // TODO: handle size changes of the map; currently the planning
-  //        // information is reseted
-  //
-  //        if (ivPlannerType == "ADPlanner" &&
-  //            ivMapPtr->getResolution() == old_map->getResolution() &&
-  //            ivMapPtr->size().height == old_map->size().height &&
-  //            ivMapPtr->size().width == old_map->size().width)
-  //        {
-  //            ROS_INFO("Received an updated map => change detection");
-  //
-  //            std::vector<State2> changed_states;
-  //            cv::Mat changed_cells;
-  //
-  //            // get new occupied cells only (0: occupied in binary map)
-  //            // changedCells(x,y) = old(x,y) AND NOT(new(x,y))
-  ////          cv::bitwise_not(gridMap->binaryMap(), changedCells);
-  ////          cv::bitwise_and(ivMapPtr->binaryMap(), changedCells, changedCells);
-  //
-  //            // to get all changed cells (new free and occupied) use XOR:
-  //            cv::bitwise_xor(old_map->binaryMap(), ivMapPtr->binaryMap(),
-  //                            changed_cells);
-  //
-  //            //inflate by outer foot radius:
-  //            cv::bitwise_not(changed_cells, changed_cells); // invert for distanceTransform
-  //            cv::Mat changedDistMap = cv::Mat(changed_cells.size(), CV_32FC1);
-  //            cv::distanceTransform(changed_cells, changedDistMap,
-  //                                  CV_DIST_L2, CV_DIST_MASK_PRECISE);
-  //            double max_foot_radius = sqrt(
-  //                    pow(std::abs(ivOriginFootShiftX) + ivFootsizeX / 2.0, 2.0) +
-  //                    pow(std::abs(ivOriginFootShiftY) + ivFootsizeY / 2.0, 2.0))
-  //                    / ivMapPtr->getResolution();
-  //            changed_cells = (changedDistMap <= max_foot_radius); // threshold, also invert back
-  //
-  //            // loop over changed cells (now marked with 255 in the mask):
-  //            unsigned int num_changed_cells = 0;
-  //            double wx, wy;
-  //            State2 s;
-  //            for (int y = 0; y < changed_cells.rows; ++y)
-  //            {
-  //                for (int x = 0; x < changed_cells.cols; ++x)
-  //                {
-  //                    if (changed_cells.at<uchar>(x,y) == 255)
-  //                    {
-  //                        ++num_changed_cells;
-  //                        ivMapPtr->mapToWorld(x, y, wx, wy);
-  //                        s.setX(wx);
-  //                        s.setY(wy);
-  //                        // on each grid cell ivNumAngleBins-many planning states
-  //                        // can be placed (if the resolution of the grid cells is
-  //                        // the same as of the planning state grid)
-  //                        for (int theta = 0; theta < ivNumAngleBins; ++theta)
-  //                        {
-  //                            s.setTheta(angle_cell_2_state(theta, ivNumAngleBins));
-  //                            changed_states.push_back(s);
-  //                        }
-  //                    }
-  //                }
-  //            }
-  //
-  //            if (num_changed_cells == 0)
-  //            {
-  //                ROS_INFO("old map equals new map; no replanning necessary");
-  //                return;
-  //            }
-  //
-  //            ROS_INFO("%d changed map cells found", num_changed_cells);
-  //            if (num_changed_cells <= ivChangedCellsLimit)
-  //            {
-  //                // update planer
-  //                ROS_INFO("Use old information in new planning taks");
-  //
-  //                std::vector<int> neighbour_ids;
-  //                if (ivForwardSearch)
-  //                    ivPlannerEnvironmentPtr->getSuccsOfGridCells(
-  //                            changed_states, &neighbour_ids);
-  //                else
-  //                    ivPlannerEnvironmentPtr->getPredsOfGridCells(
-  //                            changed_states, &neighbour_ids);
-  //
-  //                boost::shared_ptr<ADPlanner> h =
-  //                        boost::dynamic_pointer_cast<ADPlanner>(ivPlannerPtr);
-  //                h->costs_changed(PlanningStateChangeQuery(neighbour_ids));
-  //            }
-  //            else
-  //            {
-  //                ROS_INFO("Reset old information in new planning task");
-  //                // reset planner
-  //                ivPlannerEnvironmentPtr->reset();
-  //                setPlanner();
-  //                //ivPlannerPtr->force_planning_from_scratch();
-  //            }
-  //        }
-  //        else
-  //        {
-  //            ROS_INFO("Reset old information in new planning task");
-  //            // reset planner
-  //            ivPlannerEnvironmentPtr->reset();
-  //            setPlanner();
-  //            //ivPlannerPtr->force_planning_from_scratch();
-  //        }
+  // a map of another geometry resets the planning information
+  const nav_msgs::MapMetaData& old_info = old_map->getInfo();
+  const nav_msgs::MapMetaData& new_info = ivMapPtr->getInfo();
+  // (the change detection needs the dense binary maps)
+  if (!ivIncrementalReplanning ||
+      ivPlannerType != "ADPlanner" ||
+      old_map->isTiled() || ivMapPtr->isTiled() ||
+      old_info.resolution != new_info.resolution ||
+      old_info.width != new_info.width ||
+      old_info.height != new_info.height ||
+      old_info.origin.position.x != new_info.origin.position.x ||
+      old_info.origin.position.y != new_info.origin.position.y)
+  {
+    ROS_INFO("Reseting the planning environment.");
+    // reset environment
+    resetTotally();
+    // set the new map
+    ivPlannerEnvironmentPtr->updateMap(ivMapPtr);
+    return true;
+  }
+
+  ROS_INFO("Received an updated map => change detection");
+
+  // to get all changed cells (new free and occupied) use XOR:
+  cv::Mat changed_cells;
+  cv::bitwise_xor(old_map->binaryMap(), ivMapPtr->binaryMap(), changed_cells);
+  int num_changed_cells = cv::countNonZero(changed_cells);
+  if (num_changed_cells > ivChangedCellsLimit)
+  {
+    ROS_INFO("%d changed map cells found (limit: %d), reset old information "
+             "in new planning task", num_changed_cells, ivChangedCellsLimit);
+    resetTotally();
+    ivPlannerEnvironmentPtr->updateMap(ivMapPtr);
+    return true;
+  }
+
+  if (num_changed_cells == 0)
+  {
+    // the environment keeps the old map, its collision checks and heuristic
+    ROS_INFO("old map equals new map; no replanning necessary");
+    ivMapPtr = old_map;
+    return false;
+  }
+
+  // note: the cv::Mat is transposed, i.e. rows correspond to map x
+  std::vector<std::pair<unsigned int, unsigned int> > changed;
+  changed.reserve(num_changed_cells);
+  for (int x = 0; x < changed_cells.rows; ++x)
+  {
+    const uchar* row = changed_cells.ptr<uchar>(x);
+    for (int y = 0; y < changed_cells.cols; ++y)
+    {
+      if (row[y])
+        changed.push_back(std::pair<unsigned int, unsigned int>(x, y));
+    }
+  }
+
+  // the environment invalidates the affected collision checks and determines
+  // the states whose edges might have changed
+  std::vector<int> affected_ids;
+  ivPlannerEnvironmentPtr->updateMapIncrementally(ivMapPtr, changed,
+                                                  &affected_ids);
+
+  ROS_INFO("%d changed map cells found, %zu planning states affected; "
+           "use old information in new planning task",
+           num_changed_cells, affected_ids.size());
+  if (!affected_ids.empty())
+  {
+    boost::shared_ptr<ADPlanner> ad_planner =
+      boost::dynamic_pointer_cast<ADPlanner>(ivPlannerPtr);
+    ad_planner->costs_changed(PlanningStateChangeQuery(affected_ids));
+  }
+  return true;
 }
 
 
@@ -938,6 +1663,18 @@ FootstepPlanner::getFootPose(const State& robot, Leg leg)
 }
 
 
+bool
+FootstepPlanner::pathOccupied(state_iter_t begin, state_iter_t end)
+{
+  for (state_iter_t it = begin; it != end; ++it)
+  {
+    if (ivPlannerEnvironmentPtr->occupied(*it))
+      return true;
+  }
+  return false;
+}
+
+
 bool
 FootstepPlanner::pathIsNew(const std::vector<int>& new_path)
 {
@@ -954,20 +1691,31 @@ FootstepPlanner::pathIsNew(const std::vector<int>& new_path)
 
 void
 FootstepPlanner::clearFootstepPathVis(unsigned num_footsteps)
+{
+  if (num_footsteps < 1)
+  {
+    boost::mutex::scoped_lock lock(ivVisualizationMutex);
+    num_footsteps = ivLastMarkerMsgSize;
+  }
+  clearFootstepPathVis(ivMapPtr->getFrameID(), ivMarkerNamespace,
+                       num_footsteps);
+}
+
+
+void
+FootstepPlanner::clearFootstepPathVis(const std::string& frame_id,
+                                      const std::string& marker_ns,
+                                      unsigned num_footsteps)
 {
   visualization_msgs::Marker marker;
   visualization_msgs::MarkerArray marker_msg;
 
   marker.header.stamp = ros::Time::now();
-  marker.header.frame_id = ivMapPtr->getFrameID();
-
-
-  if (num_footsteps < 1)
-    num_footsteps = ivLastMarkerMsgSize;
+  marker.header.frame_id = frame_id;
 
   for (unsigned i = 0; i < num_footsteps; ++i)
   {
-    marker.ns = ivMarkerNamespace;
+    marker.ns = marker_ns;
     marker.id = i;
     marker.action = visualization_msgs::Marker::DELETE;
 
@@ -981,45 +1729,242 @@ FootstepPlanner::clearFootstepPathVis(unsigned num_footsteps)
 void
 FootstepPlanner::broadcastExpandedNodesVis()
 {
-  if (ivExpandedStatesVisPub.getNumSubscribers() > 0)
+  if (ivExpandedStatesVisPub.getNumSubscribers() > 0 &&
+      ivPlannerEnvironmentPtr->tracksExpandedStates())
   {
-    sensor_msgs::PointCloud cloud_msg;
-    geometry_msgs::Point32 point;
-    std::vector<geometry_msgs::Point32> points;
+    // copying the bitmap is much cheaper than building the point cloud
+    visualization_t vis;
+    vis.has_expanded_states = true;
+    vis.expanded_states = ivPlannerEnvironmentPtr->getExpandedStates();
+    queueVisualization(vis);
+  }
+}
+
+
+void
+FootstepPlanner::broadcastFootstepPathVis()
+{
+  if (getPathSize() == 0)
+  {
+    ROS_INFO("no path has been extracted yet");
+    return;
+  }
+  if (ivFootstepPathVisPub.getNumSubscribers() == 0)
+    return;
+
+  visualization_t vis;
+  vis.has_footsteps = true;
+  vis.path = ivPath;
+  vis.start_foot_left = ivStartFootLeft;
+  vis.start_foot_right = ivStartFootRight;
+  queueVisualization(vis);
+}
+
+
+void
+FootstepPlanner::broadcastRandomNodesVis()
+{
+  if (ivRandomStatesVisPub.getNumSubscribers() > 0)
+  {
+    // the states are only valid until the next planning task
+    visualization_t vis;
+    vis.has_random_states = true;
 
     State s;
-    FootstepPlannerEnvironment::exp_states_2d_iter_t state_id_it;
-    for(state_id_it = ivPlannerEnvironmentPtr->getExpandedStatesStart();
-        state_id_it != ivPlannerEnvironmentPtr->getExpandedStatesEnd();
-        ++state_id_it)
+    FootstepPlannerEnvironment::exp_states_iter_t state_id_iter;
+    for(state_id_iter = ivPlannerEnvironmentPtr->getRandomStatesStart();
+        state_id_iter != ivPlannerEnvironmentPtr->getRandomStatesEnd();
+        ++state_id_iter)
     {
-      point.x = cell_2_state(state_id_it->first,
-                             ivEnvironmentParams.cell_size);
-      point.y = cell_2_state(state_id_it->second,
-                             ivEnvironmentParams.cell_size);
-      point.z = 0.01;
-      points.push_back(point);
+      if (!ivPlannerEnvironmentPtr->getState(*state_id_iter, &s))
+        ROS_WARN("Could not get random state %d", *state_id_iter);
+      else
+        vis.random_states.push_back(s);
     }
-    cloud_msg.header.stamp = ros::Time::now();
-    cloud_msg.header.frame_id = ivMapPtr->getFrameID();
-
-    cloud_msg.points = points;
-
-    ivExpandedStatesVisPub.publish(cloud_msg);
+    queueVisualization(vis);
   }
 }
 
 
 void
-FootstepPlanner::broadcastFootstepPathVis()
+FootstepPlanner::broadcastPathVis()
 {
   if (getPathSize() == 0)
   {
     ROS_INFO("no path has been extracted yet");
     return;
   }
+  if (ivPathVisPub.getNumSubscribers() == 0)
+    return;
+
+  visualization_t vis;
+  vis.has_path = true;
+  vis.path = ivPath;
+  queueVisualization(vis);
+}
+
+
+void
+FootstepPlanner::queueVisualization(visualization_t& vis)
+{
+  vis.frame_id = ivMapPtr->getFrameID();
+  vis.marker_ns = ivMarkerNamespace;
+  if (!ivVisualizationThreadPtr)
+  {
+    publishVisualization(vis);
+    return;
+  }
+
+  {
+    boost::mutex::scoped_lock lock(ivVisualizationMutex);
+    visualization_t& pending = ivPendingVisualization;
+    pending.frame_id.swap(vis.frame_id);
+    pending.marker_ns.swap(vis.marker_ns);
+    if (vis.has_expanded_states)
+    {
+      pending.has_expanded_states = true;
+      pending.expanded_states.swap(vis.expanded_states);
+    }
+    if (vis.has_random_states)
+    {
+      pending.has_random_states = true;
+      pending.random_states.swap(vis.random_states);
+    }
+    if (vis.has_footsteps || vis.has_path)
+    {
+      pending.has_footsteps = pending.has_footsteps || vis.has_footsteps;
+      pending.has_path = pending.has_path || vis.has_path;
+      pending.path.swap(vis.path);
+      // only footstep snapshots contain the start feet
+      if (vis.has_footsteps)
+      {
+        pending.start_foot_left = vis.start_foot_left;
+        pending.start_foot_right = vis.start_foot_right;
+      }
+    }
+  }
+  ivVisualizationCondition.notify_one();
+}
+
+
+void
+FootstepPlanner::visualizationThread()
+{
+  visualization_t vis;
+  while (true)
+  {
+    {
+      boost::unique_lock<boost::mutex> lock(ivVisualizationMutex);
+      while (!ivVisualizationShutdown &&
+             !ivPendingVisualization.has_expanded_states &&
+             !ivPendingVisualization.has_random_states &&
+             !ivPendingVisualization.has_footsteps &&
+             !ivPendingVisualization.has_path)
+      {
+        ivVisualizationCondition.wait(lock);
+      }
+      if (ivVisualizationShutdown)
+        return;
+
+      // a visualization queued in the meantime replaces this one
+      vis.swap(ivPendingVisualization);
+      ivPendingVisualization.has_expanded_states = false;
+      ivPendingVisualization.has_random_states = false;
+      ivPendingVisualization.has_footsteps = false;
+      ivPendingVisualization.has_path = false;
+    }
+    publishVisualization(vis);
+  }
+}
+
+
+void
+FootstepPlanner::visualization_t::swap(visualization_t& other)
+{
+  frame_id.swap(other.frame_id);
+  marker_ns.swap(other.marker_ns);
+  std::swap(has_expanded_states, other.has_expanded_states);
+  expanded_states.swap(other.expanded_states);
+  std::swap(has_random_states, other.has_random_states);
+  random_states.swap(other.random_states);
+  std::swap(has_footsteps, other.has_footsteps);
+  std::swap(has_path, other.has_path);
+  path.swap(other.path);
+  std::swap(start_foot_left, other.start_foot_left);
+  std::swap(start_foot_right, other.start_foot_right);
+}
+
+
+void
+FootstepPlanner::publishVisualization(const visualization_t& vis)
+{
+  if (vis.has_expanded_states)
+    publishExpandedStates(vis);
+  if (vis.has_random_states)
+    publishRandomStates(vis);
+  if (vis.has_footsteps)
+    publishFootstepPath(vis);
+  if (vis.has_path)
+    publishPath(vis);
+}
+
+
+void
+FootstepPlanner::publishExpandedStates(const visualization_t& vis)
+{
+  sensor_msgs::PointCloud cloud_msg;
+  geometry_msgs::Point32 point;
+  point.z = 0.01;
+
+  int counter = 0;
+  CellBitmap::const_iterator cell_it;
+  for (cell_it = vis.expanded_states.begin();
+       cell_it != vis.expanded_states.end(); ++cell_it)
+  {
+    if (counter++ % ivExpandedStatesDecimation != 0)
+      continue;
+    point.x = cell_2_state(cell_it->first, ivEnvironmentParams.cell_size);
+    point.y = cell_2_state(cell_it->second, ivEnvironmentParams.cell_size);
+    cloud_msg.points.push_back(point);
+  }
+  cloud_msg.header.stamp = ros::Time::now();
+  cloud_msg.header.frame_id = vis.frame_id;
+
+  ivExpandedStatesVisPub.publish(cloud_msg);
+}
+
 
-  clearFootstepPathVis(0);
+void
+FootstepPlanner::publishRandomStates(const visualization_t& vis)
+{
+  sensor_msgs::PointCloud cloud_msg;
+  geometry_msgs::Point32 point;
+  point.z = 0.01;
+
+  std::vector<State>::const_iterator state_iter;
+  for (state_iter = vis.random_states.begin();
+       state_iter != vis.random_states.end(); ++state_iter)
+  {
+    point.x = state_iter->getX();
+    point.y = state_iter->getY();
+    cloud_msg.points.push_back(point);
+  }
+  cloud_msg.header.stamp = ros::Time::now();
+  cloud_msg.header.frame_id = vis.frame_id;
+
+  ivRandomStatesVisPub.publish(cloud_msg);
+}
+
+
+void
+FootstepPlanner::publishFootstepPath(const visualization_t& vis)
+{
+  int last_marker_msg_size;
+  {
+    boost::mutex::scoped_lock lock(ivVisualizationMutex);
+    last_marker_msg_size = ivLastMarkerMsgSize;
+  }
+  clearFootstepPathVis(vis.frame_id, vis.marker_ns, last_marker_msg_size);
 
   visualization_msgs::Marker marker;
   visualization_msgs::MarkerArray broadcast_msg;
@@ -1028,18 +1973,19 @@ FootstepPlanner::broadcastFootstepPathVis()
   int markers_counter = 0;
 
   marker.header.stamp = ros::Time::now();
-  marker.header.frame_id = ivMapPtr->getFrameID();
+  marker.header.frame_id = vis.frame_id;
+  marker.ns = vis.marker_ns;
 
   // add the missing start foot to the publish vector for visualization:
-  if (ivPath.front().getLeg() == LEFT)
-    footPoseToMarker(ivStartFootRight, &marker);
+  if (vis.path.front().getLeg() == LEFT)
+    footPoseToMarker(vis.start_foot_right, &marker);
   else
-    footPoseToMarker(ivStartFootLeft, &marker);
+    footPoseToMarker(vis.start_foot_left, &marker);
   marker.id = markers_counter++;
   markers.push_back(marker);
 
   // add the footsteps of the path to the publish vector
-  for(state_iter_t path_iter = getPathBegin(); path_iter != getPathEnd();
+  for(state_iter_t path_iter = vis.path.begin(); path_iter != vis.path.end();
       ++path_iter)
   {
     footPoseToMarker(*path_iter, &marker);
@@ -1048,71 +1994,26 @@ FootstepPlanner::broadcastFootstepPathVis()
   }
 
   broadcast_msg.markers = markers;
-  ivLastMarkerMsgSize = markers.size();
+  {
+    boost::mutex::scoped_lock lock(ivVisualizationMutex);
+    ivLastMarkerMsgSize = markers.size();
+  }
 
   ivFootstepPathVisPub.publish(broadcast_msg);
 }
 
 
 void
-FootstepPlanner::broadcastRandomNodesVis()
+FootstepPlanner::publishPath(const visualization_t& vis)
 {
-  if (ivRandomStatesVisPub.getNumSubscribers() > 0){
-    sensor_msgs::PointCloud cloud_msg;
-    geometry_msgs::Point32 point;
-    std::vector<geometry_msgs::Point32> points;
-    visualization_msgs::Marker marker;
-    visualization_msgs::MarkerArray broadcast_msg;
-    std::vector<visualization_msgs::Marker> markers;
-
-    marker.header.stamp = ros::Time::now();
-    marker.header.frame_id = ivMapPtr->getFrameID();
-
-    State s;
-    FootstepPlannerEnvironment::exp_states_iter_t state_id_iter;
-    for(state_id_iter = ivPlannerEnvironmentPtr->getRandomStatesStart();
-        state_id_iter != ivPlannerEnvironmentPtr->getRandomStatesEnd();
-        ++state_id_iter)
-    {
-      if (!ivPlannerEnvironmentPtr->getState(*state_id_iter, &s))
-      {
-        ROS_WARN("Could not get random state %d", *state_id_iter);
-      }
-      else
-      {
-        point.x = s.getX();
-        point.y = s.getY();
-        point.z = 0.01;
-        points.push_back(point);
-      }
-    }
-    cloud_msg.header.stamp = ros::Time::now();
-    cloud_msg.header.frame_id = ivMapPtr->getFrameID();
-
-    cloud_msg.points = points;
-
-    ivRandomStatesVisPub.publish(cloud_msg);
-  }
-}
-
-
-void
-FootstepPlanner::broadcastPathVis()
-{
-  if (getPathSize() == 0)
-  {
-    ROS_INFO("no path has been extracted yet");
-    return;
-  }
-
   nav_msgs::Path path_msg;
   geometry_msgs::PoseStamped state;
 
   state.header.stamp = ros::Time::now();
-  state.header.frame_id = ivMapPtr->getFrameID();
+  state.header.frame_id = vis.frame_id;
 
   state_iter_t path_iter;
-  for(path_iter = getPathBegin(); path_iter != getPathEnd(); ++path_iter)
+  for(path_iter = vis.path.begin(); path_iter != vis.path.end(); ++path_iter)
   {
     state.pose.position.x = path_iter->getX();
     state.pose.position.y = path_iter->getY();
@@ -1128,9 +2029,6 @@ void
 FootstepPlanner::footPoseToMarker(const State& foot_pose,
                                   visualization_msgs::Marker* marker)
 {
-  marker->header.stamp = ros::Time::now();
-  marker->header.frame_id = ivMapPtr->getFrameID();
-  marker->ns = ivMarkerNamespace;
   marker->type = visualization_msgs::Marker::CUBE;
   marker->action = visualization_msgs::Marker::ADD;
 
@@ -20,6 +20,10 @@
 
 #include <footstep_planner/FootstepPlannerEnvironment.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 
 namespace footstep_planner
 {
@@ -31,8 +35,9 @@ FootstepPlannerEnvironment::FootstepPlannerEnvironment(
   ivIdStartFootRight(-1),
   ivIdGoalFootLeft(-1),
   ivIdGoalFootRight(-1),
-  ivpStateHash2State(
-    new std::vector<const PlanningState*>[params.hash_table_size]),
+  ivStateHash(params.hash_table_size),
+  ivStateArena(cvArenaChunkSize),
+  ivStateIndexArena(cvArenaChunkSize * NUMOFINDICES_STATEID2IND),
   ivFootstepSet(params.footstep_set),
   ivHeuristicConstPtr(params.heuristic),
   ivFootsizeX(params.footsize_x),
@@ -50,16 +55,27 @@ FootstepPlannerEnvironment::FootstepPlannerEnvironment(
                        params.num_angle_bins)),
   ivStepCost(cvMmScale * params.step_cost),
   ivCollisionCheckAccuracy(params.collision_check_accuracy),
+  ivUseCollisionCache(params.collision_cache),
   ivHashTableSize(params.hash_table_size),
   ivCellSize(params.cell_size),
   ivNumAngleBins(params.num_angle_bins),
   ivForwardSearch(params.forward_search),
+  ivBatchedExpansion(params.batched_expansion),
+  ivNumExpansionThreads(params.num_expansion_threads),
   ivMaxStepWidth(double(disc_val(params.max_step_width, params.cell_size))),
   ivNumRandomNodes(params.num_random_nodes),
   ivRandomNodeDist(params.random_node_distance / ivCellSize),
   ivHeuristicScale(params.heuristic_scale),
   ivHeuristicExpired(true),
-  ivNumExpandedStates(0)
+  ivTrackExpandedStates(params.track_expanded_states),
+  ivUseCorridor(false),
+  ivCancelled(false),
+  ivStateBudgetExceeded(false),
+  ivMaxStates(std::max(params.max_states, 0)),
+  ivSearchStateSize(0),
+  ivMaxMemory(size_t(std::max(params.max_memory, 0.0) * 1024.0 * 1024.0)),
+  ivNumExpandedStates(0),
+  ivCollisionCache(params.num_angle_bins)
 {
   int num_angle_bins_half = ivNumAngleBins / 2;
   if (ivMaxFootstepTheta >= num_angle_bins_half)
@@ -80,17 +96,138 @@ FootstepPlannerEnvironment::FootstepPlannerEnvironment(
         pointWithinPolygon(i, j, params.step_range);
     }
   }
+
+  initFootprints();
+  initStateAreaSteps();
+  selectKernels();
+
+#ifdef _OPENMP
+  if (ivNumExpansionThreads <= 0)
+    ivNumExpansionThreads = omp_get_max_threads();
+#else
+  ivNumExpansionThreads = 1;
+#endif
 }
 
 
-FootstepPlannerEnvironment::~FootstepPlannerEnvironment()
+void
+FootstepPlannerEnvironment::selectKernels()
 {
-  reset();
-  if (ivpStateHash2State)
+  switch (ivNumAngleBins)
   {
-    delete[] ivpStateHash2State;
-    ivpStateHash2State = NULL;
+    case 64:
+      ivGetSuccsKernel = &FootstepPlannerEnvironment::getSuccs<64>;
+      ivGetPredsKernel = &FootstepPlannerEnvironment::getPreds<64>;
+      break;
+    case 128:
+      ivGetSuccsKernel = &FootstepPlannerEnvironment::getSuccs<128>;
+      ivGetPredsKernel = &FootstepPlannerEnvironment::getPreds<128>;
+      break;
+    default:
+      ivGetSuccsKernel = &FootstepPlannerEnvironment::getSuccs<0>;
+      ivGetPredsKernel = &FootstepPlannerEnvironment::getPreds<0>;
+      break;
   }
+}
+
+
+void
+FootstepPlannerEnvironment::initFootprints()
+{
+  ivFootOuterRadius =
+    sqrt(ivFootsizeX*ivFootsizeX + ivFootsizeY*ivFootsizeY) / 2.0;
+  ivFootInnerRadius = std::min(ivFootsizeX, ivFootsizeY) / 2.0;
+
+  // cover the foot by a row of circles along its longer side, each of them
+  // being the circumcircle of a (nearly) square segment of the foot
+  const double length = std::max(ivFootsizeX, ivFootsizeY);
+  const double width = std::min(ivFootsizeX, ivFootsizeY);
+  const int num_circles = std::max(1, int(ceil(length / width)));
+  const double segment_half = length / (2.0 * num_circles);
+  ivCoverCircleRadius =
+    sqrt(segment_half*segment_half + width*width / 4.0);
+  ivCoverCircleInnerRadius = std::min(segment_half, width / 2.0);
+
+  ivFootprints.resize(ivNumAngleBins);
+  for (int i = 0; i < ivNumAngleBins; ++i)
+  {
+    footprint_t& fp = ivFootprints[i];
+    double theta = angle_cell_2_state(i, ivNumAngleBins);
+    fp.cos_theta = cos(theta);
+    fp.sin_theta = sin(theta);
+
+    // (same transformation as used before in occupied())
+    fp.shift_x_left = fp.cos_theta*ivOriginFootShiftX -
+                      fp.sin_theta*ivOriginFootShiftY;
+    fp.shift_y_left = fp.sin_theta*ivOriginFootShiftX +
+                      fp.cos_theta*ivOriginFootShiftY;
+    fp.shift_x_right = fp.shift_x_left;
+    fp.shift_y_right = fp.sin_theta*ivOriginFootShiftX -
+                       fp.cos_theta*ivOriginFootShiftY;
+
+    fp.circles.clear();
+    for (int j = 0; j < num_circles; ++j)
+    {
+      double offset = -length / 2.0 + (2*j + 1) * segment_half;
+      double dx = (ivFootsizeX >= ivFootsizeY) ? offset : 0.0;
+      double dy = (ivFootsizeX >= ivFootsizeY) ? 0.0 : offset;
+      fp.circles.push_back(std::pair<double, double>(
+        fp.cos_theta*dx - fp.sin_theta*dy,
+        fp.sin_theta*dx + fp.cos_theta*dy));
+    }
+  }
+}
+
+
+void
+FootstepPlannerEnvironment::initStateAreaSteps()
+{
+  ivStateAreaSteps.assign(2 * ivNumAngleBins, std::vector<area_step_t>());
+
+  // the steps only depend on the orientation and the leg of the foot the
+  // area is attached to, so they are determined for a foot at (0, 0)
+  double cont_step_x, cont_step_y, cont_step_theta;
+  for (int step_y = ivMaxInvFootstepY; step_y <= ivMaxFootstepY; ++step_y)
+  {
+    for (int step_x = ivMaxInvFootstepX; step_x <= ivMaxFootstepX; ++step_x)
+    {
+      for (int step_theta = ivMaxInvFootstepTheta;
+           step_theta <= ivMaxFootstepTheta;
+           ++step_theta)
+      {
+        cont_step_x = cont_val(step_x, ivCellSize);
+        cont_step_y = cont_val(step_y, ivCellSize);
+        cont_step_theta = angle_cell_2_state(step_theta, ivNumAngleBins);
+        Footstep step(cont_step_x, cont_step_y, cont_step_theta,
+                      ivCellSize, ivNumAngleBins, ivHashTableSize);
+
+        for (int theta = 0; theta < ivNumAngleBins; ++theta)
+        {
+          for (int leg = RIGHT; leg <= LEFT; ++leg)
+          {
+            PlanningState foot(0, 0, theta, Leg(leg), ivHashTableSize);
+            PlanningState s = ivForwardSearch ?
+              step.reverseMeOnThisState(foot) :
+              step.performMeOnThisState(foot);
+
+            area_step_t area_step;
+            area_step.x = s.getX();
+            area_step.y = s.getY();
+            area_step.theta = s.getTheta();
+            area_step.reachable =
+              ivForwardSearch ? reachable(s, foot) : reachable(foot, s);
+            ivStateAreaSteps[2 * theta + leg].push_back(area_step);
+          }
+        }
+      }
+    }
+  }
+}
+
+
+FootstepPlannerEnvironment::~FootstepPlannerEnvironment()
+{
+  reset();
   if (ivpStepRange)
   {
     delete[] ivpStepRange;
@@ -186,8 +323,21 @@ FootstepPlannerEnvironment::createNewHashEntry(const State& s)
 const PlanningState*
 FootstepPlannerEnvironment::createNewHashEntry(const PlanningState& s)
 {
-  unsigned int state_hash = s.getHashTag();
-  PlanningState* new_state = new PlanningState(s);
+  FOOTSTEP_PLANNER_PROFILE(ivStats.hash_insert);
+
+  // insert the new state into the hash map
+  int state_id = ivStateHash.insert(s.getX(), s.getY(), s.getTheta(),
+                                    s.getLeg(), ivStateId2State.size());
+  assert((size_t)state_id == ivStateId2State.size());
+
+  return createNewState(s);
+}
+
+
+const PlanningState*
+FootstepPlannerEnvironment::createNewState(const PlanningState& s)
+{
+  PlanningState* new_state = new (ivStateArena.allocate()) PlanningState(s);
 
   size_t state_id = ivStateId2State.size();
   assert(state_id < (size_t)std::numeric_limits<int>::max());
@@ -196,10 +346,7 @@ FootstepPlannerEnvironment::createNewHashEntry(const PlanningState& s)
   new_state->setId(state_id);
   ivStateId2State.push_back(new_state);
 
-  // insert the new state into the hash map at the corresponding position
-  ivpStateHash2State[state_hash].push_back(new_state);
-
-  int* entry = new int[NUMOFINDICES_STATEID2IND];
+  int* entry = ivStateIndexArena.allocate(NUMOFINDICES_STATEID2IND);
   StateID2IndexMapping.push_back(entry);
   for(int i = 0; i < NUMOFINDICES_STATEID2IND; ++i)
   {
@@ -208,10 +355,41 @@ FootstepPlannerEnvironment::createNewHashEntry(const PlanningState& s)
 
   assert(StateID2IndexMapping.size() - 1 == state_id);
 
+  // the state is created nevertheless (the callers rely on it), the search
+  // is stopped by the following expansions; the memory is only summed up
+  // every cvMemoryCheckInterval states
+  if (!ivStateBudgetExceeded &&
+      ((ivMaxStates > 0 && state_id + 1 >= ivMaxStates) ||
+       (ivMaxMemory > 0 && state_id % cvMemoryCheckInterval == 0 &&
+        getMemoryUsage().search() >= ivMaxMemory)))
+  {
+    ivStateBudgetExceeded = true;
+    ROS_WARN("Footstep planner state budget exceeded (%zu states, %.1f MB)",
+             state_id + 1, getMemoryUsage().search() / (1024.0 * 1024.0));
+  }
+
   return new_state;
 }
 
 
+memory_usage_t
+FootstepPlannerEnvironment::getMemoryUsage()
+const
+{
+  memory_usage_t usage;
+  usage.states = ivStateArena.bytesReserved() +
+                 ivStateId2State.capacity() * sizeof(const PlanningState*);
+  usage.index_mappings = ivStateIndexArena.bytesReserved() +
+                         StateID2IndexMapping.capacity() * sizeof(int*);
+  usage.hash_table = ivStateHash.bytesAllocated();
+  usage.planner_states = ivStateId2State.size() * ivSearchStateSize;
+  usage.collision_cache = ivCollisionCache.bytesAllocated();
+  usage.bitmaps = ivExpandedStates.bytesAllocated() +
+                  ivCorridor.bytesAllocated();
+  return usage;
+}
+
+
 const PlanningState*
 FootstepPlannerEnvironment::getHashEntry(const State& s)
 {
@@ -223,29 +401,31 @@ FootstepPlannerEnvironment::getHashEntry(const State& s)
 const PlanningState*
 FootstepPlannerEnvironment::getHashEntry(const PlanningState& s)
 {
-  unsigned int state_hash = s.getHashTag();
-  std::vector<const PlanningState*>::const_iterator state_iter;
-  for (state_iter = ivpStateHash2State[state_hash].begin();
-       state_iter != ivpStateHash2State[state_hash].end();
-       ++state_iter)
-  {
-    if (*(*state_iter) == s)
-      return *state_iter;
-  }
+  FOOTSTEP_PLANNER_PROFILE(ivStats.hash_lookup);
+
+  int state_id = ivStateHash.find(s.getX(), s.getY(), s.getTheta(),
+                                  s.getLeg());
+  if (state_id == -1)
+    return NULL;
 
-  return NULL;
+  return ivStateId2State[state_id];
 }
 
 const PlanningState*
 FootstepPlannerEnvironment::createHashEntryIfNotExists(
     const PlanningState& s)
 {
-  const PlanningState* hash_entry = getHashEntry(s);
-  if (hash_entry == NULL)
-    hash_entry = createNewHashEntry(s);
+  FOOTSTEP_PLANNER_PROFILE(ivStats.hash_insert);
 
-  return hash_entry;
+  // single probe: either finds the existing entry or reserves the slot for
+  // the state to be created
+  size_t new_id = ivStateId2State.size();
+  int state_id = ivStateHash.insert(s.getX(), s.getY(), s.getTheta(),
+                                    s.getLeg(), new_id);
+  if ((size_t)state_id != new_id)
+    return ivStateId2State[state_id];
 
+  return createNewState(s);
 }
 
 
@@ -275,26 +455,161 @@ FootstepPlannerEnvironment::occupied(const State& s)
 
 bool
 FootstepPlannerEnvironment::occupied(const PlanningState& s)
+{
+  FOOTSTEP_PLANNER_PROFILE(ivStats.occupied);
+
+  if (ivUseCollisionCache)
+  {
+    CollisionCache::Status status = ivCollisionCache.get(
+      s.getX(), s.getY(), s.getTheta(), s.getLeg());
+    if (status != CollisionCache::UNKNOWN)
+      return status == CollisionCache::OCCUPIED;
+  }
+
+  bool occ;
+  {
+    // (profiled here since collisionCheck() is called concurrently by
+    // getNeighborsBatched())
+    FOOTSTEP_PLANNER_PROFILE(ivStats.collision_check);
+    occ = collisionCheck(s);
+  }
+  if (ivUseCollisionCache)
+    ivCollisionCache.set(s.getX(), s.getY(), s.getTheta(), s.getLeg(), occ);
+  return occ;
+}
+
+
+bool
+FootstepPlannerEnvironment::collisionCheck(const PlanningState& s)
+const
 {
   double x = cell_2_state(s.getX(), ivCellSize);
   double y = cell_2_state(s.getY(), ivCellSize);
   // collision check for the planning state
   if (ivMapPtr->isOccupiedAt(x,y))
     return true;
-  double theta = angle_cell_2_state(s.getTheta(), ivNumAngleBins);
-  double theta_cos = cos(theta);
-  double theta_sin = sin(theta);
+
+  assert(s.getTheta() >= 0 && s.getTheta() < ivNumAngleBins);
+  const footprint_t& fp = ivFootprints[s.getTheta()];
 
   // transform the planning state to the foot center
-  x += theta_cos*ivOriginFootShiftX - theta_sin*ivOriginFootShiftY;
   if (s.getLeg() == LEFT)
-    y += theta_sin*ivOriginFootShiftX + theta_cos*ivOriginFootShiftY;
+  {
+    x += fp.shift_x_left;
+    y += fp.shift_y_left;
+  }
   else // leg == RLEG
-    y += theta_sin*ivOriginFootShiftX - theta_cos*ivOriginFootShiftY;
+  {
+    x += fp.shift_x_right;
+    y += fp.shift_y_right;
+  }
 
   // collision check for the foot center
-  return collision_check(x, y, theta, ivFootsizeX, ivFootsizeY,
-                         ivCollisionCheckAccuracy, *ivMapPtr);
+  if (ivCollisionCheckAccuracy == 2)
+    return footprintOccupied(x, y, fp);
+  return collision_check(x, y, fp.cos_theta, fp.sin_theta, ivFootsizeX,
+                         ivFootsizeY, ivCollisionCheckAccuracy, *ivMapPtr);
+}
+
+
+void
+FootstepPlannerEnvironment::prefilterBatch()
+{
+  const int num_uncached = ivBatchUncached.size();
+  ivBatchPositions.resize(4 * num_uncached);
+  ivBatchStateOccupied.resize(num_uncached);
+  ivBatchDistances.resize(num_uncached);
+  // layout: state x, state y, foot center x, foot center y
+  double* state_x = &ivBatchPositions[0];
+  double* state_y = state_x + num_uncached;
+  double* foot_x = state_y + num_uncached;
+  double* foot_y = foot_x + num_uncached;
+
+  for (int j = 0; j < num_uncached; ++j)
+  {
+    const PlanningState& s = ivBatchStates[ivBatchUncached[j]];
+    const footprint_t& fp = ivFootprints[s.getTheta()];
+    state_x[j] = cell_2_state(s.getX(), ivCellSize);
+    state_y[j] = cell_2_state(s.getY(), ivCellSize);
+    if (s.getLeg() == LEFT)
+    {
+      foot_x[j] = state_x[j] + fp.shift_x_left;
+      foot_y[j] = state_y[j] + fp.shift_y_left;
+    }
+    else // leg == RLEG
+    {
+      foot_x[j] = state_x[j] + fp.shift_x_right;
+      foot_y[j] = state_y[j] + fp.shift_y_right;
+    }
+  }
+
+  ivMapPtr->isOccupiedAt(state_x, state_y, num_uncached,
+                         &ivBatchStateOccupied[0]);
+  ivMapPtr->distanceMapAt(foot_x, foot_y, num_uncached, &ivBatchDistances[0]);
+
+  // the same decisions as collisionCheck() based on the foot center's
+  // distance to the closest obstacle (circumcircle / incircle of the foot)
+  const double res = ivMapPtr->getResolution();
+  for (int j = 0; j < num_uncached; ++j)
+  {
+    const int i = ivBatchUncached[j];
+    const double d = ivBatchDistances[j] - res;
+    if (ivBatchStateOccupied[j] || ivBatchDistances[j] < 0.0f)
+      ivBatchOccupied[i] = true;
+    else if (d >= ivFootOuterRadius)
+      ivBatchOccupied[i] = false;
+    else if (ivCollisionCheckAccuracy > 0 && d <= ivFootInnerRadius)
+      ivBatchOccupied[i] = true;
+    else
+      ivBatchUnresolved.push_back(i);
+  }
+}
+
+
+bool
+FootstepPlannerEnvironment::footprintOccupied(double x, double y,
+                                              const footprint_t& fp)
+const
+{
+  const gridmap_2d::GridMap2D& map = *ivMapPtr;
+  const nav_msgs::MapMetaData& info = map.getInfo();
+  const double res = info.resolution;
+  const double inv_res = 1.0 / res;
+  // foot center in (continuous) map cell coordinates
+  const double cx = (x - info.origin.position.x) * inv_res;
+  const double cy = (y - info.origin.position.y) * inv_res;
+
+  // everything that is not decided by the circumcircle, the incircle or the
+  // covering circles is handed to the recursive check
+  if (cx < 0.0 || cy < 0.0 ||
+      cx >= info.width || cy >= info.height)
+    return true;
+  double d = map.distanceMapAtCell((unsigned int)cx, (unsigned int)cy) - res;
+  if (d >= ivFootOuterRadius)
+    return false;
+  if (d <= ivFootInnerRadius)
+    return true;
+
+  bool covered = true;
+  std::vector<std::pair<double, double> >::const_iterator circle_iter;
+  for (circle_iter = fp.circles.begin(); circle_iter != fp.circles.end();
+       ++circle_iter)
+  {
+    double px = cx + circle_iter->first * inv_res;
+    double py = cy + circle_iter->second * inv_res;
+    if (px < 0.0 || py < 0.0 || px >= info.width || py >= info.height)
+      return true;
+    d = map.distanceMapAtCell((unsigned int)px, (unsigned int)py) - res;
+    if (d <= ivCoverCircleInnerRadius)
+      return true;
+    if (d < ivCoverCircleRadius)
+      covered = false;
+  }
+  if (covered)
+    return false;
+
+  return collision_check(x, y, fp.cos_theta, fp.sin_theta, ivFootsizeX,
+                         ivFootsizeY, ivCollisionCheckAccuracy, map);
 }
 
 
@@ -315,24 +630,323 @@ FootstepPlannerEnvironment::getState(unsigned int id, State* s)
 }
 
 
+bool
+FootstepPlannerEnvironment::extractPath(const std::vector<int>& state_ids,
+                                        const State& start_right,
+                                        const State& goal_left,
+                                        const State& goal_right,
+                                        std::vector<State>* path)
+{
+  path->clear();
+
+  State s;
+  State start_left;
+  std::vector<int>::const_iterator state_ids_iter = state_ids.begin();
+
+  // first state is always the robot's left foot
+  if (!getState(*state_ids_iter, &start_left))
+  {
+    path->clear();
+    return false;
+  }
+  ++state_ids_iter;
+  if (!getState(*state_ids_iter, &s))
+  {
+    path->clear();
+    return false;
+  }
+  ++state_ids_iter;
+
+  // check if the robot's left foot can be ommited as first state in the path,
+  // i.e. the robot's right foot is appended first to the path
+  if (s.getLeg() == LEFT)
+    path->push_back(start_right);
+  else
+    path->push_back(start_left);
+  path->push_back(s);
+
+  for(; state_ids_iter < state_ids.end(); ++state_ids_iter)
+  {
+    if (!getState(*state_ids_iter, &s))
+    {
+      path->clear();
+      return false;
+    }
+    path->push_back(s);
+  }
+
+  // add last neutral step
+  if (path->back().getLeg() == RIGHT)
+    path->push_back(goal_left);
+  else // last_leg == LEFT
+    path->push_back(goal_right);
+
+  return true;
+}
+
+
 void
 FootstepPlannerEnvironment::updateMap(gridmap_2d::GridMap2DPtr map)
 {
   ivMapPtr.reset();
   ivMapPtr = map;
 
+  // cover all planning cells within the map's extent
+  const nav_msgs::MapMetaData& info = map->getInfo();
+  int min_x = state_2_cell(info.origin.position.x, ivCellSize);
+  int min_y = state_2_cell(info.origin.position.y, ivCellSize);
+  int max_x = state_2_cell(
+    info.origin.position.x + info.width * info.resolution, ivCellSize);
+  int max_y = state_2_cell(
+    info.origin.position.y + info.height * info.resolution, ivCellSize);
+  if (ivUseCollisionCache)
+  {
+    ivCollisionCache.resize(min_x, min_y, max_x - min_x + 1,
+                            max_y - min_y + 1);
+  }
+  if (ivTrackExpandedStates)
+  {
+    ivExpandedStates.resize(min_x, min_y, max_x - min_x + 1,
+                            max_y - min_y + 1);
+  }
+  ivCorridor.resize(min_x, min_y, max_x - min_x + 1, max_y - min_y + 1);
+  ivUseCorridor = false;
+
+  updateHeuristicMap();
+}
+
+
+bool
+FootstepPlannerEnvironment::setCorridor(const nav_msgs::Path& path,
+                                        double width)
+{
+  ivCorridor.clear();
+  ivUseCorridor = false;
+  if (path.poses.empty())
+    return false;
+
+  // offsets of all cells within the corridor's half width (at least the
+  // 8-neighborhood so that diagonal steps of the path stay connected)
+  int radius = std::max(1, int(ceil(width / 2.0 / ivCellSize)));
+  std::vector<std::pair<int, int> > disc;
+  for (int dy = -radius; dy <= radius; ++dy)
+  {
+    for (int dx = -radius; dx <= radius; ++dx)
+    {
+      if (dx * dx + dy * dy <= radius * radius ||
+          (abs(dx) <= 1 && abs(dy) <= 1))
+        disc.push_back(std::pair<int, int>(dx, dy));
+    }
+  }
+
+  // stamp the disc along the path, interpolated to steps of at most one
+  // cell
+  double x0 = path.poses[0].pose.position.x;
+  double y0 = path.poses[0].pose.position.y;
+  for (unsigned int i = 0; i < path.poses.size(); ++i)
+  {
+    double x1 = path.poses[i].pose.position.x;
+    double y1 = path.poses[i].pose.position.y;
+    int num_steps = std::max(1, int(ceil(euclidean_distance(x0, y0, x1, y1) /
+                                         ivCellSize)));
+    for (int j = (i == 0) ? 0 : 1; j <= num_steps; ++j)
+    {
+      double t = double(j) / num_steps;
+      int cx = state_2_cell(x0 + t * (x1 - x0), ivCellSize);
+      int cy = state_2_cell(y0 + t * (y1 - y0), ivCellSize);
+      std::vector<std::pair<int, int> >::const_iterator it;
+      for (it = disc.begin(); it != disc.end(); ++it)
+        ivCorridor.insert(cx + it->first, cy + it->second);
+    }
+    x0 = x1;
+    y0 = y1;
+  }
+
+  ivUseCorridor = true;
+  return true;
+}
+
+
+void
+FootstepPlannerEnvironment::updateHeuristicMap()
+{
   if (ivHeuristicConstPtr->getHeuristicType() == Heuristic::PATH_COST)
   {
     boost::shared_ptr<PathCostHeuristic> h =
         boost::dynamic_pointer_cast<PathCostHeuristic>(
             ivHeuristicConstPtr);
-    h->updateMap(map);
+    h->updateMap(ivMapPtr);
 
     ivHeuristicExpired = true;
   }
 }
 
 
+void
+FootstepPlannerEnvironment::updateMapIncrementally(
+    gridmap_2d::GridMap2DPtr map,
+    const std::vector<std::pair<unsigned int, unsigned int> >& changed_cells,
+    std::vector<int>* affected_ids)
+{
+  affected_ids->clear();
+  ivMapPtr = map;
+  if (changed_cells.empty())
+    return;
+
+  // all planning cells closer than this to a changed map cell might host a
+  // foot touching the cell
+  const double margin = ivFootOuterRadius +
+                        sqrt(ivOriginFootShiftX * ivOriginFootShiftX +
+                             ivOriginFootShiftY * ivOriginFootShiftY) +
+                        map->getResolution();
+  const int margin_cells = int(ceil(margin / ivCellSize)) + 1;
+
+  // bounding box of the changed map cells
+  unsigned int min_mx = changed_cells[0].first;
+  unsigned int max_mx = min_mx;
+  unsigned int min_my = changed_cells[0].second;
+  unsigned int max_my = min_my;
+  std::vector<std::pair<unsigned int, unsigned int> >::const_iterator
+    cell_iter;
+  for (cell_iter = changed_cells.begin(); cell_iter != changed_cells.end();
+       ++cell_iter)
+  {
+    min_mx = std::min(min_mx, cell_iter->first);
+    max_mx = std::max(max_mx, cell_iter->first);
+    min_my = std::min(min_my, cell_iter->second);
+    max_my = std::max(max_my, cell_iter->second);
+  }
+
+  // ...dilated by the margin to the affected planning cells
+  double wx, wy;
+  map->mapToWorld(min_mx, min_my, wx, wy);
+  const int min_px = state_2_cell(wx, ivCellSize) - margin_cells;
+  const int min_py = state_2_cell(wy, ivCellSize) - margin_cells;
+  map->mapToWorld(max_mx, max_my, wx, wy);
+  const int max_px = state_2_cell(wx, ivCellSize) + margin_cells;
+  const int max_py = state_2_cell(wy, ivCellSize) + margin_cells;
+
+  if (ivUseCollisionCache)
+    ivCollisionCache.clear(min_px, min_py, max_px, max_py);
+
+  // determine the existing states within the affected cells; either by
+  // probing all their poses or by going through all states (whatever is
+  // cheaper)
+  std::vector<int> affected_states;
+  const size_t num_affected_cells =
+    size_t(max_px - min_px + 1) * size_t(max_py - min_py + 1);
+  if (num_affected_cells * 2 * ivNumAngleBins < ivStateId2State.size())
+  {
+    for (int px = min_px; px <= max_px; ++px)
+    {
+      for (int py = min_py; py <= max_py; ++py)
+      {
+        for (int theta = 0; theta < ivNumAngleBins; ++theta)
+        {
+          int id = ivStateHash.find(px, py, theta, LEFT);
+          if (id != -1)
+            affected_states.push_back(id);
+          id = ivStateHash.find(px, py, theta, RIGHT);
+          if (id != -1)
+            affected_states.push_back(id);
+        }
+      }
+    }
+  }
+  else
+  {
+    std::vector<const PlanningState*>::const_iterator state_iter;
+    for (state_iter = ivStateId2State.begin();
+         state_iter != ivStateId2State.end();
+         ++state_iter)
+    {
+      const int px = (*state_iter)->getX();
+      const int py = (*state_iter)->getY();
+      if (px >= min_px && px <= max_px && py >= min_py && py <= max_py)
+        affected_states.push_back((*state_iter)->getId());
+    }
+  }
+
+  // the edges from and to the affected states might have changed
+  std::vector<int>::const_iterator id_iter;
+  for (id_iter = affected_states.begin(); id_iter != affected_states.end();
+       ++id_iter)
+  {
+    const PlanningState* s = ivStateId2State[*id_iter];
+    affected_ids->push_back(*id_iter);
+
+    std::vector<Footstep>::const_iterator footstep_set_iter;
+    for(footstep_set_iter = ivFootstepSet.begin();
+        footstep_set_iter != ivFootstepSet.end();
+        ++footstep_set_iter)
+    {
+      const PlanningState* neighbor =
+        getHashEntry(footstep_set_iter->performMeOnThisState(*s));
+      if (neighbor)
+        affected_ids->push_back(neighbor->getId());
+      neighbor = getHashEntry(footstep_set_iter->reverseMeOnThisState(*s));
+      if (neighbor)
+        affected_ids->push_back(neighbor->getId());
+    }
+  }
+
+  // the state area (the neighbors of the goal / start feet) only contains
+  // free states, so the edges of these feet change with the area
+  const int area_left = ivForwardSearch ? ivIdGoalFootLeft : ivIdStartFootLeft;
+  const int area_right = ivForwardSearch ? ivIdGoalFootRight :
+                                           ivIdStartFootRight;
+  if (area_left != -1 && area_right != -1)
+  {
+    std::vector<int> old_area = ivStateArea;
+    setStateArea(*ivStateId2State[area_left], *ivStateId2State[area_right]);
+    if (ivStateArea != old_area)
+    {
+      affected_ids->push_back(area_left);
+      affected_ids->push_back(area_right);
+    }
+  }
+
+  std::sort(affected_ids->begin(), affected_ids->end());
+  affected_ids->erase(std::unique(affected_ids->begin(), affected_ids->end()),
+                      affected_ids->end());
+
+  // only the inflated cells around the changed ones can change the heuristic
+  if (ivHeuristicConstPtr->getHeuristicType() == Heuristic::PATH_COST)
+  {
+    boost::shared_ptr<PathCostHeuristic> h =
+        boost::dynamic_pointer_cast<PathCostHeuristic>(
+            ivHeuristicConstPtr);
+    const unsigned int revision = h->getMapRevision();
+    h->updateMapIncrementally(
+        map, cv::Rect(min_mx, min_my, max_mx - min_mx + 1,
+                      max_my - min_my + 1));
+    if (h->getMapRevision() != revision)
+      ivHeuristicExpired = true;
+  }
+}
+
+
+void
+FootstepPlannerEnvironment::invalidateCollisionCache(double min_x,
+                                                     double min_y,
+                                                     double max_x,
+                                                     double max_y)
+{
+  if (!ivUseCollisionCache)
+    return;
+
+  // a foot pose is affected if its foot might overlap with the area
+  double margin = ivFootOuterRadius +
+                  sqrt(ivOriginFootShiftX * ivOriginFootShiftX +
+                       ivOriginFootShiftY * ivOriginFootShiftY) +
+                  (ivMapPtr ? ivMapPtr->getResolution() : 0.0) + ivCellSize;
+  ivCollisionCache.clear(state_2_cell(min_x - margin, ivCellSize),
+                         state_2_cell(min_y - margin, ivCellSize),
+                         state_2_cell(max_x + margin, ivCellSize),
+                         state_2_cell(max_y + margin, ivCellSize));
+}
+
+
 void
 FootstepPlannerEnvironment::updateHeuristicValues()
 {
@@ -376,22 +990,15 @@ FootstepPlannerEnvironment::updateHeuristicValues()
 void
 FootstepPlannerEnvironment::reset()
 {
-  for(unsigned int i = 0; i < ivStateId2State.size(); ++i)
-  {
-    if (ivStateId2State[i])
-    {
-      delete ivStateId2State[i];
-    }
-  }
+  // the planning states and their index arrays are owned by the arenas;
+  // StateID2IndexMapping has to be emptied before the arena memory is reused
+  // (and before ~DiscreteSpaceInformation() would try to delete[] it)
   ivStateId2State.clear();
-
-  if (ivpStateHash2State)
-  {
-    for(int i = 0; i < ivHashTableSize; ++i)
-      ivpStateHash2State[i].clear();
-  }
-
   StateID2IndexMapping.clear();
+  ivStateArena.clear();
+  ivStateIndexArena.clear();
+
+  ivStateHash.clear();
 
   ivExpandedStates.clear();
   ivNumExpandedStates = 0;
@@ -405,9 +1012,12 @@ FootstepPlannerEnvironment::reset()
   ivIdStartFootRight = -1;
 
   ivHeuristicExpired = true;
+  ivCancelled = false;
+  ivStateBudgetExceeded = false;
 }
 
 
+template <int N>
 bool
 FootstepPlannerEnvironment::closeToStart(const PlanningState& from)
 {
@@ -418,10 +1028,11 @@ FootstepPlannerEnvironment::closeToStart(const PlanningState& from)
   else
     start = ivStateId2State[ivIdStartFootRight];
 
-  return reachable(*start, from);
+  return reachable<N>(*start, from);
 }
 
 
+template <int N>
 bool
 FootstepPlannerEnvironment::closeToGoal(const PlanningState& from)
 {
@@ -433,10 +1044,11 @@ FootstepPlannerEnvironment::closeToGoal(const PlanningState& from)
     goal = ivStateId2State[ivIdGoalFootRight];
 
   // TODO: check step if reachable == True
-  return reachable(from, *goal);
+  return reachable<N>(from, *goal);
 }
 
 
+template <int N>
 bool
 FootstepPlannerEnvironment::reachable(const PlanningState& from,
                                       const PlanningState& to)
@@ -447,30 +1059,22 @@ FootstepPlannerEnvironment::reachable(const PlanningState& from,
       return false;
   }
 
-  tf::Transform step =
-    tf::Pose(
-      tf::createQuaternionFromYaw(
-        angle_cell_2_state(from.getTheta(), ivNumAngleBins)),
-      tf::Point(cell_2_state(from.getX(), ivCellSize),
-                cell_2_state(from.getY(), ivCellSize),
-                0.0)).inverse() *
-    tf::Pose(
-      tf::createQuaternionFromYaw(
-        angle_cell_2_state(from.getTheta(), ivNumAngleBins)),
-      tf::Point(cell_2_state(to.getX(), ivCellSize),
-                cell_2_state(to.getY(), ivCellSize),
-                0.0));
-  int footstep_x = disc_val(step.getOrigin().x(), ivCellSize);
-  int footstep_y = disc_val(step.getOrigin().y(), ivCellSize);
+  // rotate the translation into the view of 'from' (the same as
+  // inverse(pose(from)) * pose(to) but without constructing the transforms)
+  const footprint_t& fp = ivFootprints[from.getTheta()];
+  double dx = cell_2_state(to.getX(), ivCellSize) -
+              cell_2_state(from.getX(), ivCellSize);
+  double dy = cell_2_state(to.getY(), ivCellSize) -
+              cell_2_state(from.getY(), ivCellSize);
+  int footstep_x = disc_val(fp.cos_theta * dx + fp.sin_theta * dy,
+                            ivCellSize);
+  int footstep_y = disc_val(-fp.sin_theta * dx + fp.cos_theta * dy,
+                            ivCellSize);
 
   // calculate the footstep rotation
   int footstep_theta = to.getTheta() - from.getTheta();
   // transform the value into [-ivNumAngleBins/2..ivNumAngleBins/2)
-  int num_angle_bins_half = ivNumAngleBins / 2;
-  if (footstep_theta >= num_angle_bins_half)
-    footstep_theta -= ivNumAngleBins;
-  else if (footstep_theta < -num_angle_bins_half)
-    footstep_theta += ivNumAngleBins;
+  footstep_theta = AngleBins<N>::wrapDiff(footstep_theta, ivNumAngleBins);
 
   // adjust for the left foot
   if (from.getLeg() == LEFT)
@@ -532,6 +1136,36 @@ FootstepPlannerEnvironment::reachable(const PlanningState& from,
 }
 
 
+bool
+FootstepPlannerEnvironment::closeToStart(const PlanningState& from)
+{
+  return closeToStart<0>(from);
+}
+
+
+bool
+FootstepPlannerEnvironment::closeToGoal(const PlanningState& from)
+{
+  return closeToGoal<0>(from);
+}
+
+
+bool
+FootstepPlannerEnvironment::reachable(const PlanningState& from,
+                                      const PlanningState& to)
+{
+  switch (ivNumAngleBins)
+  {
+    case 64:
+      return reachable<64>(from, to);
+    case 128:
+      return reachable<128>(from, to);
+    default:
+      return reachable<0>(from, to);
+  }
+}
+
+
 void
 FootstepPlannerEnvironment::getPredsOfGridCells(
     const std::vector<State>& changed_states,
@@ -619,6 +1253,8 @@ int
 FootstepPlannerEnvironment::GetFromToHeuristic(const PlanningState& from,
                                                const PlanningState& to)
 {
+  FOOTSTEP_PLANNER_PROFILE(ivStats.heuristic);
+
   return cvMmScale * ivHeuristicScale *
     ivHeuristicConstPtr->getHValue(from, to);
 }
@@ -635,6 +1271,23 @@ void
 FootstepPlannerEnvironment::GetPreds(int TargetStateID,
                                      std::vector<int> *PredIDV,
                                      std::vector<int> *CostV)
+{
+  FOOTSTEP_PLANNER_PROFILE(ivStats.get_preds);
+  if (ivCancelled || ivStateBudgetExceeded)
+  {
+    PredIDV->clear();
+    CostV->clear();
+    return;
+  }
+  (this->*ivGetPredsKernel)(TargetStateID, PredIDV, CostV);
+}
+
+
+template <int N>
+void
+FootstepPlannerEnvironment::getPreds(int TargetStateID,
+                                     std::vector<int> *PredIDV,
+                                     std::vector<int> *CostV)
 {
   PredIDV->clear();
   CostV->clear();
@@ -679,10 +1332,11 @@ FootstepPlannerEnvironment::GetPreds(int TargetStateID,
     }
   }
 
-  ivExpandedStates.insert(std::pair<int,int>(current->getX(), current->getY()));
+  if (ivTrackExpandedStates)
+    ivExpandedStates.insert(current->getX(), current->getY());
   ++ivNumExpandedStates;
 
-  if (closeToStart(*current))
+  if (closeToStart<N>(*current))
   {
     // map to the start state id
     PredIDV->push_back(ivIdStartFootLeft);
@@ -697,6 +1351,12 @@ FootstepPlannerEnvironment::GetPreds(int TargetStateID,
     return;
   }
 
+  if (ivBatchedExpansion)
+  {
+    getNeighborsBatched<N>(*current, false, PredIDV, CostV);
+    return;
+  }
+
   PredIDV->reserve(ivFootstepSet.size());
   CostV->reserve(ivFootstepSet.size());
   std::vector<Footstep>::const_iterator footstep_set_iter;
@@ -705,8 +1365,8 @@ FootstepPlannerEnvironment::GetPreds(int TargetStateID,
       ++footstep_set_iter)
   {
     const PlanningState predecessor =
-        footstep_set_iter->reverseMeOnThisState(*current);
-    if (occupied(predecessor))
+        footstep_set_iter->reverseMeOnThisState<N>(*current);
+    if (!inCorridor(predecessor) || occupied(predecessor))
       continue;
 
     const PlanningState* predecessor_hash = createHashEntryIfNotExists(
@@ -730,6 +1390,23 @@ void
 FootstepPlannerEnvironment::GetSuccs(int SourceStateID,
                                      std::vector<int> *SuccIDV,
                                      std::vector<int> *CostV)
+{
+  FOOTSTEP_PLANNER_PROFILE(ivStats.get_succs);
+  if (ivCancelled || ivStateBudgetExceeded)
+  {
+    SuccIDV->clear();
+    CostV->clear();
+    return;
+  }
+  (this->*ivGetSuccsKernel)(SourceStateID, SuccIDV, CostV);
+}
+
+
+template <int N>
+void
+FootstepPlannerEnvironment::getSuccs(int SourceStateID,
+                                     std::vector<int> *SuccIDV,
+                                     std::vector<int> *CostV)
 {
   SuccIDV->clear();
   CostV->clear();
@@ -777,10 +1454,11 @@ FootstepPlannerEnvironment::GetSuccs(int SourceStateID,
     }
   }
 
-  ivExpandedStates.insert(std::pair<int,int>(current->getX(), current->getY()));
+  if (ivTrackExpandedStates)
+    ivExpandedStates.insert(current->getX(), current->getY());
   ++ivNumExpandedStates;
 
-  if (closeToGoal(*current))
+  if (closeToGoal<N>(*current))
   {
     int goal_id;
     assert(current->getLeg() != NOLEG);
@@ -796,6 +1474,12 @@ FootstepPlannerEnvironment::GetSuccs(int SourceStateID,
     return;
   }
 
+  if (ivBatchedExpansion)
+  {
+    getNeighborsBatched<N>(*current, true, SuccIDV, CostV);
+    return;
+  }
+
   SuccIDV->reserve(ivFootstepSet.size());
   CostV->reserve(ivFootstepSet.size());
   std::vector<Footstep>::const_iterator footstep_set_iter;
@@ -804,8 +1488,8 @@ FootstepPlannerEnvironment::GetSuccs(int SourceStateID,
       ++footstep_set_iter)
   {
     PlanningState successor =
-        footstep_set_iter->performMeOnThisState(*current);
-    if (occupied(successor))
+        footstep_set_iter->performMeOnThisState<N>(*current);
+    if (!inCorridor(successor) || occupied(successor))
       continue;
 
     const PlanningState* successor_hash_entry =
@@ -817,6 +1501,100 @@ FootstepPlannerEnvironment::GetSuccs(int SourceStateID,
   }
 }
 
+
+template <int N>
+void
+FootstepPlannerEnvironment::getNeighborsBatched(const PlanningState& current,
+                                                bool forward,
+                                                std::vector<int>* NeighIDV,
+                                                std::vector<int>* CostV)
+{
+  const int num_steps = ivFootstepSet.size();
+  ivBatchStates.clear();
+  ivBatchStates.reserve(num_steps);
+  ivBatchOccupied.resize(num_steps);
+  ivBatchUncached.clear();
+
+  // collision checks of all candidates (profiled as occupied() calls)
+  {
+    FOOTSTEP_PLANNER_PROFILE_CALLS(ivStats.occupied, num_steps);
+
+    // generate all candidates and look them up in the collision cache
+    for (int i = 0; i < num_steps; ++i)
+    {
+      if (forward)
+        ivBatchStates.push_back(
+          ivFootstepSet[i].performMeOnThisState<N>(current));
+      else
+        ivBatchStates.push_back(
+          ivFootstepSet[i].reverseMeOnThisState<N>(current));
+
+      const PlanningState& s = ivBatchStates.back();
+      if (!inCorridor(s))
+      {
+        ivBatchOccupied[i] = true;
+        continue;
+      }
+      CollisionCache::Status status = CollisionCache::UNKNOWN;
+      if (ivUseCollisionCache)
+        status = ivCollisionCache.get(s.getX(), s.getY(), s.getTheta(),
+                                      s.getLeg());
+      if (status == CollisionCache::UNKNOWN)
+        ivBatchUncached.push_back(i);
+      else
+        ivBatchOccupied[i] = (status == CollisionCache::OCCUPIED);
+    }
+
+    // decide the clear cases of collisionCheck() for all remaining
+    // candidates with two batch queries of the map
+    const int num_uncached = ivBatchUncached.size();
+    ivBatchUnresolved.clear();
+    if (num_uncached > 0)
+      prefilterBatch();
+
+    // collision check the rest (collisionCheck() only reads the map so it
+    // can be called concurrently)
+    const int num_unresolved = ivBatchUnresolved.size();
+    {
+      FOOTSTEP_PLANNER_PROFILE_CALLS(ivStats.collision_check, num_unresolved);
+#pragma omp parallel for schedule(dynamic, 4) num_threads(ivNumExpansionThreads) if(num_unresolved > 8)
+      for (int j = 0; j < num_unresolved; ++j)
+      {
+        int i = ivBatchUnresolved[j];
+        ivBatchOccupied[i] = collisionCheck(ivBatchStates[i]);
+      }
+    }
+
+    if (ivUseCollisionCache)
+    {
+      for (int j = 0; j < num_uncached; ++j)
+      {
+        const PlanningState& s = ivBatchStates[ivBatchUncached[j]];
+        ivCollisionCache.set(s.getX(), s.getY(), s.getTheta(), s.getLeg(),
+                             ivBatchOccupied[ivBatchUncached[j]]);
+      }
+    }
+  }
+
+  // create the hash entries in the order of the footstep set to keep the
+  // state IDs deterministic
+  NeighIDV->reserve(num_steps);
+  CostV->reserve(num_steps);
+  for (int i = 0; i < num_steps; ++i)
+  {
+    if (ivBatchOccupied[i])
+      continue;
+
+    const PlanningState* hash_entry =
+      createHashEntryIfNotExists(ivBatchStates[i]);
+
+    int cost = stepCost(current, *hash_entry);
+    NeighIDV->push_back(hash_entry->getId());
+    CostV->push_back(cost);
+  }
+}
+
+
 void
 FootstepPlannerEnvironment::GetSuccsTo(int SourceStateID, int goalStateId,
                                        std::vector<int> *SuccIDV,
@@ -826,6 +1604,8 @@ FootstepPlannerEnvironment::GetSuccsTo(int SourceStateID, int goalStateId,
 
   SuccIDV->clear();
   CostV->clear();
+  if (ivCancelled || ivStateBudgetExceeded)
+    return;
 
   assert(SourceStateID >= 0 &&
          unsigned(SourceStateID) < ivStateId2State.size());
@@ -836,7 +1616,8 @@ FootstepPlannerEnvironment::GetSuccsTo(int SourceStateID, int goalStateId,
   }
 
   const PlanningState* current = ivStateId2State[SourceStateID];
-  ivExpandedStates.insert(std::pair<int,int>(current->getX(), current->getY()));
+  if (ivTrackExpandedStates)
+    ivExpandedStates.insert(current->getX(), current->getY());
   ++ivNumExpandedStates;
 
   //ROS_INFO("GetSuccsTo %d -> %d: %f", SourceStateID, goalStateId, euclidean_distance(current->getX(), current->getY(), ivStateId2State[goalStateId]->getX(), ivStateId2State[goalStateId]->getY()));
@@ -879,6 +1660,12 @@ FootstepPlannerEnvironment::GetSuccsTo(int SourceStateID, int goalStateId,
   }
 
 
+  if (ivBatchedExpansion)
+  {
+    getNeighborsBatched<0>(*current, true, SuccIDV, CostV);
+    return;
+  }
+
   SuccIDV->reserve(ivFootstepSet.size());
   CostV->reserve(ivFootstepSet.size());
   std::vector<Footstep>::const_iterator footstep_set_iter;
@@ -905,6 +1692,13 @@ FootstepPlannerEnvironment::GetRandomSuccsatDistance(int SourceStateID,
                                                      std::vector<int>* SuccIDV, std::vector<int>* CLowV)
 {
 
+  if (ivCancelled || ivStateBudgetExceeded)
+  {
+    SuccIDV->clear();
+    CLowV->clear();
+    return;
+  }
+
   assert(SourceStateID >= 0 && unsigned(SourceStateID) < ivStateId2State.size());
   //goal state should be absorbing
   if (SourceStateID == ivIdGoalFootLeft || SourceStateID == ivIdGoalFootRight )
@@ -927,6 +1721,13 @@ FootstepPlannerEnvironment::GetRandomPredsatDistance(int TargetStateID,
                                                      std::vector<int>* PredIDV, std::vector<int>* CLowV)
 {
 
+  if (ivCancelled || ivStateBudgetExceeded)
+  {
+    PredIDV->clear();
+    CLowV->clear();
+    return;
+  }
+
   assert(TargetStateID >= 0 &&
 		 unsigned(TargetStateID) < ivStateId2State.size());
 
@@ -1224,7 +2025,7 @@ FootstepPlannerEnvironment::SetAllPreds(CMDPSTATE *state)
 int
 FootstepPlannerEnvironment::SizeofCreatedEnv()
 {
-  return ivStateId2State.size();
+  return ivStateArena.highWaterMark();
 }
 
 
@@ -1232,55 +2033,44 @@ void
 FootstepPlannerEnvironment::setStateArea(const PlanningState& left,
                                          const PlanningState& right)
 {
+  FOOTSTEP_PLANNER_PROFILE(ivStats.set_state_area);
+
   ivStateArea.clear();
 
   const PlanningState* p_state = getHashEntry(right);
   ivStateArea.push_back(p_state->getId());
 
-  double cont_step_x, cont_step_y, cont_step_theta;
-  for (int step_y = ivMaxInvFootstepY; step_y <= ivMaxFootstepY; ++step_y)
+  // all states reachable from the start feet (or from which the goal feet
+  // are reachable for the forward search); as before the tables, a step
+  // is only added for the right foot if it is valid for the left foot, so
+  // the state IDs are created in the same order
+  const std::vector<area_step_t>& left_steps =
+    ivStateAreaSteps[2 * left.getTheta() + left.getLeg()];
+  const std::vector<area_step_t>& right_steps =
+    ivStateAreaSteps[2 * right.getTheta() + right.getLeg()];
+  for (size_t i = 0; i < left_steps.size(); ++i)
   {
-    for (int step_x = ivMaxInvFootstepX; step_x <= ivMaxFootstepX; ++step_x)
-    {
-      for (int step_theta = ivMaxInvFootstepTheta;
-           step_theta <= ivMaxFootstepTheta;
-           ++step_theta)
-      {
-        cont_step_x = cont_val(step_x, ivCellSize);
-        cont_step_y = cont_val(step_y, ivCellSize);
-        cont_step_theta = angle_cell_2_state(step_theta, ivNumAngleBins);
-        Footstep step(cont_step_x, cont_step_y, cont_step_theta,
-                      ivCellSize, ivNumAngleBins, ivHashTableSize);
-        if (ivForwardSearch)
-        {
-          PlanningState pred = step.reverseMeOnThisState(left);
-          if (occupied(pred) || !reachable(pred, left))
-            continue;
-          p_state = createHashEntryIfNotExists(pred);
-          ivStateArea.push_back(p_state->getId());
-
-          pred = step.reverseMeOnThisState(right);
-          if (occupied(pred) || !reachable(pred, right))
-            continue;
-          p_state = createHashEntryIfNotExists(pred);
-          ivStateArea.push_back(p_state->getId());
-        }
-        else
-        {
-          PlanningState succ = step.performMeOnThisState(left);
-          if (occupied(succ) || !reachable(left, succ))
-            continue;
-          p_state = createHashEntryIfNotExists(succ);
-          ivStateArea.push_back(p_state->getId());
-
-          succ = step.performMeOnThisState(right);
-          if (occupied(succ) || !reachable(right, succ))
-            continue;
-          p_state = createHashEntryIfNotExists(succ);
-          ivStateArea.push_back(p_state->getId());
-        }
-      }
-    }
+    const area_step_t& left_step = left_steps[i];
+    if (!left_step.reachable)
+      continue;
+    PlanningState s(left.getX() + left_step.x, left.getY() + left_step.y,
+                    left_step.theta, left.getLeg() == LEFT ? RIGHT : LEFT,
+                    ivHashTableSize);
+    if (occupied(s))
+      continue;
+    p_state = createHashEntryIfNotExists(s);
+    ivStateArea.push_back(p_state->getId());
+
+    const area_step_t& right_step = right_steps[i];
+    if (!right_step.reachable)
+      continue;
+    s = PlanningState(right.getX() + right_step.x, right.getY() + right_step.y,
+                      right_step.theta, right.getLeg() == LEFT ? RIGHT : LEFT,
+                      ivHashTableSize);
+    if (occupied(s))
+      continue;
+    p_state = createHashEntryIfNotExists(s);
+    ivStateArea.push_back(p_state->getId());
   }
 }
 
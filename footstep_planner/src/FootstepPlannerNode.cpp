@@ -20,6 +20,8 @@
 
 #include <footstep_planner/FootstepPlannerNode.h>
 
+#include <boost/bind.hpp>
+
 namespace footstep_planner
 {
 FootstepPlannerNode::FootstepPlannerNode()
@@ -32,11 +34,43 @@ FootstepPlannerNode::FootstepPlannerNode()
   ivStartPoseSub = nh.subscribe<geometry_msgs::PoseWithCovarianceStamped>("initialpose", 1, &FootstepPlanner::startPoseCallback, &ivFootstepPlanner);
 
   // service:
-  ivFootstepPlanService = nh.advertiseService("plan_footsteps", &FootstepPlanner::planService, &ivFootstepPlanner);
-  ivFootstepPlanFeetService = nh.advertiseService("plan_footsteps_feet", &FootstepPlanner::planFeetService, &ivFootstepPlanner);
+  unsigned int num_workers = ivFootstepPlanner.getNumPlanningWorkers();
+  if (num_workers == 0)
+  {
+    ivFootstepPlanService = nh.advertiseService("plan_footsteps", &FootstepPlanner::planService, &ivFootstepPlanner);
+    ivFootstepPlanFeetService = nh.advertiseService("plan_footsteps_feet", &FootstepPlanner::planFeetService, &ivFootstepPlanner);
+    ivFootstepPlanBatchService = nh.advertiseService("plan_footsteps_batch", &FootstepPlanner::planBatchService, &ivFootstepPlanner);
+  }
+  else
+  {
+    // the service calls are served by their own threads so that they are
+    // planned concurrently (and independently of the map / pose callbacks)
+    ros::AdvertiseServiceOptions ops;
+    ops = ros::AdvertiseServiceOptions::create<humanoid_nav_msgs::PlanFootsteps>(
+        "plan_footsteps",
+        boost::bind(&FootstepPlanner::planService, &ivFootstepPlanner, _1, _2),
+        ros::VoidConstPtr(), &ivServiceQueue);
+    ivFootstepPlanService = nh.advertiseService(ops);
+    ops = ros::AdvertiseServiceOptions::create<humanoid_nav_msgs::PlanFootstepsBetweenFeet>(
+        "plan_footsteps_feet",
+        boost::bind(&FootstepPlanner::planFeetService, &ivFootstepPlanner, _1, _2),
+        ros::VoidConstPtr(), &ivServiceQueue);
+    ivFootstepPlanFeetService = nh.advertiseService(ops);
+    ops = ros::AdvertiseServiceOptions::create<humanoid_nav_msgs::PlanFootstepsBatch>(
+        "plan_footsteps_batch",
+        boost::bind(&FootstepPlanner::planBatchService, &ivFootstepPlanner, _1, _2),
+        ros::VoidConstPtr(), &ivServiceQueue);
+    ivFootstepPlanBatchService = nh.advertiseService(ops);
+
+    ivServiceSpinner.reset(new ros::AsyncSpinner(num_workers, &ivServiceQueue));
+    ivServiceSpinner->start();
+  }
 }
 
 
 FootstepPlannerNode::~FootstepPlannerNode()
-{}
+{
+  if (ivServiceSpinner)
+    ivServiceSpinner->stop();
+}
 }
@@ -0,0 +1,257 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <footstep_planner/FootstepPlannerPool.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+
+
+namespace footstep_planner
+{
+FootstepPlannerPool::FootstepPlannerPool(
+    unsigned int size,
+    const environment_params& params,
+    const heuristic_factory_t& create_heuristic,
+    const planner_factory_t& create_planner,
+    double max_search_time, double initial_epsilon,
+    bool search_until_first_solution)
+: ivSize(std::max(1u, size)),
+  ivEnvironmentParams(params),
+  ivCreateHeuristic(create_heuristic),
+  ivCreatePlanner(create_planner),
+  ivMaxSearchTime(max_search_time),
+  ivInitialEpsilon(initial_epsilon),
+  ivSearchUntilFirstSolution(search_until_first_solution)
+{
+  // the expanded states of the instances are not visualized
+  ivEnvironmentParams.track_expanded_states = false;
+  ivInstances.reserve(ivSize);
+  ivFreeInstances.reserve(ivSize);
+}
+
+
+FootstepPlannerPool::~FootstepPlannerPool()
+{}
+
+
+void
+FootstepPlannerPool::updateMap(const gridmap_2d::GridMap2DPtr& map)
+{
+  boost::mutex::scoped_lock lock(ivMutex);
+  ivMapPtr = map;
+}
+
+
+FootstepPlannerPool::instance_t*
+FootstepPlannerPool::acquire(gridmap_2d::GridMap2DPtr* map)
+{
+  boost::mutex::scoped_lock lock(ivMutex);
+  *map = ivMapPtr;
+  if (ivFreeInstances.empty() && ivInstances.size() < ivSize)
+  {
+    // NOTE: the environment keeps a reference to the footstep set of the
+    // parameters (shared by all instances), so the parameters of the pool
+    // are used with the instance's own heuristic
+    ivEnvironmentParams.heuristic = ivCreateHeuristic();
+    boost::shared_ptr<instance_t> instance(new instance_t);
+    instance->environment.reset(
+        new FootstepPlannerEnvironment(ivEnvironmentParams));
+    ivEnvironmentParams.heuristic.reset();
+    instance->planner = ivCreatePlanner(instance->environment.get());
+    ivInstances.push_back(instance);
+    ROS_DEBUG("Created planning instance %zu of %u", ivInstances.size(),
+              ivSize);
+    return instance.get();
+  }
+  while (ivFreeInstances.empty())
+    ivInstanceReleased.wait(lock);
+
+  instance_t* instance = ivFreeInstances.back();
+  ivFreeInstances.pop_back();
+  return instance;
+}
+
+
+void
+FootstepPlannerPool::release(instance_t* instance)
+{
+  {
+    boost::mutex::scoped_lock lock(ivMutex);
+    ivFreeInstances.push_back(instance);
+  }
+  ivInstanceReleased.notify_one();
+}
+
+
+bool
+FootstepPlannerPool::plan(const query_t& query, result_t* result)
+{
+  gridmap_2d::GridMap2DPtr map;
+  instance_t* instance = acquire(&map);
+  bool success = false;
+  try
+  {
+    success = plan(instance, map, query, result);
+  }
+  catch (...)
+  {
+    release(instance);
+    throw;
+  }
+  release(instance);
+  return success;
+}
+
+
+bool
+FootstepPlannerPool::plan(instance_t* instance,
+                          const gridmap_2d::GridMap2DPtr& map,
+                          const query_t& query, result_t* result)
+{
+  *result = result_t();
+  if (!map)
+  {
+    ROS_ERROR("FootstepPlannerPool has no map for planning yet.");
+    return false;
+  }
+
+  FootstepPlannerEnvironment& env = *instance->environment;
+  // plan from scratch (see FootstepPlanner::reset())
+  env.reset();
+  if (instance->map != map)
+  {
+    env.updateMap(map);
+    instance->map = map;
+  }
+  instance->planner = ivCreatePlanner(instance->environment.get());
+  SBPLPlanner& planner = *instance->planner;
+
+  if (env.occupied(query.start_left) || env.occupied(query.start_right))
+  {
+    ROS_ERROR("Start pose not accessible.");
+    return false;
+  }
+  if (env.occupied(query.goal_left) || env.occupied(query.goal_right))
+  {
+    ROS_ERROR("Goal pose not accessible.");
+    return false;
+  }
+
+  MDPConfig mdp_config;
+  env.updateStart(query.start_left, query.start_right);
+  env.updateGoal(query.goal_left, query.goal_right);
+  env.updateHeuristicValues();
+  env.InitializeEnv(NULL);
+  env.InitializeMDPCfg(&mdp_config);
+  env.resetStats();
+
+  if (planner.set_start(mdp_config.startstateid) == 0)
+  {
+    ROS_ERROR("Failed to set start state.");
+    return false;
+  }
+  if (planner.set_goal(mdp_config.goalstateid) == 0)
+  {
+    ROS_ERROR("Failed to set goal state.");
+    return false;
+  }
+  planner.set_initialsolution_eps(ivInitialEpsilon);
+  planner.set_search_mode(ivSearchUntilFirstSolution);
+
+  std::vector<int> solution_state_ids;
+  int path_cost = 0;
+  int ret = 0;
+  ros::WallTime start_time = ros::WallTime::now();
+  try
+  {
+    ret = planner.replan(ivMaxSearchTime, &solution_state_ids, &path_cost);
+  }
+  catch (const SBPL_Exception& e)
+  {
+    ret = 0;
+  }
+  result->planning_time = (ros::WallTime::now() - start_time).toSec();
+  result->expanded_states = env.getNumExpandedStates();
+  result->final_eps = planner.get_final_epsilon();
+
+  if (!ret || solution_state_ids.empty())
+  {
+    ROS_DEBUG("No solution found");
+    return false;
+  }
+  result->costs = double(path_cost) / FootstepPlannerEnvironment::cvMmScale;
+  result->success = env.extractPath(solution_state_ids, query.start_right,
+                                    query.goal_left, query.goal_right,
+                                    &result->path);
+  if (!result->success)
+    ROS_ERROR("extracting path failed");
+  return result->success;
+}
+
+
+void
+FootstepPlannerPool::planBatch(const std::vector<query_t>& queries,
+                               std::vector<result_t>* results)
+{
+  results->clear();
+  results->resize(queries.size());
+  if (queries.empty())
+    return;
+
+  unsigned int next_query = 0;
+  boost::mutex next_mutex;
+  unsigned int num_threads =
+    std::min(ivSize, (unsigned int)queries.size());
+  boost::thread_group workers;
+  // the calling thread is one of the workers
+  for (unsigned int i = 1; i < num_threads; ++i)
+  {
+    workers.create_thread(
+        boost::bind(&FootstepPlannerPool::planBatchWorker, this, &queries,
+                    results, &next_query, &next_mutex));
+  }
+  planBatchWorker(&queries, results, &next_query, &next_mutex);
+  workers.join_all();
+}
+
+
+void
+FootstepPlannerPool::planBatchWorker(const std::vector<query_t>* queries,
+                                     std::vector<result_t>* results,
+                                     unsigned int* next_query,
+                                     boost::mutex* next_mutex)
+{
+  while (true)
+  {
+    unsigned int i;
+    {
+      boost::mutex::scoped_lock lock(*next_mutex);
+      if (*next_query >= queries->size())
+        return;
+      i = (*next_query)++;
+    }
+    plan((*queries)[i], &(*results)[i]);
+  }
+}
+}
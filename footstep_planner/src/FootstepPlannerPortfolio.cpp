@@ -0,0 +1,288 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <footstep_planner/FootstepPlannerPortfolio.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <limits>
+
+
+namespace footstep_planner
+{
+FootstepPlannerPortfolio::FootstepPlannerPortfolio(
+    const std::vector<std::string>& planner_types,
+    const environment_params& params,
+    const heuristic_factory_t& create_heuristic,
+    const planner_factory_t& create_planner,
+    double max_search_time, double initial_epsilon,
+    bool search_until_first_solution,
+    double target_epsilon, double time_slice)
+: ivPlannerTypes(planner_types),
+  ivEnvironmentParams(params),
+  ivCreatePlanner(create_planner),
+  ivMaxSearchTime(max_search_time),
+  ivInitialEpsilon(initial_epsilon),
+  ivSearchUntilFirstSolution(search_until_first_solution),
+  ivTargetEpsilon(search_until_first_solution ?
+                  std::numeric_limits<double>::max() : target_epsilon),
+  ivTimeSlice(time_slice),
+  ivRaceUntilFirstSolution(ivSearchUntilFirstSolution),
+  ivRaceTargetEpsilon(ivTargetEpsilon),
+  ivWinner(-1)
+{
+  // the expanded states of the members are not visualized
+  ivEnvironmentParams.track_expanded_states = false;
+
+  // NOTE: the environments keep a reference to the footstep set of the
+  // parameters, so the parameters of the portfolio are used with each
+  // member's own heuristic
+  ivMembers.resize(ivPlannerTypes.size());
+  for (unsigned int i = 0; i < ivMembers.size(); ++i)
+  {
+    ivEnvironmentParams.heuristic = create_heuristic();
+    ivMembers[i].planner_type = ivPlannerTypes[i];
+    ivMembers[i].environment.reset(
+        new FootstepPlannerEnvironment(ivEnvironmentParams));
+  }
+  ivEnvironmentParams.heuristic.reset();
+}
+
+
+FootstepPlannerPortfolio::~FootstepPlannerPortfolio()
+{}
+
+
+void
+FootstepPlannerPortfolio::updateMap(const gridmap_2d::GridMap2DPtr& map)
+{
+  ivMapPtr = map;
+}
+
+
+bool
+FootstepPlannerPortfolio::plan(const query_t& query, result_t* result,
+                               std::string* winner, double max_search_time,
+                               bool search_until_first_solution)
+{
+  *result = result_t();
+  winner->clear();
+  if (!ivMapPtr)
+  {
+    ROS_ERROR("FootstepPlannerPortfolio has no map for planning yet.");
+    return false;
+  }
+  if (ivMembers.empty())
+    return false;
+
+  ivWinner = -1;
+  ivRaceUntilFirstSolution =
+    ivSearchUntilFirstSolution || search_until_first_solution;
+  ivRaceTargetEpsilon = ivRaceUntilFirstSolution ?
+                        std::numeric_limits<double>::max() : ivTargetEpsilon;
+  if (max_search_time <= 0.0)
+    max_search_time = ivMaxSearchTime;
+  ros::WallTime start_time = ros::WallTime::now();
+  ros::WallTime deadline = start_time + ros::WallDuration(max_search_time);
+
+  // the calling thread runs the first member
+  boost::thread_group searches;
+  for (unsigned int i = 1; i < ivMembers.size(); ++i)
+  {
+    searches.create_thread(
+        boost::bind(&FootstepPlannerPortfolio::search, this, i, &query,
+                    deadline));
+  }
+  search(0, &query, deadline);
+  searches.join_all();
+
+  // without a winner use the solution with the smallest epsilon (and the
+  // smallest costs)
+  int best = ivWinner;
+  for (unsigned int i = 0; i < ivMembers.size() && ivWinner < 0; ++i)
+  {
+    const result_t& r = ivMembers[i].result;
+    if (!r.success)
+      continue;
+    if (best < 0 || r.final_eps < ivMembers[best].result.final_eps ||
+        (r.final_eps == ivMembers[best].result.final_eps &&
+         r.costs < ivMembers[best].result.costs))
+      best = i;
+  }
+
+  for (unsigned int i = 0; i < ivMembers.size(); ++i)
+  {
+    const result_t& r = ivMembers[i].result;
+    ROS_DEBUG("Portfolio member %s: %s (eps %f, costs %f, %f s, %i "
+              "expanded states)", ivMembers[i].planner_type.c_str(),
+              r.success ? "solved" : "no solution", r.final_eps, r.costs,
+              r.planning_time, r.expanded_states);
+  }
+
+  if (best < 0)
+  {
+    ROS_INFO("Portfolio: no planner found a solution");
+    return false;
+  }
+
+  *result = ivMembers[best].result;
+  *winner = ivMembers[best].planner_type;
+  ROS_INFO("Portfolio: %s %s after %f s (eps %f, costs %f)",
+           winner->c_str(), ivWinner >= 0 ? "won" : "found the best solution",
+           result->planning_time, result->final_eps, result->costs);
+  // the time until the portfolio returned
+  result->planning_time = (ros::WallTime::now() - start_time).toSec();
+  return true;
+}
+
+
+bool
+FootstepPlannerPortfolio::decided()
+{
+  boost::mutex::scoped_lock lock(ivMutex);
+  return ivWinner >= 0;
+}
+
+
+void
+FootstepPlannerPortfolio::finish(unsigned int member)
+{
+  boost::mutex::scoped_lock lock(ivMutex);
+  const result_t& r = ivMembers[member].result;
+  if (ivWinner >= 0 || !r.success || r.final_eps > ivRaceTargetEpsilon)
+    return;
+
+  ivWinner = member;
+  for (unsigned int i = 0; i < ivMembers.size(); ++i)
+  {
+    if (i != member)
+      ivMembers[i].environment->cancel();
+  }
+}
+
+
+void
+FootstepPlannerPortfolio::search(unsigned int member, const query_t* query,
+                                 ros::WallTime deadline)
+{
+  member_t& m = ivMembers[member];
+  m.result = result_t();
+  ros::WallTime start_time = ros::WallTime::now();
+
+  FootstepPlannerEnvironment& env = *m.environment;
+  // plan from scratch (see FootstepPlanner::reset()); resetting also revokes
+  // a cancellation of the previous race
+  env.reset();
+  if (m.map != ivMapPtr)
+  {
+    env.updateMap(ivMapPtr);
+    m.map = ivMapPtr;
+  }
+  m.planner = ivCreatePlanner(m.planner_type, m.environment.get());
+  SBPLPlanner& planner = *m.planner;
+
+  if (env.occupied(query->start_left) || env.occupied(query->start_right) ||
+      env.occupied(query->goal_left) || env.occupied(query->goal_right))
+  {
+    ROS_ERROR("Start or goal pose not accessible.");
+    return;
+  }
+
+  MDPConfig mdp_config;
+  env.updateStart(query->start_left, query->start_right);
+  env.updateGoal(query->goal_left, query->goal_right);
+  env.updateHeuristicValues();
+  env.InitializeEnv(NULL);
+  env.InitializeMDPCfg(&mdp_config);
+  env.resetStats();
+
+  if (planner.set_start(mdp_config.startstateid) == 0 ||
+      planner.set_goal(mdp_config.goalstateid) == 0)
+  {
+    ROS_ERROR("Failed to set start / goal state.");
+    return;
+  }
+  planner.set_initialsolution_eps(ivInitialEpsilon);
+
+  // a race decided while the member was set up cancels its search
+  if (decided())
+    return;
+
+  std::vector<int> solution_state_ids;
+  int path_cost = 0;
+  try
+  {
+    if (m.planner_type == "RSTARPlanner")
+    {
+      // the R* planner does not provide intermediate solutions
+      planner.set_search_mode(ivRaceUntilFirstSolution);
+      double remaining_time = (deadline - ros::WallTime::now()).toSec();
+      if (remaining_time > 0.0 &&
+          !planner.replan(remaining_time, &solution_state_ids, &path_cost))
+        solution_state_ids.clear();
+    }
+    else
+    {
+      // search in time slices to check for the target epsilon (see
+      // FootstepPlanner::replanStreaming())
+      planner.set_search_mode(false);
+      std::vector<int> state_ids;
+      int cost;
+      while (!decided())
+      {
+        double remaining_time = (deadline - ros::WallTime::now()).toSec();
+        if (remaining_time <= 0.0)
+          break;
+
+        state_ids.clear();
+        int found = planner.replan(std::min(ivTimeSlice, remaining_time),
+                                   &state_ids, &cost);
+        if (!found || state_ids.empty())
+          continue;
+
+        solution_state_ids = state_ids;
+        path_cost = cost;
+        if (planner.get_solution_eps() <= std::max(ivRaceTargetEpsilon, 1.0))
+          break;
+      }
+    }
+  }
+  catch (const SBPL_Exception& e)
+  {
+    solution_state_ids.clear();
+  }
+
+  m.result.planning_time = (ros::WallTime::now() - start_time).toSec();
+  m.result.expanded_states = env.getNumExpandedStates();
+  if (!solution_state_ids.empty())
+  {
+    m.result.final_eps = planner.get_final_epsilon();
+    m.result.costs =
+      double(path_cost) / FootstepPlannerEnvironment::cvMmScale;
+    m.result.success = env.extractPath(
+        solution_state_ids, query->start_right, query->goal_left,
+        query->goal_right, &m.result.path);
+  }
+  finish(member);
+}
+}
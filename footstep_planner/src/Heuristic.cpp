@@ -90,13 +90,13 @@ const
   double diff_angle = 0.0;
   if (ivDiffAngleCost > 0.0)
   {
-    // get the number of bins between from.theta and to.theta
-    int diff_angle_disc = (
-        ((to.getTheta() - from.getTheta()) % ivNumAngleBins) +
-        ivNumAngleBins) % ivNumAngleBins;
+    // get the number of bins between from.theta and to.theta (in
+    // [-ivNumAngleBins/2..ivNumAngleBins/2), i.e. already normalized)
+    int diff_angle_disc = AngleBins<0>::wrapDiff(
+        to.getTheta() - from.getTheta(), ivNumAngleBins);
     // get the rotation independent from the rotation direction
-    diff_angle = std::abs(angles::normalize_angle(
-        angle_cell_2_state(diff_angle_disc, ivNumAngleBins)));
+    diff_angle = angle_cell_2_state(std::abs(diff_angle_disc),
+                                    ivNumAngleBins);
   }
 
   return (dist + expected_steps * ivStepCost +
@@ -20,6 +20,8 @@
 
 #include <footstep_planner/PathCostHeuristic.h>
 
+#include <algorithm>
+
 
 namespace footstep_planner
 {
@@ -28,23 +30,27 @@ PathCostHeuristic::PathCostHeuristic(double cell_size,
                                      double step_cost,
                                      double diff_angle_cost,
                                      double max_step_width,
-                                     double inflation_radius)
+                                     double inflation_radius,
+                                     unsigned int cache_size,
+                                     bool early_termination,
+                                     double termination_margin)
 : Heuristic(cell_size, num_angle_bins, PATH_COST),
-  ivpGrid(NULL),
+  ivMapRevision(0),
   ivStepCost(step_cost),
   ivDiffAngleCost(diff_angle_cost),
   ivMaxStepWidth(max_step_width),
   ivInflationRadius(inflation_radius),
   ivGoalX(-1),
-  ivGoalY(-1)
-{}
+  ivGoalY(-1),
+  ivTerminationMargin(early_termination ?
+                      std::max(0.0, termination_margin) : -1.0)
+{
+  gridmap_2d::CostToGo2D::shared().reserve(std::max(1u, cache_size));
+}
 
 
 PathCostHeuristic::~PathCostHeuristic()
-{
-  if (ivpGrid)
-    resetGrid();
-}
+{}
 
 
 double
@@ -79,21 +85,25 @@ const
               "calculateDistances() before!");
   }
   assert((unsigned int)ivGoalX == to_x && (unsigned int)ivGoalY == to_y);
+  assert(ivDistanceField);
 
-  double dist = double(ivGridSearchPtr->getlowerboundoncostfromstart_inmm(
-      from_x, from_y)) / 1000.0;
+  // cells not settled by an early terminated search only have a lower bound
+  // (which keeps the heuristic admissible)
+  double dist = 0.0;
+  if (from_x < ivDistanceField->width() && from_y < ivDistanceField->height())
+    dist = double(ivDistanceField->costAt(from_x, from_y)) / 1000.0;
 
   double expected_steps = dist / ivMaxStepWidth;
   double diff_angle = 0.0;
   if (ivDiffAngleCost > 0.0)
   {
-    // get the number of bins between from.theta and to.theta
-    int diff_angle_disc = (
-        ((to.getTheta() - current.getTheta()) % ivNumAngleBins) +
-        ivNumAngleBins) % ivNumAngleBins;
+    // get the number of bins between from.theta and to.theta (in
+    // [-ivNumAngleBins/2..ivNumAngleBins/2), i.e. already normalized)
+    int diff_angle_disc = AngleBins<0>::wrapDiff(
+        to.getTheta() - current.getTheta(), ivNumAngleBins);
     // get the rotation independent from the rotation direction
-    diff_angle = std::abs(angles::normalize_angle(
-        angle_cell_2_state(diff_angle_disc, ivNumAngleBins)));
+    diff_angle = angle_cell_2_state(std::abs(diff_angle_disc),
+                                    ivNumAngleBins);
   }
 
   return (dist + expected_steps * ivStepCost + diff_angle * ivDiffAngleCost);
@@ -118,72 +128,171 @@ PathCostHeuristic::calculateDistances(const PlanningState& from,
                                cell_2_state(to.getY(), ivCellSize),
                                to_x, to_y);
 
-  if ((int)to_x != ivGoalX || (int)to_y != ivGoalY)
-  {
-    ivGoalX = to_x;
-    ivGoalY = to_y;
-    ivGridSearchPtr->search(ivpGrid, cvObstacleThreshold,
-                            ivGoalX, ivGoalY, from_x, from_y,
-                            SBPL_2DGRIDSEARCH_TERM_CONDITION_ALLCELLS);
-  }
+  ivGoalX = to_x;
+  ivGoalY = to_y;
+
+  // reuses a distance field of the current map and goal cell in which the
+  // start cell has been settled (also one computed by another footstep
+  // planner of the process with the same inflation radius)
+  std::vector<cv::Point> stop_cells(1, cv::Point(from_x, from_y));
+  ivDistanceField = gridmap_2d::CostToGo2D::shared().get(
+      *ivMapPtr, ivInflationRadius, to_x, to_y, stop_cells,
+      ivTerminationMargin);
 
   return true;
 }
 
 
-void
-PathCostHeuristic::updateMap(gridmap_2d::GridMap2DPtr map)
+bool
+PathCostHeuristic::extractPath2D(const PlanningState& from,
+                                 nav_msgs::Path* path)
+const
 {
-  if (ivpGrid) // reset map before change it's sizes (in other case we will get SEGMENT ERROR)
-    resetGrid();
+  path->poses.clear();
+  if (!ivDistanceField)
+    return false;
 
-  ivMapPtr.reset();
-  ivMapPtr = map;
+  unsigned int x;
+  unsigned int y;
+  ivMapPtr->worldToMapNoBounds(cell_2_state(from.getX(), ivCellSize),
+                               cell_2_state(from.getY(), ivCellSize),
+                               x, y);
 
-  ivGoalX = ivGoalY = -1;
+  // from the cell of 'from' to the goal cell
+  std::vector<cv::Point> cells;
+  if (!ivDistanceField->extractPath(x, y, cells))
+    return false;
 
-  unsigned width = ivMapPtr->getInfo().width;
-  unsigned height = ivMapPtr->getInfo().height;
+  path->header.frame_id = ivMapPtr->getFrameID();
+  path->header.stamp = ros::Time::now();
+  geometry_msgs::PoseStamped pose;
+  pose.header = path->header;
+  pose.pose.orientation.w = 1.0;
+  path->poses.reserve(cells.size());
+  for (std::vector<cv::Point>::const_iterator cell_iter = cells.begin();
+       cell_iter != cells.end();
+       ++cell_iter)
+  {
+    ivMapPtr->mapToWorld(cell_iter->x, cell_iter->y,
+                         pose.pose.position.x, pose.pose.position.y);
+    path->poses.push_back(pose);
+  }
+  return true;
+}
 
-  if (ivGridSearchPtr)
-    ivGridSearchPtr->destroy();
-  ivGridSearchPtr.reset(new SBPL2DGridSearch(width, height,
-                                             ivMapPtr->getResolution()));
 
-  ivpGrid = new unsigned char* [width];
+void
+PathCostHeuristic::updateMap(gridmap_2d::GridMap2DPtr map)
+{
+  if (map == ivMapPtr)
+    return;
 
-  for (unsigned x = 0; x < width; ++x)
-    ivpGrid[x] = new unsigned char [height];
-  for (unsigned y = 0; y < height; ++y)
+  // keep the former map (and thereby the distance fields computed on it) if
+  // the inflated map did not change
+  if (ivMapPtr &&
+      ivMapPtr->getInfo().width == map->getInfo().width &&
+      ivMapPtr->getInfo().height == map->getInfo().height &&
+      ivMapPtr->getResolution() == map->getResolution() &&
+      ivMapPtr->getInfo().origin.position.x == map->getInfo().origin.position.x &&
+      ivMapPtr->getInfo().origin.position.y == map->getInfo().origin.position.y)
   {
-    for (unsigned x = 0; x < width; ++x)
+    const unsigned width = map->getInfo().width;
+    const unsigned height = map->getInfo().height;
+    const bool tiled = map->isTiled() || ivMapPtr->isTiled();
+    bool changed = false;
+    std::vector<cv::Rect> changed_tiles;
+    const bool compared_tiles = map->isTiled() && ivMapPtr->isTiled() &&
+        map->tiledMap()->changedTiles(*ivMapPtr->tiledMap(), changed_tiles);
+    // only cells within the inflation radius of a changed tile can differ,
+    // i.e. the distances of the other tiles are not computed
+    for (size_t i = 0; compared_tiles && i < changed_tiles.size() && !changed;
+         ++i)
+      changed = inflationChanged(*map, changed_tiles[i]);
+    // the cv::Mat is transposed, i.e. each row holds one x value
+    for (unsigned x = 0; x < width && !changed && !compared_tiles; ++x)
     {
-      float dist = ivMapPtr->distanceMapAtCell(x,y);
-      if (dist < 0.0f)
-        ROS_ERROR("Distance map at %d %d out of bounds", x, y);
-      else if (dist <= ivInflationRadius)
-        ivpGrid[x][y] = 255;
+      if (tiled)
+      {
+        // no dense distance map, query the tiles per cell
+        for (unsigned y = 0; y < height && !changed; ++y)
+          changed = (map->distanceMapAtCell(x, y) <= ivInflationRadius) !=
+                    (ivMapPtr->distanceMapAtCell(x, y) <= ivInflationRadius);
+      }
       else
-        ivpGrid[x][y] = 0;
+      {
+        const float* dist = map->distanceMap().ptr<float>(x);
+        const float* old_dist = ivMapPtr->distanceMap().ptr<float>(x);
+        for (unsigned y = 0; y < height && !changed; ++y)
+          changed = (dist[y] <= ivInflationRadius) !=
+                    (old_dist[y] <= ivInflationRadius);
+      }
     }
+    if (!changed)
+      return;
   }
+
+  ivMapPtr = map;
+
+  ++ivMapRevision;
+  ivDistanceField.reset();
+  ivGoalX = ivGoalY = -1;
 }
 
 
 void
-PathCostHeuristic::resetGrid()
+PathCostHeuristic::updateMapIncrementally(gridmap_2d::GridMap2DPtr map,
+                                          const cv::Rect& changed_cells)
+{
+  if (map == ivMapPtr)
+    return;
+
+  if (!ivMapPtr ||
+      ivMapPtr->getInfo().width != map->getInfo().width ||
+      ivMapPtr->getInfo().height != map->getInfo().height ||
+      ivMapPtr->getResolution() != map->getResolution() ||
+      ivMapPtr->getInfo().origin.position.x != map->getInfo().origin.position.x ||
+      ivMapPtr->getInfo().origin.position.y != map->getInfo().origin.position.y)
+  {
+    updateMap(map);
+    return;
+  }
+
+  // keep the former map (and its distance fields) if the inflated map did
+  // not change around the changed cells
+  if (!inflationChanged(*map, changed_cells))
+    return;
+
+  ivMapPtr = map;
+
+  ++ivMapRevision;
+  ivDistanceField.reset();
+  ivGoalX = ivGoalY = -1;
+}
+
+
+bool
+PathCostHeuristic::inflationChanged(const gridmap_2d::GridMap2D& map,
+                                    const cv::Rect& cells)
+const
 {
-  // CvSize size = ivMapPtr->size(); // here we get (height; width) instead of (width; height)
-  int width = ivMapPtr->getInfo().width;
-  for (int x = 0; x < width; ++x)
+  const int width = map.getInfo().width;
+  const int height = map.getInfo().height;
+  const int margin = int(ceil(ivInflationRadius / map.getResolution())) + 1;
+  const unsigned x0 = std::max(cells.x - margin, 0);
+  const unsigned y0 = std::max(cells.y - margin, 0);
+  const unsigned x1 =
+    std::max(std::min(cells.x + cells.width + margin, width), 0);
+  const unsigned y1 =
+    std::max(std::min(cells.y + cells.height + margin, height), 0);
+  for (unsigned x = x0; x < x1; ++x)
   {
-    if (ivpGrid[x])
+    for (unsigned y = y0; y < y1; ++y)
     {
-      delete[] ivpGrid[x];
-      ivpGrid[x] = NULL;
+      if ((map.distanceMapAtCell(x, y) <= ivInflationRadius) !=
+          (ivMapPtr->distanceMapAtCell(x, y) <= ivInflationRadius))
+        return true;
     }
   }
-  delete[] ivpGrid;
-  ivpGrid = NULL;
+  return false;
 }
 } // end of namespace
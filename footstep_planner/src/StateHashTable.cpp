@@ -0,0 +1,163 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <footstep_planner/StateHashTable.h>
+
+#include <cassert>
+
+
+namespace footstep_planner
+{
+const double StateHashTable::cvMaxLoadFactor = 0.7;
+
+
+StateHashTable::StateHashTable(unsigned int initial_capacity)
+: ivMask(0),
+  ivSize(0),
+  ivMaxSize(0)
+{
+  unsigned int capacity = 16;
+  while (capacity < initial_capacity)
+    capacity <<= 1;
+
+  Slot empty;
+  empty.x = empty.y = empty.theta_leg = 0;
+  empty.id = -1;
+  ivSlots.assign(capacity, empty);
+  ivMask = capacity - 1;
+  ivMaxSize = (unsigned int)(capacity * cvMaxLoadFactor);
+}
+
+
+StateHashTable::~StateHashTable()
+{}
+
+
+unsigned int
+StateHashTable::probe(int x, int y, int theta_leg)
+const
+{
+  unsigned int i = hash(x, y, theta_leg) & ivMask;
+  while (true)
+  {
+    const Slot& slot = ivSlots[i];
+    if (slot.id == -1 ||
+        (slot.x == x && slot.y == y && slot.theta_leg == theta_leg))
+      return i;
+    i = (i + 1) & ivMask;
+  }
+}
+
+
+int
+StateHashTable::find(int x, int y, int theta, Leg leg)
+const
+{
+  return ivSlots[probe(x, y, packThetaLeg(theta, leg))].id;
+}
+
+
+int
+StateHashTable::insert(int x, int y, int theta, Leg leg, int id)
+{
+  assert(id >= 0);
+
+  int theta_leg = packThetaLeg(theta, leg);
+  unsigned int i = probe(x, y, theta_leg);
+  Slot& slot = ivSlots[i];
+  if (slot.id != -1)
+    return slot.id;
+
+  slot.x = x;
+  slot.y = y;
+  slot.theta_leg = theta_leg;
+  slot.id = id;
+  ++ivSize;
+
+  if (ivSize > ivMaxSize)
+    grow();
+
+  return id;
+}
+
+
+void
+StateHashTable::clear()
+{
+  if (ivSize == 0)
+    return;
+
+  for (std::vector<Slot>::iterator it = ivSlots.begin(); it != ivSlots.end();
+       ++it)
+  {
+    it->id = -1;
+  }
+  ivSize = 0;
+}
+
+
+void
+StateHashTable::getProbeLengths(double* mean, unsigned int* max)
+const
+{
+  *mean = 0.0;
+  *max = 0;
+  if (ivSize == 0)
+    return;
+
+  unsigned long sum = 0;
+  for (unsigned int i = 0; i < ivSlots.size(); ++i)
+  {
+    const Slot& slot = ivSlots[i];
+    if (slot.id == -1)
+      continue;
+    // distance to the slot the key is hashed to (wrapping around)
+    unsigned int home = hash(slot.x, slot.y, slot.theta_leg) & ivMask;
+    unsigned int length = ((i - home) & ivMask) + 1;
+    sum += length;
+    if (length > *max)
+      *max = length;
+  }
+  *mean = double(sum) / ivSize;
+}
+
+
+void
+StateHashTable::grow()
+{
+  std::vector<Slot> old_slots;
+  old_slots.swap(ivSlots);
+
+  unsigned int capacity = old_slots.size() << 1;
+  Slot empty;
+  empty.x = empty.y = empty.theta_leg = 0;
+  empty.id = -1;
+  ivSlots.assign(capacity, empty);
+  ivMask = capacity - 1;
+  ivMaxSize = (unsigned int)(capacity * cvMaxLoadFactor);
+
+  std::vector<Slot>::const_iterator it;
+  for (it = old_slots.begin(); it != old_slots.end(); ++it)
+  {
+    if (it->id != -1)
+      ivSlots[probe(it->x, it->y, it->theta_leg)] = *it;
+  }
+}
+}
@@ -0,0 +1,765 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Offline benchmark of the footstep planner over the bundled maps.
+ *
+ * For each map and start / goal query of the query file and for each
+ * planner type a planning task is set up from scratch (the same way
+ * FootstepPlanner::plan() does) and the results are written as CSV or JSON.
+ * Usage:
+ *
+ *   footstep_planner_benchmark [-q queries.yaml] [-p params.yaml]...
+ *                              [-P planner_type]... [-f csv|json] [-o file]
+ *
+ * -q  the query file (default: config/benchmark_queries.yaml)
+ * -p  a parameter file; can be given multiple times, later files override
+ *     earlier ones like consecutive rosparam loads (default:
+ *     planning_params.yaml, planning_params_nao.yaml, footsteps_nao.yaml)
+ * -P  ARAPlanner, ADPlanner or RSTARPlanner; can be given multiple times
+ *     (default: all)
+ * -f  output format (default: csv)
+ * -o  output file (default: stdout)
+ *
+ * Relative file names are resolved within the package (config/ resp. maps/).
+ * Does not need a running roscore: the parameters are read directly from the
+ * yaml files instead of the parameter server.
+ */
+
+#include <footstep_planner/FootstepPlannerEnvironment.h>
+#include <footstep_planner/Heuristic.h>
+#include <footstep_planner/PathCostHeuristic.h>
+#include <gridmap_2d/GridMap2D.h>
+#include <map_server/image_loader.h>
+#include <nav_msgs/GetMap.h>
+#include <ros/package.h>
+#include <ros/ros.h>
+#include <yaml-cpp/yaml.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using footstep_planner::environment_params;
+using footstep_planner::Footstep;
+using footstep_planner::FootstepPlannerEnvironment;
+using footstep_planner::Heuristic;
+using footstep_planner::Leg;
+using footstep_planner::LEFT;
+using footstep_planner::PathCostHeuristic;
+using footstep_planner::PlanningState;
+using footstep_planner::RIGHT;
+using footstep_planner::State;
+using gridmap_2d::GridMap2D;
+using gridmap_2d::GridMap2DPtr;
+
+
+namespace
+{
+/// @brief Planning parameters read from (multiple) yaml files.
+class Params
+{
+public:
+  bool load(const std::string& file)
+  {
+    try
+    {
+      YAML::Node node = YAML::LoadFile(file);
+      if (!node.IsMap())
+      {
+        fprintf(stderr, "Parameter file %s is not a map\n", file.c_str());
+        return false;
+      }
+      ivNodes.push_back(node);
+    }
+    catch (const YAML::Exception& e)
+    {
+      fprintf(stderr, "Error reading %s: %s\n", file.c_str(), e.what());
+      return false;
+    }
+    return true;
+  }
+
+  /// @brief Reads the parameter 'key' (e.g. "foot/size/x") from the last
+  /// file defining it.
+  template <class T>
+  void param(const std::string& key, T& value, const T& default_value) const
+  {
+    for (int i = ivNodes.size() - 1; i >= 0; --i)
+    {
+      if (lookup(ivNodes[i], key, &value))
+        return;
+    }
+    value = default_value;
+  }
+
+private:
+  template <class T>
+  static bool lookup(const YAML::Node& node, const std::string& key,
+                     T* value)
+  {
+    size_t pos = key.find('/');
+    const YAML::Node child = node[key.substr(0, pos)];
+    if (!child.IsDefined())
+      return false;
+    if (pos == std::string::npos)
+    {
+      *value = child.as<T>();
+      return true;
+    }
+    if (!child.IsMap())
+      return false;
+    return lookup(child, key.substr(pos + 1), value);
+  }
+
+  std::vector<YAML::Node> ivNodes;
+};
+
+
+/// @brief The setup of a planning task (as done by the FootstepPlanner).
+struct Setup
+{
+  environment_params env_params;
+  std::string heuristic_type;
+  double diff_angle_cost;
+  double max_step_width;
+  int heuristic_cache_size;
+  bool heuristic_early_termination;
+  double heuristic_termination_margin;
+  double corridor_width;
+  double foot_separation;
+  bool search_until_first_solution;
+  double allocated_time;
+  double initial_epsilon;
+  double time_slice;
+};
+
+
+struct Query
+{
+  State start;
+  State goal;
+};
+
+
+struct Result
+{
+  bool success;
+  double wall_time;
+  double time_to_first_solution;
+  double final_eps;
+  double path_cost;
+  int path_size;
+  int expanded_states;
+  int created_states;
+  long peak_memory_kb;
+  /// Memory of the states, index mappings and hash table (see
+  /// FootstepPlannerEnvironment::getMemoryUsage()).
+  long search_memory_kb;
+};
+
+
+std::string
+resolvePath(const std::string& package_dir, const std::string& sub_dir,
+            const std::string& file)
+{
+  if (file.empty() || file[0] == '/')
+    return file;
+  return package_dir + "/" + sub_dir + "/" + file;
+}
+
+
+/// @brief Reads the parameters the same way FootstepPlanner does.
+bool
+readSetup(const Params& p, Setup* setup)
+{
+  environment_params& env = setup->env_params;
+  p.param("heuristic_type", setup->heuristic_type,
+          std::string("EuclideanHeuristic"));
+  p.param("heuristic_scale", env.heuristic_scale, 1.0);
+  p.param("max_hash_size", env.hash_table_size, 65536);
+  p.param("accuracy/collision_check", env.collision_check_accuracy, 2);
+  p.param("accuracy/collision_cache", env.collision_cache, true);
+  p.param("track_expanded_states", env.track_expanded_states, true);
+  p.param("batched_expansion", env.batched_expansion, false);
+  p.param("num_expansion_threads", env.num_expansion_threads, 0);
+  p.param("state_budget/max_states", env.max_states, 0);
+  p.param("state_budget/max_memory", env.max_memory, 0.0);
+  p.param("accuracy/cell_size", env.cell_size, 0.01);
+  p.param("accuracy/num_angle_bins", env.num_angle_bins, 64);
+  p.param("step_cost", env.step_cost, 0.05);
+  p.param("diff_angle_cost", setup->diff_angle_cost, 0.0);
+  p.param("heuristic_cache_size", setup->heuristic_cache_size, 4);
+  p.param("heuristic_early_termination", setup->heuristic_early_termination,
+          false);
+  p.param("heuristic_termination_margin",
+          setup->heuristic_termination_margin, 0.2);
+  p.param("corridor_width", setup->corridor_width, 0.0);
+
+  p.param("search_until_first_solution", setup->search_until_first_solution,
+          false);
+  p.param("allocated_time", setup->allocated_time, 7.0);
+  p.param("forward_search", env.forward_search, false);
+  p.param("initial_epsilon", setup->initial_epsilon, 3.0);
+  p.param("stream_time_slice", setup->time_slice, 0.1);
+  p.param("num_random_nodes", env.num_random_nodes, 20);
+  p.param("random_node_dist", env.random_node_distance, 1.0);
+
+  p.param("foot/size/x", env.footsize_x, 0.16);
+  p.param("foot/size/y", env.footsize_y, 0.06);
+  p.param("foot/size/z", env.footsize_z, 0.015);
+  p.param("foot/separation", setup->foot_separation, 0.1);
+  p.param("foot/origin_shift/x", env.foot_origin_shift_x, 0.02);
+  p.param("foot/origin_shift/y", env.foot_origin_shift_y, 0.0);
+  p.param("foot/max/step/x", env.max_footstep_x, 0.08);
+  p.param("foot/max/step/y", env.max_footstep_y, 0.16);
+  p.param("foot/max/step/theta", env.max_footstep_theta, 0.3);
+  p.param("foot/max/inverse/step/x", env.max_inverse_footstep_x, -0.04);
+  p.param("foot/max/inverse/step/y", env.max_inverse_footstep_y, 0.09);
+  p.param("foot/max/inverse/step/theta", env.max_inverse_footstep_theta,
+          -0.3);
+
+  // footstep discretization
+  std::vector<double> footsteps_x, footsteps_y, footsteps_theta;
+  std::vector<double> empty;
+  p.param("footsteps/x", footsteps_x, empty);
+  p.param("footsteps/y", footsteps_y, empty);
+  p.param("footsteps/theta", footsteps_theta, empty);
+  if (footsteps_x.empty() || footsteps_x.size() != footsteps_y.size() ||
+      footsteps_x.size() != footsteps_theta.size())
+  {
+    fprintf(stderr, "Footstep parameterization missing or of different "
+            "sizes for x/y/theta.\n");
+    return false;
+  }
+  env.footstep_set.clear();
+  setup->max_step_width = 0.0;
+  for (unsigned int i = 0; i < footsteps_x.size(); ++i)
+  {
+    double x = footsteps_x[i];
+    double y = footsteps_y[i];
+    double theta = footsteps_theta[i];
+    env.footstep_set.push_back(Footstep(x, y, theta, env.cell_size,
+                                        env.num_angle_bins,
+                                        env.hash_table_size));
+    setup->max_step_width = std::max(setup->max_step_width,
+                                     sqrt(x * x + y * y));
+  }
+
+  // step range
+  std::vector<double> step_range_x, step_range_y;
+  p.param("step_range/x", step_range_x, empty);
+  p.param("step_range/y", step_range_y, empty);
+  if (step_range_x.empty() || step_range_x.size() != step_range_y.size())
+  {
+    fprintf(stderr, "Step range points missing or of different size.\n");
+    return false;
+  }
+  env.step_range.clear();
+  double max_x = 0.0;
+  double max_y = 0.0;
+  for (unsigned int i = 0; i < step_range_x.size(); ++i)
+  {
+    max_x = std::max(max_x, fabs(step_range_x[i]));
+    max_y = std::max(max_y, fabs(step_range_y[i]));
+    env.step_range.push_back(std::pair<int, int>(
+      footstep_planner::disc_val(step_range_x[i], env.cell_size),
+      footstep_planner::disc_val(step_range_y[i], env.cell_size)));
+  }
+  // insert first point again at the end!
+  env.step_range.push_back(env.step_range[0]);
+  env.max_step_width = sqrt(max_x * max_x + max_y * max_y) * 1.5;
+
+  return true;
+}
+
+
+boost::shared_ptr<Heuristic>
+createHeuristic(const Setup& setup)
+{
+  const environment_params& env = setup.env_params;
+  boost::shared_ptr<Heuristic> h;
+  if (setup.heuristic_type == "EuclideanHeuristic")
+  {
+    h.reset(new footstep_planner::EuclideanHeuristic(env.cell_size,
+                                                     env.num_angle_bins));
+  }
+  else if (setup.heuristic_type == "EuclStepCostHeuristic")
+  {
+    h.reset(new footstep_planner::EuclStepCostHeuristic(
+      env.cell_size, env.num_angle_bins, env.step_cost, setup.diff_angle_cost,
+      setup.max_step_width));
+  }
+  else if (setup.heuristic_type == "PathCostHeuristic")
+  {
+    double foot_incircle =
+      std::min((env.footsize_x / 2.0 - std::abs(env.foot_origin_shift_x)),
+               (env.footsize_y / 2.0 - std::abs(env.foot_origin_shift_y)));
+    h.reset(new footstep_planner::PathCostHeuristic(
+      env.cell_size, env.num_angle_bins, env.step_cost, setup.diff_angle_cost,
+      setup.max_step_width, foot_incircle,
+      std::max(1, setup.heuristic_cache_size),
+      setup.heuristic_early_termination,
+      setup.heuristic_termination_margin));
+  }
+  return h;
+}
+
+
+boost::shared_ptr<SBPLPlanner>
+createPlanner(const std::string& planner_type,
+              FootstepPlannerEnvironment* env, bool forward_search)
+{
+  boost::shared_ptr<SBPLPlanner> planner;
+  if (planner_type == "ARAPlanner")
+    planner.reset(new ARAPlanner(env, forward_search));
+  else if (planner_type == "ADPlanner")
+    planner.reset(new ADPlanner(env, forward_search));
+  else if (planner_type == "RSTARPlanner")
+    planner.reset(new RSTARPlanner(env, forward_search));
+  return planner;
+}
+
+
+/// @brief Loads a map in the map_server format.
+GridMap2DPtr
+loadMap(const std::string& file)
+{
+  GridMap2DPtr map;
+  try
+  {
+    YAML::Node node = YAML::LoadFile(file);
+    std::string image = node["image"].as<std::string>();
+    if (image[0] != '/')
+      image = file.substr(0, file.find_last_of('/') + 1) + image;
+    std::vector<double> origin = node["origin"].as<std::vector<double> >();
+    if (origin.size() != 3)
+    {
+      fprintf(stderr, "Invalid origin in map file %s\n", file.c_str());
+      return map;
+    }
+
+    nav_msgs::GetMap::Response map_resp;
+    map_server::loadMapFromFile(&map_resp, image.c_str(),
+                                node["resolution"].as<double>(),
+                                node["negate"].as<int>() != 0,
+                                node["occupied_thresh"].as<double>(),
+                                node["free_thresh"].as<double>(),
+                                &origin[0]);
+    map_resp.map.header.frame_id = "map";
+    nav_msgs::OccupancyGridConstPtr grid(
+      new nav_msgs::OccupancyGrid(map_resp.map));
+    map.reset(new GridMap2D(grid));
+  }
+  catch (const std::exception& e)
+  {
+    fprintf(stderr, "Error loading map %s: %s\n", file.c_str(), e.what());
+  }
+  return map;
+}
+
+
+bool
+readQueries(const YAML::Node& node, std::vector<Query>* queries)
+{
+  for (unsigned int i = 0; i < node.size(); ++i)
+  {
+    std::vector<double> q = node[i].as<std::vector<double> >();
+    if (q.size() != 6)
+    {
+      fprintf(stderr, "A query needs to consist of 6 values (start x, y, "
+              "theta, goal x, y, theta).\n");
+      return false;
+    }
+    Query query;
+    query.start = State(q[0], q[1], q[2], footstep_planner::NOLEG);
+    query.goal = State(q[3], q[4], q[5], footstep_planner::NOLEG);
+    queries->push_back(query);
+  }
+  return true;
+}
+
+
+/// @brief Returns the foot pose of a leg for a given robot pose (see
+/// FootstepPlanner::getFootPose()).
+State
+getFootPose(const State& robot, Leg leg, double foot_separation)
+{
+  double shift_x = -sin(robot.getTheta()) * foot_separation / 2.0;
+  double shift_y =  cos(robot.getTheta()) * foot_separation / 2.0;
+  double sign = (leg == LEFT) ? 1.0 : -1.0;
+  return State(robot.getX() + sign * shift_x, robot.getY() + sign * shift_y,
+               robot.getTheta(), leg);
+}
+
+
+/// @brief Resets the peak resident set size of the process (Linux only).
+void
+resetPeakMemory()
+{
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  if (clear_refs)
+    clear_refs << "5";
+}
+
+
+/// @return The peak resident set size of the process in kB (-1 if unknown).
+long
+getPeakMemory()
+{
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (line.compare(0, 6, "VmHWM:") == 0)
+      return atol(line.c_str() + 6);
+  }
+  return -1;
+}
+
+
+/**
+ * @brief Plans from scratch for one query.
+ *
+ * Planning is done in time slices (see FootstepPlanner::replanStreaming())
+ * to determine the time to the first solution; the R* planner does not
+ * support this, so its time to the first solution is not available (-1).
+ */
+Result
+plan(const Setup& setup, const std::string& planner_type,
+     const GridMap2DPtr& map, const Query& query)
+{
+  Result result;
+  result.success = false;
+  result.wall_time = 0.0;
+  result.time_to_first_solution = -1.0;
+  result.final_eps = -1.0;
+  result.path_cost = -1.0;
+  result.path_size = 0;
+  result.expanded_states = 0;
+  result.created_states = 0;
+  result.search_memory_kb = 0;
+
+  resetPeakMemory();
+
+  environment_params env_params = setup.env_params;
+  env_params.heuristic = createHeuristic(setup);
+  FootstepPlannerEnvironment env(env_params);
+  env.updateMap(map);
+
+  State start_left = getFootPose(query.start, LEFT, setup.foot_separation);
+  State start_right = getFootPose(query.start, RIGHT, setup.foot_separation);
+  State goal_left = getFootPose(query.goal, LEFT, setup.foot_separation);
+  State goal_right = getFootPose(query.goal, RIGHT, setup.foot_separation);
+  if (env.occupied(start_left) || env.occupied(start_right) ||
+      env.occupied(goal_left) || env.occupied(goal_right))
+  {
+    fprintf(stderr, "Start or goal pose of query is occupied.\n");
+    result.peak_memory_kb = getPeakMemory();
+    return result;
+  }
+
+  ros::WallTime start_time = ros::WallTime::now();
+
+  MDPConfig mdp_config;
+  env.updateStart(start_left, start_right);
+  env.updateGoal(goal_left, goal_right);
+  env.updateHeuristicValues();
+  // restrict the search to the corridor around the heuristic's 2D path
+  // (without the fallback to the unrestricted search of the FootstepPlanner)
+  if (setup.corridor_width > 0.0 &&
+      setup.heuristic_type == "PathCostHeuristic")
+  {
+    boost::shared_ptr<const PathCostHeuristic> h =
+      boost::dynamic_pointer_cast<const PathCostHeuristic>(
+        env_params.heuristic);
+    const State& from = env_params.forward_search ? start_left : goal_left;
+    nav_msgs::Path path;
+    if (h->extractPath2D(PlanningState(from, env_params.cell_size,
+                                       env_params.num_angle_bins,
+                                       env_params.hash_table_size),
+                         &path))
+      env.setCorridor(path, setup.corridor_width);
+  }
+  env.InitializeEnv(NULL);
+  env.InitializeMDPCfg(&mdp_config);
+
+  boost::shared_ptr<SBPLPlanner> planner =
+    createPlanner(planner_type, &env, env_params.forward_search);
+  planner->set_start(mdp_config.startstateid);
+  planner->set_goal(mdp_config.goalstateid);
+  planner->set_initialsolution_eps(setup.initial_epsilon);
+
+  std::vector<int> solution_state_ids;
+  int path_cost = 0;
+  try
+  {
+    if (planner_type == "RSTARPlanner")
+    {
+      planner->set_search_mode(setup.search_until_first_solution);
+      result.success = planner->replan(setup.allocated_time,
+                                       &solution_state_ids, &path_cost);
+    }
+    else
+    {
+      planner->set_search_mode(false);
+      std::vector<int> state_ids;
+      int cost;
+      while (true)
+      {
+        double remaining_time = setup.allocated_time -
+          (ros::WallTime::now() - start_time).toSec();
+        if (remaining_time <= 0.0)
+          break;
+
+        state_ids.clear();
+        int found = planner->replan(std::min(setup.time_slice,
+                                             remaining_time),
+                                    &state_ids, &cost);
+        if (!found || state_ids.empty())
+          continue;
+
+        if (!result.success)
+        {
+          result.time_to_first_solution =
+            (ros::WallTime::now() - start_time).toSec();
+        }
+        result.success = true;
+        solution_state_ids = state_ids;
+        path_cost = cost;
+
+        if (setup.search_until_first_solution ||
+            planner->get_solution_eps() <= 1.0)
+          break;
+      }
+    }
+  }
+  catch (const SBPL_Exception& e)
+  {
+    result.success = false;
+  }
+
+  result.wall_time = (ros::WallTime::now() - start_time).toSec();
+  result.success = result.success && !solution_state_ids.empty();
+  if (result.success)
+  {
+    result.final_eps = planner->get_final_epsilon();
+    result.path_cost =
+      double(path_cost) / FootstepPlannerEnvironment::cvMmScale;
+    result.path_size = solution_state_ids.size();
+  }
+  result.expanded_states = env.getNumExpandedStates();
+  result.created_states = env.SizeofCreatedEnv();
+  result.peak_memory_kb = getPeakMemory();
+  result.search_memory_kb = env.getMemoryUsage().search() / 1024;
+  return result;
+}
+
+
+void
+writeHeader(FILE* out, const std::string& format)
+{
+  if (format == "json")
+    fprintf(out, "[\n");
+  else
+    fprintf(out, "map,planner,query,success,wall_time,time_to_first_solution,"
+            "expanded_states,final_eps,path_cost,path_size,created_states,"
+            "peak_memory_kb,search_memory_kb\n");
+}
+
+
+void
+writeResult(FILE* out, const std::string& format, bool first,
+            const std::string& map, const std::string& planner, int query,
+            const Result& r)
+{
+  if (format == "json")
+  {
+    fprintf(out, "%s  {\"map\": \"%s\", \"planner\": \"%s\", \"query\": %d, "
+            "\"success\": %s, \"wall_time\": %f, "
+            "\"time_to_first_solution\": %f, \"expanded_states\": %d, "
+            "\"final_eps\": %f, \"path_cost\": %f, \"path_size\": %d, "
+            "\"created_states\": %d, \"peak_memory_kb\": %ld, "
+            "\"search_memory_kb\": %ld}",
+            first ? "" : ",\n", map.c_str(), planner.c_str(), query,
+            r.success ? "true" : "false", r.wall_time,
+            r.time_to_first_solution, r.expanded_states, r.final_eps,
+            r.path_cost, r.path_size, r.created_states, r.peak_memory_kb,
+            r.search_memory_kb);
+  }
+  else
+  {
+    fprintf(out, "%s,%s,%d,%d,%f,%f,%d,%f,%f,%d,%d,%ld,%ld\n", map.c_str(),
+            planner.c_str(), query, r.success ? 1 : 0, r.wall_time,
+            r.time_to_first_solution, r.expanded_states, r.final_eps,
+            r.path_cost, r.path_size, r.created_states, r.peak_memory_kb,
+            r.search_memory_kb);
+  }
+  fflush(out);
+}
+
+
+void
+usage(const char* name)
+{
+  fprintf(stderr, "Usage: %s [-q queries.yaml] [-p params.yaml]... "
+          "[-P planner_type]... [-f csv|json] [-o file]\n", name);
+}
+}
+
+
+int
+main(int argc, char** argv)
+{
+  ros::Time::init();
+
+  std::string package_dir = ros::package::getPath("footstep_planner");
+  std::string query_file = "benchmark_queries.yaml";
+  std::vector<std::string> param_files;
+  std::vector<std::string> planner_types;
+  std::string format = "csv";
+  std::string output_file;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (i + 1 >= argc)
+    {
+      usage(argv[0]);
+      return 1;
+    }
+    if (arg == "-q")
+      query_file = argv[++i];
+    else if (arg == "-p")
+      param_files.push_back(argv[++i]);
+    else if (arg == "-P")
+      planner_types.push_back(argv[++i]);
+    else if (arg == "-f")
+      format = argv[++i];
+    else if (arg == "-o")
+      output_file = argv[++i];
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (param_files.empty())
+  {
+    param_files.push_back("planning_params.yaml");
+    param_files.push_back("planning_params_nao.yaml");
+    param_files.push_back("footsteps_nao.yaml");
+  }
+  if (planner_types.empty())
+  {
+    planner_types.push_back("ARAPlanner");
+    planner_types.push_back("ADPlanner");
+    planner_types.push_back("RSTARPlanner");
+  }
+  if (format != "csv" && format != "json")
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  for (unsigned int i = 0; i < planner_types.size(); ++i)
+  {
+    if (planner_types[i] != "ARAPlanner" && planner_types[i] != "ADPlanner" &&
+        planner_types[i] != "RSTARPlanner")
+    {
+      fprintf(stderr, "Planner %s not available.\n",
+              planner_types[i].c_str());
+      return 1;
+    }
+  }
+
+  Params params;
+  for (unsigned int i = 0; i < param_files.size(); ++i)
+  {
+    if (!params.load(resolvePath(package_dir, "config", param_files[i])))
+      return 1;
+  }
+  Setup setup;
+  if (!readSetup(params, &setup))
+    return 1;
+  if (!createHeuristic(setup))
+  {
+    fprintf(stderr, "Heuristic %s not available.\n",
+            setup.heuristic_type.c_str());
+    return 1;
+  }
+
+  YAML::Node maps;
+  try
+  {
+    maps = YAML::LoadFile(resolvePath(package_dir, "config", query_file))
+      ["maps"];
+  }
+  catch (const YAML::Exception& e)
+  {
+    fprintf(stderr, "Error reading %s: %s\n", query_file.c_str(), e.what());
+    return 1;
+  }
+  if (!maps.IsDefined() || !maps.IsSequence())
+  {
+    fprintf(stderr, "No maps defined in %s\n", query_file.c_str());
+    return 1;
+  }
+
+  FILE* out = stdout;
+  if (!output_file.empty())
+  {
+    out = fopen(output_file.c_str(), "w");
+    if (out == NULL)
+    {
+      fprintf(stderr, "Cannot open %s\n", output_file.c_str());
+      return 1;
+    }
+  }
+
+  writeHeader(out, format);
+  bool first = true;
+  for (unsigned int m = 0; m < maps.size(); ++m)
+  {
+    std::string map_name = maps[m]["map"].as<std::string>();
+    GridMap2DPtr map = loadMap(resolvePath(package_dir, "maps", map_name));
+    std::vector<Query> queries;
+    if (!map || !readQueries(maps[m]["queries"], &queries))
+      continue;
+
+    for (unsigned int p = 0; p < planner_types.size(); ++p)
+    {
+      for (unsigned int q = 0; q < queries.size(); ++q)
+      {
+        Result result = plan(setup, planner_types[p], map, queries[q]);
+        writeResult(out, format, first, map_name, planner_types[p], q,
+                    result);
+        first = false;
+      }
+    }
+  }
+  if (format == "json")
+    fprintf(out, "\n]\n");
+
+  if (out != stdout)
+    fclose(out);
+
+  return 0;
+}
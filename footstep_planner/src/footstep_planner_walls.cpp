@@ -37,6 +37,7 @@ using gridmap_2d::GridMap2DPtr;
 class FootstepPlannerWallsNode {
 public:
   FootstepPlannerWallsNode()
+  : ivWallMapHash(0)
   {
     ros::NodeHandle privateNh("~");
     // params:
@@ -56,7 +57,7 @@ public:
   void mapCallback(const nav_msgs::OccupancyGridConstPtr& occupancyMap)
   {
     ROS_INFO("Obstacle map received, now waiting for wall map.");
-    ivGridMap = GridMap2DPtr(new GridMap2D(occupancyMap));
+    ivGridMap = ivFootstepPlanner.createMap(occupancyMap);
     // don't set wall => wait for wall map!
     //ivFootstepPlanner.setMap(ivGridMap);
 
@@ -69,14 +70,32 @@ public:
   {
     ROS_INFO("Wall / Obstacle map received");
     assert(ivGridMap);
-    GridMap2DPtr wallMap(new GridMap2D(occupancyMap));
-
-    GridMap2DPtr enlargedWallMap(new GridMap2D(occupancyMap));
-    cv::Mat binaryMap =  (enlargedWallMap->distanceMap() > ivFootstepWallDist);
+    if (ivGridMap->isTiled())
+    {
+      ROS_ERROR("Wall maps need a dense map, set map_tile_size to 0");
+      return;
+    }
+
+    // the same walls for the same obstacle map (e.g. republished): reuse
+    const boost::uint64_t wallMapHash = GridMap2D::contentHash(*occupancyMap, false);
+    if (ivEnlargedWallMap && wallMapHash == ivWallMapHash && ivEnlargedWallBaseMap == ivGridMap)
+    {
+      ivFootstepPlanner.updateMap(ivEnlargedWallMap);
+      return;
+    }
+
+    // one distance transform of the walls, one of the combined map
+    GridMap2D wallMap(occupancyMap);
+    cv::Mat binaryMap =  (wallMap.distanceMap() > ivFootstepWallDist);
     bitwise_and(binaryMap, ivGridMap->binaryMap(), binaryMap);
 
+    // shares the map info with wallMap, setMap() replaces the data
+    GridMap2DPtr enlargedWallMap(new GridMap2D(wallMap));
     enlargedWallMap->setMap(binaryMap);
 
+    ivWallMapHash = wallMapHash;
+    ivEnlargedWallMap = enlargedWallMap;
+    ivEnlargedWallBaseMap = ivGridMap;
     ivFootstepPlanner.updateMap(enlargedWallMap);
   }
 
@@ -84,6 +103,10 @@ protected:
   ros::NodeHandle ivNh;
   footstep_planner::FootstepPlanner ivFootstepPlanner;
   GridMap2DPtr ivGridMap;
+  /// last map combined of ivEnlargedWallBaseMap and the walls with hash ivWallMapHash
+  GridMap2DPtr ivEnlargedWallMap;
+  GridMap2DPtr ivEnlargedWallBaseMap;
+  boost::uint64_t ivWallMapHash;
   double ivFootstepWallDist;
   ros::Subscriber ivGoalPoseSub, ivGridMapSub, ivWallMapSub, ivStartPoseSub, ivRobotPoseSub;
   ros::ServiceServer ivFootstepPlanService;
@@ -26,6 +26,16 @@ bool
 collision_check(double x, double y, double theta, double height,
                 double width, int accuracy,
                 const gridmap_2d::GridMap2D& distance_map)
+{
+  return collision_check(x, y, cos(theta), sin(theta), height, width,
+                         accuracy, distance_map);
+}
+
+
+bool
+collision_check(double x, double y, double theta_cos, double theta_sin,
+                double height, double width, int accuracy,
+                const gridmap_2d::GridMap2D& distance_map)
 {
   double d = distance_map.distanceMapAt(x, y);
   if (d < 0.0) // if out of bounds => collision
@@ -68,15 +78,13 @@ collision_check(double x, double y, double theta, double height,
     delta_x = 0.0;
     delta_y = w_clear + w_new / 2.0;
   }
-  const double theta_cos = cos(theta);
-  const double theta_sin = sin(theta);
   const double x_shift = theta_cos*delta_x - theta_sin*delta_y;
   const double y_shift = theta_sin*delta_x + theta_cos*delta_y;
 
-  return (collision_check(x+x_shift, y+y_shift, theta, h_new, w_new,
-                          accuracy, distance_map) ||
-          collision_check(x-x_shift, y-y_shift, theta, h_new, w_new,
-                          accuracy, distance_map));
+  return (collision_check(x+x_shift, y+y_shift, theta_cos, theta_sin,
+                          h_new, w_new, accuracy, distance_map) ||
+          collision_check(x-x_shift, y-y_shift, theta_cos, theta_sin,
+                          h_new, w_new, accuracy, distance_map));
 }
 
 
@@ -0,0 +1,249 @@
+/*
+ * A footstep planner for humanoid robots
+ *
+ * Copyright 2010-2011 Johannes Garimort, Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/footstep_planner
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Microbenchmark comparing the bucket vector hash map formerly used by
+ * FootstepPlannerEnvironment with the open addressing StateHashTable.
+ *
+ * The access pattern mimics GetSuccs(): states are expanded in FIFO order
+ * and every expansion queries (and if necessary creates) the successors
+ * reached by a fixed footstep set. Usage:
+ *
+ *   state_hash_benchmark [num_states] [max_hash_size] [num_angle_bins]
+ *
+ * Does not need a running roscore.
+ */
+
+#include <footstep_planner/PlanningState.h>
+#include <footstep_planner/StateHashTable.h>
+#include <ros/ros.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+
+using footstep_planner::Leg;
+using footstep_planner::LEFT;
+using footstep_planner::RIGHT;
+using footstep_planner::PlanningState;
+using footstep_planner::StateHashTable;
+
+
+namespace
+{
+struct Key
+{
+  int x, y, theta;
+  Leg leg;
+};
+
+/// Discrete footstep offsets (in cells/angle bins) applied to the left leg.
+const int cvNumSteps = 8;
+const int cvSteps[cvNumSteps][3] = {
+  { 20,  9,  0}, { 10,  9,  0}, {  0,  9,  0}, {-10,  9,  0},
+  { 15, 12,  4}, { 15, 12, -4}, {  0, 13,  6}, { 15,  7,  0}
+};
+
+Key
+successor(const Key& k, int step, int num_angle_bins)
+{
+  Key s;
+  int dy = (k.leg == RIGHT) ? cvSteps[step][1] : -cvSteps[step][1];
+  int dtheta = (k.leg == RIGHT) ? cvSteps[step][2] : -cvSteps[step][2];
+  // axis aligned steps are sufficient to produce the same kind of clustered
+  // keys as the planner does
+  s.x = k.x + cvSteps[step][0];
+  s.y = k.y + dy;
+  s.theta = (k.theta + dtheta + num_angle_bins) % num_angle_bins;
+  s.leg = (k.leg == RIGHT) ? LEFT : RIGHT;
+  return s;
+}
+
+
+/// The former FootstepPlannerEnvironment scheme.
+class BucketVectorMap
+{
+public:
+  explicit BucketVectorMap(int max_hash_size)
+  : ivMaxHashSize(max_hash_size),
+    ivpBuckets(new std::vector<const PlanningState*>[max_hash_size])
+  {}
+
+  ~BucketVectorMap()
+  {
+    for (unsigned int i = 0; i < ivStates.size(); ++i)
+      delete ivStates[i];
+    delete[] ivpBuckets;
+  }
+
+  int createIfNotExists(const Key& k)
+  {
+    PlanningState s(k.x, k.y, k.theta, k.leg, ivMaxHashSize);
+    std::vector<const PlanningState*>& bucket = ivpBuckets[s.getHashTag()];
+    std::vector<const PlanningState*>::const_iterator it;
+    for (it = bucket.begin(); it != bucket.end(); ++it)
+    {
+      if (*(*it) == s)
+        return (*it)->getId();
+    }
+
+    PlanningState* new_state = new PlanningState(s);
+    new_state->setId(ivStates.size());
+    ivStates.push_back(new_state);
+    bucket.push_back(new_state);
+    return new_state->getId();
+  }
+
+  size_t size() const { return ivStates.size(); }
+
+private:
+  const int ivMaxHashSize;
+  std::vector<const PlanningState*>* ivpBuckets;
+  std::vector<const PlanningState*> ivStates;
+};
+
+
+/// The StateHashTable scheme (states are allocated as before).
+class FlatMap
+{
+public:
+  explicit FlatMap(int max_hash_size)
+  : ivMaxHashSize(max_hash_size),
+    ivTable(max_hash_size)
+  {}
+
+  ~FlatMap()
+  {
+    for (unsigned int i = 0; i < ivStates.size(); ++i)
+      delete ivStates[i];
+  }
+
+  int createIfNotExists(const Key& k)
+  {
+    int new_id = ivStates.size();
+    int id = ivTable.insert(k.x, k.y, k.theta, k.leg, new_id);
+    if (id != new_id)
+      return id;
+
+    PlanningState* new_state =
+      new PlanningState(k.x, k.y, k.theta, k.leg, ivMaxHashSize);
+    new_state->setId(new_id);
+    ivStates.push_back(new_state);
+    return new_id;
+  }
+
+  size_t size() const { return ivStates.size(); }
+
+private:
+  const int ivMaxHashSize;
+  StateHashTable ivTable;
+  std::vector<const PlanningState*> ivStates;
+};
+
+
+/**
+ * Runs the expansion until 'num_states' states have been created.
+ * @return The number of createIfNotExists() calls.
+ */
+template <class Map>
+size_t
+expand(Map& map, size_t num_states, int num_angle_bins,
+       std::vector<Key>* keys)
+{
+  std::deque<Key> open;
+  Key start = { 0, 0, 0, LEFT };
+  map.createIfNotExists(start);
+  keys->push_back(start);
+  open.push_back(start);
+
+  size_t num_queries = 1;
+  while (!open.empty() && map.size() < num_states)
+  {
+    Key k = open.front();
+    open.pop_front();
+    for (int i = 0; i < cvNumSteps; ++i)
+    {
+      Key s = successor(k, i, num_angle_bins);
+      size_t old_size = map.size();
+      map.createIfNotExists(s);
+      ++num_queries;
+      if (map.size() > old_size)
+      {
+        keys->push_back(s);
+        open.push_back(s);
+      }
+    }
+  }
+  return num_queries;
+}
+
+
+template <class Map>
+void
+run(const char* name, size_t num_states, int max_hash_size,
+    int num_angle_bins)
+{
+  Map map(max_hash_size);
+  std::vector<Key> keys;
+  keys.reserve(num_states + cvNumSteps);
+
+  ros::WallTime t0 = ros::WallTime::now();
+  size_t num_queries = expand(map, num_states, num_angle_bins, &keys);
+  double t_expand = (ros::WallTime::now() - t0).toSec();
+
+  // pure lookups of existing states in creation order
+  t0 = ros::WallTime::now();
+  long checksum = 0;
+  for (size_t i = 0; i < keys.size(); ++i)
+    checksum += map.createIfNotExists(keys[i]);
+  double t_lookup = (ros::WallTime::now() - t0).toSec();
+
+  printf("%-14s states: %8lu  queries: %9lu  expand: %8.2f ms "
+         "(%6.1f ns/query)  lookup: %8.2f ms (%6.1f ns/query)  [%ld]\n",
+         name, (unsigned long)map.size(), (unsigned long)num_queries,
+         t_expand * 1000.0, t_expand * 1e9 / num_queries,
+         t_lookup * 1000.0, t_lookup * 1e9 / keys.size(), checksum);
+}
+}
+
+
+int
+main(int argc, char** argv)
+{
+  size_t num_states = 500000;
+  int max_hash_size = 65536;
+  int num_angle_bins = 128;
+  if (argc > 1)
+    num_states = strtoul(argv[1], NULL, 10);
+  if (argc > 2)
+    max_hash_size = atoi(argv[2]);
+  if (argc > 3)
+    num_angle_bins = atoi(argv[3]);
+
+  printf("num_states: %lu, max_hash_size: %d, num_angle_bins: %d\n",
+         (unsigned long)num_states, max_hash_size, num_angle_bins);
+
+  run<BucketVectorMap>("bucket vector", num_states, max_hash_size,
+                       num_angle_bins);
+  run<FlatMap>("open address", num_states, max_hash_size, num_angle_bins);
+
+  return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * A simple 2D gridmap structure
+ *
+ * Copyright 2011 Armin Hornung, University of Freiburg
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the University of Freiburg nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef GRIDMAP2D_COSTTOGO2D_H_
+#define GRIDMAP2D_COSTTOGO2D_H_
+
+#include <gridmap_2d/GridMap2D.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <list>
+#include <vector>
+
+
+namespace gridmap_2d{
+/**
+ * @brief Costs (path lengths in mm) of all cells of a GridMap2D to one root
+ * cell, computed by a Dijkstra search on the map inflated by a radius
+ * (8-connected, no cutting of blocked corners).
+ *
+ * The map is indexed as GridMap2D's map coordinates <mx, my>. For tiled maps
+ * (see GridMap2D::setMapTiled()) the costs are stored in tiles of the same
+ * size, allocated only where the search reaches them.
+ */
+class CostToGoField {
+public:
+  /// Costs of blocked and unreachable cells
+  static const int INFINITE_COST = 1000000000;
+
+  /// @return the cost (in mm) from <mx, my> to the root cell; a lower bound
+  /// only if not isExact().
+  inline int costAt(unsigned int mx, unsigned int my) const {
+    if (m_tileSize == 0)
+      return m_cost[size_t(mx) * m_height + my];
+    const std::vector<int>& tile = m_tiles[size_t(mx / m_tileSize) * m_tilesY + my / m_tileSize];
+    return tile.empty() ? m_untouchedCost : tile[(mx % m_tileSize) * m_tileSize + my % m_tileSize];
+  }
+
+  /// @return false if the search has been terminated before settling <mx, my>.
+  inline bool isExact(unsigned int mx, unsigned int my) const {return costAt(mx, my) < m_bound;}
+
+  /**
+   * @brief Follows the costs from <mx, my> down to the root cell.
+   * @param[out] cells From <mx, my> (x: mx, y: my) to the root cell.
+   * @return false if the cell is not exact or unreachable.
+   */
+  bool extractPath(unsigned int mx, unsigned int my, std::vector<cv::Point>& cells) const;
+
+  inline unsigned int rootX() const {return m_rootX;}
+  inline unsigned int rootY() const {return m_rootY;}
+  inline unsigned int width() const {return m_width;}
+  inline unsigned int height() const {return m_height;}
+  inline unsigned long mapRevision() const {return m_mapRevision;}
+  inline double inflationRadius() const {return m_inflationRadius;}
+  /// Costs at or above are lower bounds (of an early terminated search)
+  inline int bound() const {return m_bound;}
+  /// @return the cost (in mm) of a straight move between two cells.
+  inline int straightCost() const {return m_straightCost;}
+
+protected:
+  friend class CostToGo2D;
+  CostToGoField();
+
+  /// Runs the search; stop_cells (x: mx, y: my) and termination_margin as in CostToGo2D::get()
+  void compute(const GridMap2D& map, double inflation_radius, unsigned int root_x, unsigned int root_y,
+               const std::vector<cv::Point>& stop_cells, double termination_margin);
+
+  /// Marks cells of the inflated map during compute()
+  static const int BLOCKED_COST = INFINITE_COST + 1;
+
+  /// @return the writable cost of <mx, my> during compute(), allocates its tile on the first access.
+  inline int& cell(const GridMap2D& map, unsigned int mx, unsigned int my) {
+    if (m_tileSize == 0)
+      return m_cost[size_t(mx) * m_height + my];
+    std::vector<int>& tile = m_tiles[size_t(mx / m_tileSize) * m_tilesY + my / m_tileSize];
+    if (tile.empty())
+      initTile(map, mx / m_tileSize, my / m_tileSize, tile);
+    return tile[(mx % m_tileSize) * m_tileSize + my % m_tileSize];
+  }
+
+  /// Allocates the tile <tx, ty> with its blocked cells (computes only the distances of that map tile).
+  void initTile(const GridMap2D& map, unsigned int tx, unsigned int ty, std::vector<int>& tile) const;
+
+  /// Replaces BLOCKED_COST by INFINITE_COST and clamps the costs to m_bound.
+  void finishCosts();
+
+  unsigned long m_mapRevision;
+  double m_inflationRadius;
+  unsigned int m_rootX;
+  unsigned int m_rootY;
+  unsigned int m_width;
+  unsigned int m_height;
+  int m_bound;
+  int m_straightCost;
+  int m_diagonalCost;
+  std::vector<int> m_cost; ///< indexed by mx * height + my, empty for tiled maps
+  unsigned int m_tileSize; ///< edge length of m_tiles in cells, 0 if dense
+  unsigned int m_tilesY;   ///< number of tiles along my
+  int m_untouchedCost;     ///< cost of the cells of tiles not reached by the search
+  /// tiles of costs (indexed by mx * tile size + my within), empty if not reached
+  std::vector<std::vector<int> > m_tiles;
+};
+
+typedef boost::shared_ptr<const CostToGoField> CostToGoFieldConstPtr;
+
+
+/**
+ * @brief Cache of CostToGoFields shared by all 2D searches of a process (e.g.
+ * the heuristics of a FootstepPlannerPool), so each field is computed once
+ * per map revision, root cell and inflation radius. Only searches with the
+ * same root and inflation radius reuse a field; the cache is not shared
+ * between processes.
+ *
+ * Thread-safe; the search itself runs without holding the lock.
+ */
+class CostToGo2D {
+public:
+  explicit CostToGo2D(unsigned int cache_size = 1);
+  virtual ~CostToGo2D();
+
+  /// @return the instance shared by the whole process.
+  static CostToGo2D& shared();
+
+  /**
+   * @brief Returns the field of map (see GridMap2D::revision()) inflated by
+   * inflation_radius (cells with at most this distance to an obstacle are
+   * blocked) to the root cell, computed if not cached.
+   *
+   * @param stop_cells Cells (x: mx, y: my) whose costs are needed: a search
+   * stops once they are settled and the costs exceed their maximum by
+   * termination_margin (relative), a cached field is used if they are exact.
+   * @param termination_margin Negative: always search all cells.
+   */
+  CostToGoFieldConstPtr get(const GridMap2D& map, double inflation_radius,
+                            unsigned int root_x, unsigned int root_y,
+                            const std::vector<cv::Point>& stop_cells = std::vector<cv::Point>(),
+                            double termination_margin = -1.0);
+
+  /// Increases the number of cached fields to at least cache_size.
+  void reserve(unsigned int cache_size);
+
+  /// Removes all cached fields.
+  void clear();
+
+protected:
+  /// @return the cached field with the key if it covers stop_cells (moved to the front).
+  CostToGoFieldConstPtr lookup(const GridMap2D& map, double inflation_radius,
+                               unsigned int root_x, unsigned int root_y,
+                               const std::vector<cv::Point>& stop_cells);
+
+  unsigned int m_cacheSize;
+  std::list<CostToGoFieldConstPtr> m_fields; ///< most recently used first
+  boost::mutex m_mutex;
+};
+}
+
+#endif /* GRIDMAP2D_COSTTOGO2D_H_ */
@@ -36,23 +36,46 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <nav_msgs/OccupancyGrid.h>
 #include <opencv2/core/types_c.h>
+#include <gridmap_2d/TiledGridMap2D.h>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
 
 
 
 
 namespace gridmap_2d{
+class GridMap2D;
+typedef boost::shared_ptr< GridMap2D> GridMap2DPtr;
+typedef boost::shared_ptr<const GridMap2D> GridMap2DConstPtr;
+
 /**
  * @brief Stores a nav_msgs::OccupancyGrid in a convenient opencv cv::Mat
  * as binary map (free: 255, occupied: 0) and as distance map (distance
  * to closest obstacle in meter).
+ *
+ * Very large maps can instead be stored in tiles (see setMapTiled() and
+ * TiledGridMap2D); the cell and coordinate queries work the same for both,
+ * but binaryMap() and distanceMap() are then empty.
+ *
+ * Copies share the map data (copy-on-write): it is only duplicated when a
+ * copy changes it in place, e.g. by updateCells() or setBinaryMapAtCell().
  */
 class GridMap2D {
 public:
   GridMap2D();
   ///@brief Create from nav_msgs::OccupancyGrid
   GridMap2D(const nav_msgs::OccupancyGridConstPtr& grid_map, bool unknown_as_obstacle = false);
-  ///@brief Copy constructor, performs a deep copy of underlying data structures
+  ///@brief Copy constructor, shares the underlying data structures until
+  /// one of the copies changes them (copy-on-write)
   GridMap2D(const GridMap2D& other);
+  ///@brief Assignment, shares the data like the copy constructor
+  GridMap2D& operator=(const GridMap2D& other);
   virtual ~GridMap2D();
 
   void mapToWorld(unsigned int mx, unsigned int my, double& wx, double& wy) const;
@@ -67,6 +90,14 @@ public:
    */
   void inflateMap(double inflationRaduis);
 
+  /**
+   * @brief A copy of this map inflated by inflation_radius (see inflateMap()).
+   * The inflated map is computed on the first request per radius and then
+   * shared by all returned copies (copy-on-write) until this map changes.
+   * Thread-safe with other const methods.
+   */
+  GridMap2DPtr inflatedMap(double inflation_radius) const;
+
   /// Distance (in m) between two map coordinates (indices)
   inline double worldDist(unsigned x1, unsigned y1, unsigned x2, unsigned y2){
     return worldDist(cv::Point(x1, y1), cv::Point(x2, y2));
@@ -92,14 +123,38 @@ public:
   /// Returns distance (in m) at map cell <mx, my> in m; -1 if out of bounds!
   float distanceMapAtCell(unsigned int mx, unsigned int my) const;
 
+  /**
+   * @brief Batch version of distanceMapAt() for n world coordinates: one
+   * coordinate transform (without divisions) and bounds check per point and
+   * a gather from the distance map.
+   *
+   * @param wx, wy Arrays of n world coordinates (in m).
+   * @param[out] dist Array of n distances (in m); -1 if out of bounds.
+   * @param interpolate Interpolate bilinearly between the centers of the
+   *   neighboring cells instead of returning the value of the containing cell.
+   * @return The number of coordinates within the map bounds.
+   */
+  size_t distanceMapAt(const double* wx, const double* wy, size_t n, float* dist,
+                       bool interpolate = false) const;
+
+  /// Batch version of distanceMapAtCell() (additionally bounds checked: -1 if out of bounds).
+  /// @return The number of cells within the map bounds.
+  size_t distanceMapAtCells(const unsigned int* mx, const unsigned int* my, size_t n,
+                            float* dist) const;
+
+  /// Batch version of isOccupiedAt(): occupied[i] is 1 iff <wx[i], wy[i]> is
+  /// occupied or out of bounds. @return The number of occupied coordinates.
+  size_t isOccupiedAt(const double* wx, const double* wy, size_t n, uchar* occupied) const;
+
   /// Returns map value at world coordinates <wx, wy>; out of bounds will be returned as 0!
   uchar binaryMapAt(double wx, double wy) const;
 
   /// Returns map value at map cell <mx, my>; out of bounds will be returned as 0!
   uchar binaryMapAtCell(unsigned int mx, unsigned int my) const;
 
-  /// Returns map value at map cell <mx, my>; out of bounds will be returned as 0!
-  uchar& binaryMapAtCell(unsigned int mx, unsigned int my);
+  /// Sets the map value at map cell <mx, my> (not bounds checked), duplicating
+  /// shared data first. The distance map is not updated, see updateCells().
+  void setBinaryMapAtCell(unsigned int mx, unsigned int my, uchar value);
 
   /// @return true if map is occupied at world coordinate <wx, wy>. Out of bounds
   /// 		will be returned as occupied.
@@ -111,6 +166,65 @@ public:
   ///@brief Initialize map from a ROS OccupancyGrid message
   void setMap(const nav_msgs::OccupancyGridConstPtr& grid_map, bool unknown_as_obstacle = false);
 
+  /**
+   * @brief Initialize map from a ROS OccupancyGrid message into sparse tiles
+   * (see TiledGridMap2D) instead of dense cv::Mats: only tiles which are not
+   * completely free or occupied store their cells, and distances are computed
+   * per tile on their first query.
+   *
+   * Distances are exact up to halo_radius and clamped to it beyond, so it has
+   * to be at least the largest distance queried or inflated by.
+   * Whole-map operations (binaryMap(), distanceMap(), saveCache()) are not
+   * available for tiled maps; setMap(cv::Mat) switches back to dense storage.
+   *
+   * @param tile_size Edge length of the tiles in cells.
+   * @param halo_radius In m.
+   */
+  void setMapTiled(const nav_msgs::OccupancyGridConstPtr& grid_map, bool unknown_as_obstacle,
+                   unsigned tile_size, double halo_radius);
+
+  /// @return true if the map is stored in tiles (see setMapTiled()).
+  inline bool isTiled() const {return bool(m_tiledMap);}
+
+  /// @return the tiled storage of the map (NULL if dense).
+  inline TiledGridMap2DPtr tiledMap() const {return m_tiledMap;}
+
+  /**
+   * @brief Same as setMap(grid_map, unknown_as_obstacle), but reuses the
+   * binary and distance map of cache_file (see loadCache()) if it has been
+   * created from the same map content. Otherwise the map is converted and,
+   * if save_cache, the cache file is (re)written. Rewriting the file for
+   * each changing map is expensive, so users of changing maps should rather
+   * call saveCache() once the map has been stable.
+   *
+   * @return true if the map has been loaded from the cache.
+   */
+  bool setMapCached(const nav_msgs::OccupancyGridConstPtr& grid_map, bool unknown_as_obstacle,
+                    const std::string& cache_file, bool save_cache = false);
+
+  /**
+   * @brief Writes map info, frame, binary and distance map to a cache file
+   * (written to a unique temporary file first and then renamed, so
+   * concurrent readers never see a partial file and concurrent writers do
+   * not interfere).
+   *
+   * @param content_hash Stored with the data to identify the source map (see contentHash()).
+   */
+  bool saveCache(const std::string& filename, boost::uint64_t content_hash) const;
+
+  /**
+   * @brief Loads a cache file written by saveCache(). The file is mapped into
+   * memory (copy-on-write) and the binary and distance map refer to it
+   * without copying (so shallow copies of them must not outlive this map).
+   *
+   * @param content_hash if not 0, the file is only used if it has been saved with this hash.
+   * @return false (and the map unchanged) if the file is missing, invalid or does not match.
+   */
+  bool loadCache(const std::string& filename, boost::uint64_t content_hash = 0);
+
+  /// @return a hash (64 bit FNV-1a) of everything that determines the GridMap2D of a message.
+  static boost::uint64_t contentHash(const nav_msgs::OccupancyGrid& grid_map, bool unknown_as_obstacle);
+
   ///@brief Converts back into a ROS nav_msgs::OccupancyGrid msg
   nav_msgs::OccupancyGrid toOccupancyGridMsg() const;
 
@@ -120,16 +234,43 @@ public:
   ///@brief Recalculate the internal distance map. Required after manual changes to the grid map data.
   void updateDistanceMap();
 
+  /**
+   * @brief Changes the occupancy of single cells and repairs the distance map
+   * only where it is affected (dynamic Euclidean distance transform after
+   * Lau et al., "Improved updating of Euclidean distance maps and Voronoi
+   * diagrams", IROS 2010), instead of recomputing it as updateDistanceMap().
+   *
+   * The first call sets up the bookkeeping (nearest obstacle per cell) with
+   * one pass over the whole map; setMap(), inflateMap() and
+   * updateDistanceMap() discard it again.
+   *
+   * @param changed_occupied Map cells (x: mx, y: my) which became occupied.
+   * @param changed_free Map cells which became free.
+   * For tiled maps (see setMapTiled()) the distances of the affected tiles
+   * are recomputed on their next query instead, and the bounding box covers
+   * all cells within the halo radius of the changed ones. If no cell
+   * actually changes, the map keeps its revision().
+   *
+   * @return The bounding box of all cells whose distance changed in map
+   * coordinates (x: mx, y: my; empty if none).
+   */
+  cv::Rect updateCells(const std::vector<cv::Point>& changed_occupied,
+                       const std::vector<cv::Point>& changed_free);
+
+  /// @return an identifier of the map content: unique to each change of the
+  /// map, and the same for copies as long as none of them changes.
+  inline unsigned long revision() const {return m_revision;}
+
   inline const nav_msgs::MapMetaData& getInfo() const {return m_mapInfo;}
   inline float getResolution() const {return m_mapInfo.resolution; }
   /// returns the tf frame ID of the map (usually "/map")
   inline const std::string getFrameID() const {return m_frameId;}
-  /// @return the cv::Mat distance image.
+  /// @return the cv::Mat distance image (empty for tiled maps).
   const cv::Mat& distanceMap() const {return m_distMap;}
-  /// @return the cv::Mat binary image.
+  /// @return the cv::Mat binary image (empty for tiled maps).
   const cv::Mat& binaryMap() const {return m_binaryMap;}
   /// @return the size of the cv::Mat binary image. Note that x/y are swapped wrt. height/width
-  inline const cv::Size size() const {return m_binaryMap.size();}
+  inline const cv::Size size() const {return m_tiledMap ? cv::Size(m_mapInfo.height, m_mapInfo.width) : m_binaryMap.size();}
 
   const static uchar FREE = 255;  ///< char value for "free": 255
   const static uchar OCCUPIED = 0; ///< char value for "free": 0
@@ -139,11 +280,51 @@ protected:
   cv::Mat m_distMap;		///< distance map (in meter)
   nav_msgs::MapMetaData m_mapInfo;
   std::string m_frameId;	///< "map" frame where ROS OccupancyGrid originated from
+  unsigned long m_revision; ///< see revision()
 
-};
+  /// @return true if updateCells() would change any cell within the map.
+  bool cellsChange(const std::vector<cv::Point>& changed_occupied,
+                   const std::vector<cv::Point>& changed_free) const;
+  /// updateCells() for tiled maps: invalidates the distances of the affected tiles.
+  cv::Rect updateTiledCells(const std::vector<cv::Point>& changed_occupied,
+                            const std::vector<cv::Point>& changed_free);
+  /// distanceMapAt() (batch version) for tiled maps
+  size_t tiledDistanceMapAt(const double* wx, const double* wy, size_t n, float* dist,
+                            bool interpolate) const;
 
-typedef boost::shared_ptr< GridMap2D> GridMap2DPtr;
-typedef boost::shared_ptr<const GridMap2D> GridMap2DConstPtr;
+  /// Sets up the bookkeeping of updateCells() for the current binary map.
+  void initDynamicDistanceMap();
+  /// Processes the queue of updateCells(), optionally recording the changed cells.
+  void propagateDynamicDistanceMap(std::vector<int>* changed_cells);
+  /// Duplicates data shared with copies (copy-on-write) before changes of it
+  /// in place and discards the derived maps.
+  void makeUnique();
+  /// Discards the derived maps of inflatedMap() and assigns a new revision
+  /// (after changes of the map).
+  void clearDerivedMaps();
+
+  /// @return true if the cell with the (row-major) index is an obstacle.
+  inline bool isObstacleIndex(int idx) const {return m_binaryMap.data[idx] == OCCUPIED;}
+
+  /// Tiled storage replacing m_binaryMap and m_distMap if set (see setMapTiled())
+  TiledGridMap2DPtr m_tiledMap;
+
+  /// Memory mapping of loadCache() the maps may refer to (released with the last copy).
+  boost::shared_ptr<void> m_mappedCache;
+
+  /// Maps derived from this one by inflatedMap() (radius => map)
+  mutable std::map<double, GridMap2DConstPtr> m_inflatedMaps;
+  mutable boost::mutex m_derivedMapsMutex; ///< guards m_inflatedMaps
+
+  /// Bookkeeping of updateCells() (empty until its first call), indexed by
+  /// mx * height + my (the memory layout of m_binaryMap):
+  std::vector<int> m_edtObstacle;   ///< index of the closest obstacle (-1: none)
+  std::vector<int> m_edtDist2;      ///< squared distance to it in cells
+  std::vector<unsigned char> m_edtRaise; ///< cleared, waiting to be raised
+  /// Open list (squared distance, index) of the update
+  std::vector<std::pair<int, int> > m_edtOpen;
+
+};
 }
 
 #endif /* GRIDMAP2D_H_ */
@@ -0,0 +1,163 @@
+/*
+ * A simple 2D gridmap structure
+ *
+ * Copyright 2011 Armin Hornung, University of Freiburg
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the University of Freiburg nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef GRIDMAP2D_TILEDGRIDMAP2D_H_
+#define GRIDMAP2D_TILEDGRIDMAP2D_H_
+
+#include <opencv2/core/core.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <vector>
+
+
+namespace gridmap_2d{
+/**
+ * @brief Sparse storage of the binary and distance map of a GridMap2D in
+ * square tiles of fixed size, for maps too large to keep densely in memory.
+ *
+ * A tile which is completely free or completely occupied (e.g. unknown space
+ * treated as obstacle) only stores that value. The distance map of a tile is
+ * computed on its first query from the tile and a halo of neighboring cells
+ * around it, so it is exact up to the halo radius; larger distances are
+ * clamped to it. Tiles without an obstacle within the halo never allocate one.
+ *
+ * Cells are addressed as map coordinates <mx, my> like in GridMap2D.
+ * Distance queries are thread-safe, everything else is not.
+ */
+class TiledGridMap2D {
+public:
+  /**
+   * @param width, height Map size in cells.
+   * @param resolution Cell size in m.
+   * @param tile_size Edge length of the tiles in cells.
+   * @param halo_radius Distances (in m) are exact up to this radius.
+   */
+  TiledGridMap2D(unsigned width, unsigned height, double resolution,
+                 unsigned tile_size, double halo_radius);
+  ///@brief Copy constructor, performs a deep copy of all tiles
+  TiledGridMap2D(const TiledGridMap2D& other);
+  virtual ~TiledGridMap2D();
+
+  /**
+   * @brief Sets all cells from row-major nav_msgs::OccupancyGrid data
+   * (width * height values) and discards the distance maps.
+   *
+   * @param occupied_threshold Values above are occupied.
+   */
+  void setData(const signed char* data, bool unknown_as_obstacle, int occupied_threshold);
+
+  /// Binary map value (GridMap2D::FREE / OCCUPIED) at map cell <mx, my> (not bounds checked)
+  uchar binaryAt(unsigned int mx, unsigned int my) const;
+
+  /// Writable binary map value at map cell <mx, my>, allocates a uniform tile.
+  /// Call invalidateDistances() after changes.
+  uchar& binaryAt(unsigned int mx, unsigned int my);
+
+  /// Distance (in m, at most haloRadius()) at map cell <mx, my> (not bounds checked)
+  float distanceAt(unsigned int mx, unsigned int my) const;
+
+  /// Discards all distance maps, they are recomputed on demand.
+  void invalidateDistances();
+
+  /// Discards the distance maps which depend on the map cells in cells (x: mx, y: my).
+  void invalidateDistances(const cv::Rect& cells);
+
+  /// Marks all cells within radius (in m, clamped to less than haloRadius()) of an obstacle as occupied.
+  void inflate(double radius);
+
+  /**
+   * @brief Compares the binary cells with a map of the same size and tiling.
+   * @param[out] changed Map cells (x: mx, y: my) of the tiles which differ.
+   * @return false if the maps are not tiled the same way (nothing compared).
+   */
+  bool changedTiles(const TiledGridMap2D& other, std::vector<cv::Rect>& changed) const;
+
+  /// @return the number of bytes allocated for the tiles.
+  size_t bytesAllocated() const;
+
+  /// @return the number of tiles storing cells (not only a uniform value).
+  size_t numAllocatedTiles() const;
+
+  inline unsigned width() const {return m_width;}
+  inline unsigned height() const {return m_height;}
+  inline unsigned tileSize() const {return m_tileSize;}
+  inline double haloRadius() const {return m_haloDist;}
+
+protected:
+  /// State of the distance map of a tile
+  enum DistanceState {
+    DIST_PENDING,   ///< not computed yet
+    DIST_FAR,       ///< no obstacle within the halo, all distances are the halo radius
+    DIST_ZERO,      ///< completely occupied, all distances are 0
+    DIST_COMPUTED   ///< stored in Tile::dist
+  };
+
+  struct Tile {
+    Tile() : uniform(255), dist_state(DIST_PENDING) {}
+    uchar uniform;      ///< value of all cells if binary is empty
+    cv::Mat binary;     ///< tile_size x tile_size cells (rows: mx) or empty
+    /// distance map (in m) if dist_state is DIST_COMPUTED, written by computeDistances()
+    mutable cv::Mat dist;
+    mutable boost::atomic<int> dist_state;
+  };
+
+  inline size_t tileIndex(unsigned int mx, unsigned int my) const {
+    return size_t(mx / m_tileSize) * m_tilesY + my / m_tileSize;
+  }
+
+  /// Computes the distance map of a tile (if still pending). @return its DistanceState
+  int computeDistances(size_t tile_idx) const;
+
+  /// Cells of a tile within the map: x: first my, y: first mx (as cv::Rect within a cv::Mat)
+  cv::Rect tileRect(size_t tile_idx) const;
+
+  unsigned m_width;
+  unsigned m_height;
+  double m_resolution;
+  unsigned m_tileSize;
+  unsigned m_tilesX;      ///< number of tiles along mx
+  unsigned m_tilesY;      ///< number of tiles along my
+  unsigned m_haloCells;   ///< halo radius in cells (rounded up)
+  float m_haloDist;       ///< halo radius in m
+  std::vector<boost::shared_ptr<Tile> > m_tiles; ///< row-major by (mx, my) tile coordinates
+  mutable boost::mutex m_distanceMutex; ///< serializes computeDistances()
+
+private:
+  TiledGridMap2D& operator=(const TiledGridMap2D&);
+};
+
+typedef boost::shared_ptr<TiledGridMap2D> TiledGridMap2DPtr;
+}
+
+#endif /* GRIDMAP2D_TILEDGRIDMAP2D_H_ */
@@ -0,0 +1,323 @@
+/*
+ * A simple 2D gridmap structure
+ *
+ * Copyright 2011 Armin Hornung, University of Freiburg
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the University of Freiburg nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gridmap_2d/CostToGo2D.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace gridmap_2d{
+
+namespace {
+/// Instance of CostToGo2D::shared()
+CostToGo2D g_sharedCostToGo;
+
+/// Replaces the blocked marks of costs by CostToGoField::INFINITE_COST and clamps them to bound
+void finishTile(std::vector<int>& costs, int blocked, int bound){
+  for (size_t i = 0; i < costs.size(); ++i){
+    if (costs[i] == blocked)
+      costs[i] = CostToGoField::INFINITE_COST;
+    else if (costs[i] > bound)
+      costs[i] = bound;
+  }
+}
+}
+
+CostToGoField::CostToGoField()
+: m_mapRevision(0), m_inflationRadius(0.0), m_rootX(0), m_rootY(0), m_width(0), m_height(0),
+  m_bound(std::numeric_limits<int>::max()), m_straightCost(1), m_diagonalCost(1),
+  m_tileSize(0), m_tilesY(0), m_untouchedCost(INFINITE_COST)
+{
+
+}
+
+void CostToGoField::compute(const GridMap2D& map, double inflation_radius, unsigned int root_x, unsigned int root_y,
+                            const std::vector<cv::Point>& stop_cells, double termination_margin){
+  m_mapRevision = map.revision();
+  m_inflationRadius = inflation_radius;
+  m_rootX = root_x;
+  m_rootY = root_y;
+  m_width = map.getInfo().width;
+  m_height = map.getInfo().height;
+  m_bound = std::numeric_limits<int>::max();
+  m_untouchedCost = INFINITE_COST;
+  // in mm as SBPL's 2D grid search
+  m_straightCost = std::max(1, int(map.getResolution() * 1000.0 + 0.5));
+  m_diagonalCost = std::max(1, int(map.getResolution() * 1000.0 * sqrt(2.0) + 0.5));
+
+  const int width = m_width;
+  const int height = m_height;
+  m_cost.clear();
+  m_tiles.clear();
+  m_tileSize = map.isTiled() ? map.tiledMap()->tileSize() : 0;
+  if (m_tileSize == 0){
+    m_cost.assign(size_t(width) * height, int(INFINITE_COST));
+  } else {
+    m_tilesY = (m_height + m_tileSize - 1) / m_tileSize;
+    m_tiles.resize(size_t((m_width + m_tileSize - 1) / m_tileSize) * m_tilesY);
+  }
+  if (root_x >= m_width || root_y >= m_height)
+    return;
+
+  // blocked cells of the inflated map are marked in the costs themselves (same
+  // memory layout as the distance map), i.e. the search needs no second grid;
+  // tiles of a tiled map are marked when the search first reaches them, so
+  // only the distances of these map tiles are computed
+  const int blocked = BLOCKED_COST;
+  if (m_tileSize == 0){
+    for (int x = 0; x < width; ++x){
+      const float* dist = map.distanceMap().ptr<float>(x);
+      int* row = &m_cost[size_t(x) * height];
+      for (int y = 0; y < height; ++y){
+        if (dist[y] <= inflation_radius)
+          row[y] = blocked;
+      }
+    }
+  }
+
+  if (cell(map, root_x, root_y) == blocked){
+    finishCosts();
+    return;
+  }
+
+  // cells to settle before an early termination
+  std::vector<size_t> stops;
+  if (termination_margin >= 0.0){
+    for (size_t i = 0; i < stop_cells.size(); ++i){
+      const cv::Point& p = stop_cells[i];
+      if (p.x >= 0 && p.y >= 0 && p.x < width && p.y < height)
+        stops.push_back(size_t(p.x) * height + p.y);
+    }
+    std::sort(stops.begin(), stops.end());
+    stops.erase(std::unique(stops.begin(), stops.end()), stops.end());
+  }
+  size_t num_open_stops = stops.size();
+  int max_stop_cost = 0;
+  int cost_limit = std::numeric_limits<int>::max();
+
+  typedef std::pair<int, size_t> Entry; // costs, cell index mx * height + my
+  const std::greater<Entry> cmp;
+  std::vector<Entry> open;
+  cell(map, root_x, root_y) = 0;
+  open.push_back(Entry(0, size_t(root_x) * height + root_y));
+  while (!open.empty()){
+    std::pop_heap(open.begin(), open.end(), cmp);
+    const Entry entry = open.back();
+    open.pop_back();
+    const size_t idx = entry.second;
+    const int x = idx / height;
+    const int y = idx % height;
+    if (entry.first > cell(map, x, y))
+      continue; // outdated entry
+
+    if (entry.first > cost_limit){
+      // everything below has been settled
+      m_bound = entry.first;
+      break;
+    }
+
+    if (num_open_stops > 0 && std::binary_search(stops.begin(), stops.end(), idx)){
+      max_stop_cost = std::max(max_stop_cost, entry.first);
+      if (--num_open_stops == 0)
+        cost_limit = int(std::min(max_stop_cost * (1.0 + termination_margin), double(INFINITE_COST - 1)));
+    }
+
+    for (int dx = -1; dx <= 1; ++dx){
+      const int nx = x + dx;
+      if (nx < 0 || nx >= width)
+        continue;
+      for (int dy = -1; dy <= 1; ++dy){
+        const int ny = y + dy;
+        if ((dx == 0 && dy == 0) || ny < 0 || ny >= height)
+          continue;
+        int& n_cost = cell(map, nx, ny);
+        if (n_cost == blocked)
+          continue;
+        const bool diagonal = (dx != 0 && dy != 0);
+        if (diagonal && (cell(map, nx, y) == blocked || cell(map, x, ny) == blocked))
+          continue;
+
+        const int new_cost = entry.first + (diagonal ? m_diagonalCost : m_straightCost);
+        if (new_cost < n_cost){
+          n_cost = new_cost;
+          open.push_back(Entry(new_cost, size_t(nx) * height + ny));
+          std::push_heap(open.begin(), open.end(), cmp);
+        }
+      }
+    }
+  }
+
+  finishCosts();
+}
+
+void CostToGoField::initTile(const GridMap2D& map, unsigned int tx, unsigned int ty, std::vector<int>& tile) const{
+  tile.assign(size_t(m_tileSize) * m_tileSize, int(INFINITE_COST));
+  const unsigned int x_end = std::min((tx + 1) * m_tileSize, m_width);
+  const unsigned int y_end = std::min((ty + 1) * m_tileSize, m_height);
+  for (unsigned int x = tx * m_tileSize; x < x_end; ++x){
+    int* row = &tile[size_t(x - tx * m_tileSize) * m_tileSize];
+    for (unsigned int y = ty * m_tileSize; y < y_end; ++y){
+      if (map.distanceMapAtCell(x, y) <= m_inflationRadius)
+        row[y - ty * m_tileSize] = BLOCKED_COST;
+    }
+  }
+}
+
+void CostToGoField::finishCosts(){
+  // blocked cells are unreachable; the costs of all free cells not settled
+  // are at least the bound
+  finishTile(m_cost, BLOCKED_COST, m_bound);
+  for (size_t i = 0; i < m_tiles.size(); ++i)
+    finishTile(m_tiles[i], BLOCKED_COST, m_bound);
+  // tiles never reached are unreachable after a complete search
+  if (m_bound < std::numeric_limits<int>::max())
+    m_untouchedCost = m_bound;
+}
+
+bool CostToGoField::extractPath(unsigned int mx, unsigned int my, std::vector<cv::Point>& cells) const{
+  cells.clear();
+  if (mx >= m_width || my >= m_height || costAt(mx, my) >= INFINITE_COST || !isExact(mx, my))
+    return false;
+
+  const int width = m_width;
+  const int height = m_height;
+  int x = mx;
+  int y = my;
+  cells.push_back(cv::Point(x, y));
+  while (x != int(m_rootX) || y != int(m_rootY)){
+    const int cost = costAt(x, y);
+    bool found = false;
+    // a neighbor whose cost plus the move exactly gives the cost of the cell
+    for (int dx = -1; dx <= 1 && !found; ++dx){
+      const int nx = x + dx;
+      if (nx < 0 || nx >= width)
+        continue;
+      for (int dy = -1; dy <= 1; ++dy){
+        const int ny = y + dy;
+        if ((dx == 0 && dy == 0) || ny < 0 || ny >= height)
+          continue;
+        const bool diagonal = (dx != 0 && dy != 0);
+        if (diagonal && (costAt(nx, y) >= INFINITE_COST || costAt(x, ny) >= INFINITE_COST))
+          continue;
+        if (costAt(nx, ny) + (diagonal ? m_diagonalCost : m_straightCost) == cost){
+          x = nx;
+          y = ny;
+          found = true;
+          break;
+        }
+      }
+    }
+    if (!found){
+      cells.clear();
+      return false;
+    }
+    cells.push_back(cv::Point(x, y));
+  }
+  return true;
+}
+
+
+CostToGo2D::CostToGo2D(unsigned int cache_size)
+: m_cacheSize(std::max(cache_size, 1u))
+{
+
+}
+
+CostToGo2D::~CostToGo2D(){
+
+}
+
+CostToGo2D& CostToGo2D::shared(){
+  return g_sharedCostToGo;
+}
+
+CostToGoFieldConstPtr CostToGo2D::get(const GridMap2D& map, double inflation_radius,
+                                      unsigned int root_x, unsigned int root_y,
+                                      const std::vector<cv::Point>& stop_cells,
+                                      double termination_margin){
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    CostToGoFieldConstPtr field = lookup(map, inflation_radius, root_x, root_y, stop_cells);
+    if (field)
+      return field;
+  }
+
+  boost::shared_ptr<CostToGoField> field(new CostToGoField());
+  field->compute(map, inflation_radius, root_x, root_y, stop_cells, termination_margin);
+
+  boost::mutex::scoped_lock lock(m_mutex);
+  // replaces a field with the same key which did not cover the stop cells
+  for (std::list<CostToGoFieldConstPtr>::iterator it = m_fields.begin(); it != m_fields.end(); ++it){
+    if ((*it)->mapRevision() == field->mapRevision() && (*it)->inflationRadius() == inflation_radius
+        && (*it)->rootX() == root_x && (*it)->rootY() == root_y){
+      m_fields.erase(it);
+      break;
+    }
+  }
+  m_fields.push_front(field);
+  while (m_fields.size() > m_cacheSize)
+    m_fields.pop_back();
+  return field;
+}
+
+CostToGoFieldConstPtr CostToGo2D::lookup(const GridMap2D& map, double inflation_radius,
+                                         unsigned int root_x, unsigned int root_y,
+                                         const std::vector<cv::Point>& stop_cells){
+  for (std::list<CostToGoFieldConstPtr>::iterator it = m_fields.begin(); it != m_fields.end(); ++it){
+    const CostToGoField& field = **it;
+    if (field.mapRevision() != map.revision() || field.inflationRadius() != inflation_radius
+        || field.rootX() != root_x || field.rootY() != root_y)
+      continue;
+
+    for (size_t i = 0; i < stop_cells.size(); ++i){
+      const cv::Point& p = stop_cells[i];
+      if (p.x >= 0 && p.y >= 0 && p.x < int(field.width()) && p.y < int(field.height())
+          && !field.isExact(p.x, p.y))
+        return CostToGoFieldConstPtr();
+    }
+    m_fields.splice(m_fields.begin(), m_fields, it);
+    return m_fields.front();
+  }
+  return CostToGoFieldConstPtr();
+}
+
+void CostToGo2D::reserve(unsigned int cache_size){
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_cacheSize = std::max(m_cacheSize, cache_size);
+}
+
+void CostToGo2D::clear(){
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_fields.clear();
+}
+
+}
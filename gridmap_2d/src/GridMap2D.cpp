@@ -31,27 +31,138 @@
 #include "gridmap_2d/GridMap2D.h"
 #include <ros/console.h>
 
+#include <boost/atomic.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+
 namespace gridmap_2d{
 
+namespace {
+/// Version of the cache file format (part of the content hash)
+const boost::uint32_t CACHE_VERSION = 1;
+const char CACHE_MAGIC[8] = {'G', 'R', 'I', 'D', 'M', 'A', 'P', '2'};
+
+/// Fixed size header of a cache file, followed by the frame id and (each
+/// aligned to CACHE_ALIGNMENT) the binary and the distance map in the memory
+/// layout of the cv::Mats. Host byte order.
+struct CacheHeader {
+  char magic[8];
+  boost::uint32_t version;
+  boost::uint32_t frame_id_length;
+  boost::uint64_t content_hash;
+  boost::uint32_t width;
+  boost::uint32_t height;
+  double resolution;
+  double origin[7]; ///< position x, y, z, orientation x, y, z, w
+  boost::uint64_t binary_offset;
+  boost::uint64_t dist_offset;
+};
+
+const size_t CACHE_ALIGNMENT = 64;
+
+inline boost::uint64_t alignOffset(boost::uint64_t offset){
+  return (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+}
+
+inline boost::uint64_t fnv1a(const void* data, size_t size, boost::uint64_t hash){
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i){
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/// @return true if the data of mat may be referenced by another cv::Mat
+/// (mapping: the memory mapping owning external data, if any)
+inline bool isShared(const cv::Mat& mat, const boost::shared_ptr<void>& mapping){
+  if (mat.empty())
+    return false;
+  if (mat.u)
+    return mat.u->refcount > 1;
+  return !mapping || mapping.use_count() > 1;
+}
+
+/// Source of GridMap2D::revision()
+boost::atomic<unsigned long> g_lastRevision(0);
+
+inline unsigned long newRevision(){
+  return g_lastRevision.fetch_add(1) + 1;
+}
+
+/// Deleter of the memory mapping of a cache file
+struct CacheUnmapper {
+  explicit CacheUnmapper(size_t length) : length(length) {}
+  void operator()(void* addr) const { munmap(addr, length); }
+  size_t length;
+};
+}
+
 GridMap2D::GridMap2D()
-: m_frameId("/map")
+: m_frameId("/map"), m_revision(newRevision())
 {
 
 }
 
-GridMap2D::GridMap2D(const nav_msgs::OccupancyGridConstPtr& gridMap, bool unknown_as_obstacle) {
+GridMap2D::GridMap2D(const nav_msgs::OccupancyGridConstPtr& gridMap, bool unknown_as_obstacle)
+: m_revision(0)
+{
 
   setMap(gridMap, unknown_as_obstacle);
 
 }
 
 GridMap2D::GridMap2D(const GridMap2D& other)
- : m_binaryMap(other.m_binaryMap.clone()),
-   m_distMap(other.m_distMap.clone()),
+ : m_binaryMap(other.m_binaryMap),
+   m_distMap(other.m_distMap),
    m_mapInfo(other.m_mapInfo),
-   m_frameId(other.m_frameId)
+   m_frameId(other.m_frameId),
+   m_revision(other.m_revision),
+   m_tiledMap(other.m_tiledMap),
+   m_mappedCache(other.m_mappedCache)
 {
+  // the bookkeeping of updateCells() is rebuilt on demand
+  boost::mutex::scoped_lock lock(other.m_derivedMapsMutex);
+  m_inflatedMaps = other.m_inflatedMaps;
+}
 
+GridMap2D& GridMap2D::operator=(const GridMap2D& other){
+  if (this == &other)
+    return *this;
+
+  m_binaryMap = other.m_binaryMap;
+  m_distMap = other.m_distMap;
+  m_mapInfo = other.m_mapInfo;
+  m_frameId = other.m_frameId;
+  m_revision = other.m_revision;
+  m_tiledMap = other.m_tiledMap;
+  m_mappedCache = other.m_mappedCache;
+  // the bookkeeping of updateCells() is rebuilt on demand
+  m_edtObstacle.clear();
+  m_edtDist2.clear();
+  m_edtRaise.clear();
+  m_edtOpen.clear();
+
+  std::map<double, GridMap2DConstPtr> inflated_maps;
+  {
+    boost::mutex::scoped_lock lock(other.m_derivedMapsMutex);
+    inflated_maps = other.m_inflatedMaps;
+  }
+  boost::mutex::scoped_lock lock(m_derivedMapsMutex);
+  m_inflatedMaps.swap(inflated_maps);
+  return *this;
 }
 
 GridMap2D::~GridMap2D() {
@@ -59,6 +170,16 @@ GridMap2D::~GridMap2D() {
 }
 
 void GridMap2D::updateDistanceMap(){
+  m_edtObstacle.clear();
+  clearDerivedMaps();
+  if (m_tiledMap){
+    makeUnique();
+    m_tiledMap->invalidateDistances();
+    return;
+  }
+  // recomputed completely, no need to copy shared data
+  if (isShared(m_distMap, m_mappedCache))
+    m_distMap.release();
   cv::distanceTransform(m_binaryMap, m_distMap, cv::DIST_L2, cv::DIST_MASK_PRECISE);
   // distance map now contains distance in meters:
   m_distMap = m_distMap * m_mapInfo.resolution;
@@ -67,63 +188,275 @@ void GridMap2D::updateDistanceMap(){
 void GridMap2D::setMap(const nav_msgs::OccupancyGridConstPtr& grid_map, bool unknown_as_obstacle){
   m_mapInfo = grid_map->info;
   m_frameId = grid_map->header.frame_id;
-  // allocate map structs so that x/y in the world correspond to x/y in the image
-  // (=> cv::Mat is rotated by 90 deg, because it's row-major!)
-  m_binaryMap = cv::Mat(m_mapInfo.width, m_mapInfo.height, CV_8UC1);
-  m_distMap = cv::Mat(m_binaryMap.size(), CV_32FC1);
-
-  std::vector<signed char>::const_iterator mapDataIter = grid_map->data.begin();
+  m_edtObstacle.clear();
+  m_tiledMap.reset();
+  clearDerivedMaps();
 
   //TODO check / param
-  unsigned char map_occ_thres = 70;
-
-  // iterate over map, store in image
-  // (0,0) is lower left corner of OccupancyGrid
-  for(unsigned int j = 0; j < m_mapInfo.height; ++j){
-    for(unsigned int i = 0; i < m_mapInfo.width; ++i){
-      if (*mapDataIter > map_occ_thres
-          || (unknown_as_obstacle && *mapDataIter < 0))
-      {
-        m_binaryMap.at<uchar>(i,j) = OCCUPIED;
-      } else{
-        m_binaryMap.at<uchar>(i,j) = FREE;
-      }
-      ++mapDataIter;
+  const int map_occ_thres = 70;
+
+  if (grid_map->data.size() != size_t(m_mapInfo.width) * m_mapInfo.height){
+    ROS_ERROR("OccupancyGrid with %zu cells does not match its size %d x %d",
+              grid_map->data.size(), m_mapInfo.width, m_mapInfo.height);
+    m_binaryMap = cv::Mat(m_mapInfo.width, m_mapInfo.height, CV_8UC1, cv::Scalar(OCCUPIED));
+    updateDistanceMap();
+    return;
+  }
+
+  // threshold the row-major message data as a whole (vectorized by OpenCV):
+  // (0,0) is lower left corner of OccupancyGrid, i.e. the rows are y
+  cv::Mat grid;
+  if (m_mapInfo.width > 0 && m_mapInfo.height > 0){
+    const cv::Mat data(m_mapInfo.height, m_mapInfo.width, CV_8SC1,
+                       const_cast<signed char*>(&grid_map->data[0]));
+    // FREE (255) iff not above the threshold
+    cv::compare(data, cv::Scalar(map_occ_thres), grid, cv::CMP_LE);
+    if (unknown_as_obstacle){
+      cv::Mat known;
+      cv::compare(data, cv::Scalar(0), known, cv::CMP_GE);
+      cv::bitwise_and(grid, known, grid);
     }
+  } else {
+    grid = cv::Mat(m_mapInfo.height, m_mapInfo.width, CV_8UC1);
   }
+  // allocate map structs so that x/y in the world correspond to x/y in the image
+  // (=> cv::Mat is rotated by 90 deg, because it's row-major!); the blocked
+  // transpose writes into new buffers, copies of the old maps may still be in use
+  m_binaryMap.release();
+  cv::transpose(grid, m_binaryMap);
+  m_distMap = cv::Mat(m_binaryMap.size(), CV_32FC1);
+  m_mappedCache.reset();
 
   updateDistanceMap();
 
   ROS_INFO("GridMap2D created with %d x %d cells at %f resolution.", m_mapInfo.width, m_mapInfo.height, m_mapInfo.resolution);
 }
 
+void GridMap2D::setMapTiled(const nav_msgs::OccupancyGridConstPtr& grid_map, bool unknown_as_obstacle,
+                            unsigned tile_size, double halo_radius){
+  if (grid_map->data.size() != size_t(grid_map->info.width) * grid_map->info.height){
+    ROS_ERROR("OccupancyGrid with %zu cells does not match its size %d x %d",
+              grid_map->data.size(), grid_map->info.width, grid_map->info.height);
+    setMap(grid_map, unknown_as_obstacle);
+    return;
+  }
+
+  m_mapInfo = grid_map->info;
+  m_frameId = grid_map->header.frame_id;
+  m_edtObstacle.clear();
+  m_binaryMap.release();
+  m_distMap.release();
+  m_mappedCache.reset();
+  clearDerivedMaps();
+
+  const int map_occ_thres = 70;
+  m_tiledMap.reset(new TiledGridMap2D(m_mapInfo.width, m_mapInfo.height, m_mapInfo.resolution,
+                                      tile_size, halo_radius));
+  if (!grid_map->data.empty())
+    m_tiledMap->setData(&grid_map->data[0], unknown_as_obstacle, map_occ_thres);
+
+  ROS_INFO("Tiled GridMap2D created with %d x %d cells at %f resolution (%zu of %u x %u tiles allocated, %zu KB).",
+           m_mapInfo.width, m_mapInfo.height, m_mapInfo.resolution, m_tiledMap->numAllocatedTiles(),
+           tile_size, tile_size, m_tiledMap->bytesAllocated() / 1024);
+}
+
+bool GridMap2D::setMapCached(const nav_msgs::OccupancyGridConstPtr& grid_map, bool unknown_as_obstacle,
+                             const std::string& cache_file, bool save_cache){
+  if (cache_file.empty()){
+    setMap(grid_map, unknown_as_obstacle);
+    return false;
+  }
+
+  const boost::uint64_t hash = contentHash(*grid_map, unknown_as_obstacle);
+  if (loadCache(cache_file, hash)){
+    ROS_INFO("GridMap2D with %d x %d cells loaded from cache %s", m_mapInfo.width, m_mapInfo.height, cache_file.c_str());
+    return true;
+  }
+
+  setMap(grid_map, unknown_as_obstacle);
+  if (save_cache && !saveCache(cache_file, hash))
+    ROS_WARN("Could not write the GridMap2D cache %s", cache_file.c_str());
+  return false;
+}
+
+bool GridMap2D::saveCache(const std::string& filename, boost::uint64_t content_hash) const{
+  if (m_tiledMap || !m_binaryMap.isContinuous() || !m_distMap.isContinuous()
+      || m_binaryMap.size() != m_distMap.size() || m_distMap.type() != CV_32FC1)
+    return false;
+
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+  header.version = CACHE_VERSION;
+  header.frame_id_length = m_frameId.size();
+  header.content_hash = content_hash;
+  header.width = m_mapInfo.width;
+  header.height = m_mapInfo.height;
+  header.resolution = m_mapInfo.resolution;
+  header.origin[0] = m_mapInfo.origin.position.x;
+  header.origin[1] = m_mapInfo.origin.position.y;
+  header.origin[2] = m_mapInfo.origin.position.z;
+  header.origin[3] = m_mapInfo.origin.orientation.x;
+  header.origin[4] = m_mapInfo.origin.orientation.y;
+  header.origin[5] = m_mapInfo.origin.orientation.z;
+  header.origin[6] = m_mapInfo.origin.orientation.w;
+
+  const size_t num_cells = size_t(m_binaryMap.rows) * m_binaryMap.cols;
+  header.binary_offset = alignOffset(sizeof(header) + header.frame_id_length);
+  header.dist_offset = alignOffset(header.binary_offset + num_cells);
+
+  // unique temporary file in the same directory, renamed when complete
+  std::vector<char> tmp_name(filename.begin(), filename.end());
+  const char suffix[] = ".tmpXXXXXX";
+  tmp_name.insert(tmp_name.end(), suffix, suffix + sizeof(suffix));
+  int fd = mkstemp(&tmp_name[0]);
+  if (fd < 0)
+    return false;
+  const std::string tmp_filename(&tmp_name[0]);
+  // mkstemp() creates the file only readable by the owner
+  fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  FILE* file = fdopen(fd, "wb");
+  if (!file){
+    close(fd);
+    remove(tmp_filename.c_str());
+    return false;
+  }
+
+  const char padding[CACHE_ALIGNMENT] = {0};
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+      && fwrite(m_frameId.data(), 1, m_frameId.size(), file) == m_frameId.size()
+      && fwrite(padding, 1, header.binary_offset - sizeof(header) - header.frame_id_length, file)
+         == header.binary_offset - sizeof(header) - header.frame_id_length
+      && fwrite(m_binaryMap.data, 1, num_cells, file) == num_cells
+      && fwrite(padding, 1, header.dist_offset - header.binary_offset - num_cells, file)
+         == header.dist_offset - header.binary_offset - num_cells
+      && fwrite(m_distMap.data, sizeof(float), num_cells, file) == num_cells;
+  ok = (fclose(file) == 0) && ok;
+
+  if (!ok || rename(tmp_filename.c_str(), filename.c_str()) != 0){
+    remove(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool GridMap2D::loadCache(const std::string& filename, boost::uint64_t content_hash){
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || size_t(file_stat.st_size) < sizeof(CacheHeader)){
+    close(fd);
+    return false;
+  }
+  const size_t length = file_stat.st_size;
+  // private mapping: changes of the maps (e.g. updateCells()) do not reach the file
+  void* addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return false;
+  boost::shared_ptr<void> mapping(addr, CacheUnmapper(length));
+
+  CacheHeader header;
+  memcpy(&header, addr, sizeof(header));
+  const size_t num_cells = size_t(header.width) * header.height;
+  if (memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0
+      || header.version != CACHE_VERSION
+      || (content_hash != 0 && header.content_hash != content_hash)
+      || sizeof(header) + header.frame_id_length > header.binary_offset
+      || header.binary_offset + num_cells > header.dist_offset
+      || header.dist_offset + num_cells * sizeof(float) > length
+      || header.dist_offset % sizeof(float) != 0
+      || num_cells == 0)
+    return false;
+
+  unsigned char* data = static_cast<unsigned char*>(addr);
+  m_frameId.assign(reinterpret_cast<const char*>(data + sizeof(header)), header.frame_id_length);
+  m_mapInfo = nav_msgs::MapMetaData();
+  m_mapInfo.width = header.width;
+  m_mapInfo.height = header.height;
+  m_mapInfo.resolution = header.resolution;
+  m_mapInfo.origin.position.x = header.origin[0];
+  m_mapInfo.origin.position.y = header.origin[1];
+  m_mapInfo.origin.position.z = header.origin[2];
+  m_mapInfo.origin.orientation.x = header.origin[3];
+  m_mapInfo.origin.orientation.y = header.origin[4];
+  m_mapInfo.origin.orientation.z = header.origin[5];
+  m_mapInfo.origin.orientation.w = header.origin[6];
+
+  // x/y layout as in setMap() (width rows of height cells)
+  m_binaryMap = cv::Mat(header.width, header.height, CV_8UC1, data + header.binary_offset);
+  m_distMap = cv::Mat(header.width, header.height, CV_32FC1, data + header.dist_offset);
+  m_mappedCache = mapping;
+  m_tiledMap.reset();
+  m_edtObstacle.clear();
+  clearDerivedMaps();
+
+  return true;
+}
+
+boost::uint64_t GridMap2D::contentHash(const nav_msgs::OccupancyGrid& grid_map, bool unknown_as_obstacle){
+  boost::uint64_t hash = 14695981039346656037ULL;
+  const boost::uint32_t version = CACHE_VERSION;
+  const unsigned char unknown = unknown_as_obstacle;
+  const nav_msgs::MapMetaData& info = grid_map.info;
+  const double origin[7] = {info.origin.position.x, info.origin.position.y, info.origin.position.z,
+                            info.origin.orientation.x, info.origin.orientation.y,
+                            info.origin.orientation.z, info.origin.orientation.w};
+  hash = fnv1a(&version, sizeof(version), hash);
+  hash = fnv1a(&unknown, sizeof(unknown), hash);
+  hash = fnv1a(&info.width, sizeof(info.width), hash);
+  hash = fnv1a(&info.height, sizeof(info.height), hash);
+  hash = fnv1a(&info.resolution, sizeof(info.resolution), hash);
+  hash = fnv1a(origin, sizeof(origin), hash);
+  hash = fnv1a(grid_map.header.frame_id.data(), grid_map.header.frame_id.size(), hash);
+  if (!grid_map.data.empty())
+    hash = fnv1a(&grid_map.data[0], grid_map.data.size(), hash);
+  // 0 means "any hash" for loadCache()
+  return hash ? hash : 1;
+}
+
 nav_msgs::OccupancyGrid GridMap2D::toOccupancyGridMsg() const{
   nav_msgs::OccupancyGrid msg;
   msg.header.frame_id = m_frameId;
   msg.header.stamp = ros::Time::now();
   msg.info = m_mapInfo;
   msg.data.resize(msg.info.height*msg.info.width);
-
-  // iterate over map, store in data
-  std::vector<signed char>::iterator mapDataIter = msg.data.begin();
-  // (0,0) is lower left corner of OccupancyGrid
-  for(unsigned int j = 0; j < m_mapInfo.height; ++j){
-    for(unsigned int i = 0; i < m_mapInfo.width; ++i){
-      if (m_binaryMap.at<uchar>(i,j) == OCCUPIED)
-        *mapDataIter = 100;
-      else
-        *mapDataIter = 0;
-
-      ++mapDataIter;
+  if (msg.data.empty())
+    return msg;
+
+  if (m_tiledMap){
+    const TiledGridMap2D& tiles = *m_tiledMap;
+    std::vector<signed char>::iterator mapDataIter = msg.data.begin();
+    for(unsigned int j = 0; j < m_mapInfo.height; ++j){
+      for(unsigned int i = 0; i < m_mapInfo.width; ++i){
+        *mapDataIter = (tiles.binaryAt(i, j) == OCCUPIED) ? 100 : 0;
+        ++mapDataIter;
+      }
     }
+    return msg;
   }
 
+  // reverse of setMap(): transpose into the row-major message layout and
+  // map OCCUPIED to 100, FREE to 0
+  cv::Mat grid;
+  cv::transpose(m_binaryMap, grid);
+  cv::Mat occupied;
+  cv::compare(grid, cv::Scalar(OCCUPIED), occupied, cv::CMP_EQ);
+  cv::Mat data(m_mapInfo.height, m_mapInfo.width, CV_8UC1, &msg.data[0]);
+  cv::bitwise_and(occupied, cv::Scalar(100), data);
+
   return msg;
 }
 
 void GridMap2D::setMap(const cv::Mat& binaryMap){
   m_binaryMap = binaryMap.clone();
   m_distMap = cv::Mat(m_binaryMap.size(), CV_32FC1);
+  m_edtObstacle.clear();
+  m_tiledMap.reset();
+  m_mappedCache.reset();
+  clearDerivedMaps();
 
   cv::distanceTransform(m_binaryMap, m_distMap, cv::DIST_L2, cv::DIST_MASK_PRECISE);
   // distance map now contains distance in meters:
@@ -134,12 +467,278 @@ void GridMap2D::setMap(const cv::Mat& binaryMap){
 }
 
 void GridMap2D::inflateMap(double inflationRadius){
+  clearDerivedMaps();
+  if (m_tiledMap){
+    makeUnique();
+    m_tiledMap->inflate(inflationRadius);
+    return;
+  }
   m_binaryMap = (m_distMap > inflationRadius );
+  m_edtObstacle.clear();
+  if (isShared(m_distMap, m_mappedCache))
+    m_distMap.release();
   // recompute distance map with new binary map:
   cv::distanceTransform(m_binaryMap, m_distMap, cv::DIST_L2, cv::DIST_MASK_PRECISE);
   m_distMap = m_distMap * m_mapInfo.resolution;
 }
 
+GridMap2DPtr GridMap2D::inflatedMap(double inflation_radius) const{
+  GridMap2DConstPtr inflated;
+  {
+    boost::mutex::scoped_lock lock(m_derivedMapsMutex);
+    std::map<double, GridMap2DConstPtr>::const_iterator it = m_inflatedMaps.find(inflation_radius);
+    if (it != m_inflatedMaps.end())
+      inflated = it->second;
+  }
+
+  if (!inflated){
+    // without the lock, the copy constructor takes it
+    GridMap2DPtr map(new GridMap2D(*this));
+    map->inflateMap(inflation_radius);
+    boost::mutex::scoped_lock lock(m_derivedMapsMutex);
+    // keep the map of a concurrent call if there was one
+    inflated = m_inflatedMaps.insert(std::make_pair(inflation_radius, GridMap2DConstPtr(map))).first->second;
+  }
+  return GridMap2DPtr(new GridMap2D(*inflated));
+}
+
+void GridMap2D::makeUnique(){
+  clearDerivedMaps();
+  if (isShared(m_binaryMap, m_mappedCache))
+    m_binaryMap = m_binaryMap.clone();
+  if (isShared(m_distMap, m_mappedCache))
+    m_distMap = m_distMap.clone();
+  if (m_tiledMap && m_tiledMap.use_count() > 1)
+    m_tiledMap.reset(new TiledGridMap2D(*m_tiledMap));
+}
+
+void GridMap2D::clearDerivedMaps(){
+  m_revision = newRevision();
+  boost::mutex::scoped_lock lock(m_derivedMapsMutex);
+  m_inflatedMaps.clear();
+}
+
+bool GridMap2D::cellsChange(const std::vector<cv::Point>& changed_occupied,
+                            const std::vector<cv::Point>& changed_free) const{
+  const int rows = m_mapInfo.width;
+  const int cols = m_mapInfo.height;
+  for (size_t i = 0; i < changed_occupied.size() + changed_free.size(); ++i){
+    const bool occupied = i < changed_occupied.size();
+    const cv::Point& p = occupied ? changed_occupied[i] : changed_free[i - changed_occupied.size()];
+    if (p.x < 0 || p.y < 0 || p.x >= rows || p.y >= cols)
+      continue;
+    if ((binaryMapAtCell(p.x, p.y) == OCCUPIED) != occupied)
+      return true;
+  }
+  return false;
+}
+
+cv::Rect GridMap2D::updateCells(const std::vector<cv::Point>& changed_occupied,
+                                const std::vector<cv::Point>& changed_free){
+  if (!m_tiledMap && m_binaryMap.empty())
+    return cv::Rect();
+  // without an actual change, copies keep sharing the data and the derived
+  // maps (and caches keyed on the revision) stay valid
+  if (!cellsChange(changed_occupied, changed_free))
+    return cv::Rect();
+
+  if (m_tiledMap)
+    return updateTiledCells(changed_occupied, changed_free);
+
+  makeUnique();
+
+  if (m_edtObstacle.empty())
+    initDynamicDistanceMap();
+
+  const int rows = m_binaryMap.rows;
+  const int cols = m_binaryMap.cols;
+  std::vector<int> changed_cells;
+
+  for (size_t i = 0; i < changed_occupied.size(); ++i){
+    const cv::Point& p = changed_occupied[i];
+    if (p.x < 0 || p.y < 0 || p.x >= rows || p.y >= cols)
+      continue;
+    int idx = p.x * cols + p.y;
+    if (isObstacleIndex(idx))
+      continue;
+
+    m_binaryMap.data[idx] = OCCUPIED;
+    m_edtObstacle[idx] = idx;
+    m_edtDist2[idx] = 0;
+    m_edtRaise[idx] = 0;
+    m_edtOpen.push_back(std::make_pair(0, idx));
+    std::push_heap(m_edtOpen.begin(), m_edtOpen.end(), std::greater<std::pair<int, int> >());
+    changed_cells.push_back(idx);
+  }
+
+  for (size_t i = 0; i < changed_free.size(); ++i){
+    const cv::Point& p = changed_free[i];
+    if (p.x < 0 || p.y < 0 || p.x >= rows || p.y >= cols)
+      continue;
+    int idx = p.x * cols + p.y;
+    if (!isObstacleIndex(idx))
+      continue;
+
+    m_binaryMap.data[idx] = FREE;
+    m_edtObstacle[idx] = -1;
+    m_edtDist2[idx] = std::numeric_limits<int>::max();
+    m_edtRaise[idx] = 1;
+    m_edtOpen.push_back(std::make_pair(0, idx));
+    std::push_heap(m_edtOpen.begin(), m_edtOpen.end(), std::greater<std::pair<int, int> >());
+    changed_cells.push_back(idx);
+  }
+
+  propagateDynamicDistanceMap(&changed_cells);
+
+  // write back the repaired distances (in meter)
+  if (changed_cells.empty())
+    return cv::Rect();
+
+  // without any obstacle, cells get the length of the map diagonal
+  const float no_obstacle_dist = sqrt(float(rows) * rows + float(cols) * cols) * m_mapInfo.resolution;
+  int min_x = rows, min_y = cols, max_x = -1, max_y = -1;
+  float* dist = m_distMap.ptr<float>();
+  for (size_t i = 0; i < changed_cells.size(); ++i){
+    int idx = changed_cells[i];
+    int x = idx / cols;
+    int y = idx % cols;
+    min_x = std::min(min_x, x);
+    min_y = std::min(min_y, y);
+    max_x = std::max(max_x, x);
+    max_y = std::max(max_y, y);
+
+    if (m_edtObstacle[idx] < 0)
+      dist[idx] = no_obstacle_dist;
+    else
+      dist[idx] = sqrt(float(m_edtDist2[idx])) * m_mapInfo.resolution;
+  }
+
+  return cv::Rect(min_x, min_y, max_x - min_x + 1, max_y - min_y + 1);
+}
+
+cv::Rect GridMap2D::updateTiledCells(const std::vector<cv::Point>& changed_occupied,
+                                     const std::vector<cv::Point>& changed_free){
+  makeUnique();
+  const int rows = m_mapInfo.width;
+  const int cols = m_mapInfo.height;
+  int min_x = rows, min_y = cols, max_x = -1, max_y = -1;
+  for (size_t i = 0; i < changed_occupied.size() + changed_free.size(); ++i){
+    const bool occupied = i < changed_occupied.size();
+    const cv::Point& p = occupied ? changed_occupied[i] : changed_free[i - changed_occupied.size()];
+    if (p.x < 0 || p.y < 0 || p.x >= rows || p.y >= cols)
+      continue;
+    const uchar value = occupied ? OCCUPIED : FREE;
+    if (binaryMapAtCell(p.x, p.y) == value)
+      continue;
+
+    m_tiledMap->binaryAt(p.x, p.y) = value;
+    min_x = std::min(min_x, p.x);
+    min_y = std::min(min_y, p.y);
+    max_x = std::max(max_x, p.x);
+    max_y = std::max(max_y, p.y);
+  }
+  if (max_x < 0)
+    return cv::Rect();
+
+  // distances can only change within the halo around the changed cells
+  const cv::Rect changed(min_x, min_y, max_x - min_x + 1, max_y - min_y + 1);
+  m_tiledMap->invalidateDistances(changed);
+  const int halo = int(std::ceil(m_tiledMap->haloRadius() / m_mapInfo.resolution));
+  const int x0 = std::max(min_x - halo, 0);
+  const int y0 = std::max(min_y - halo, 0);
+  const int x1 = std::min(max_x + halo, rows - 1);
+  const int y1 = std::min(max_y + halo, cols - 1);
+  return cv::Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+}
+
+void GridMap2D::initDynamicDistanceMap(){
+  assert(m_binaryMap.isContinuous() && m_distMap.isContinuous());
+
+  const int num_cells = m_binaryMap.rows * m_binaryMap.cols;
+  m_edtObstacle.assign(num_cells, -1);
+  m_edtDist2.assign(num_cells, std::numeric_limits<int>::max());
+  m_edtRaise.assign(num_cells, 0);
+  m_edtOpen.clear();
+
+  for (int idx = 0; idx < num_cells; ++idx){
+    if (isObstacleIndex(idx)){
+      m_edtObstacle[idx] = idx;
+      m_edtDist2[idx] = 0;
+      m_edtOpen.push_back(std::make_pair(0, idx));
+    }
+  }
+  // all priorities are equal, the list already is a heap
+  propagateDynamicDistanceMap(NULL);
+}
+
+void GridMap2D::propagateDynamicDistanceMap(std::vector<int>* changed_cells){
+  const int rows = m_binaryMap.rows;
+  const int cols = m_binaryMap.cols;
+  const std::greater<std::pair<int, int> > cmp;
+
+  while (!m_edtOpen.empty()){
+    std::pop_heap(m_edtOpen.begin(), m_edtOpen.end(), cmp);
+    const int idx = m_edtOpen.back().second;
+    m_edtOpen.pop_back();
+
+    const int x = idx / cols;
+    const int y = idx % cols;
+    const bool raise = m_edtRaise[idx];
+    const int obstacle = m_edtObstacle[idx];
+    // stale entry of a cell that has been updated again in the meantime
+    if (!raise && (obstacle < 0 || !isObstacleIndex(obstacle)))
+      continue;
+    const int ox = obstacle / cols;
+    const int oy = obstacle % cols;
+
+    for (int dx = -1; dx <= 1; ++dx){
+      const int nx = x + dx;
+      if (nx < 0 || nx >= rows)
+        continue;
+      for (int dy = -1; dy <= 1; ++dy){
+        const int ny = y + dy;
+        if ((dx == 0 && dy == 0) || ny < 0 || ny >= cols)
+          continue;
+        const int n = nx * cols + ny;
+        if (m_edtRaise[n])
+          continue;
+
+        if (raise){
+          // RAISE: clear the cells whose closest obstacle has been removed,
+          // the others restart the LOWER wave into the cleared region
+          const int n_obstacle = m_edtObstacle[n];
+          if (n_obstacle < 0)
+            continue;
+          if (!isObstacleIndex(n_obstacle)){
+            m_edtOpen.push_back(std::make_pair(m_edtDist2[n], n));
+            m_edtObstacle[n] = -1;
+            m_edtDist2[n] = std::numeric_limits<int>::max();
+            m_edtRaise[n] = 1;
+            if (changed_cells)
+              changed_cells->push_back(n);
+          } else {
+            m_edtOpen.push_back(std::make_pair(m_edtDist2[n], n));
+          }
+          std::push_heap(m_edtOpen.begin(), m_edtOpen.end(), cmp);
+        } else {
+          // LOWER: propagate the closest obstacle
+          const int d2 = (nx - ox) * (nx - ox) + (ny - oy) * (ny - oy);
+          if (d2 < m_edtDist2[n]){
+            m_edtDist2[n] = d2;
+            m_edtObstacle[n] = obstacle;
+            m_edtOpen.push_back(std::make_pair(d2, n));
+            std::push_heap(m_edtOpen.begin(), m_edtOpen.end(), cmp);
+            if (changed_cells)
+              changed_cells->push_back(n);
+          }
+        }
+      }
+    }
+    if (raise)
+      m_edtRaise[idx] = 0;
+  }
+}
+
 // See costmap2D for mapToWorld / worldToMap implementations:
 
 void GridMap2D::mapToWorld(unsigned int mx, unsigned int my, double& wx, double& wy) const {
@@ -176,37 +775,207 @@ float GridMap2D::distanceMapAt(double wx, double wy) const{
   unsigned mx, my;
 
   if (worldToMap(wx, wy, mx, my))
-    return m_distMap.at<float>(mx, my);
+    return distanceMapAtCell(mx, my);
   else
     return -1.0f;
 }
 
 
+size_t GridMap2D::distanceMapAt(const double* wx, const double* wy, size_t n, float* dist,
+                                bool interpolate) const{
+  if (m_tiledMap)
+    return tiledDistanceMapAt(wx, wy, n, dist, interpolate);
+
+  const double inv_res = 1.0 / m_mapInfo.resolution;
+  const double ox = m_mapInfo.origin.position.x;
+  const double oy = m_mapInfo.origin.position.y;
+  const int width = m_mapInfo.width;
+  const int height = m_mapInfo.height;
+  const float* dist_map = m_distMap.ptr<float>();
+  // row-major cv::Mat with x as row (see setMap())
+  const int cols = m_distMap.cols;
+
+  size_t num_valid = 0;
+  for (size_t i = 0; i < n; ++i){
+    const double fx = (wx[i] - ox) * inv_res;
+    const double fy = (wy[i] - oy) * inv_res;
+    if (!(fx >= 0.0 && fy >= 0.0 && fx < width && fy < height)){
+      dist[i] = -1.0f;
+      continue;
+    }
+    ++num_valid;
+
+    if (!interpolate){
+      dist[i] = dist_map[int(fx) * cols + int(fy)];
+      continue;
+    }
+
+    // bilinear interpolation between the cell centers (clamped at the border)
+    const double u = std::max(fx - 0.5, 0.0);
+    const double v = std::max(fy - 0.5, 0.0);
+    const int x0 = std::min(int(u), width - 1);
+    const int y0 = std::min(int(v), height - 1);
+    const int x1 = std::min(x0 + 1, width - 1);
+    const int y1 = std::min(y0 + 1, height - 1);
+    const float tx = float(std::min(u - x0, 1.0));
+    const float ty = float(std::min(v - y0, 1.0));
+    const float d00 = dist_map[x0 * cols + y0];
+    const float d01 = dist_map[x0 * cols + y1];
+    const float d10 = dist_map[x1 * cols + y0];
+    const float d11 = dist_map[x1 * cols + y1];
+    dist[i] = (1.0f - tx) * ((1.0f - ty) * d00 + ty * d01) +
+              tx * ((1.0f - ty) * d10 + ty * d11);
+  }
+  return num_valid;
+}
+
+
+size_t GridMap2D::tiledDistanceMapAt(const double* wx, const double* wy, size_t n, float* dist,
+                                     bool interpolate) const{
+  const double inv_res = 1.0 / m_mapInfo.resolution;
+  const double ox = m_mapInfo.origin.position.x;
+  const double oy = m_mapInfo.origin.position.y;
+  const int width = m_mapInfo.width;
+  const int height = m_mapInfo.height;
+  const TiledGridMap2D& tiles = *m_tiledMap;
+
+  size_t num_valid = 0;
+  for (size_t i = 0; i < n; ++i){
+    const double fx = (wx[i] - ox) * inv_res;
+    const double fy = (wy[i] - oy) * inv_res;
+    if (!(fx >= 0.0 && fy >= 0.0 && fx < width && fy < height)){
+      dist[i] = -1.0f;
+      continue;
+    }
+    ++num_valid;
+
+    if (!interpolate){
+      dist[i] = tiles.distanceAt(int(fx), int(fy));
+      continue;
+    }
+
+    // same interpolation as for the dense map
+    const double u = std::max(fx - 0.5, 0.0);
+    const double v = std::max(fy - 0.5, 0.0);
+    const int x0 = std::min(int(u), width - 1);
+    const int y0 = std::min(int(v), height - 1);
+    const int x1 = std::min(x0 + 1, width - 1);
+    const int y1 = std::min(y0 + 1, height - 1);
+    const float tx = float(std::min(u - x0, 1.0));
+    const float ty = float(std::min(v - y0, 1.0));
+    const float d00 = tiles.distanceAt(x0, y0);
+    const float d01 = tiles.distanceAt(x0, y1);
+    const float d10 = tiles.distanceAt(x1, y0);
+    const float d11 = tiles.distanceAt(x1, y1);
+    dist[i] = (1.0f - tx) * ((1.0f - ty) * d00 + ty * d01) +
+              tx * ((1.0f - ty) * d10 + ty * d11);
+  }
+  return num_valid;
+}
+
+
+size_t GridMap2D::distanceMapAtCells(const unsigned int* mx, const unsigned int* my, size_t n,
+                                     float* dist) const{
+  if (m_tiledMap){
+    size_t num_valid = 0;
+    for (size_t i = 0; i < n; ++i){
+      if (mx[i] < m_mapInfo.width && my[i] < m_mapInfo.height){
+        dist[i] = m_tiledMap->distanceAt(mx[i], my[i]);
+        ++num_valid;
+      } else {
+        dist[i] = -1.0f;
+      }
+    }
+    return num_valid;
+  }
+
+  const float* dist_map = m_distMap.ptr<float>();
+  const int cols = m_distMap.cols;
+
+  size_t num_valid = 0;
+  for (size_t i = 0; i < n; ++i){
+    if (mx[i] < m_mapInfo.width && my[i] < m_mapInfo.height){
+      dist[i] = dist_map[mx[i] * cols + my[i]];
+      ++num_valid;
+    } else {
+      dist[i] = -1.0f;
+    }
+  }
+  return num_valid;
+}
+
+
+size_t GridMap2D::isOccupiedAt(const double* wx, const double* wy, size_t n, uchar* occupied) const{
+  if (m_tiledMap){
+    size_t num_occupied = 0;
+    for (size_t i = 0; i < n; ++i){
+      occupied[i] = isOccupiedAt(wx[i], wy[i]);
+      num_occupied += occupied[i];
+    }
+    return num_occupied;
+  }
+
+  const double inv_res = 1.0 / m_mapInfo.resolution;
+  const double ox = m_mapInfo.origin.position.x;
+  const double oy = m_mapInfo.origin.position.y;
+  const int width = m_mapInfo.width;
+  const int height = m_mapInfo.height;
+  const uchar* binary_map = m_binaryMap.ptr<uchar>();
+  const int cols = m_binaryMap.cols;
+
+  size_t num_occupied = 0;
+  for (size_t i = 0; i < n; ++i){
+    const double fx = (wx[i] - ox) * inv_res;
+    const double fy = (wy[i] - oy) * inv_res;
+    if (fx >= 0.0 && fy >= 0.0 && fx < width && fy < height)
+      occupied[i] = binary_map[int(fx) * cols + int(fy)] < FREE;
+    else
+      occupied[i] = 1;
+    num_occupied += occupied[i];
+  }
+  return num_occupied;
+}
+
+
 uchar GridMap2D::binaryMapAt(double wx, double wy) const{
   unsigned mx, my;
 
   if (worldToMap(wx, wy, mx, my))
-    return m_binaryMap.at<uchar>(mx, my);
+    return binaryMapAtCell(mx, my);
   else
     return 0;
 }
 
 float GridMap2D::distanceMapAtCell(unsigned int mx, unsigned int my) const{
+  if (m_tiledMap)
+    return m_tiledMap->distanceAt(mx, my);
   return m_distMap.at<float>(mx, my);
 }
 
 
 uchar GridMap2D::binaryMapAtCell(unsigned int mx, unsigned int my) const{
+  // (the non-const TiledGridMap2D::binaryAt() would allocate the tile)
+  if (m_tiledMap)
+    return static_cast<const TiledGridMap2D&>(*m_tiledMap).binaryAt(mx, my);
   return m_binaryMap.at<uchar>(mx, my);
 }
 
-uchar& GridMap2D::binaryMapAtCell(unsigned int mx, unsigned int my){
-  return m_binaryMap.at<uchar>(mx, my);
+void GridMap2D::setBinaryMapAtCell(unsigned int mx, unsigned int my, uchar value){
+  // reads never detach, i.e. unchanged maps keep their revision
+  if (binaryMapAtCell(mx, my) == value)
+    return;
+
+  makeUnique();
+  if (m_tiledMap){
+    m_tiledMap->binaryAt(mx, my) = value;
+    m_tiledMap->invalidateDistances(cv::Rect(mx, my, 1, 1));
+  } else
+    m_binaryMap.at<uchar>(mx, my) = value;
 }
 
 
 bool GridMap2D::isOccupiedAtCell(unsigned int mx, unsigned int my) const{
-  return (m_binaryMap.at<uchar>(mx, my) < 255);
+  return (binaryMapAtCell(mx, my) < 255);
 }
 
 
@@ -0,0 +1,317 @@
+/*
+ * A simple 2D gridmap structure
+ *
+ * Copyright 2011 Armin Hornung, University of Freiburg
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the University of Freiburg nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gridmap_2d/TiledGridMap2D.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <ros/console.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace gridmap_2d{
+
+namespace {
+const uchar FREE = 255;
+const uchar OCCUPIED = 0;
+}
+
+TiledGridMap2D::TiledGridMap2D(unsigned width, unsigned height, double resolution,
+                               unsigned tile_size, double halo_radius)
+: m_width(width), m_height(height), m_resolution(resolution),
+  m_tileSize(std::max(tile_size, 1u)),
+  m_haloCells(unsigned(std::ceil(std::max(halo_radius, 0.0) / resolution))),
+  m_haloDist(float(std::max(halo_radius, 0.0)))
+{
+  m_tilesX = (m_width + m_tileSize - 1) / m_tileSize;
+  m_tilesY = (m_height + m_tileSize - 1) / m_tileSize;
+  m_tiles.resize(size_t(m_tilesX) * m_tilesY);
+  for (size_t i = 0; i < m_tiles.size(); ++i)
+    m_tiles[i].reset(new Tile());
+}
+
+TiledGridMap2D::TiledGridMap2D(const TiledGridMap2D& other)
+: m_width(other.m_width), m_height(other.m_height), m_resolution(other.m_resolution),
+  m_tileSize(other.m_tileSize), m_tilesX(other.m_tilesX), m_tilesY(other.m_tilesY),
+  m_haloCells(other.m_haloCells), m_haloDist(other.m_haloDist)
+{
+  boost::mutex::scoped_lock lock(other.m_distanceMutex);
+  m_tiles.resize(other.m_tiles.size());
+  for (size_t i = 0; i < m_tiles.size(); ++i){
+    const Tile& src = *other.m_tiles[i];
+    m_tiles[i].reset(new Tile());
+    m_tiles[i]->uniform = src.uniform;
+    m_tiles[i]->binary = src.binary.clone();
+    m_tiles[i]->dist = src.dist.clone();
+    m_tiles[i]->dist_state.store(src.dist_state.load());
+  }
+}
+
+TiledGridMap2D::~TiledGridMap2D() {
+
+}
+
+cv::Rect TiledGridMap2D::tileRect(size_t tile_idx) const{
+  const unsigned mx0 = unsigned(tile_idx / m_tilesY) * m_tileSize;
+  const unsigned my0 = unsigned(tile_idx % m_tilesY) * m_tileSize;
+  return cv::Rect(my0, mx0, std::min(m_tileSize, m_height - my0), std::min(m_tileSize, m_width - mx0));
+}
+
+void TiledGridMap2D::setData(const signed char* data, bool unknown_as_obstacle, int occupied_threshold){
+  // cells beyond the map border stay free, they are never queried
+  cv::Mat scratch(m_tileSize, m_tileSize, CV_8UC1);
+  for (size_t t = 0; t < m_tiles.size(); ++t){
+    Tile& tile = *m_tiles[t];
+    const cv::Rect rect = tileRect(t);
+    scratch.setTo(cv::Scalar(FREE));
+
+    int num_occupied = 0;
+    // the message is row-major in y, i.e. contiguous along mx
+    for (int ly = 0; ly < rect.width; ++ly){
+      const signed char* row = data + size_t(rect.x + ly) * m_width + rect.y;
+      for (int lx = 0; lx < rect.height; ++lx){
+        if (row[lx] > occupied_threshold || (unknown_as_obstacle && row[lx] < 0)){
+          scratch.at<uchar>(lx, ly) = OCCUPIED;
+          ++num_occupied;
+        }
+      }
+    }
+
+    if (num_occupied == 0 || num_occupied == rect.area()){
+      tile.uniform = num_occupied ? OCCUPIED : FREE;
+      tile.binary.release();
+    } else {
+      tile.binary = scratch.clone();
+    }
+  }
+  invalidateDistances();
+}
+
+uchar TiledGridMap2D::binaryAt(unsigned int mx, unsigned int my) const{
+  const Tile& tile = *m_tiles[tileIndex(mx, my)];
+  if (tile.binary.empty())
+    return tile.uniform;
+  return tile.binary.at<uchar>(mx % m_tileSize, my % m_tileSize);
+}
+
+uchar& TiledGridMap2D::binaryAt(unsigned int mx, unsigned int my){
+  Tile& tile = *m_tiles[tileIndex(mx, my)];
+  if (tile.binary.empty())
+    tile.binary = cv::Mat(m_tileSize, m_tileSize, CV_8UC1, cv::Scalar(tile.uniform));
+  return tile.binary.at<uchar>(mx % m_tileSize, my % m_tileSize);
+}
+
+float TiledGridMap2D::distanceAt(unsigned int mx, unsigned int my) const{
+  const size_t t = tileIndex(mx, my);
+  const Tile& tile = *m_tiles[t];
+  int state = tile.dist_state.load(boost::memory_order_acquire);
+  if (state == DIST_PENDING)
+    state = computeDistances(t);
+
+  switch (state){
+  case DIST_ZERO:
+    return 0.0f;
+  case DIST_COMPUTED:
+    return tile.dist.at<float>(mx % m_tileSize, my % m_tileSize);
+  default:
+    return m_haloDist;
+  }
+}
+
+int TiledGridMap2D::computeDistances(size_t tile_idx) const{
+  boost::mutex::scoped_lock lock(m_distanceMutex);
+  const Tile& tile = *m_tiles[tile_idx];
+  int state = tile.dist_state.load(boost::memory_order_relaxed);
+  if (state != DIST_PENDING)
+    return state;
+
+  if (tile.binary.empty() && tile.uniform == OCCUPIED){
+    tile.dist_state.store(DIST_ZERO, boost::memory_order_release);
+    return DIST_ZERO;
+  }
+
+  // the tile and its halo (within the map), x: my, y: mx as in the binary maps
+  const cv::Rect rect = tileRect(tile_idx);
+  const int halo = m_haloCells;
+  const int wx0 = std::max(rect.y - halo, 0);
+  const int wy0 = std::max(rect.x - halo, 0);
+  const int wx1 = std::min(rect.y + rect.height + halo, int(m_width));
+  const int wy1 = std::min(rect.x + rect.width + halo, int(m_height));
+  cv::Mat window(wx1 - wx0, wy1 - wy0, CV_8UC1, cv::Scalar(FREE));
+
+  bool has_obstacle = false;
+  const int ts = m_tileSize;
+  for (int tx = wx0 / ts; tx <= (wx1 - 1) / ts; ++tx){
+    for (int ty = wy0 / ts; ty <= (wy1 - 1) / ts; ++ty){
+      const Tile& neighbor = *m_tiles[size_t(tx) * m_tilesY + ty];
+      if (neighbor.binary.empty() && neighbor.uniform == FREE)
+        continue;
+      has_obstacle = true;
+
+      const int ox0 = std::max(tx * ts, wx0);
+      const int oy0 = std::max(ty * ts, wy0);
+      const int ox1 = std::min((tx + 1) * ts, wx1);
+      const int oy1 = std::min((ty + 1) * ts, wy1);
+      cv::Mat dst = window(cv::Rect(oy0 - wy0, ox0 - wx0, oy1 - oy0, ox1 - ox0));
+      if (neighbor.binary.empty())
+        dst.setTo(cv::Scalar(neighbor.uniform));
+      else
+        neighbor.binary(cv::Rect(oy0 - ty * ts, ox0 - tx * ts, oy1 - oy0, ox1 - ox0)).copyTo(dst);
+    }
+  }
+
+  if (!has_obstacle){
+    tile.dist_state.store(DIST_FAR, boost::memory_order_release);
+    return DIST_FAR;
+  }
+
+  cv::Mat window_dist;
+  cv::distanceTransform(window, window_dist, cv::DIST_L2, cv::DIST_MASK_PRECISE);
+  // distance in meters, clamped to the halo beyond which it is not exact:
+  window_dist = window_dist * m_resolution;
+  cv::min(window_dist, double(m_haloDist), window_dist);
+
+  tile.dist = cv::Mat(m_tileSize, m_tileSize, CV_32FC1, cv::Scalar(m_haloDist));
+  cv::Mat dst = tile.dist(cv::Rect(0, 0, rect.width, rect.height));
+  window_dist(cv::Rect(rect.x - wy0, rect.y - wx0, rect.width, rect.height)).copyTo(dst);
+  tile.dist_state.store(DIST_COMPUTED, boost::memory_order_release);
+  return DIST_COMPUTED;
+}
+
+void TiledGridMap2D::invalidateDistances(){
+  for (size_t t = 0; t < m_tiles.size(); ++t){
+    m_tiles[t]->dist.release();
+    m_tiles[t]->dist_state.store(DIST_PENDING);
+  }
+}
+
+void TiledGridMap2D::invalidateDistances(const cv::Rect& cells){
+  if (cells.empty() || m_tiles.empty())
+    return;
+
+  // every tile whose halo overlaps the cells
+  const int halo = m_haloCells;
+  const int ts = m_tileSize;
+  const int tx0 = std::max(cells.x - halo, 0) / ts;
+  const int ty0 = std::max(cells.y - halo, 0) / ts;
+  const int tx1 = std::min((cells.x + cells.width - 1 + halo) / ts, int(m_tilesX) - 1);
+  const int ty1 = std::min((cells.y + cells.height - 1 + halo) / ts, int(m_tilesY) - 1);
+  for (int tx = tx0; tx <= tx1; ++tx){
+    for (int ty = ty0; ty <= ty1; ++ty){
+      Tile& tile = *m_tiles[size_t(tx) * m_tilesY + ty];
+      tile.dist.release();
+      tile.dist_state.store(DIST_PENDING);
+    }
+  }
+}
+
+void TiledGridMap2D::inflate(double radius){
+  // distances are clamped to the halo, i.e. a larger radius would occupy all cells
+  const double max_radius = m_haloDist - 0.5 * m_resolution;
+  if (radius > max_radius){
+    ROS_WARN("Inflation radius %f exceeds the halo %f of the tiled map, obstacles are "
+             "inflated by %f only", radius, m_haloDist, max_radius);
+    radius = max_radius;
+  }
+
+  // all tiles have to be inflated before their binary maps change
+  std::vector<uchar> uniform(m_tiles.size(), FREE);
+  std::vector<cv::Mat> binary(m_tiles.size());
+  for (size_t t = 0; t < m_tiles.size(); ++t){
+    const Tile& tile = *m_tiles[t];
+    int state = tile.dist_state.load();
+    if (state == DIST_PENDING)
+      state = computeDistances(t);
+
+    if (state == DIST_ZERO){
+      uniform[t] = OCCUPIED;
+    } else if (state == DIST_FAR){
+      uniform[t] = (m_haloDist > radius) ? FREE : OCCUPIED;
+    } else {
+      binary[t] = (tile.dist > radius);
+      const cv::Rect rect = tileRect(t);
+      const int num_free = cv::countNonZero(binary[t](cv::Rect(0, 0, rect.width, rect.height)));
+      if (num_free == 0 || num_free == rect.area()){
+        uniform[t] = num_free ? FREE : OCCUPIED;
+        binary[t].release();
+      }
+    }
+  }
+
+  for (size_t t = 0; t < m_tiles.size(); ++t){
+    m_tiles[t]->uniform = uniform[t];
+    m_tiles[t]->binary = binary[t];
+  }
+  invalidateDistances();
+}
+
+bool TiledGridMap2D::changedTiles(const TiledGridMap2D& other, std::vector<cv::Rect>& changed) const{
+  if (other.m_width != m_width || other.m_height != m_height || other.m_tileSize != m_tileSize)
+    return false;
+
+  for (size_t t = 0; t < m_tiles.size(); ++t){
+    const Tile& a = *m_tiles[t];
+    const Tile& b = *other.m_tiles[t];
+    const cv::Rect rect = tileRect(t);
+    bool equal;
+    if (a.binary.empty() && b.binary.empty())
+      equal = a.uniform == b.uniform;
+    else if (a.binary.empty())
+      equal = cv::countNonZero(b.binary(cv::Rect(0, 0, rect.width, rect.height)) != double(a.uniform)) == 0;
+    else if (b.binary.empty())
+      equal = cv::countNonZero(a.binary(cv::Rect(0, 0, rect.width, rect.height)) != double(b.uniform)) == 0;
+    else
+      equal = cv::countNonZero(a.binary(cv::Rect(0, 0, rect.width, rect.height)) !=
+                               b.binary(cv::Rect(0, 0, rect.width, rect.height))) == 0;
+    if (!equal)
+      changed.push_back(cv::Rect(rect.y, rect.x, rect.height, rect.width));
+  }
+  return true;
+}
+
+size_t TiledGridMap2D::bytesAllocated() const{
+  size_t bytes = m_tiles.size() * (sizeof(Tile) + sizeof(boost::shared_ptr<Tile>));
+  for (size_t t = 0; t < m_tiles.size(); ++t){
+    const Tile& tile = *m_tiles[t];
+    bytes += tile.binary.total() * tile.binary.elemSize();
+    bytes += tile.dist.total() * tile.dist.elemSize();
+  }
+  return bytes;
+}
+
+size_t TiledGridMap2D::numAllocatedTiles() const{
+  size_t num = 0;
+  for (size_t t = 0; t < m_tiles.size(); ++t){
+    if (!m_tiles[t]->binary.empty())
+      ++num;
+  }
+  return num;
+}
+
+}
@@ -0,0 +1,213 @@
+/*
+ * A simple 2D gridmap structure
+ *
+ * Copyright 2011 Armin Hornung, University of Freiburg
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the University of Freiburg nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Microbenchmark of the conversion between nav_msgs::OccupancyGrid and
+ * GridMap2D: the former per cell loops (writing the transposed cv::Mat column
+ * by column) against GridMap2D::setMap() / toOccupancyGridMsg(). The distance
+ * transform is timed separately since both variants share it. Also compares
+ * the tiled storage (setMapTiled()) to the dense map: memory, conversion and
+ * a distance query of every cell (including the lazy distance transforms).
+ * Usage:
+ *
+ *   gridmap_2d_benchmark [width] [height] [repetitions] [tile size]
+ *
+ * Does not need a running roscore.
+ */
+
+#include <gridmap_2d/GridMap2D.h>
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using gridmap_2d::GridMap2D;
+
+
+namespace {
+
+/// The former setMap() conversion (without the distance transform).
+void legacySetMap(const nav_msgs::OccupancyGrid& grid_map, bool unknown_as_obstacle,
+                  cv::Mat& binary_map){
+  const nav_msgs::MapMetaData& info = grid_map.info;
+  binary_map = cv::Mat(info.width, info.height, CV_8UC1);
+
+  std::vector<signed char>::const_iterator mapDataIter = grid_map.data.begin();
+  unsigned char map_occ_thres = 70;
+
+  for(unsigned int j = 0; j < info.height; ++j){
+    for(unsigned int i = 0; i < info.width; ++i){
+      if (*mapDataIter > map_occ_thres
+          || (unknown_as_obstacle && *mapDataIter < 0))
+      {
+        binary_map.at<uchar>(i,j) = GridMap2D::OCCUPIED;
+      } else{
+        binary_map.at<uchar>(i,j) = GridMap2D::FREE;
+      }
+      ++mapDataIter;
+    }
+  }
+}
+
+/// The former toOccupancyGridMsg() conversion.
+void legacyToMsg(const cv::Mat& binary_map, const nav_msgs::MapMetaData& info,
+                 nav_msgs::OccupancyGrid& msg){
+  msg.info = info;
+  msg.data.resize(info.height*info.width);
+
+  std::vector<signed char>::iterator mapDataIter = msg.data.begin();
+  for(unsigned int j = 0; j < info.height; ++j){
+    for(unsigned int i = 0; i < info.width; ++i){
+      if (binary_map.at<uchar>(i,j) == GridMap2D::OCCUPIED)
+        *mapDataIter = 100;
+      else
+        *mapDataIter = 0;
+
+      ++mapDataIter;
+    }
+  }
+}
+
+/// Random map with rectangular obstacles and some unknown cells.
+nav_msgs::OccupancyGridPtr createMap(unsigned width, unsigned height){
+  nav_msgs::OccupancyGridPtr grid(new nav_msgs::OccupancyGrid());
+  grid->header.frame_id = "map";
+  grid->info.width = width;
+  grid->info.height = height;
+  grid->info.resolution = 0.05;
+  grid->data.assign(size_t(width) * height, 0);
+
+  srand(42);
+  const unsigned num_obstacles = width * height / 2000 + 1;
+  for (unsigned k = 0; k < num_obstacles; ++k){
+    unsigned x0 = rand() % width;
+    unsigned y0 = rand() % height;
+    unsigned w = rand() % 40 + 1;
+    unsigned h = rand() % 40 + 1;
+    signed char value = (k % 10 == 0) ? -1 : 100;
+    for (unsigned y = y0; y < std::min(y0 + h, height); ++y)
+      for (unsigned x = x0; x < std::min(x0 + w, width); ++x)
+        grid->data[size_t(y) * width + x] = value;
+  }
+  return grid;
+}
+
+}
+
+
+int
+main(int argc, char** argv)
+{
+  unsigned width = argc > 1 ? atoi(argv[1]) : 4000;
+  unsigned height = argc > 2 ? atoi(argv[2]) : 4000;
+  int repetitions = argc > 3 ? atoi(argv[3]) : 5;
+  unsigned tile_size = argc > 4 ? atoi(argv[4]) : 256;
+  const double halo_radius = 1.0;
+
+  ros::Time::init();
+  nav_msgs::OccupancyGridPtr grid = createMap(width, height);
+  printf("map: %u x %u cells, %d repetitions\n", width, height, repetitions);
+
+  cv::Mat legacy_map;
+  nav_msgs::OccupancyGrid legacy_msg;
+  ros::WallTime start = ros::WallTime::now();
+  for (int i = 0; i < repetitions; ++i)
+    legacySetMap(*grid, true, legacy_map);
+  double legacy_set_time = (ros::WallTime::now() - start).toSec() / repetitions;
+
+  start = ros::WallTime::now();
+  for (int i = 0; i < repetitions; ++i)
+    legacyToMsg(legacy_map, grid->info, legacy_msg);
+  double legacy_msg_time = (ros::WallTime::now() - start).toSec() / repetitions;
+
+  GridMap2D map;
+  start = ros::WallTime::now();
+  for (int i = 0; i < repetitions; ++i)
+    map.setMap(grid, true);
+  double set_time = (ros::WallTime::now() - start).toSec() / repetitions;
+
+  start = ros::WallTime::now();
+  for (int i = 0; i < repetitions; ++i)
+    map.updateDistanceMap();
+  double dist_time = (ros::WallTime::now() - start).toSec() / repetitions;
+
+  nav_msgs::OccupancyGrid msg;
+  start = ros::WallTime::now();
+  for (int i = 0; i < repetitions; ++i)
+    msg = map.toOccupancyGridMsg();
+  double msg_time = (ros::WallTime::now() - start).toSec() / repetitions;
+
+  // both variants have to agree
+  size_t mismatches = cv::countNonZero(legacy_map != map.binaryMap());
+  for (size_t i = 0; i < msg.data.size(); ++i){
+    if (msg.data[i] != legacy_msg.data[i])
+      ++mismatches;
+  }
+
+  // tiled storage, queried cell by cell (first query per tile computes its distances)
+  GridMap2D tiled_map;
+  start = ros::WallTime::now();
+  tiled_map.setMapTiled(grid, true, tile_size, halo_radius);
+  double tiled_set_time = (ros::WallTime::now() - start).toSec();
+  const size_t tiled_bytes_before = tiled_map.tiledMap()->bytesAllocated();
+
+  size_t tiled_mismatches = 0;
+  start = ros::WallTime::now();
+  for (unsigned x = 0; x < width; ++x){
+    for (unsigned y = 0; y < height; ++y){
+      const float tiled_dist = tiled_map.distanceMapAtCell(x, y);
+      const float dense_dist = std::min(map.distanceMapAtCell(x, y), float(halo_radius));
+      if (std::abs(tiled_dist - dense_dist) > 1e-4f
+          || tiled_map.binaryMapAtCell(x, y) != map.binaryMapAtCell(x, y))
+        ++tiled_mismatches;
+    }
+  }
+  double tiled_query_time = (ros::WallTime::now() - start).toSec();
+  const size_t dense_bytes = map.binaryMap().total() * (sizeof(uchar) + sizeof(float));
+
+  printf("setMap:             %8.2f ms (legacy conversion %8.2f ms + distance "
+         "transform %8.2f ms)\n", set_time * 1000.0,
+         legacy_set_time * 1000.0, dist_time * 1000.0);
+  printf("conversion only:    %8.2f ms (legacy %8.2f ms)\n",
+         std::max(set_time - dist_time, 0.0) * 1000.0, legacy_set_time * 1000.0);
+  printf("toOccupancyGridMsg: %8.2f ms (legacy %8.2f ms)\n", msg_time * 1000.0,
+         legacy_msg_time * 1000.0);
+  printf("mismatching cells:  %zu\n", mismatches);
+  printf("tiled setMap:       %8.2f ms, all cells queried in %8.2f ms (%u cell tiles, "
+         "%zu allocated)\n", tiled_set_time * 1000.0, tiled_query_time * 1000.0, tile_size,
+         tiled_map.tiledMap()->numAllocatedTiles());
+  printf("tiled memory:       %8zu KB (%zu KB before the queries), dense %zu KB\n",
+         tiled_map.tiledMap()->bytesAllocated() / 1024, tiled_bytes_before / 1024, dense_bytes / 1024);
+  printf("tiled mismatches:   %zu\n", tiled_mismatches);
+
+  return (mismatches == 0 && tiled_mismatches == 0) ? 0 : 1;
+}
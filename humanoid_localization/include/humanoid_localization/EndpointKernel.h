@@ -0,0 +1,101 @@
+// SVN $HeadURL$
+// SVN $Id$
+
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HUMANOID_LOCALIZATION_ENDPOINTKERNEL_H_
+#define HUMANOID_LOCALIZATION_ENDPOINTKERNEL_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace humanoid_localization{
+
+/**
+ * CUDA implementation of the endpoint model likelihood (see EndpointModel):
+ * the quantized distance grid of a LikelihoodField stays on the device,
+ * the filtered scan is uploaded once per update, and one thread block per
+ * particle transforms and scores all beams. Only the per-particle sums of
+ * log-likelihoods are copied back. Plain C++ interface, so that only
+ * EndpointKernel.cu has to be compiled by nvcc.
+ */
+class EndpointKernel{
+public:
+  /// Geometry of the distance grid (see LikelihoodField)
+  struct Grid{
+    float originX, originY, originZ;
+    float invResolution;
+    unsigned sizeX, sizeY, sizeZ;
+    unsigned bits; ///< 8 or 16
+    float codeToDistance;
+  };
+
+  EndpointKernel();
+  ~EndpointKernel();
+
+  /// @return true if a CUDA device is available
+  static bool deviceAvailable();
+
+  /**
+   * Uploads the distance grid and the log-likelihood of each code
+   * (for a constant sigma), replacing the previous one.
+   */
+  bool uploadGrid(const Grid& grid, const void* data, const std::vector<float>& logLikelihoods);
+
+  /// Uploads the sensor points (sensor frame) and their measured ranges
+  bool uploadPoints(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z,
+                    const std::vector<float>& ranges);
+
+  /**
+   * Computes the sum of log-likelihoods of all uploaded points for each
+   * particle. Endpoints outside of the grid score as maxObstacleDistance.
+   * @param transforms 12 floats per particle: row-major 3x3 rotation and translation of the sensor
+   * @param sigma std.dev., scaled by the squared range of each beam if squaredError
+   * @param[out] logLikelihoods one sum per particle
+   */
+  bool integrate(const std::vector<float>& transforms, float sigma, bool squaredError,
+                 float maxObstacleDistance, std::vector<float>& logLikelihoods);
+
+  const std::string& lastError() const { return m_lastError; }
+
+protected:
+  void release();
+  bool check(int error, const char* what);
+
+  void* m_grid;
+  void* m_gridLogLikelihoods;
+  void* m_points; ///< x, y, z, range (SoA)
+  void* m_transforms;
+  void* m_results;
+  size_t m_gridBytes;
+  size_t m_pointsCapacity;
+  size_t m_particlesCapacity;
+  unsigned m_numPoints;
+  unsigned m_numCodes;
+  Grid m_gridInfo;
+  std::string m_lastError;
+};
+
+}
+
+#endif
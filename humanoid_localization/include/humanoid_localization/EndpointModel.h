@@ -33,6 +33,7 @@
 #include <tf/transform_datatypes.h>
 
 #include <humanoid_localization/ObservationModel.h>
+#include <humanoid_localization/LikelihoodField.h>
 #include <octomap/octomap.h>
 #include <dynamicEDT3D/dynamicEDTOctomap.h>
 #include <visualization_msgs/Marker.h>
@@ -48,11 +49,23 @@ public:
   virtual void setMap(boost::shared_ptr<octomap::OcTree> map);
 
 protected:
-  bool getHeightError(const Particle& p, const tf::StampedTransform& footprintToBase, double& heightError) const;
+  bool getHeightError(const tf::Vector3& position, const tf::StampedTransform& footprintToBase, double& heightError) const;
   void initDistanceMap();
+  /// bakes m_likelihoodField (unless loaded from the map cache) and m_logLikelihoods from m_distanceMap
+  void initLikelihoodField();
+  /// map cache for the likelihood field, NULL if disabled or not matching m_map
+  boost::shared_ptr<MapCache> likelihoodFieldCache() const;
+  std::string likelihoodFieldCacheSection() const;
   double m_sigma;
   double m_maxObstacleDistance;
+  /// NULL if not needed (complete likelihood field from the map cache)
   boost::shared_ptr<DynamicEDTOctomap> m_distanceMap;
+  /// precomputed distances, 0 MB disables it
+  int m_likelihoodFieldMaxMB;
+  int m_likelihoodFieldBits;
+  LikelihoodField m_likelihoodField;
+  /// log-likelihood for each code of m_likelihoodField (constant sigma only)
+  std::vector<float> m_logLikelihoods;
 };
 
 }
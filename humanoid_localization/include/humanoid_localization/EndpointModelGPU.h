@@ -0,0 +1,63 @@
+// SVN $HeadURL$
+// SVN $Id$
+
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HUMANOID_LOCALIZATION_ENDPOINTMODELGPU_H_
+#define HUMANOID_LOCALIZATION_ENDPOINTMODELGPU_H_
+
+#include <humanoid_localization/EndpointModel.h>
+#include <humanoid_localization/EndpointKernel.h>
+
+
+namespace humanoid_localization{
+/**
+ * EndpointModel evaluated on a CUDA device (see EndpointKernel). The
+ * likelihood field is uploaded in setMap(), each filtered scan once per
+ * update, and only the weight increments are copied back. Falls back to
+ * the CPU implementation if no device is available, if the likelihood
+ * field does not cover the full map (endpoints outside of it need the EDT)
+ * or on CUDA errors.
+ */
+class EndpointModelGPU : public EndpointModel {
+public:
+  EndpointModelGPU(ros::NodeHandle* nh, boost::shared_ptr<MapModel> mapModel, EngineT * rngEngine);
+  virtual ~EndpointModelGPU();
+  virtual void integrateMeasurement(Particles& particles, const PointCloud& pc, const std::vector<float>& ranges, float max_range, const tf::Transform& baseToSensor);
+
+  virtual void setMap(boost::shared_ptr<octomap::OcTree> map);
+
+  /// @return true if the measurements are integrated on the GPU
+  bool usingGPU() const { return m_useGPU; }
+
+protected:
+  void uploadLikelihoodField();
+
+  EndpointKernel m_kernel;
+  bool m_useGPU;
+  std::vector<float> m_transforms;
+  std::vector<float> m_logLikelihoodSums;
+};
+
+}
+
+#endif
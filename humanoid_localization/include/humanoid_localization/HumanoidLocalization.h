@@ -55,17 +55,27 @@
 #include <geometry_msgs/PoseWithCovarianceStamped.h>
 
 #include <humanoid_localization/humanoid_localization_defs.h>
+#include <humanoid_localization/LatencyStats.h>
 #include <humanoid_localization/MotionModel.h>
 #include <humanoid_localization/ObservationModel.h>
 #include <humanoid_localization/RaycastingModel.h>
 #ifndef SKIP_ENDPOINT_MODEL
   #include <humanoid_localization/EndpointModel.h>
+  #include <humanoid_localization/SphereTracingModel.h>
+#endif
+#ifdef WITH_CUDA_ENDPOINT_MODEL
+  #include <humanoid_localization/EndpointModelGPU.h>
 #endif
 
 
 #include <octomap/octomap.h>
 #include <sensor_msgs/Imu.h>
 #include <boost/circular_buffer.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <diagnostic_msgs/DiagnosticArray.h>
 
 namespace humanoid_localization{
 
@@ -85,7 +95,9 @@ public:
     //typedef pcl::PointCloud<pcl::PointXYZ> PointCloud;
 
 public:
-  HumanoidLocalization(unsigned randomSeed);
+  /// @param tfSpinThread whether m_tfListener processes the tf topic in its
+  /// own thread, disabled when transforms are fed by setTransform() instead
+  HumanoidLocalization(unsigned randomSeed, bool tfSpinThread = true);
   virtual ~HumanoidLocalization();
   virtual void laserCallback(const sensor_msgs::LaserScanConstPtr& msg);
   virtual void pointCloudCallback(const sensor_msgs::PointCloud2::ConstPtr& msg);
@@ -100,9 +112,10 @@ public:
 
   /**
    * Importance sampling from m_particles according to weights,
-   * resets weight to 1/numParticles. Uses low variance sampling
+   * resets weight to 1/numParticles. Uses low variance sampling, or
+   * KLD-sampling with an adaptive number of particles (if enabled)
    *
-   * @param numParticles how many particles to sample, 0 (default): keep size of particle distribution
+   * @param numParticles how many particles to sample, 0 (default): num_particles or adaptive (KLD)
    */
   void resample(unsigned numParticles = 0);
   /// Returns index of particle with highest weight (log or normal scale)
@@ -117,9 +130,41 @@ public:
   /// function call for global initialization (called by globalLocalizationCallback)
   void initGlobal();
 
+  /// accumulated wall clock time of the filter stages in s (for benchmarking)
+  struct StageTimings{
+    StageTimings() { reset(); }
+    void reset(){
+      motion = preprocessing = observation = verifyPoses = resampling = publish = 0.0;
+      numMeasurements = 0;
+      numParticleUpdates = 0;
+    }
+    double motion; ///< motion model (with and without measurements)
+    double preprocessing; ///< sensor data to filtered point cloud
+    double observation; ///< pose and sensor observation models
+    double verifyPoses;
+    double resampling; ///< normalizing weights, nEff and resampling
+    double publish;
+    unsigned numMeasurements; ///< number of integrated measurements
+    unsigned long numParticleUpdates; ///< particles evaluated over all measurements
+  };
+  const StageTimings& getStageTimings() const { return m_stageTimings; }
+  void resetStageTimings() { m_stageTimings.reset(); }
+
   // needed for pointcloud callback (from OctomapServer)
   static void filterGroundPlane(const PointCloud& pc, PointCloud& ground, PointCloud& nonground, double groundFilterDistance, double groundFilterAngle, double groundFilterPlaneDistance);
 
+  /**
+   * Fast ground plane extraction seeded with the floor plane z=0 of pc's frame
+   * (base footprint): classifies all points by their distance to the plane,
+   * refined by a few least squares fits of the inliers.
+   *
+   * @return false if the refined plane violates groundFilterAngle / groundFilterPlaneDistance
+   * or less than minInlierRatio of the points are ground (use filterGroundPlane() then)
+   */
+  static bool filterGroundPlanePrior(const PointCloud& pc, PointCloud& ground, PointCloud& nonground,
+                                     double groundFilterDistance, double groundFilterAngle, double groundFilterPlaneDistance,
+                                     double minInlierRatio, int refinementIterations);
+
 protected:
   /**
    * General reset of the filter:
@@ -152,7 +197,25 @@ protected:
   /**
    * Converts particles into log scale
    */
-  void toLogForm();
+  static void toLogForm(Particles& particles);
+
+  /**
+   * KLD-sampling (Fox 2003): draws particles according to their weights
+   * until the number of particles bounds the KL distance (m_kldEpsilon) to
+   * the true posterior with probability given by m_kldZ, for the number of
+   * occupied (x, y, yaw) bins. Stays within [m_kldMinParticles, m_kldMaxParticles].
+   * @param[out] indices of the drawn particles
+   */
+  void sampleKLD(std::vector<unsigned>& indices);
+
+  /// Low variance sampling of numParticles particles according to their weights
+  void lowVarianceSample(unsigned numParticles, std::vector<unsigned>& indices);
+
+  /// number of low variance samples (targets firstTarget + n*interval) below cumWeight
+  static unsigned numSamplesBelow(double cumWeight, double firstTarget, double interval, unsigned numParticles);
+
+  /// KLD bound on the number of particles for k occupied bins (not clamped)
+  double kldNumParticles(unsigned k) const;
 
   /**
    * Returns the IMU message with stamp closest to a given stamp.
@@ -164,6 +227,9 @@ protected:
    */
   bool getImuMsg(const ros::Time& stamp, ros::Time& imuStamp, double& angleX, double& angleY) const;
 
+  /// Roll and pitch of the newest IMU message, false if none received yet
+  bool getLatestImuRP(double& roll, double& pitch) const;
+
   /**
    * Prepares a LaserScan msg to be integrated into the observations model. Filters
    * near range measurements out and creates a sparse point cloud (out of m_numSensorBeams points)
@@ -185,6 +251,21 @@ protected:
 
   bool localizeWithMeasurement(const PointCloud& pc_filtered, const std::vector<float>& ranges, double max_range);
 
+  /// Stamp of a filtered point cloud
+  static ros::Time measurementStamp(const PointCloud& pc);
+
+  /// Motion update of m_particles to the stamp t of a measurement (temporal sampling, motion constraints)
+  bool applyMotionToMeasurement(const ros::Time& t);
+
+  /**
+   * Pose and sensor observation update of particles (weights in log-form afterwards).
+   * Only reads the filter state, i.e. may run on a copy of m_particles without m_filterMutex.
+   */
+  bool integrateObservation(Particles& particles, const PointCloud& pc_filtered, const std::vector<float>& ranges, double max_range) const;
+
+  /// Normalizes the weights of m_particles after an observation update and resamples if needed
+  void finishObservation();
+
   void constrainMotion(const tf::Pose& odomPose);
 
   void timerCallback(const ros::TimerEvent & e);
@@ -199,6 +280,35 @@ protected:
 
   bool lookupPoseHeight(const ros::Time& t, double& poseHeight) const;
 
+  /// sensor message and odometry state in the asynchronous pipeline (async_preprocessing)
+  struct PipelineMeasurement{
+    sensor_msgs::LaserScanConstPtr laser;
+    sensor_msgs::PointCloud2::ConstPtr cloud;
+    tf::Stamped<tf::Pose> odomPose;
+    double headYaw, headPitch;
+    /// filled by the preprocessing thread:
+    PointCloud pc;
+    std::vector<float> ranges;
+    double maxRange;
+    /// stage timestamps for latency reporting
+    ros::WallTime receivedTime, preprocessingStartTime, preparedTime;
+  };
+  typedef boost::shared_ptr<PipelineMeasurement> PipelineMeasurementPtr;
+
+  /// hands a sensor message to the preprocessing thread (replaces an unprocessed older one)
+  void enqueueMeasurement(const PipelineMeasurementPtr& measurement);
+  /// preprocessing thread: raw sensor messages to filtered point clouds and ranges
+  void preprocessingThread();
+  /// filter thread: integrates the newest prepared measurement
+  void filterThread();
+  void startPipeline();
+  void stopPipeline();
+
+  /// Adds a stage time to m_stageTimings and the rolling latency statistics
+  void addStageTime(double& accumulatedTime, const char* stage, double seconds);
+  /// Publishes the latency statistics every latency_stats_period (if subscribed)
+  void publishLatencyStats();
+
   EngineT m_rngEngine;
   /// standard normal distribution
   NormalGeneratorT m_rngNormal;
@@ -220,7 +330,7 @@ protected:
 
   ros::Publisher m_posePub, m_poseEvalPub, m_poseOdomPub, m_poseTruePub,
                  m_poseArrayPub, m_bestPosePub, m_nEffPub,
-                 m_filteredPointCloudPub;
+                 m_filteredPointCloudPub, m_latencyStatsPub;
   ros::Subscriber m_imuSub;
   ros::ServiceServer m_globalLocSrv, m_pauseLocSrv, m_resumeLocSrv;
   tf::TransformListener m_tfListener;
@@ -236,6 +346,14 @@ protected:
   bool m_useRaycasting;
   bool m_initFromTruepose;
   int m_numParticles;
+  /// KLD-sampling parameters
+  bool m_useKLDSampling;
+  int m_kldMinParticles;
+  int m_kldMaxParticles;
+  double m_kldEpsilon;
+  double m_kldZ;
+  double m_kldBinSizeXY;
+  double m_kldBinSizeYaw;
   double m_sensorSampleDist;
 
   double m_nEffFactor;
@@ -249,10 +367,13 @@ protected:
 
 
   Particles m_particles;
+  Particles m_particlesBuffer; ///< back buffer for resampling (swapped with m_particles)
+  std::vector<double> m_cumWeights; ///< cumulative weights for resampling (preallocated)
   int m_bestParticleIdx;
   tf::Pose m_odomPose; // incrementally added odometry pose (=dead reckoning)
   geometry_msgs::PoseArray m_poseArray; // particles as PoseArray (preallocated)
   boost::circular_buffer<sensor_msgs::Imu> m_lastIMUMsgBuffer;
+  mutable boost::mutex m_imuMutex; ///< protects m_lastIMUMsgBuffer (filter thread vs. imuCallback)
 
   bool m_bestParticleAsMean;
   bool m_receivedSensorData;
@@ -278,6 +399,9 @@ protected:
   double m_groundFilterAngle;
   double m_groundFilterPlaneDistance;
   double m_sensorSampleDistGroundFactor;
+  bool m_groundFilterPrior;
+  double m_groundFilterPriorMinInliers;
+  int m_groundFilterPriorIterations;
 
 
   /// sensor data last integrated at this odom pose, to check if moved enough since then
@@ -296,6 +420,28 @@ protected:
   // timer stuff
   bool m_useTimer;
   double m_timerPeriod;
+
+  StageTimings m_stageTimings;
+  LatencyStats m_latencyStats;
+  double m_particleCloudPeriod; ///< min. time between particle cloud messages, 0: every update
+  ros::Time m_lastParticleCloudTime;
+  double m_latencyStatsPeriod;
+  ros::WallTime m_lastLatencyStatsTime;
+
+  /// protects the filter state (particles, motion model) across ROS callbacks and the filter thread
+  boost::mutex m_filterMutex;
+  /// incremented on (re-)initialization of the particles, discards concurrent observation updates
+  unsigned m_numFilterResets;
+
+  // asynchronous sensor preprocessing pipeline, latest-only queues
+  bool m_asyncPreprocessing;
+  boost::mutex m_pipelineMutex;
+  boost::condition_variable m_pipelineCondition;
+  PipelineMeasurementPtr m_rawMeasurement; ///< waiting for preprocessing
+  PipelineMeasurementPtr m_preparedMeasurement; ///< waiting for the filter
+  bool m_pipelineShutdown;
+  unsigned m_numDroppedRaw, m_numDroppedPrepared;
+  boost::thread m_preprocessingThread, m_filterThread;
 };
 }
 
@@ -0,0 +1,66 @@
+// SVN $HeadURL$
+// SVN $Id$
+
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HUMANOID_LOCALIZATION_LATENCYSTATS_H_
+#define HUMANOID_LOCALIZATION_LATENCYSTATS_H_
+
+#include <string>
+#include <vector>
+
+#include <boost/circular_buffer.hpp>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+namespace humanoid_localization{
+
+/**
+ * Rolling latency statistics of named stages: keeps the last windowSize
+ * samples of each stage and summarizes their distribution (mean,
+ * percentiles, max), e.g. for publishing as diagnostics.
+ */
+class LatencyStats{
+public:
+  LatencyStats(size_t windowSize = 200);
+
+  /// Changes the number of samples per stage (drops all samples)
+  void setWindowSize(size_t windowSize);
+  /// Adds a latency sample (in s) of a stage, stages are reported in the order of their first sample
+  void add(const std::string& stage, double seconds);
+  void clear();
+
+  /// One status per stage with count, mean, p50, p90, p99 and max in ms
+  void toDiagnostics(diagnostic_msgs::DiagnosticArray& msg, const std::string& prefix) const;
+
+protected:
+  struct Stage{
+    std::string name;
+    boost::circular_buffer<double> samples;
+    unsigned long count; ///< all samples since clear()
+  };
+
+  size_t m_windowSize;
+  std::vector<Stage> m_stages;
+};
+
+}
+
+#endif
@@ -0,0 +1,128 @@
+// SVN $HeadURL$
+// SVN $Id$
+
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HUMANOID_LOCALIZATION_LIKELIHOODFIELD_H_
+#define HUMANOID_LOCALIZATION_LIKELIHOODFIELD_H_
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <stdint.h>
+
+#include <octomap/octomap.h>
+#include <dynamicEDT3D/dynamicEDTOctomap.h>
+
+namespace humanoid_localization{
+
+/**
+ * Dense voxel grid of quantized obstacle distances, baked from a
+ * DynamicEDTOctomap for a static map. A lookup is a single indexed load
+ * (no octree key computation or search). Each cell stores a code
+ * (8 or 16 bit) of the distance in [0, maxDistance]; points outside of the
+ * EDT are stored as maxDistance, obstacles as 0 or maxDistance (see build()).
+ * The grid covers at most a given memory budget around the map center,
+ * lookups outside of its extent return false.
+ */
+class LikelihoodField{
+public:
+  LikelihoodField();
+
+  /**
+   * Bakes the grid from distanceMap within [min, max] at the given
+   * resolution (should match the octree). If the full extent exceeds
+   * maxBytes, the grid is cropped in x and y around the center.
+   * @param bits 8 or 16 bit per cell
+   * @param obstaclesAsMaxDistance store obstacle cells (distance 0) as maxDistance
+   * (as EndpointModel scores endpoints inside obstacles), otherwise as 0
+   * @return false if disabled (maxBytes == 0) or nothing could be baked
+   */
+  bool build(const DynamicEDTOctomap& distanceMap, const octomap::point3d& min, const octomap::point3d& max,
+             double resolution, float maxDistance, size_t maxBytes, unsigned bits,
+             bool obstaclesAsMaxDistance = true);
+  void clear();
+
+  /// Raw copy of the grid and its parameters (e.g. for MapCache)
+  void serialize(std::vector<char>& data) const;
+  /// Restores a grid written by serialize(), false if data is invalid
+  bool deserialize(const char* data, size_t size);
+  /// MapCache section name of a grid built with the given parameters
+  static std::string cacheSectionName(const std::string& prefix, double resolution, float maxDistance,
+                                      size_t maxBytes, unsigned bits, bool obstaclesAsMaxDistance);
+
+  bool empty() const { return m_numCells == 0; }
+  /// true if the grid does not cover the full extent passed to build()
+  bool isCropped() const { return m_cropped; }
+  double resolution() const { return m_resolution; }
+  /// number of different codes (2^bits)
+  unsigned numCodes() const { return m_maxCode + 1; }
+  size_t bytesAllocated() const { return m_data8.capacity() + m_data16.capacity() * sizeof(uint16_t); }
+
+  /// Distance code at (x,y,z), false outside of the grid
+  inline bool lookup(float x, float y, float z, unsigned& code) const{
+    const float fx = (x - m_originX) * m_invResolution;
+    const float fy = (y - m_originY) * m_invResolution;
+    const float fz = (z - m_originZ) * m_invResolution;
+    // also rejects NaN:
+    if (!(fx >= 0.0f && fy >= 0.0f && fz >= 0.0f))
+      return false;
+
+    const unsigned ix = unsigned(fx), iy = unsigned(fy), iz = unsigned(fz);
+    if (ix >= m_sizeX || iy >= m_sizeY || iz >= m_sizeZ)
+      return false;
+
+    const size_t idx = (size_t(iz) * m_sizeY + iy) * m_sizeX + ix;
+    code = m_data16.empty() ? m_data8[idx] : m_data16[idx];
+    return true;
+  }
+
+  /// Distance corresponding to a code
+  inline float distance(unsigned code) const { return code * m_codeToDistance; }
+
+  /// raw grid (x fastest, then y, z) for uploading it elsewhere
+  const void* data() const { return m_data16.empty() ? (const void*)m_data8.data() : (const void*)m_data16.data(); }
+  unsigned bits() const { return m_data16.empty() ? 8 : 16; }
+  float originX() const { return m_originX; }
+  float originY() const { return m_originY; }
+  float originZ() const { return m_originZ; }
+  unsigned sizeX() const { return m_sizeX; }
+  unsigned sizeY() const { return m_sizeY; }
+  unsigned sizeZ() const { return m_sizeZ; }
+  float codeToDistance() const { return m_codeToDistance; }
+
+protected:
+  float m_originX, m_originY, m_originZ;
+  float m_invResolution;
+  double m_resolution;
+  bool m_cropped;
+  unsigned m_sizeX, m_sizeY, m_sizeZ;
+  size_t m_numCells;
+  unsigned m_maxCode;
+  float m_codeToDistance;
+  std::vector<uint8_t> m_data8;
+  std::vector<uint16_t> m_data16;
+};
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+// SVN $HeadURL$
+// SVN $Id$
+
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HUMANOID_LOCALIZATION_MAPCACHE_H_
+#define HUMANOID_LOCALIZATION_MAPCACHE_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace humanoid_localization{
+
+/**
+ * Persistent cache of everything precomputed from a static map (octree,
+ * floor index, distance fields), as named binary sections of one file.
+ * The file is memory mapped read-only on open() and sections are accessed
+ * in place. It belongs to the map with the content hash mapHash(); section
+ * names should encode all parameters their content depends on.
+ * The format is raw memory and only meant for the machine that wrote it.
+ */
+class MapCache{
+public:
+  MapCache();
+  ~MapCache();
+
+  /// Maps filename, false if it does not exist or is no valid cache file
+  bool open(const std::string& filename);
+  /// Drops all sections and assigns the cache to the map with the given hash,
+  /// to be written to filename
+  void reset(const std::string& filename, uint64_t mapHash);
+
+  uint64_t mapHash() const { return m_mapHash; }
+  const std::string& filename() const { return m_filename; }
+
+  /// Section data (in the file mapping or added since), false if not present
+  bool getSection(const std::string& name, const char*& data, size_t& size) const;
+  void setSection(const std::string& name, const char* data, size_t size);
+
+  /// true if sections were added since open() / the last write()
+  bool isModified() const { return !m_addedSections.empty(); }
+  /// Writes all sections to filename(), replaces the file atomically
+  bool write();
+
+  /// 64 bit FNV-1a hash
+  static uint64_t hash(const char* data, size_t size);
+
+protected:
+  void close();
+
+  std::string m_filename;
+  uint64_t m_mapHash;
+  void* m_mapping;
+  size_t m_mappingSize;
+  /// sections within m_mapping, name => (offset, size)
+  std::map<std::string, std::pair<size_t, size_t> > m_mappedSections;
+  std::map<std::string, std::vector<char> > m_addedSections;
+};
+
+}
+
+#endif
@@ -29,8 +29,10 @@
 #include <octomap_msgs/conversions.h>
 #include <octomap_msgs/GetOctomap.h>
 #include <octomap_ros/conversions.h>
+#include <boost/unordered_map.hpp>
 
 #include <humanoid_localization/humanoid_localization_defs.h>
+#include <humanoid_localization/MapCache.h>
 
 namespace humanoid_localization{
 
@@ -42,10 +44,16 @@ public:
   //void setMap(boost::shared_ptr<octomap::OcTree> map);
   boost::shared_ptr<octomap::OcTree> getMap() const;
 
+  /// Cache of everything precomputed from getMap() (map_cache_file), NULL if disabled
+  boost::shared_ptr<MapCache> getMapCache() const;
+
   /**
    * Check if particles represent valid poses:
    * Must be within map bounding box and not in an occupied area.
    * Otherwise weight is minimized (=> die out at next resampling)
+   *
+   * Particles are clustered by their octree voxel, so that each voxel is
+   * only checked once. Results are cached over calls (the map is static).
    */
   virtual void verifyPoses(Particles& particles);
 
@@ -61,7 +69,9 @@ public:
   virtual double getFloorHeight(const tf::Transform& pose) const = 0;
 
   /**
-   * Get a list of valid z values at a given xy-position
+   * Get a list of valid z values at a given xy-position.
+   * Uses the precomputed floor index if totalHeight equals its clearance
+   * (floor_index_clearance), otherwise the octree column is scanned.
    *
    * @param x
    * @param y
@@ -70,9 +80,33 @@ public:
    */
   void getHeightlist(double x, double y, double totalHeight, std::vector<double>& heights);
 
+  /// Clears the cached voxel checks of verifyPoses(), call when the map changes
+  void clearVoxelCache();
+
+  /// Writes the map cache if anything was added to it, call once after all
+  /// users of getMapCache() (e.g. the observation models) are initialized
+  void writeMapCache();
+
+protected:
+  /// Loads m_map from the octree in map_cache_file, false if not available
+  bool loadMapFromCache();
+  /// Opens map_cache_file for m_map, resets it if it belongs to a different map
+  void initMapCache();
+  /// Precomputes the list of valid floor heights of all (x,y) cells of m_map
+  /// for floor_index_clearance, call once after loading the map
+  void initFloorIndex();
+
+  /// Restores the floor index from the map cache, false if not available
+  bool loadFloorIndex(const std::string& cacheSection, size_t numCells);
+
+  /// Scans the column of m_map at (x,y) for valid floor heights (slow)
+  void scanHeightlist(double x, double y, double totalHeight, std::vector<double>& heights) const;
+
 
 protected:
   boost::shared_ptr<octomap::OcTree> m_map;
+  std::string m_mapCacheFile;
+  boost::shared_ptr<MapCache> m_mapCache;
 
   double m_motionMeanZ;
   double m_motionRangeZ;
@@ -80,6 +114,29 @@ protected:
   double m_motionRangePitch;
   double m_motionObstacleDist;
 
+  double m_floorIndexClearance;
+  double m_floorIndexMaxMB;
+  /// 2.5D floor index: heights of cell (ix, iy) are [offsets[c], offsets[c+1]) with c = iy*sizeX + ix
+  std::vector<unsigned> m_floorIndexOffsets;
+  std::vector<float> m_floorIndexHeights;
+  octomap::key_type m_floorIndexMinKeyX, m_floorIndexMinKeyY;
+  unsigned m_floorIndexSizeX, m_floorIndexSizeY;
+
+private:
+  /// cached result of the map checks in verifyPoses() for one voxel
+  struct VoxelState{
+    bool occupied;
+    double floorHeight; ///< only computed for free voxels if motion_range_z >= 0
+  };
+  typedef boost::unordered_map<octomap::OcTreeKey, unsigned, octomap::OcTreeKey::KeyHash> VoxelIndexMap;
+
+  VoxelIndexMap m_voxelIndices; ///< voxel key => index in m_voxelStates
+  std::vector<VoxelState> m_voxelStates;
+  unsigned m_voxelCacheMaxSize;
+  // reused per call of verifyPoses():
+  std::vector<octomap::OcTreeKey> m_particleKeys;
+  std::vector<int> m_particleVoxels; ///< index in m_voxelStates per particle, -1 if out of map
+  std::vector<unsigned> m_newVoxels;
 };
 
 
@@ -56,7 +56,8 @@ public:
   void applyOdomTransform(Particles& particles, const tf::Transform& odomTransform);
 
   /// apply odomTransform to all particles (noisy), with temporal sampling over the range of dt.
-  /// Times are sampled in an interval +-dt/2 around t, iff dt > 0.0.
+  /// Times are sampled in an interval +-dt/2 around t, iff dt > 0.0, discretized into
+  /// m_temporalSamplingBins bins (one tf lookup per bin).
   bool applyOdomTransformTemporal(Particles& particles, const ros::Time& t, double dt);
 
   /// store odomPose as m_lastOdomPose to compute future odom transforms
@@ -81,6 +82,12 @@ protected:
   /// May not be called in parallel, accesses the random generator m_rngNormal
   tf::Transform odomTransformNoise(const tf::Transform& odomTransform);
 
+  /// Generates motion noise corresponding to odomTransform from rngNormal
+  tf::Transform odomTransformNoise(const tf::Transform& odomTransform, NormalGeneratorT& rngNormal) const;
+
+  /// Creates the random generators of all OpenMP threads (if not done yet)
+  void initThreadRngEngines();
+
   /// @return calibrated odometry transform w.r.t. 2D drift (pos. + orientation)
   tf::Transform calibrateOdometry(const tf::Transform& odomTransform) const;
 
@@ -88,6 +95,12 @@ protected:
 
   NormalGeneratorT m_rngNormal; // standard normal-distributed noise
   UniformGeneratorT m_rngUniform;
+  /// one random generator per OpenMP thread for the parallel particle updates,
+  /// seeded with m_threadRngSeed + thread number (deterministic for a fixed number of threads)
+  std::vector<EngineT> m_threadRngEngines;
+  unsigned m_threadRngSeed;
+  /// number of time bins for temporal sampling
+  int m_temporalSamplingBins;
   // parameters:
   /// variance parameters for calibrated odometry noise
   Eigen::Matrix3d m_odomNoise2D;
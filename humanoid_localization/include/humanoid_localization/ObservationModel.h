@@ -80,7 +80,7 @@ public:
 
   virtual void setMap(boost::shared_ptr<octomap::OcTree> map);
 protected:
-  virtual bool getHeightError(const Particle& p, const tf::StampedTransform& footprintToBase, double& heightError) const = 0;
+  virtual bool getHeightError(const tf::Vector3& position, const tf::StampedTransform& footprintToBase, double& heightError) const = 0;
   boost::shared_ptr<MapModel> m_mapModel;
   EngineT m_rngEngine;
   NormalGeneratorT m_rngNormal;
@@ -0,0 +1,130 @@
+// SVN $HeadURL$
+// SVN $Id$
+
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HUMANOID_LOCALIZATION_PARTICLES_H_
+#define HUMANOID_LOCALIZATION_PARTICLES_H_
+
+#include <vector>
+
+#include <tf/transform_datatypes.h>
+
+#include <eigen3/Eigen/Core>
+
+#include <pcl/point_types.h>
+#include <pcl_ros/point_cloud.h>
+
+namespace humanoid_localization{
+
+/// Particle consists of a pose and a weight (single particle of Particles)
+struct Particle{
+  double weight;
+  tf::Pose pose;
+};
+
+/**
+ * Points of a sensor measurement as structure of arrays (single precision),
+ * to be transformed into many particle poses.
+ */
+struct SensorPoints{
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+
+  SensorPoints() {}
+  explicit SensorPoints(const pcl::PointCloud<pcl::PointXYZ>& pc) { assign(pc); }
+
+  void assign(const pcl::PointCloud<pcl::PointXYZ>& pc);
+  void resize(size_t size);
+  size_t size() const { return x.size(); }
+
+  /// out = rotation * points + translation (vectorized; resizes out, a reused out does not reallocate)
+  void transform(const Eigen::Matrix3f& rotation, const Eigen::Vector3f& translation, SensorPoints& out) const;
+};
+
+/**
+ * Particle set as structure of arrays: one contiguous array per pose
+ * component (x, y, z, roll, pitch, yaw in single precision) and one for the
+ * weights (double precision, in log form during the observation update).
+ * The loops over all particles only stream through the components they need,
+ * and the weight kernels are vectorized via Eigen. getPose() / setPose()
+ * convert from / to tf::Pose for the existing APIs.
+ */
+class Particles{
+public:
+  Particles() {}
+  explicit Particles(size_t size) { resize(size); }
+
+  size_t size() const { return m_weights.size(); }
+  bool empty() const { return m_weights.empty(); }
+  /// new particles have the identity pose and weight 0
+  void resize(size_t size);
+  void swap(Particles& other);
+
+  /// @return the 6D pose of particle i
+  tf::Pose getPose(size_t i) const;
+  void setPose(size_t i, const tf::Pose& pose);
+  Particle getParticle(size_t i) const;
+  void setParticle(size_t i, const Particle& particle);
+
+  tf::Vector3 getPosition(size_t i) const { return tf::Vector3(m_x[i], m_y[i], m_z[i]); }
+  void setPosition(size_t i, double x, double y, double z) { m_x[i] = x; m_y[i] = y; m_z[i] = z; }
+  void getRPY(size_t i, double& roll, double& pitch, double& yaw) const { roll = m_roll[i]; pitch = m_pitch[i]; yaw = m_yaw[i]; }
+  void setRPY(size_t i, double roll, double pitch, double yaw) { m_roll[i] = roll; m_pitch[i] = pitch; m_yaw[i] = yaw; }
+
+  /// Pose of a sensor at baseToSensor (relative to the particle pose i) in single precision
+  void getSensorTransform(size_t i, const tf::Transform& baseToSensor,
+                          Eigen::Matrix3f& rotation, Eigen::Vector3f& translation) const;
+
+  /// Copies pose and weight of particle srcIdx in src to dstIdx
+  void copyParticle(size_t dstIdx, const Particles& src, size_t srcIdx);
+
+  /// Inclusive prefix sum of the weights (parallel), cumWeights.back() is the total weight
+  void cumulativeWeights(std::vector<double>& cumWeights) const;
+
+  double& weight(size_t i) { return m_weights[i]; }
+  double weight(size_t i) const { return m_weights[i]; }
+
+  /// All weights, e.g. for vectorized operations
+  Eigen::Map<Eigen::ArrayXd> weights() { return Eigen::Map<Eigen::ArrayXd>(m_weights.data(), m_weights.size()); }
+  Eigen::Map<const Eigen::ArrayXd> weights() const { return Eigen::Map<const Eigen::ArrayXd>(m_weights.data(), m_weights.size()); }
+
+  const float* x() const { return m_x.data(); }
+  const float* y() const { return m_y.data(); }
+  const float* z() const { return m_z.data(); }
+  const float* roll() const { return m_roll.data(); }
+  const float* pitch() const { return m_pitch.data(); }
+  const float* yaw() const { return m_yaw.data(); }
+
+protected:
+  std::vector<float> m_x;
+  std::vector<float> m_y;
+  std::vector<float> m_z;
+  std::vector<float> m_roll;
+  std::vector<float> m_pitch;
+  std::vector<float> m_yaw;
+  std::vector<double> m_weights;
+};
+
+}
+#endif
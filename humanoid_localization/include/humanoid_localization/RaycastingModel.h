@@ -45,7 +45,13 @@ public:
   virtual void integrateMeasurement(Particles& particles, const PointCloud& pc, const std::vector<float>& ranges, float max_range, const tf::Transform& baseToSensor);
 
 protected:
-  bool getHeightError(const Particle& p, const tf::StampedTransform& footprintToBase, double& heightError) const;
+  bool getHeightError(const tf::Vector3& position, const tf::StampedTransform& footprintToBase, double& heightError) const;
+  /**
+   * Casts a ray from origin along direction up to maxRange (ignoring unknown space).
+   * @return true if an obstacle was hit, range is then the distance to it
+   */
+  virtual bool castRay(const octomap::point3d& origin, const octomap::point3d& direction,
+                       float maxRange, float& range) const;
   // laser parameters:
   double m_zHit;
   double m_zRand;
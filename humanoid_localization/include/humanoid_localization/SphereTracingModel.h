@@ -0,0 +1,62 @@
+// SVN $HeadURL$
+// SVN $Id$
+
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HUMANOID_LOCALIZATION_SPHERETRACINGMODEL_H_
+#define HUMANOID_LOCALIZATION_SPHERETRACINGMODEL_H_
+
+#include <humanoid_localization/RaycastingModel.h>
+#include <humanoid_localization/LikelihoodField.h>
+
+
+namespace humanoid_localization{
+/**
+ * Raycasting observation model (same beam model as RaycastingModel) that
+ * casts rays by sphere tracing in a precomputed distance field instead of
+ * stepping through the octree voxel by voxel: each step advances by the
+ * (conservative) free distance around the current point, so rays through
+ * free space take few steps. Rays starting outside of a cropped field fall
+ * back to OcTree::castRay(). Thin obstacles hit only at a voxel corner can be
+ * missed, since steps close to obstacles are half a voxel.
+ */
+class SphereTracingModel : public RaycastingModel {
+public:
+  SphereTracingModel(ros::NodeHandle* nh, boost::shared_ptr<MapModel> mapModel, EngineT * rngEngine);
+  virtual ~SphereTracingModel();
+
+  virtual void setMap(boost::shared_ptr<octomap::OcTree> map);
+
+protected:
+  virtual bool castRay(const octomap::point3d& origin, const octomap::point3d& direction,
+                       float maxRange, float& range) const;
+  void initDistanceField();
+
+  double m_maxDistance;
+  int m_maxMB;
+  int m_bits;
+  LikelihoodField m_distanceField;
+};
+
+}
+
+#endif
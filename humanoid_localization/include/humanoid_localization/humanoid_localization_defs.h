@@ -37,15 +37,9 @@
 #include <pcl_ros/point_cloud.h>
 #include <pcl/point_types.h>
 
-namespace humanoid_localization{
-
-/// Particle consists of a pose and a weight
-struct Particle{
-  double weight;
-  tf::Pose pose;
-};
+#include <humanoid_localization/Particles.h>
 
-typedef std::vector<Particle> Particles;
+namespace humanoid_localization{
 
 typedef pcl::PointCloud<pcl::PointXYZ> PointCloud;
 
@@ -0,0 +1,209 @@
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <humanoid_localization/EndpointKernel.h>
+
+#include <cuda_runtime.h>
+
+namespace humanoid_localization{
+
+namespace {
+
+const unsigned cvBlockSize = 128; // threads per particle, power of two
+const float cvLogSqrt2Pi = 0.91893853320467274178f;
+
+__device__ inline float logLikelihood(float x, float sigma){
+  return -cvLogSqrt2Pi - logf(sigma) - ((x * x) / (2.0f * sigma * sigma));
+}
+
+/// one block per particle, threads stride over the beams
+template <typename CellT>
+__global__ void endpointLikelihoodKernel(const CellT* grid, EndpointKernel::Grid g, const float* gridLogLikelihoods,
+                                         const float* points, unsigned numPoints, const float* transforms,
+                                         float sigma, bool squaredError, float maxObstacleDistance, float* results)
+{
+  __shared__ float partialSums[cvBlockSize];
+
+  const float* t = transforms + 12 * blockIdx.x;
+  const float r00 = t[0], r01 = t[1], r02 = t[2];
+  const float r10 = t[3], r11 = t[4], r12 = t[5];
+  const float r20 = t[6], r21 = t[7], r22 = t[8];
+  const float tx = t[9], ty = t[10], tz = t[11];
+
+  const float* px = points;
+  const float* py = points + numPoints;
+  const float* pz = points + 2 * numPoints;
+  const float* pRange = points + 3 * numPoints;
+
+  float sum = 0.0f;
+  for (unsigned j = threadIdx.x; j < numPoints; j += blockDim.x){
+    const float x = r00 * px[j] + r01 * py[j] + r02 * pz[j] + tx;
+    const float y = r10 * px[j] + r11 * py[j] + r12 * pz[j] + ty;
+    const float z = r20 * px[j] + r21 * py[j] + r22 * pz[j] + tz;
+
+    const float sigmaScaled = squaredError ? pRange[j] * pRange[j] * sigma : sigma;
+
+    const float fx = (x - g.originX) * g.invResolution;
+    const float fy = (y - g.originY) * g.invResolution;
+    const float fz = (z - g.originZ) * g.invResolution;
+    if (fx >= 0.0f && fy >= 0.0f && fz >= 0.0f
+        && unsigned(fx) < g.sizeX && unsigned(fy) < g.sizeY && unsigned(fz) < g.sizeZ)
+    {
+      const size_t idx = (size_t(unsigned(fz)) * g.sizeY + unsigned(fy)) * g.sizeX + unsigned(fx);
+      const unsigned code = grid[idx];
+      if (squaredError)
+        sum += logLikelihood(code * g.codeToDistance, sigmaScaled);
+      else
+        sum += gridLogLikelihoods[code];
+    } else {
+      sum += logLikelihood(maxObstacleDistance, sigmaScaled);
+    }
+  }
+
+  partialSums[threadIdx.x] = sum;
+  __syncthreads();
+  for (unsigned s = blockDim.x / 2; s > 0; s >>= 1){
+    if (threadIdx.x < s)
+      partialSums[threadIdx.x] += partialSums[threadIdx.x + s];
+    __syncthreads();
+  }
+
+  if (threadIdx.x == 0)
+    results[blockIdx.x] = partialSums[0];
+}
+
+}
+
+EndpointKernel::EndpointKernel()
+: m_grid(NULL), m_gridLogLikelihoods(NULL), m_points(NULL), m_transforms(NULL), m_results(NULL),
+  m_gridBytes(0), m_pointsCapacity(0), m_particlesCapacity(0), m_numPoints(0), m_numCodes(0)
+{
+
+}
+
+EndpointKernel::~EndpointKernel(){
+  release();
+}
+
+bool EndpointKernel::deviceAvailable(){
+  int count = 0;
+  return cudaGetDeviceCount(&count) == cudaSuccess && count > 0;
+}
+
+void EndpointKernel::release(){
+  cudaFree(m_grid);
+  cudaFree(m_gridLogLikelihoods);
+  cudaFree(m_points);
+  cudaFree(m_transforms);
+  cudaFree(m_results);
+  m_grid = m_gridLogLikelihoods = m_points = m_transforms = m_results = NULL;
+  m_gridBytes = m_pointsCapacity = m_particlesCapacity = 0;
+  m_numPoints = m_numCodes = 0;
+}
+
+bool EndpointKernel::check(int error, const char* what){
+  if (error == cudaSuccess)
+    return true;
+
+  m_lastError = std::string(what) + ": " + cudaGetErrorString(cudaError_t(error));
+  return false;
+}
+
+bool EndpointKernel::uploadGrid(const Grid& grid, const void* data, const std::vector<float>& logLikelihoods){
+  release();
+  m_gridInfo = grid;
+  m_gridBytes = size_t(grid.sizeX) * grid.sizeY * grid.sizeZ * (grid.bits / 8);
+  m_numCodes = logLikelihoods.size();
+
+  return check(cudaMalloc(&m_grid, m_gridBytes), "allocating the grid")
+      && check(cudaMemcpy(m_grid, data, m_gridBytes, cudaMemcpyHostToDevice), "uploading the grid")
+      && check(cudaMalloc(&m_gridLogLikelihoods, m_numCodes * sizeof(float)), "allocating the likelihood table")
+      && check(cudaMemcpy(m_gridLogLikelihoods, logLikelihoods.data(), m_numCodes * sizeof(float),
+                          cudaMemcpyHostToDevice), "uploading the likelihood table");
+}
+
+bool EndpointKernel::uploadPoints(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z,
+                                  const std::vector<float>& ranges){
+  m_numPoints = x.size();
+  if (m_numPoints > m_pointsCapacity){
+    cudaFree(m_points);
+    m_points = NULL;
+    m_pointsCapacity = 0;
+    if (!check(cudaMalloc(&m_points, 4 * m_numPoints * sizeof(float)), "allocating the points"))
+      return false;
+    m_pointsCapacity = m_numPoints;
+  }
+  if (m_numPoints == 0)
+    return true;
+
+  float* points = static_cast<float*>(m_points);
+  const size_t bytes = m_numPoints * sizeof(float);
+  return check(cudaMemcpy(points, x.data(), bytes, cudaMemcpyHostToDevice), "uploading the points")
+      && check(cudaMemcpy(points + m_numPoints, y.data(), bytes, cudaMemcpyHostToDevice), "uploading the points")
+      && check(cudaMemcpy(points + 2 * m_numPoints, z.data(), bytes, cudaMemcpyHostToDevice), "uploading the points")
+      && check(cudaMemcpy(points + 3 * m_numPoints, ranges.data(), bytes, cudaMemcpyHostToDevice), "uploading the ranges");
+}
+
+bool EndpointKernel::integrate(const std::vector<float>& transforms, float sigma, bool squaredError,
+                               float maxObstacleDistance, std::vector<float>& logLikelihoods){
+  const unsigned numParticles = transforms.size() / 12;
+  logLikelihoods.assign(numParticles, 0.0f);
+  if (numParticles == 0 || m_numPoints == 0)
+    return true;
+
+  if (!m_grid){
+    m_lastError = "no grid uploaded";
+    return false;
+  }
+
+  if (numParticles > m_particlesCapacity){
+    cudaFree(m_transforms);
+    cudaFree(m_results);
+    m_transforms = m_results = NULL;
+    m_particlesCapacity = 0;
+    if (!check(cudaMalloc(&m_transforms, 12 * numParticles * sizeof(float)), "allocating the transforms")
+        || !check(cudaMalloc(&m_results, numParticles * sizeof(float)), "allocating the results"))
+      return false;
+    m_particlesCapacity = numParticles;
+  }
+
+  if (!check(cudaMemcpy(m_transforms, transforms.data(), transforms.size() * sizeof(float), cudaMemcpyHostToDevice),
+             "uploading the transforms"))
+    return false;
+
+  const float* points = static_cast<const float*>(m_points);
+  const float* table = static_cast<const float*>(m_gridLogLikelihoods);
+  const float* particleTransforms = static_cast<const float*>(m_transforms);
+  float* results = static_cast<float*>(m_results);
+  if (m_gridInfo.bits == 8){
+    endpointLikelihoodKernel<<<numParticles, cvBlockSize>>>(static_cast<const uint8_t*>(m_grid), m_gridInfo, table,
+        points, m_numPoints, particleTransforms, sigma, squaredError, maxObstacleDistance, results);
+  } else {
+    endpointLikelihoodKernel<<<numParticles, cvBlockSize>>>(static_cast<const uint16_t*>(m_grid), m_gridInfo, table,
+        points, m_numPoints, particleTransforms, sigma, squaredError, maxObstacleDistance, results);
+  }
+
+  return check(cudaGetLastError(), "launching the kernel")
+      && check(cudaMemcpy(&logLikelihoods[0], m_results, numParticles * sizeof(float), cudaMemcpyDeviceToHost),
+               "downloading the weights");
+}
+
+}
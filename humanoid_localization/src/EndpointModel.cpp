@@ -26,12 +26,15 @@
 namespace humanoid_localization{
 
 EndpointModel::EndpointModel(ros::NodeHandle* nh, boost::shared_ptr<MapModel> mapModel, EngineT * rngEngine)
-: ObservationModel(nh, mapModel, rngEngine), m_sigma(0.2), m_maxObstacleDistance(0.5)
+: ObservationModel(nh, mapModel, rngEngine), m_sigma(0.2), m_maxObstacleDistance(0.5),
+  m_likelihoodFieldMaxMB(256), m_likelihoodFieldBits(8)
 {
   ROS_INFO("Using Endpoint observation model (precomputing...)");
 
   nh->param("endpoint/sigma", m_sigma, m_sigma);
   nh->param("endpoint/max_obstacle_distance", m_maxObstacleDistance, m_maxObstacleDistance);
+  nh->param("endpoint/likelihood_field_max_mb", m_likelihoodFieldMaxMB, m_likelihoodFieldMaxMB);
+  nh->param("endpoint/likelihood_field_bits", m_likelihoodFieldBits, m_likelihoodFieldBits);
 
   if (m_sigma <= 0.0){
     ROS_ERROR("Sigma (std.dev) needs to be > 0 in EndpointModel");
@@ -48,37 +51,63 @@ EndpointModel::~EndpointModel(){
 
 void EndpointModel::integrateMeasurement(Particles& particles, const PointCloud& pc, const std::vector<float>& ranges, float max_range, const tf::Transform& baseToSensor){
 
-    // iterate over samples, multithreaded:
-#pragma omp parallel for
-  for (unsigned i=0; i < particles.size(); ++i){
-    Eigen::Matrix4f globalLaserOrigin;
-    pcl_ros::transformAsMatrix(particles[i].pose * baseToSensor, globalLaserOrigin);
-    PointCloud pc_transformed;
-    pcl::transformPointCloud(pc, pc_transformed, globalLaserOrigin);
-
-    std::vector<float>::const_iterator ranges_it = ranges.begin();
-    // iterate over beams:
-    for (PointCloud::const_iterator it = pc_transformed.begin(); it != pc_transformed.end(); ++it, ++ranges_it){
-      // search only for endpoint in tree
-      octomap::point3d endPoint(it->x, it->y, it->z);
-      float dist = m_distanceMap->getDistance(endPoint);
-      float sigma_scaled = m_sigma;
-      if (m_use_squared_error)
-         sigma_scaled = (*ranges_it) * (*ranges_it) * (m_sigma);
-      if (dist > 0.0){ // endpoint is inside map:
-        particles[i].weight += logLikelihood(dist, sigma_scaled);
-      } else { //assign weight of max.distance:
-        particles[i].weight += logLikelihood(m_maxObstacleDistance, sigma_scaled);
+  assert(pc.size() == ranges.size());
+  const SensorPoints points(pc);
+  const bool useLikelihoodTable = !m_use_squared_error && !m_logLikelihoods.empty();
+
+  // iterate over samples, multithreaded:
+#pragma omp parallel
+  {
+    // transformed points, reused for all particles of this thread:
+    SensorPoints pointsTransformed;
+#pragma omp for
+    for (unsigned i=0; i < particles.size(); ++i){
+      Eigen::Matrix3f rotation;
+      Eigen::Vector3f translation;
+      particles.getSensorTransform(i, baseToSensor, rotation, translation);
+      points.transform(rotation, translation, pointsTransformed);
+
+      const float* px = pointsTransformed.x.data();
+      const float* py = pointsTransformed.y.data();
+      const float* pz = pointsTransformed.z.data();
+      double weight = 0.0;
+      // iterate over beams:
+      for (unsigned j = 0; j < pointsTransformed.size(); ++j){
+        // precomputed field first, distance map outside of its extent:
+        unsigned code;
+        const bool inField = m_likelihoodField.lookup(px[j], py[j], pz[j], code);
+        if (inField && useLikelihoodTable){
+          weight += m_logLikelihoods[code];
+          continue;
+        }
+
+        float sigma_scaled = m_sigma;
+        if (m_use_squared_error)
+           sigma_scaled = ranges[j] * ranges[j] * (m_sigma);
+
+        if (inField){ // field stores max. distance for invalid distances
+          weight += logLikelihood(m_likelihoodField.distance(code), sigma_scaled);
+          continue;
+        }
+
+        // search only for endpoint in tree
+        // (no distance map if the field from the map cache covers the whole map)
+        octomap::point3d endPoint(px[j], py[j], pz[j]);
+        float dist = m_distanceMap ? m_distanceMap->getDistance(endPoint) : -1.0f;
+        if (dist > 0.0){ // endpoint is inside map:
+          weight += logLikelihood(dist, sigma_scaled);
+        } else { //assign weight of max.distance:
+          weight += logLikelihood(m_maxObstacleDistance, sigma_scaled);
+        }
       }
+      particles.weight(i) += weight;
+      // TODO: handle max range measurements
     }
-    // TODO: handle max range measurements
-    //std::cout << "\n";
   }
 
 }
 
-bool EndpointModel::getHeightError(const Particle& p, const tf::StampedTransform& footprintToBase, double& heightError) const{
-  tf::Vector3 xyz = p.pose.getOrigin();
+bool EndpointModel::getHeightError(const tf::Vector3& xyz, const tf::StampedTransform& footprintToBase, double& heightError) const{
   double poseHeight = footprintToBase.getOrigin().getZ();
   std::vector<double> heights;
   m_mapModel->getHeightlist(xyz.getX(), xyz.getY(), 0.6, heights);
@@ -105,14 +134,72 @@ void EndpointModel::setMap(boost::shared_ptr<octomap::OcTree> map){
 }
 
 void EndpointModel::initDistanceMap(){
+  m_distanceMap.reset();
+  m_likelihoodField.clear();
+
+  // a complete likelihood field from the map cache makes the distance map unnecessary:
+  boost::shared_ptr<MapCache> cache = likelihoodFieldCache();
+  const char* data;
+  size_t size;
+  if (cache && cache->getSection(likelihoodFieldCacheSection(), data, size) && m_likelihoodField.deserialize(data, size)){
+    ROS_INFO("Likelihood field for endpoint model loaded from the map cache");
+  }
+
+  if (m_likelihoodField.empty() || m_likelihoodField.isCropped()){
+    double x,y,z;
+    m_map->getMetricMin(x,y,z);
+    octomap::point3d min(x,y,z);
+    m_map->getMetricMax(x,y,z);
+    octomap::point3d max(x,y,z);
+    m_distanceMap = boost::shared_ptr<DynamicEDTOctomap>(new DynamicEDTOctomap(float(m_maxObstacleDistance), &(*m_map), min, max, false));
+    m_distanceMap->update();
+    ROS_INFO("Distance map for endpoint model completed");
+  }
+
+  initLikelihoodField();
+}
+
+boost::shared_ptr<MapCache> EndpointModel::likelihoodFieldCache() const{
+  // only valid for the map the cache belongs to (not after setMap()):
+  if (m_map != m_mapModel->getMap())
+    return boost::shared_ptr<MapCache>();
+
+  return m_mapModel->getMapCache();
+}
+
+std::string EndpointModel::likelihoodFieldCacheSection() const{
+  return LikelihoodField::cacheSectionName("endpoint", m_map->getResolution(), float(m_maxObstacleDistance),
+                                           size_t(std::max(0, m_likelihoodFieldMaxMB)) * 1024 * 1024,
+                                           unsigned(m_likelihoodFieldBits), true);
+}
+
+void EndpointModel::initLikelihoodField(){
+  m_logLikelihoods.clear();
   double x,y,z;
   m_map->getMetricMin(x,y,z);
   octomap::point3d min(x,y,z);
   m_map->getMetricMax(x,y,z);
   octomap::point3d max(x,y,z);
-  m_distanceMap = boost::shared_ptr<DynamicEDTOctomap>(new DynamicEDTOctomap(float(m_maxObstacleDistance), &(*m_map), min, max, false));
-  m_distanceMap->update();
-  ROS_INFO("Distance map for endpoint model completed");
+
+  const size_t maxBytes = size_t(std::max(0, m_likelihoodFieldMaxMB)) * 1024 * 1024;
+  if (m_likelihoodField.empty()){ // not loaded from the map cache
+    if (!m_likelihoodField.build(*m_distanceMap, min, max, m_map->getResolution(), float(m_maxObstacleDistance),
+                                 maxBytes, unsigned(m_likelihoodFieldBits)))
+      return;
+
+    boost::shared_ptr<MapCache> cache = likelihoodFieldCache();
+    if (cache){
+      std::vector<char> data;
+      m_likelihoodField.serialize(data);
+      cache->setSection(likelihoodFieldCacheSection(), &data[0], data.size());
+    }
+  }
+
+  m_logLikelihoods.resize(m_likelihoodField.numCodes());
+  for (unsigned code = 0; code < m_logLikelihoods.size(); ++code)
+    m_logLikelihoods[code] = logLikelihood(m_likelihoodField.distance(code), m_sigma);
+
+  ROS_INFO("Likelihood field for endpoint model completed (%zu KB)", m_likelihoodField.bytesAllocated() / 1024);
 }
 
 }
@@ -0,0 +1,108 @@
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <humanoid_localization/EndpointModelGPU.h>
+
+namespace humanoid_localization{
+
+EndpointModelGPU::EndpointModelGPU(ros::NodeHandle* nh, boost::shared_ptr<MapModel> mapModel, EngineT * rngEngine)
+: EndpointModel(nh, mapModel, rngEngine), m_useGPU(false)
+{
+  uploadLikelihoodField();
+}
+
+EndpointModelGPU::~EndpointModelGPU(){
+
+}
+
+void EndpointModelGPU::setMap(boost::shared_ptr<octomap::OcTree> map){
+  EndpointModel::setMap(map);
+  uploadLikelihoodField();
+}
+
+void EndpointModelGPU::uploadLikelihoodField(){
+  m_useGPU = false;
+  if (!EndpointKernel::deviceAvailable()){
+    ROS_WARN("No CUDA device available, evaluating the endpoint model on the CPU");
+    return;
+  }
+
+  if (m_likelihoodField.empty() || m_likelihoodField.isCropped()){
+    ROS_WARN("GPU endpoint model needs a likelihood field of the full map "
+             "(increase endpoint/likelihood_field_max_mb), evaluating on the CPU");
+    return;
+  }
+
+  EndpointKernel::Grid grid;
+  grid.originX = m_likelihoodField.originX();
+  grid.originY = m_likelihoodField.originY();
+  grid.originZ = m_likelihoodField.originZ();
+  grid.invResolution = 1.0 / m_likelihoodField.resolution();
+  grid.sizeX = m_likelihoodField.sizeX();
+  grid.sizeY = m_likelihoodField.sizeY();
+  grid.sizeZ = m_likelihoodField.sizeZ();
+  grid.bits = m_likelihoodField.bits();
+  grid.codeToDistance = m_likelihoodField.codeToDistance();
+
+  if (!m_kernel.uploadGrid(grid, m_likelihoodField.data(), m_logLikelihoods)){
+    ROS_ERROR("Uploading the likelihood field to the GPU failed (%s), evaluating on the CPU",
+              m_kernel.lastError().c_str());
+    return;
+  }
+
+  m_useGPU = true;
+  ROS_INFO("Likelihood field uploaded to the GPU");
+}
+
+void EndpointModelGPU::integrateMeasurement(Particles& particles, const PointCloud& pc, const std::vector<float>& ranges, float max_range, const tf::Transform& baseToSensor){
+  if (!m_useGPU){
+    EndpointModel::integrateMeasurement(particles, pc, ranges, max_range, baseToSensor);
+    return;
+  }
+
+  const SensorPoints points(pc);
+  m_transforms.resize(12 * particles.size());
+  for (unsigned i = 0; i < particles.size(); ++i){
+    Eigen::Matrix3f rotation;
+    Eigen::Vector3f translation;
+    particles.getSensorTransform(i, baseToSensor, rotation, translation);
+    float* t = &m_transforms[12 * i];
+    for (unsigned r = 0; r < 3; ++r){
+      for (unsigned c = 0; c < 3; ++c)
+        t[3*r + c] = rotation(r, c);
+      t[9 + r] = translation(r);
+    }
+  }
+
+  if (!m_kernel.uploadPoints(points.x, points.y, points.z, ranges)
+      || !m_kernel.integrate(m_transforms, m_sigma, m_use_squared_error, m_maxObstacleDistance, m_logLikelihoodSums))
+  {
+    ROS_ERROR("Endpoint model on the GPU failed (%s), switching to the CPU", m_kernel.lastError().c_str());
+    m_useGPU = false;
+    EndpointModel::integrateMeasurement(particles, pc, ranges, max_range, baseToSensor);
+    return;
+  }
+
+  for (unsigned i = 0; i < particles.size(); ++i)
+    particles.weight(i) += m_logLikelihoodSums[i];
+}
+
+}
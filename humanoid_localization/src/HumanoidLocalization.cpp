@@ -20,7 +20,9 @@
 
 #include <humanoid_localization/HumanoidLocalization.h>
 #include <iostream>
+#include <stdexcept>
 #include <pcl/filters/uniform_sampling.h>
+#include <Eigen/Eigenvalues>
 
 #include <pcl_ros/transforms.h>
 
@@ -32,14 +34,17 @@
 #define _BENCH_TIME 0
 
 namespace humanoid_localization{
-HumanoidLocalization::HumanoidLocalization(unsigned randomSeed)
+HumanoidLocalization::HumanoidLocalization(unsigned randomSeed, bool tfSpinThread)
 :
 m_rngEngine(randomSeed),
 m_rngNormal(m_rngEngine, NormalDistributionT(0.0, 1.0)),
 m_rngUniform(m_rngEngine, UniformDistributionT(0.0, 1.0)),
 m_nh(),m_privateNh("~"),
+m_tfListener(ros::Duration(tf::Transformer::DEFAULT_CACHE_TIME), tfSpinThread),
 m_odomFrameId("odom"), m_targetFrameId("odom"), m_baseFrameId("torso"), m_baseFootprintId("base_footprint"), m_globalFrameId("map"),
 m_useRaycasting(true), m_initFromTruepose(false), m_numParticles(500),
+m_useKLDSampling(false), m_kldMinParticles(100), m_kldMaxParticles(5000),
+m_kldEpsilon(0.05), m_kldZ(2.326), m_kldBinSizeXY(0.25), m_kldBinSizeYaw(M_PI/18.0),
 m_sensorSampleDist(0.2),
 m_nEffFactor(1.0), m_minParticleWeight(0.0),
 m_bestParticleIdx(-1), m_lastIMUMsgBuffer(5),
@@ -52,9 +57,14 @@ m_temporalSamplingRange(0.1), m_transformTolerance(0.1),
 m_groundFilterPointCloud(true), m_groundFilterDistance(0.04),
 m_groundFilterAngle(0.15), m_groundFilterPlaneDistance(0.07),
 m_sensorSampleDistGroundFactor(3),
+m_groundFilterPrior(false), m_groundFilterPriorMinInliers(0.1), m_groundFilterPriorIterations(2),
 m_headYawRotationLastScan(0.0), m_headPitchRotationLastScan(0.0),
 m_useIMU(false),
-m_constrainMotionZ (false), m_constrainMotionRP(false), m_useTimer(false), m_timerPeriod(0.1)
+m_constrainMotionZ (false), m_constrainMotionRP(false), m_useTimer(false), m_timerPeriod(0.1),
+m_particleCloudPeriod(0.0), m_latencyStatsPeriod(1.0),
+m_numFilterResets(0),
+m_asyncPreprocessing(false), m_pipelineShutdown(false),
+m_numDroppedRaw(0), m_numDroppedPrepared(0)
 {
 
    m_latest_transform.setData (tf::Transform(tf::createIdentityQuaternion()) );
@@ -70,6 +80,23 @@ m_constrainMotionZ (false), m_constrainMotionRP(false), m_useTimer(false), m_tim
   m_privateNh.param("init_global", m_initGlobal, m_initGlobal);
   m_privateNh.param("best_particle_as_mean", m_bestParticleAsMean, m_bestParticleAsMean);
   m_privateNh.param("num_particles", m_numParticles, m_numParticles);
+  m_privateNh.param("kld_sampling", m_useKLDSampling, m_useKLDSampling);
+  m_privateNh.param("kld/min_particles", m_kldMinParticles, m_kldMinParticles);
+  m_privateNh.param("kld/max_particles", m_kldMaxParticles, m_kldMaxParticles);
+  m_privateNh.param("kld/epsilon", m_kldEpsilon, m_kldEpsilon);
+  m_privateNh.param("kld/z", m_kldZ, m_kldZ);
+  m_privateNh.param("kld/bin_size_xy", m_kldBinSizeXY, m_kldBinSizeXY);
+  m_privateNh.param("kld/bin_size_yaw", m_kldBinSizeYaw, m_kldBinSizeYaw);
+  if (m_useKLDSampling){
+    if (m_kldMinParticles < 1 || m_kldMaxParticles < m_kldMinParticles || m_kldEpsilon <= 0.0
+        || m_kldBinSizeXY <= 0.0 || m_kldBinSizeYaw <= 0.0)
+    {
+      ROS_ERROR("Invalid KLD-sampling parameters (kld/...), using a fixed number of particles");
+      m_useKLDSampling = false;
+    } else {
+      ROS_INFO("KLD-sampling with %d to %d particles", m_kldMinParticles, m_kldMaxParticles);
+    }
+  }
   m_privateNh.param("neff_factor", m_nEffFactor, m_nEffFactor);
   m_privateNh.param("min_particle_weight", m_minParticleWeight, m_minParticleWeight);
 
@@ -114,27 +141,65 @@ m_constrainMotionZ (false), m_constrainMotionRP(false), m_useTimer(false), m_tim
   m_privateNh.param("ground_filter_angle", m_groundFilterAngle, m_groundFilterAngle);
   m_privateNh.param("ground_filter_plane_distance", m_groundFilterPlaneDistance, m_groundFilterPlaneDistance);
   m_privateNh.param("sensor_sampling_dist_ground_factor", m_sensorSampleDistGroundFactor, m_sensorSampleDistGroundFactor);
+  m_privateNh.param("ground_filter_prior", m_groundFilterPrior, m_groundFilterPrior);
+  m_privateNh.param("ground_filter_prior_min_inliers", m_groundFilterPriorMinInliers, m_groundFilterPriorMinInliers);
+  m_privateNh.param("ground_filter_prior_iterations", m_groundFilterPriorIterations, m_groundFilterPriorIterations);
 
   m_privateNh.param("use_timer", m_useTimer, m_useTimer);
   m_privateNh.param("timer_period", m_timerPeriod, m_timerPeriod);
+  m_privateNh.param("async_preprocessing", m_asyncPreprocessing, m_asyncPreprocessing);
+  m_privateNh.param("particlecloud_period", m_particleCloudPeriod, m_particleCloudPeriod);
+  m_privateNh.param("latency_stats_period", m_latencyStatsPeriod, m_latencyStatsPeriod);
+  int latencyStatsWindow = 200;
+  m_privateNh.param("latency_stats_window", latencyStatsWindow, latencyStatsWindow);
+  m_latencyStats.setWindowSize(std::max(1, latencyStatsWindow));
 
   // motion model parameters
 
   m_motionModel = boost::shared_ptr<MotionModel>(new MotionModel(&m_privateNh, &m_rngEngine, &m_tfListener, m_odomFrameId, m_baseFrameId));
 
   if (m_useRaycasting){
+    // "octree" (OcTree::castRay) or "sphere_tracing" (precomputed distance field)
+    std::string raycastingBackend("octree");
+    m_privateNh.param("raycasting_backend", raycastingBackend, raycastingBackend);
+
     m_mapModel = boost::shared_ptr<MapModel>(new OccupancyMap(&m_privateNh));
-    m_observationModel = boost::shared_ptr<ObservationModel>(new RaycastingModel(&m_privateNh, m_mapModel, &m_rngEngine));
+    if (raycastingBackend == "sphere_tracing"){
+#ifndef SKIP_ENDPOINT_MODEL
+      m_observationModel = boost::shared_ptr<ObservationModel>(new SphereTracingModel(&m_privateNh, m_mapModel, &m_rngEngine));
+#else
+      ROS_WARN("SphereTracingModel not compiled due to missing dynamicEDT3D, using octree raycasting");
+#endif
+    } else if (raycastingBackend != "octree"){
+      ROS_WARN("Unknown raycasting_backend \"%s\", using octree raycasting", raycastingBackend.c_str());
+    }
+
+    if (!m_observationModel)
+      m_observationModel = boost::shared_ptr<ObservationModel>(new RaycastingModel(&m_privateNh, m_mapModel, &m_rngEngine));
   } else{
 #ifndef SKIP_ENDPOINT_MODEL
     //m_mapModel = boost::shared_ptr<MapModel>(new DistanceMap(&m_privateNh));
     m_mapModel = boost::shared_ptr<MapModel>(new OccupancyMap(&m_privateNh));
-    m_observationModel = boost::shared_ptr<ObservationModel>(new EndpointModel(&m_privateNh, m_mapModel, &m_rngEngine));
+    // evaluate the endpoint model on a CUDA device?
+    bool useGPU = false;
+    m_privateNh.param("endpoint/use_gpu", useGPU, useGPU);
+    if (useGPU){
+#ifdef WITH_CUDA_ENDPOINT_MODEL
+      m_observationModel = boost::shared_ptr<ObservationModel>(new EndpointModelGPU(&m_privateNh, m_mapModel, &m_rngEngine));
+#else
+      ROS_WARN("EndpointModelGPU not compiled due to missing CUDA, using the CPU");
+#endif
+    }
+
+    if (!m_observationModel)
+      m_observationModel = boost::shared_ptr<ObservationModel>(new EndpointModel(&m_privateNh, m_mapModel, &m_rngEngine));
 #else
     ROS_FATAL("EndpointModel not compiled due to missing dynamicEDT3D");
     exit(-1);
 #endif
   }
+  // the map and observation models added their precomputed data
+  m_mapModel->writeMapCache();
 
 
   m_particles.resize(m_numParticles);
@@ -151,11 +216,15 @@ m_constrainMotionZ (false), m_constrainMotionRP(false), m_useTimer(false), m_tim
   m_bestPosePub = m_privateNh.advertise<geometry_msgs::PoseArray>("best_particle", 10);
   m_nEffPub = m_privateNh.advertise<std_msgs::Float32>("n_eff", 10);
   m_filteredPointCloudPub = m_privateNh.advertise<sensor_msgs::PointCloud2>("filtered_cloud", 1);
+  m_latencyStatsPub = m_privateNh.advertise<diagnostic_msgs::DiagnosticArray>("latency_stats", 1);
 
 
   //TODO Propagate particles independent of sensor callback
   reset();
 
+  if (m_asyncPreprocessing)
+    startPipeline();
+
   // ROS subscriptions last:
   m_globalLocSrv = m_nh.advertiseService("global_localization", &HumanoidLocalization::globalLocalizationCallback, this);
 
@@ -192,6 +261,8 @@ m_constrainMotionZ (false), m_constrainMotionRP(false), m_useTimer(false), m_tim
 
 HumanoidLocalization::~HumanoidLocalization() {
 
+  stopPipeline();
+
   delete m_laserFilter;
   delete m_laserSub;
 
@@ -204,6 +275,7 @@ HumanoidLocalization::~HumanoidLocalization() {
 }
 
 void HumanoidLocalization::timerCallback(const ros::TimerEvent & e){
+   boost::mutex::scoped_lock lock(m_filterMutex);
    ros::Time transformExpiration = e.current_real + ros::Duration(m_transformTolerance);
    tf::StampedTransform tmp_tf_stamped(m_latest_transform, transformExpiration, m_globalFrameId, m_targetFrameId);
    m_tfBroadcaster.sendTransform(tmp_tf_stamped);
@@ -279,8 +351,8 @@ void HumanoidLocalization::reset(){
 
 #if defined(_BENCH_TIME)
   double dt = (ros::WallTime::now() - startTime).toSec();
-  ROS_INFO_STREAM("Initialization of "<< m_numParticles << " particles took "
-                  << dt << "s (="<<dt/m_numParticles<<"s/particle)");
+  ROS_INFO_STREAM("Initialization of "<< m_particles.size() << " particles took "
+                  << dt << "s (="<<dt/m_particles.size()<<"s/particle)");
 #endif
 
 
@@ -301,9 +373,7 @@ void HumanoidLocalization::initZRP(double& z, double& roll, double& pitch){
     }
 
     // Get latest roll and pitch
-    if(!m_lastIMUMsgBuffer.empty()) {
-      getRP(m_lastIMUMsgBuffer.back().orientation, roll, pitch);
-    } else {
+    if(!getLatestImuRP(roll, pitch)) {
       ROS_WARN("Could not determine current roll and pitch, falling back to init_pose_{roll,pitch}");
       roll = m_initPose(3);
       pitch = m_initPose(4);
@@ -325,6 +395,9 @@ void HumanoidLocalization::laserCallback(const sensor_msgs::LaserScanConstPtr& m
     return;
   }
 
+  boost::mutex::scoped_lock lock(m_filterMutex);
+  ros::WallTime callbackStartTime = ros::WallTime::now();
+
   double timediff = (msg->header.stamp - m_lastLaserTime).toSec();
   if (m_receivedSensorData && timediff < 0){
     ROS_WARN("Ignoring received laser data that is %f s older than previous data!", timediff);
@@ -342,21 +415,33 @@ void HumanoidLocalization::laserCallback(const sensor_msgs::LaserScanConstPtr& m
   bool sensor_integrated = false;
   if (!m_paused && (!m_receivedSensorData || isAboveMotionThreshold(odomPose))) {
 
-     // convert laser to point cloud first:
-     PointCloud pc_filtered;
-     std::vector<float> laserRangesSparse;
-     prepareLaserPointCloud(msg, pc_filtered, laserRangesSparse);
-
-     sensor_integrated = localizeWithMeasurement(pc_filtered, laserRangesSparse, msg->range_max);
+     if (m_asyncPreprocessing){
+       // integrated later by the filter thread, propagate by odometry meanwhile:
+       PipelineMeasurementPtr measurement(new PipelineMeasurement());
+       measurement->laser = msg;
+       measurement->odomPose = odomPose;
+       enqueueMeasurement(measurement);
+     } else {
+       // convert laser to point cloud first:
+       ros::WallTime preprocessingStartTime = ros::WallTime::now();
+       PointCloud pc_filtered;
+       std::vector<float> laserRangesSparse;
+       prepareLaserPointCloud(msg, pc_filtered, laserRangesSparse);
+       addStageTime(m_stageTimings.preprocessing, "preprocessing", (ros::WallTime::now() - preprocessingStartTime).toSec());
+
+       sensor_integrated = localizeWithMeasurement(pc_filtered, laserRangesSparse, msg->range_max);
+     }
 
   } 
 
   if(!sensor_integrated){ // no laser integration: propagate particles forward by full interval
 
      // relative odom transform to last odomPose
+     ros::WallTime motionStartTime = ros::WallTime::now();
      tf::Transform odomTransform = m_motionModel->computeOdomTransform(odomPose);
      m_motionModel->applyOdomTransform(m_particles, odomTransform);
      constrainMotion(odomPose);
+     addStageTime(m_stageTimings.motion, "motion_odometry", (ros::WallTime::now() - motionStartTime).toSec());
   }
   else
   {
@@ -364,8 +449,12 @@ void HumanoidLocalization::laserCallback(const sensor_msgs::LaserScanConstPtr& m
   }
 
   m_motionModel->storeOdomPose(odomPose);
+  ros::WallTime publishStartTime = ros::WallTime::now();
   publishPoseEstimate(msg->header.stamp, sensor_integrated);
-  m_lastLaserTime = msg->header.stamp; 
+  addStageTime(m_stageTimings.publish, "publish", (ros::WallTime::now() - publishStartTime).toSec());
+  m_lastLaserTime = msg->header.stamp;
+  m_latencyStats.add("laser_callback", (ros::WallTime::now() - callbackStartTime).toSec());
+  publishLatencyStats();
 }
 
 void HumanoidLocalization::constrainMotion(const tf::Pose& odomPose){
@@ -381,15 +470,15 @@ void HumanoidLocalization::constrainMotion(const tf::Pose& odomPose){
 #pragma omp parallel for
   for (unsigned i=0; i < m_particles.size(); ++i){
     if (m_constrainMotionZ){
-      tf::Vector3 pos = m_particles[i].pose.getOrigin();
-      double floor_z = m_mapModel->getFloorHeight(m_particles[i].pose);
-      pos.setZ(z+floor_z);
-      m_particles[i].pose.setOrigin(pos);
+      tf::Vector3 pos = m_particles.getPosition(i);
+      double floor_z = m_mapModel->getFloorHeight(m_particles.getPose(i));
+      m_particles.setPosition(i, pos.getX(), pos.getY(), z+floor_z);
     }
 
     if (m_constrainMotionRP){
-      double yaw =  tf::getYaw(m_particles[i].pose.getRotation());
-      m_particles[i].pose.setRotation(tf::createQuaternionFromRPY(odomRoll, odomPitch, yaw));
+      double roll, pitch, yaw;
+      m_particles.getRPY(i, roll, pitch, yaw);
+      m_particles.setRPY(i, odomRoll, odomPitch, yaw);
 
     }
   }
@@ -407,19 +496,53 @@ bool HumanoidLocalization::isAboveMotionThreshold(const tf::Pose& odomPose){
 
 bool HumanoidLocalization::localizeWithMeasurement(const PointCloud& pc_filtered, const std::vector<float>& ranges, double max_range){
   ros::WallTime startTime = ros::WallTime::now();
+  if (!applyMotionToMeasurement(measurementStamp(pc_filtered)))
+    return false;
+  ros::WallTime observationStartTime = ros::WallTime::now();
+  addStageTime(m_stageTimings.motion, "motion", (observationStartTime - startTime).toSec());
+
+  if (!integrateObservation(m_particles, pc_filtered, ranges, max_range))
+    return false;
+  ros::WallTime verifyStartTime = ros::WallTime::now();
+  addStageTime(m_stageTimings.observation, "observation", (verifyStartTime - observationStartTime).toSec());
+
+  // TODO: verify poses before measurements, ignore particles then
+  m_mapModel->verifyPoses(m_particles);
+  ros::WallTime resamplingStartTime = ros::WallTime::now();
+  addStageTime(m_stageTimings.verifyPoses, "verify_poses", (resamplingStartTime - verifyStartTime).toSec());
+
+  finishObservation();
+  addStageTime(m_stageTimings.resampling, "resampling", (ros::WallTime::now() - resamplingStartTime).toSec());
+
+  double dt = (ros::WallTime::now() - startTime).toSec();
+  ROS_INFO_STREAM("Observations for "<< m_particles.size() << " particles took "
+                  << dt << "s (="<<dt/m_particles.size()<<"s/particle)");
+
+  return true;
+}
+
+ros::Time HumanoidLocalization::measurementStamp(const PointCloud& pc){
 #if PCL_VERSION_COMPARE(>=,1,7,0)
-  ros::Time t = pcl_conversions::fromPCL(pc_filtered.header).stamp;
+  return pcl_conversions::fromPCL(pc.header).stamp;
 #else
-  ros::Time t = pc_filtered.header.stamp;
+  return pc.header.stamp;
 #endif
+}
+
+bool HumanoidLocalization::applyMotionToMeasurement(const ros::Time& t){
   // apply motion model with temporal sampling:
   m_motionModel->applyOdomTransformTemporal(m_particles, t, m_temporalSamplingRange);
-  
+
   // constrain to ground plane, if desired:
   tf::Stamped<tf::Transform> odomPose;
   if (!m_motionModel->lookupOdomPose(t, odomPose))
     return false;
   constrainMotion(odomPose);
+  return true;
+}
+
+bool HumanoidLocalization::integrateObservation(Particles& particles, const PointCloud& pc_filtered, const std::vector<float>& ranges, double max_range) const{
+  ros::Time t = measurementStamp(pc_filtered);
 
   // transformation from torso frame to sensor
   // this takes the latest tf, assumes that torso to sensor did not change over temp. sampling!
@@ -430,7 +553,7 @@ bool HumanoidLocalization::localizeWithMeasurement(const PointCloud& pc_filtered
   tf::Transform torsoToSensor(localSensorFrame.inverse());
   
 //### Particles in log-form from here...
-  toLogForm();
+  toLogForm(particles);
 
   // skip pose integration if z, roll and pitch constrained to floor by odometry
   if (!(m_constrainMotionRP && m_constrainMotionZ)){
@@ -454,7 +577,7 @@ bool HumanoidLocalization::localizeWithMeasurement(const PointCloud& pc_filtered
       if (!m_motionModel->lookupLocalTransform(m_baseFootprintId, t, footprintToTorso)) {
         ROS_WARN("Could not obtain pose height in localization, skipping Pose integration");
       } else {
-        m_observationModel->integratePoseMeasurement(m_particles, angleX, angleY, footprintToTorso);
+        m_observationModel->integratePoseMeasurement(particles, angleX, angleY, footprintToTorso);
       }
     } else {
       ROS_WARN("Could not obtain roll and pitch measurement, skipping Pose integration");
@@ -462,10 +585,13 @@ bool HumanoidLocalization::localizeWithMeasurement(const PointCloud& pc_filtered
   }
 
   m_filteredPointCloudPub.publish(pc_filtered);
-  m_observationModel->integrateMeasurement(m_particles, pc_filtered, ranges, max_range, torsoToSensor);
+  m_observationModel->integrateMeasurement(particles, pc_filtered, ranges, max_range, torsoToSensor);
+  return true;
+}
 
-  // TODO: verify poses before measurements, ignore particles then
-  m_mapModel->verifyPoses(m_particles);
+void HumanoidLocalization::finishObservation(){
+  m_stageTimings.numParticleUpdates += m_particles.size();
+  m_stageTimings.numMeasurements++;
 
   // normalize weights and transform back from log:
   normalizeWeights();
@@ -485,12 +611,6 @@ bool HumanoidLocalization::localizeWithMeasurement(const PointCloud& pc_filtered
   }
 
   m_receivedSensorData = true;
-
-  double dt = (ros::WallTime::now() - startTime).toSec();
-  ROS_INFO_STREAM("Observations for "<< m_numParticles << " particles took "
-                  << dt << "s (="<<dt/m_numParticles<<"s/particle)");
-
-  return true;
 }
 
 void HumanoidLocalization::prepareLaserPointCloud(const sensor_msgs::LaserScanConstPtr& laser, PointCloud& pc, std::vector<float>& ranges) const{
@@ -609,13 +729,15 @@ void HumanoidLocalization::filterGroundPlane(const PointCloud& pc, PointCloud& g
       seg.setEpsAngle(groundFilterAngle);
 
 
-      PointCloud cloud_filtered(pc);
+      // one shared copy of the cloud for segmentation and extraction:
+      PointCloud::Ptr cloud_filtered_ptr(new PointCloud(pc));
+      PointCloud& cloud_filtered = *cloud_filtered_ptr;
       // Create the filtering object
       pcl::ExtractIndices<pcl::PointXYZ> extract;
       bool groundPlaneFound = false;
 
       while(cloud_filtered.size() > 10 && !groundPlaneFound){
-         seg.setInputCloud(cloud_filtered.makeShared());
+         seg.setInputCloud(cloud_filtered_ptr);
          seg.segment (*inliers, *coefficients);
          if (inliers->indices.size () == 0){
             ROS_INFO("PCL segmentation did not find any plane.");
@@ -623,7 +745,7 @@ void HumanoidLocalization::filterGroundPlane(const PointCloud& pc, PointCloud& g
             break;
          }
 
-         extract.setInputCloud(cloud_filtered.makeShared());
+         extract.setInputCloud(cloud_filtered_ptr);
          extract.setIndices(inliers);
 
          if (std::abs(coefficients->values.at(3)) < groundFilterPlaneDistance){
@@ -693,6 +815,78 @@ void HumanoidLocalization::filterGroundPlane(const PointCloud& pc, PointCloud& g
 
 
 
+bool HumanoidLocalization::filterGroundPlanePrior(const PointCloud& pc, PointCloud& ground, PointCloud& nonground,
+                                                  double groundFilterDistance, double groundFilterAngle, double groundFilterPlaneDistance,
+                                                  double minInlierRatio, int refinementIterations){
+  ground.header = pc.header;
+  nonground.header = pc.header;
+  if (pc.size() < 50)
+    return false;
+
+  // prior: z = 0 in the base footprint frame (the cloud is transformed into it, so the
+  // robot's roll and pitch are already accounted for), the floor may be offset by
+  // up to groundFilterPlaneDistance in z
+  Eigen::Vector3f normal(0.0f, 0.0f, 1.0f);
+  float offset = 0.0f;
+  float threshold = (refinementIterations > 0) ? groundFilterPlaneDistance + groundFilterDistance : groundFilterDistance;
+
+  const Eigen::Map<const Eigen::MatrixXf, Eigen::Aligned, Eigen::OuterStride<> > points = pc.getMatrixXfMap(3, 4, 0);
+  Eigen::ArrayXf distances;
+  for (int iteration = 0; ; ++iteration){
+    // signed distances of all points to the plane:
+    distances = (normal.transpose() * points).transpose().array() + offset;
+    if (iteration >= refinementIterations)
+      break;
+
+    // least squares plane of the current inliers:
+    Eigen::Vector3f mean(Eigen::Vector3f::Zero());
+    Eigen::Matrix3f covariance(Eigen::Matrix3f::Zero());
+    unsigned numInliers = 0;
+    for (int i = 0; i < distances.size(); ++i){
+      if (std::abs(distances[i]) < threshold){
+        mean += points.col(i);
+        covariance += points.col(i) * points.col(i).transpose();
+        numInliers++;
+      }
+    }
+    if (numInliers < 3)
+      return false;
+
+    mean /= numInliers;
+    covariance = covariance / numInliers - mean * mean.transpose();
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(covariance);
+    normal = solver.eigenvectors().col(0);
+    if (normal.z() < 0.0f)
+      normal = -normal;
+    offset = -normal.dot(mean);
+
+    // same acceptance as the RANSAC ground plane:
+    if (std::acos(std::min(normal.z(), 1.0f)) > groundFilterAngle || std::abs(offset) > groundFilterPlaneDistance)
+      return false;
+
+    threshold = groundFilterDistance;
+  }
+
+  const unsigned numGround = (distances.abs() < threshold).count();
+  if (numGround < minInlierRatio * pc.size()){
+    ROS_DEBUG("Ground plane prior has too few inliers: %u/%zu", numGround, pc.size());
+    return false;
+  }
+
+  ground.reserve(numGround);
+  nonground.reserve(pc.size() - numGround);
+  for (unsigned i = 0; i < pc.size(); ++i){
+    if (std::abs(distances[i]) < threshold)
+      ground.push_back(pc.points[i]);
+    else
+      nonground.push_back(pc.points[i]);
+  }
+
+  ROS_DEBUG("Ground plane from prior: %u/%zu inliers. Coeff: %f %f %f %f", numGround, pc.size(),
+            normal.x(), normal.y(), normal.z(), offset);
+  return true;
+}
+
 void HumanoidLocalization::prepareGeneralPointCloud(const sensor_msgs::PointCloud2::ConstPtr& msg, PointCloud& pc, std::vector<float>& ranges) const{
 
     pc.clear();
@@ -734,7 +928,15 @@ void HumanoidLocalization::prepareGeneralPointCloud(const sensor_msgs::PointClou
         pcl_ros::transformAsMatrix(sensorToBaseFootprint.inverse(), matBaseFootprintToSensor);
         // TODO:Why transform the point cloud and not just the normal vector?
         pcl::transformPointCloud(pc, pc, matSensorToBaseFootprint );
-        filterGroundPlane(pc, ground, nonground, m_groundFilterDistance, m_groundFilterAngle, m_groundFilterPlaneDistance);
+        // fast classification with the floor prior, RANSAC if the prior does not fit:
+        if (!m_groundFilterPrior
+            || !filterGroundPlanePrior(pc, ground, nonground, m_groundFilterDistance, m_groundFilterAngle, m_groundFilterPlaneDistance,
+                                       m_groundFilterPriorMinInliers, m_groundFilterPriorIterations))
+        {
+          ground.clear();
+          nonground.clear();
+          filterGroundPlane(pc, ground, nonground, m_groundFilterDistance, m_groundFilterAngle, m_groundFilterPlaneDistance);
+        }
 
         // clear pc again and refill it based on classification
         pc.clear();
@@ -822,6 +1024,9 @@ void HumanoidLocalization::pointCloudCallback(const sensor_msgs::PointCloud2::Co
     return;
   }
 
+  boost::mutex::scoped_lock lock(m_filterMutex);
+  ros::WallTime callbackStartTime = ros::WallTime::now();
+
   double timediff = (msg->header.stamp - m_lastPointCloudTime).toSec();
   if (m_receivedSensorData && timediff < 0){
     ROS_WARN("Ignoring received PointCloud data that is %f s older than previous data!", timediff);
@@ -856,12 +1061,23 @@ void HumanoidLocalization::pointCloudCallback(const sensor_msgs::PointCloud2::Co
       isAboveHeadMotionThreshold = true;
   // end #1
 
-  if (!m_paused && (!m_receivedSensorData || isAboveHeadMotionThreshold || isAboveMotionThreshold(odomPose))) {
+  if (!m_paused && m_asyncPreprocessing && (!m_receivedSensorData || isAboveHeadMotionThreshold || isAboveMotionThreshold(odomPose))) {
+    // integrated later by the filter thread, propagate by odometry meanwhile:
+    PipelineMeasurementPtr measurement(new PipelineMeasurement());
+    measurement->cloud = msg;
+    measurement->odomPose = odomPose;
+    measurement->headYaw = headYaw;
+    measurement->headPitch = headPitch;
+    enqueueMeasurement(measurement);
+
+  } else if (!m_paused && (!m_receivedSensorData || isAboveHeadMotionThreshold || isAboveMotionThreshold(odomPose))) {
 
     // convert laser to point cloud first:
+    ros::WallTime preprocessingStartTime = ros::WallTime::now();
     PointCloud pc_filtered;
     std::vector<float> rangesSparse;
     prepareGeneralPointCloud(msg, pc_filtered, rangesSparse);
+    addStageTime(m_stageTimings.preprocessing, "preprocessing", (ros::WallTime::now() - preprocessingStartTime).toSec());
 
     double maxRange = 10.0; // TODO #4: What is a maxRange for pointClouds? NaN? maxRange is expected to be a double and integrateMeasurement checks rangesSparse[i] > maxRange
     ROS_DEBUG("Updating Pose Estimate from a PointCloud with %zu points and %zu ranges", pc_filtered.size(), rangesSparse.size());
@@ -870,9 +1086,11 @@ void HumanoidLocalization::pointCloudCallback(const sensor_msgs::PointCloud2::Co
   } 
   if(!sensor_integrated){ // no observation necessary: propagate particles forward by full interval
      // relative odom transform to last odomPose
+     ros::WallTime motionStartTime = ros::WallTime::now();
      tf::Transform odomTransform = m_motionModel->computeOdomTransform(odomPose);
      m_motionModel->applyOdomTransform(m_particles, odomTransform);
      constrainMotion(odomPose);
+     addStageTime(m_stageTimings.motion, "motion_odometry", (ros::WallTime::now() - motionStartTime).toSec());
   }
   else{
      m_lastLocalizedPose = odomPose;
@@ -882,16 +1100,208 @@ void HumanoidLocalization::pointCloudCallback(const sensor_msgs::PointCloud2::Co
   }
 
   m_motionModel->storeOdomPose(odomPose);
+  ros::WallTime publishStartTime = ros::WallTime::now();
   publishPoseEstimate(msg->header.stamp, sensor_integrated);
+  addStageTime(m_stageTimings.publish, "publish", (ros::WallTime::now() - publishStartTime).toSec());
   m_lastPointCloudTime = msg->header.stamp;
+  m_latencyStats.add("point_cloud_callback", (ros::WallTime::now() - callbackStartTime).toSec());
+  publishLatencyStats();
   ROS_DEBUG("PointCloud callback complete.");
 }
 
+void HumanoidLocalization::startPipeline(){
+  m_pipelineShutdown = false;
+  m_preprocessingThread = boost::thread(boost::bind(&HumanoidLocalization::preprocessingThread, this));
+  m_filterThread = boost::thread(boost::bind(&HumanoidLocalization::filterThread, this));
+  ROS_INFO("Asynchronous sensor preprocessing enabled");
+}
+
+void HumanoidLocalization::stopPipeline(){
+  {
+    boost::mutex::scoped_lock lock(m_pipelineMutex);
+    m_pipelineShutdown = true;
+  }
+  m_pipelineCondition.notify_all();
+  if (m_preprocessingThread.joinable())
+    m_preprocessingThread.join();
+  if (m_filterThread.joinable())
+    m_filterThread.join();
+}
+
+void HumanoidLocalization::enqueueMeasurement(const PipelineMeasurementPtr& measurement){
+  measurement->receivedTime = ros::WallTime::now();
+  {
+    boost::mutex::scoped_lock lock(m_pipelineMutex);
+    if (m_rawMeasurement)
+      m_numDroppedRaw++;
+    m_rawMeasurement = measurement;
+  }
+  m_pipelineCondition.notify_all();
+}
+
+void HumanoidLocalization::preprocessingThread(){
+  while (true){
+    PipelineMeasurementPtr measurement;
+    {
+      boost::mutex::scoped_lock lock(m_pipelineMutex);
+      while (!m_rawMeasurement && !m_pipelineShutdown)
+        m_pipelineCondition.wait(lock);
+      if (m_pipelineShutdown)
+        return;
+      measurement.swap(m_rawMeasurement);
+    }
+
+    measurement->preprocessingStartTime = ros::WallTime::now();
+    if (measurement->laser){
+      prepareLaserPointCloud(measurement->laser, measurement->pc, measurement->ranges);
+      measurement->maxRange = measurement->laser->range_max;
+    } else {
+      prepareGeneralPointCloud(measurement->cloud, measurement->pc, measurement->ranges);
+      measurement->maxRange = 10.0; // see pointCloudCallback()
+    }
+    measurement->preparedTime = ros::WallTime::now();
+
+    {
+      boost::mutex::scoped_lock lock(m_pipelineMutex);
+      // only the newest measurement is integrated:
+      if (m_preparedMeasurement)
+        m_numDroppedPrepared++;
+      m_preparedMeasurement = measurement;
+    }
+    m_pipelineCondition.notify_all();
+  }
+}
+
+void HumanoidLocalization::filterThread(){
+  while (true){
+    PipelineMeasurementPtr measurement;
+    unsigned numDroppedRaw, numDroppedPrepared;
+    {
+      boost::mutex::scoped_lock lock(m_pipelineMutex);
+      while (!m_preparedMeasurement && !m_pipelineShutdown)
+        m_pipelineCondition.wait(lock);
+      if (m_pipelineShutdown)
+        return;
+      measurement.swap(m_preparedMeasurement);
+      numDroppedRaw = m_numDroppedRaw;
+      numDroppedPrepared = m_numDroppedPrepared;
+    }
+
+    ros::Time stamp = measurement->laser ? measurement->laser->header.stamp : measurement->cloud->header.stamp;
+    ros::WallTime filterStartTime, observationStartTime;
+    Particles particles;
+    unsigned numResets;
+    {
+      boost::mutex::scoped_lock lock(m_filterMutex);
+      filterStartTime = ros::WallTime::now();
+      if (m_paused || measurement->pc.empty())
+        continue;
+
+      // The callbacks already propagated the particles by odometry to the newest
+      // message, the motion model moves them to the measurement stamp from there.
+      if (!applyMotionToMeasurement(measurementStamp(measurement->pc)))
+        continue;
+      observationStartTime = ros::WallTime::now();
+      addStageTime(m_stageTimings.motion, "motion", (observationStartTime - filterStartTime).toSec());
+
+      // The observation update runs on a copy without holding the lock, the
+      // callbacks keep propagating m_particles by odometry from the measurement on.
+      particles = m_particles;
+      m_motionModel->storeOdomPose(measurement->odomPose);
+      numResets = m_numFilterResets;
+    }
+
+    if (!integrateObservation(particles, measurement->pc, measurement->ranges, measurement->maxRange))
+      continue;
+    ros::WallTime verifyStartTime = ros::WallTime::now();
+    // TODO: verify poses before measurements, ignore particles then
+    m_mapModel->verifyPoses(particles);
+    ros::WallTime resamplingStartTime = ros::WallTime::now();
+
+    boost::mutex::scoped_lock lock(m_filterMutex);
+    addStageTime(m_stageTimings.observation, "observation", (verifyStartTime - observationStartTime).toSec());
+    addStageTime(m_stageTimings.verifyPoses, "verify_poses", (resamplingStartTime - verifyStartTime).toSec());
+    if (numResets != m_numFilterResets){
+      ROS_INFO("Particles were reset during the observation update, discarding the measurement");
+      continue;
+    }
+
+    // swap the updated particles in and re-apply the odometry since the measurement:
+    tf::Stamped<tf::Pose> lastOdomPose = measurement->odomPose;
+    m_motionModel->getLastOdomPose(lastOdomPose);
+    m_particles.swap(particles);
+    resamplingStartTime = ros::WallTime::now();
+    finishObservation();
+    addStageTime(m_stageTimings.resampling, "resampling", (ros::WallTime::now() - resamplingStartTime).toSec());
+    if (lastOdomPose.stamp_ > measurement->odomPose.stamp_){
+      ros::WallTime motionStartTime = ros::WallTime::now();
+      m_motionModel->applyOdomTransform(m_particles, measurement->odomPose.inverse() * lastOdomPose);
+      constrainMotion(lastOdomPose);
+      addStageTime(m_stageTimings.motion, "motion_odometry", (ros::WallTime::now() - motionStartTime).toSec());
+      stamp = std::max(stamp, lastOdomPose.stamp_);
+    }
+
+    m_lastLocalizedPose = measurement->odomPose;
+    if (measurement->cloud){
+      m_headYawRotationLastScan = measurement->headYaw;
+      m_headPitchRotationLastScan = measurement->headPitch;
+    }
+    ros::WallTime publishStartTime = ros::WallTime::now();
+    publishPoseEstimate(stamp, true);
+
+    ros::WallTime endTime = ros::WallTime::now();
+    addStageTime(m_stageTimings.preprocessing, "preprocessing", (measurement->preparedTime - measurement->preprocessingStartTime).toSec());
+    addStageTime(m_stageTimings.publish, "publish", (endTime - publishStartTime).toSec());
+    m_latencyStats.add("pipeline_queue", (measurement->preprocessingStartTime - measurement->receivedTime).toSec());
+    m_latencyStats.add("pipeline_wait", (filterStartTime - measurement->preparedTime).toSec());
+    m_latencyStats.add("pipeline_total", (endTime - measurement->receivedTime).toSec());
+    publishLatencyStats();
+    ROS_INFO("Pipeline latency %f s: queued %f s, preprocessing %f s, waiting %f s, filter %f s (dropped %u raw / %u prepared)",
+             (endTime - measurement->receivedTime).toSec(),
+             (measurement->preprocessingStartTime - measurement->receivedTime).toSec(),
+             (measurement->preparedTime - measurement->preprocessingStartTime).toSec(),
+             (filterStartTime - measurement->preparedTime).toSec(),
+             (endTime - filterStartTime).toSec(),
+             numDroppedRaw, numDroppedPrepared);
+  }
+}
+
+void HumanoidLocalization::addStageTime(double& accumulatedTime, const char* stage, double seconds){
+  accumulatedTime += seconds;
+  m_latencyStats.add(stage, seconds);
+}
+
+void HumanoidLocalization::publishLatencyStats(){
+  ros::WallTime now = ros::WallTime::now();
+  if (m_latencyStatsPeriod <= 0.0 || (now - m_lastLatencyStatsTime).toSec() < m_latencyStatsPeriod)
+    return;
+
+  m_lastLatencyStatsTime = now;
+  if (m_latencyStatsPub.getNumSubscribers() == 0)
+    return;
+
+  diagnostic_msgs::DiagnosticArray msg;
+  msg.header.stamp = ros::Time::now();
+  m_latencyStats.toDiagnostics(msg, "humanoid_localization/");
+  m_latencyStatsPub.publish(msg);
+}
+
 void HumanoidLocalization::imuCallback(const sensor_msgs::ImuConstPtr& msg){
+  boost::mutex::scoped_lock lock(m_imuMutex);
   m_lastIMUMsgBuffer.push_back(*msg);
 }
 
+bool HumanoidLocalization::getLatestImuRP(double& roll, double& pitch) const {
+  boost::mutex::scoped_lock lock(m_imuMutex);
+  if(m_lastIMUMsgBuffer.empty())
+    return false;
+
+  getRP(m_lastIMUMsgBuffer.back().orientation, roll, pitch);
+  return true;
+}
+
 bool HumanoidLocalization::getImuMsg(const ros::Time& stamp, ros::Time& imuStamp, double& angleX, double& angleY) const {
+  boost::mutex::scoped_lock lock(m_imuMutex);
   if(m_lastIMUMsgBuffer.empty())
     return false;
 
@@ -941,6 +1351,10 @@ bool HumanoidLocalization::getImuMsg(const ros::Time& stamp, ros::Time& imuStamp
 }
 
 void HumanoidLocalization::initPoseCallback(const geometry_msgs::PoseWithCovarianceStampedConstPtr& msg){
+  boost::mutex::scoped_lock lock(m_filterMutex);
+  // invalidates an observation update in progress (async_preprocessing)
+  m_numFilterResets++;
+
   tf::Pose pose;
   tf::poseMsgToTF(msg->pose.pose, pose);
 
@@ -991,13 +1405,12 @@ void HumanoidLocalization::initPoseCallback(const geometry_msgs::PoseWithCovaria
     if(m_initPoseRealZRP) {
       bool useOdometry = true;
       if(m_useIMU) {
-        if(m_lastIMUMsgBuffer.empty()) {
+        double roll, pitch;
+        if(!getLatestImuRP(roll, pitch)) {
           ROS_WARN("Could not determine current roll and pitch because IMU message buffer is empty.");
         } else {
-          double roll, pitch;
           if(msg->header.stamp.isZero()) {
             // Header stamp is not set (e.g. RViz), use stamp from latest IMU message instead
-            getRP(m_lastIMUMsgBuffer.back().orientation, roll, pitch);
             ok = true;
           } else {
             ros::Time imuStamp;
@@ -1043,8 +1456,9 @@ void HumanoidLocalization::initPoseCallback(const geometry_msgs::PoseWithCovaria
   // sample from initial pose covariance:
   Matrix6d initCovL = initCov.llt().matrixL();
   tf::Transform transformNoise; // transformation on original pose from noise
-  unsigned idx = 0;
-  for(Particles::iterator it = m_particles.begin(); it != m_particles.end(); ++it){
+  m_particles.resize(m_numParticles);
+  m_poseArray.poses.resize(m_numParticles);
+  for(unsigned idx = 0; idx < m_particles.size(); ++idx){
     Vector6d poseNoise;
     for (unsigned i = 0; i < 6; ++i){
       poseNoise(i) = m_rngNormal();
@@ -1062,17 +1476,15 @@ void HumanoidLocalization::initPoseCallback(const geometry_msgs::PoseWithCovaria
     q.setRPY(poseCovNoise(3), poseCovNoise(4),poseCovNoise(5));
 
     transformNoise.setRotation(q);
-    it->pose = pose;
+    tf::Pose particlePose = pose;
 
     if (heights.size() > 0){
       // distribute particles evenly between levels:
-      it->pose.getOrigin().setZ(heights.at(int(double(idx)/m_particles.size() * heights.size())) + poseHeight);
+      particlePose.getOrigin().setZ(heights.at(int(double(idx)/m_particles.size() * heights.size())) + poseHeight);
     }
 
-    it->pose *= transformNoise;
-
-    it->weight = 1.0/m_particles.size();
-    idx++;
+    m_particles.setPose(idx, particlePose * transformNoise);
+    m_particles.weight(idx) = 1.0/m_particles.size();
   }
 
   ROS_INFO("Pose reset around mean (%f %f %f)", pose.getOrigin().getX(), pose.getOrigin().getY(), pose.getOrigin().getZ());
@@ -1104,6 +1516,7 @@ void HumanoidLocalization::initPoseCallback(const geometry_msgs::PoseWithCovaria
 bool HumanoidLocalization::globalLocalizationCallback(std_srvs::Empty::Request& req, std_srvs::Empty::Response& res)
 {
 
+  boost::mutex::scoped_lock lock(m_filterMutex);
   initGlobal();
 
   return true;
@@ -1111,21 +1524,43 @@ bool HumanoidLocalization::globalLocalizationCallback(std_srvs::Empty::Request&
 
 void HumanoidLocalization::normalizeWeights() {
 
+  if (m_particles.empty())
+    return;
+
+  const int numParticles = m_particles.size();
   double wmin = std::numeric_limits<double>::max();
   double wmax = -std::numeric_limits<double>::max();
+  int bestIdx = 0;
 
-  for (unsigned i=0; i < m_particles.size(); ++i){
-    double weight = m_particles[i].weight;
-    assert (!isnan(weight));
-    if (weight < wmin)
-      wmin = weight;
-    if (weight > wmax){
-      wmax = weight;
-      m_bestParticleIdx = i;
+  // parallel min / max (with index), merged per thread:
+#pragma omp parallel
+  {
+    double threadMin = std::numeric_limits<double>::max();
+    double threadMax = -std::numeric_limits<double>::max();
+    int threadBestIdx = 0;
+#pragma omp for nowait
+    for (int i = 0; i < numParticles; ++i){
+      double weight = m_particles.weight(i);
+      assert (!isnan(weight));
+      if (weight < threadMin)
+        threadMin = weight;
+      if (weight > threadMax){
+        threadMax = weight;
+        threadBestIdx = i;
+      }
+    }
+#pragma omp critical
+    {
+      wmin = std::min(wmin, threadMin);
+      if (threadMax > wmax || (threadMax == wmax && threadBestIdx < bestIdx)){
+        wmax = threadMax;
+        bestIdx = threadBestIdx;
+      }
     }
   }
+  m_bestParticleIdx = bestIdx;
   if (wmin > wmax){
-    ROS_ERROR_STREAM("Error in weights: min=" << wmin <<", max="<<wmax<<", 1st particle weight="<< m_particles[1].weight<< std::endl);
+    ROS_ERROR_STREAM("Error in weights: min=" << wmin <<", max="<<wmax<<", 1st particle weight="<< m_particles.weight(0)<< std::endl);
 
   }
 
@@ -1144,88 +1579,160 @@ void HumanoidLocalization::normalizeWeights() {
     ROS_WARN("normalizeWeights: scale is %f < 0, dw=%f, dn=%f", scale, dw, dn );
   }
   double offset = -wmax*scale;
-  double weights_sum = 0.0;
 
-#pragma omp parallel
-  {
-
-#pragma omp for
-    for (unsigned i = 0; i < m_particles.size(); ++i){
-      double w = m_particles[i].weight;
-      w = exp(scale*w+offset);
-      assert(!isnan(w));
-      m_particles[i].weight = w;
-#pragma omp atomic
-      weights_sum += w;
-    }
+  double weights_sum = 0.0;
 
-    assert(weights_sum > 0.0);
-    // normalize sum to 1:
-#pragma omp for
-    for (unsigned i = 0; i < m_particles.size(); ++i){
-      m_particles[i].weight /= weights_sum;
-    }
+#pragma omp parallel for reduction(+:weights_sum)
+  for (int i = 0; i < numParticles; ++i){
+    double w = exp(scale*m_particles.weight(i)+offset);
+    assert(!isnan(w));
+    m_particles.weight(i) = w;
+    weights_sum += w;
+  }
 
+  assert(weights_sum > 0.0);
+  // normalize sum to 1:
+  const double normalizer = 1.0 / weights_sum;
+#pragma omp parallel for
+  for (int i = 0; i < numParticles; ++i){
+    m_particles.weight(i) *= normalizer;
   }
 }
 
 double HumanoidLocalization::getCumParticleWeight() const{
-  double cumWeight=0.0;
-
   //compute the cumulative weights
-  for (Particles::const_iterator it = m_particles.begin(); it != m_particles.end(); ++it){
-    cumWeight += it->weight;
-  }
-
-  return cumWeight;
+  return m_particles.weights().sum();
 }
 
 void HumanoidLocalization::resample(unsigned numParticles){
 
-  if (numParticles <= 0)
-    numParticles = m_numParticles;
-
-  //compute the interval
-  double interval=getCumParticleWeight()/numParticles;
-
-  //compute the initial target weight
-  double target=interval*m_rngUniform();
-
-  //compute the resampled indexes
-  double cumWeight=0;
-  std::vector<unsigned> indices(numParticles);
-
-  unsigned n=0;
-  for (unsigned i = 0; i < m_particles.size(); ++i){
-    cumWeight += m_particles[i].weight;
-    while(cumWeight > target && n < numParticles){
-      if (m_bestParticleIdx >= 0 && i == unsigned(m_bestParticleIdx)){
-        m_bestParticleIdx = n;
-      }
+  std::vector<unsigned> indices;
+  if (numParticles <= 0 && m_useKLDSampling){
+    sampleKLD(indices);
+    numParticles = indices.size();
+  } else {
+    if (numParticles <= 0)
+      numParticles = m_numParticles;
 
-      indices[n++]=i;
-      target+=interval;
-    }
+    lowVarianceSample(numParticles, indices);
   }
   // indices now contains the indices to draw from the particles distribution
 
-  Particles oldParticles = m_particles;
-  m_particles.resize(numParticles);
+  // fill the back buffer and swap (keeps the allocations of both)
+  m_particlesBuffer.resize(numParticles);
   m_poseArray.poses.resize(numParticles);
   double newWeight = 1.0/numParticles;
 #pragma omp parallel for
   for (unsigned i = 0; i < numParticles; ++i){
-    m_particles[i].pose = oldParticles[indices[i]].pose;
-    m_particles[i].weight = newWeight;
+    m_particlesBuffer.copyParticle(i, m_particles, indices[i]);
+    m_particlesBuffer.weight(i) = newWeight;
+  }
+  m_particles.swap(m_particlesBuffer);
+}
+
+void HumanoidLocalization::lowVarianceSample(unsigned numParticles, std::vector<unsigned>& indices){
+  indices.resize(numParticles);
+  if (m_particles.empty() || numParticles == 0)
+    return;
+
+  m_particles.cumulativeWeights(m_cumWeights);
+
+  //compute the interval
+  double interval=m_cumWeights.back()/numParticles;
+
+  //compute the initial target weight
+  double firstTarget=interval*m_rngUniform();
+
+  // sample n (target firstTarget + n*interval) is drawn from particle i iff
+  // cumWeight(i-1) <= target < cumWeight(i), so all particles are independent:
+  const int numOldParticles = m_particles.size();
+  const int bestIdx = m_bestParticleIdx;
+#pragma omp parallel for
+  for (int i = 0; i < numOldParticles; ++i){
+    const double cumWeightBefore = (i == 0) ? 0.0 : m_cumWeights[i-1];
+    const unsigned begin = numSamplesBelow(cumWeightBefore, firstTarget, interval, numParticles);
+    const unsigned end = numSamplesBelow(m_cumWeights[i], firstTarget, interval, numParticles);
+    for (unsigned n = begin; n < end; ++n)
+      indices[n] = i;
+
+    if (i == bestIdx && begin < end)
+      m_bestParticleIdx = begin;
   }
+
+  // rounding at the end of the cumulative weights:
+  const unsigned numDrawn = numSamplesBelow(m_cumWeights.back(), firstTarget, interval, numParticles);
+  for (unsigned n = numDrawn; n < numParticles; ++n)
+    indices[n] = numOldParticles - 1;
+}
+
+unsigned HumanoidLocalization::numSamplesBelow(double cumWeight, double firstTarget, double interval, unsigned numParticles){
+  const double n = std::ceil((cumWeight - firstTarget) / interval);
+  if (n <= 0.0)
+    return 0;
+
+  return std::min(unsigned(n), numParticles);
+}
+
+double HumanoidLocalization::kldNumParticles(unsigned k) const{
+  if (k <= 1)
+    return 0.0;
+
+  // Wilson-Hilferty approximation of the chi-square quantile
+  const double a = 2.0 / (9.0 * (k - 1));
+  const double b = 1.0 - a + std::sqrt(a) * m_kldZ;
+  return (k - 1) / (2.0 * m_kldEpsilon) * b * b * b;
+}
+
+void HumanoidLocalization::sampleKLD(std::vector<unsigned>& indices){
+  indices.clear();
+  if (m_particles.empty())
+    return;
+
+  std::vector<double>& cumWeights = m_cumWeights;
+  m_particles.cumulativeWeights(cumWeights);
+  const double cumWeight = cumWeights.back();
+
+  const unsigned minParticles = m_kldMinParticles;
+  const unsigned maxParticles = m_kldMaxParticles;
+  boost::unordered_set<int64_t> bins;
+  double bound = 0.0;
+  const int bestIdx = m_bestParticleIdx;
+  m_bestParticleIdx = -1;
+
+  while (indices.size() < maxParticles && (indices.size() < minParticles || indices.size() < bound)){
+    // draw a particle according to the cumulative weights:
+    const double target = m_rngUniform() * cumWeight;
+    const unsigned i = std::min(unsigned(std::upper_bound(cumWeights.begin(), cumWeights.end(), target) - cumWeights.begin()),
+                                unsigned(m_particles.size() - 1));
+    if (int(i) == bestIdx && m_bestParticleIdx < 0)
+      m_bestParticleIdx = indices.size();
+    indices.push_back(i);
+
+    // 21 bits per dimension:
+    const int64_t mask = (int64_t(1) << 21) - 1;
+    const int64_t bx = int64_t(std::floor(m_particles.x()[i] / m_kldBinSizeXY)) & mask;
+    const int64_t by = int64_t(std::floor(m_particles.y()[i] / m_kldBinSizeXY)) & mask;
+    const int64_t byaw = int64_t(std::floor(m_particles.yaw()[i] / m_kldBinSizeYaw)) & mask;
+    if (bins.insert((bx << 42) | (by << 21) | byaw).second)
+      bound = kldNumParticles(bins.size());
+  }
+
+  // the best particle may not have been drawn:
+  if (m_bestParticleIdx < 0)
+    m_bestParticleIdx = 0;
+
+  ROS_DEBUG("KLD-sampling: %zu particles in %zu bins", indices.size(), bins.size());
 }
 
 void HumanoidLocalization::initGlobal(){
   ROS_INFO("Initializing with uniform distribution");
+  m_numFilterResets++;
 
   double roll, pitch, z;
   initZRP(z, roll, pitch);
 
+  // global localization is as uncertain as it gets:
+  m_particles.resize(m_useKLDSampling ? m_kldMaxParticles : m_numParticles);
   m_mapModel->initGlobal(m_particles, z, roll, pitch, m_initNoiseStd, m_rngUniform, m_rngNormal);
 
 
@@ -1244,17 +1751,23 @@ void HumanoidLocalization::publishPoseEstimate(const ros::Time& time, bool publi
   // send all hypotheses as arrows:
   ////
 
-  m_poseArray.header.stamp = time;
+  // only if subscribed, at most every particlecloud_period (stamps may also jump back):
+  if (m_poseArrayPub.getNumSubscribers() > 0
+      && (time < m_lastParticleCloudTime || (time - m_lastParticleCloudTime).toSec() >= m_particleCloudPeriod))
+  {
+    m_poseArray.header.stamp = time;
+    m_lastParticleCloudTime = time;
 
-  if (m_poseArray.poses.size() != m_particles.size())
-    m_poseArray.poses.resize(m_particles.size());
+    if (m_poseArray.poses.size() != m_particles.size())
+      m_poseArray.poses.resize(m_particles.size());
 
 #pragma omp parallel for
-  for (unsigned i = 0; i < m_particles.size(); ++i){
-    tf::poseTFToMsg(m_particles[i].pose, m_poseArray.poses[i]);
-  }
+    for (unsigned i = 0; i < m_particles.size(); ++i){
+      tf::poseTFToMsg(m_particles.getPose(i), m_poseArray.poses[i]);
+    }
 
-  m_poseArrayPub.publish(m_poseArray);
+    m_poseArrayPub.publish(m_poseArray);
+  }
 
   ////
   // send best particle as pose and one array:
@@ -1317,11 +1830,13 @@ void HumanoidLocalization::publishPoseEstimate(const ros::Time& time, bool publi
   m_latest_transform = tmp_tf_stamped;
 
   m_tfBroadcaster.sendTransform(tmp_tf_stamped);
+  // end-to-end latency (sensor stamp to tf output):
+  m_latencyStats.add("sensor_to_tf", (ros::Time::now() - time).toSec());
 
 }
 
 unsigned HumanoidLocalization::getBestParticleIdx() const{
-  if (m_bestParticleIdx < 0 || m_bestParticleIdx >= m_numParticles){
+  if (m_bestParticleIdx < 0 || m_bestParticleIdx >= int(m_particles.size())){
     ROS_WARN("Index (%d) of best particle not valid, using 0 instead", m_bestParticleIdx);
     return 0;
   }
@@ -1330,7 +1845,10 @@ unsigned HumanoidLocalization::getBestParticleIdx() const{
 }
 
 tf::Pose HumanoidLocalization::getParticlePose(unsigned particleIdx) const{
-  return m_particles.at(particleIdx).pose;
+  if (particleIdx >= m_particles.size())
+    throw std::out_of_range("HumanoidLocalization::getParticlePose: invalid particle index");
+
+  return m_particles.getPose(particleIdx);
 }
 
 tf::Pose HumanoidLocalization::getBestParticlePose() const{
@@ -1342,22 +1860,36 @@ tf::Pose HumanoidLocalization::getMeanParticlePose() const{
 
   double totalWeight = 0.0;
 
-  meanPose.setBasis(tf::Matrix3x3(0,0,0,0,0,0,0,0,0));
-  for (Particles::const_iterator it = m_particles.begin(); it != m_particles.end(); ++it){
-    meanPose.getOrigin() += it->pose.getOrigin() * it->weight;
-    meanPose.getBasis()[0] += it->pose.getBasis()[0];
-    meanPose.getBasis()[1] += it->pose.getBasis()[1];
-    meanPose.getBasis()[2] += it->pose.getBasis()[2];
-    totalWeight += it->weight;
+  // parallel sums of the weighted positions and the rotation matrices:
+  double x = 0.0, y = 0.0, z = 0.0;
+  double r00 = 0.0, r01 = 0.0, r02 = 0.0, r10 = 0.0, r11 = 0.0, r12 = 0.0, r20 = 0.0, r21 = 0.0, r22 = 0.0;
+  const int numParticles = m_particles.size();
+#pragma omp parallel for reduction(+:x,y,z,r00,r01,r02,r10,r11,r12,r20,r21,r22,totalWeight)
+  for (int i = 0; i < numParticles; ++i){
+    const double weight = m_particles.weight(i);
+    x += m_particles.x()[i] * weight;
+    y += m_particles.y()[i] * weight;
+    z += m_particles.z()[i] * weight;
+    double roll, pitch, yaw;
+    m_particles.getRPY(i, roll, pitch, yaw);
+    tf::Matrix3x3 basis;
+    basis.setRPY(roll, pitch, yaw);
+    r00 += basis[0][0]; r01 += basis[0][1]; r02 += basis[0][2];
+    r10 += basis[1][0]; r11 += basis[1][1]; r12 += basis[1][2];
+    r20 += basis[2][0]; r21 += basis[2][1]; r22 += basis[2][2];
+    totalWeight += weight;
   }
   assert(!isnan(totalWeight));
+  meanPose.setOrigin(tf::Vector3(x, y, z));
+  meanPose.setBasis(tf::Matrix3x3(r00, r01, r02, r10, r11, r12, r20, r21, r22));
 
   //assert(totalWeight == 1.0);
 
   // just in case weights are not normalized:
   meanPose.getOrigin() /= totalWeight;
   // TODO: only rough estimate of mean rotation, asserts normalized weights!
-  meanPose.getBasis() = meanPose.getBasis().scaled(tf::Vector3(1.0/m_numParticles, 1.0/m_numParticles, 1.0/m_numParticles));
+  const double numParticlesInv = 1.0 / m_particles.size();
+  meanPose.getBasis() = meanPose.getBasis().scaled(tf::Vector3(numParticlesInv, numParticlesInv, numParticlesInv));
 
   // Apparently we need to normalize again
   meanPose.setRotation(meanPose.getRotation().normalized());
@@ -1367,10 +1899,7 @@ tf::Pose HumanoidLocalization::getMeanParticlePose() const{
 
 double HumanoidLocalization::nEff() const{
 
-  double sqrWeights=0.0;
-  for (Particles::const_iterator it=m_particles.begin(); it!=m_particles.end(); ++it){
-    sqrWeights+=(it->weight * it->weight);
-  }
+  double sqrWeights = m_particles.weights().square().sum();
 
   if (sqrWeights > 0.0)
     return 1./sqrWeights;
@@ -1378,13 +1907,11 @@ double HumanoidLocalization::nEff() const{
     return 0.0;
 }
 
-void HumanoidLocalization::toLogForm(){
+void HumanoidLocalization::toLogForm(Particles& particles){
   // TODO: linear offset needed?
-#pragma omp parallel for
-  for (unsigned i = 0; i < m_particles.size(); ++i){
-    assert(m_particles[i].weight > 0.0);
-    m_particles[i].weight = log(m_particles[i].weight);
-  }
+  Eigen::Map<Eigen::ArrayXd> weights = particles.weights();
+  assert((weights > 0.0).all());
+  weights = weights.log();
 }
 
 void HumanoidLocalization::pauseLocalizationCallback(const std_msgs::BoolConstPtr& msg){
@@ -0,0 +1,101 @@
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <humanoid_localization/LatencyStats.h>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace humanoid_localization{
+
+namespace {
+
+diagnostic_msgs::KeyValue keyValue(const std::string& key, double value, const char* format){
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), format, value);
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = buffer;
+  return kv;
+}
+
+}
+
+LatencyStats::LatencyStats(size_t windowSize)
+: m_windowSize(std::max(size_t(1), windowSize))
+{
+
+}
+
+void LatencyStats::setWindowSize(size_t windowSize){
+  m_windowSize = std::max(size_t(1), windowSize);
+  m_stages.clear();
+}
+
+void LatencyStats::clear(){
+  m_stages.clear();
+}
+
+void LatencyStats::add(const std::string& stage, double seconds){
+  // few stages => linear search
+  for (unsigned i = 0; i < m_stages.size(); ++i){
+    if (m_stages[i].name == stage){
+      m_stages[i].samples.push_back(seconds);
+      m_stages[i].count++;
+      return;
+    }
+  }
+
+  m_stages.push_back(Stage());
+  m_stages.back().name = stage;
+  m_stages.back().samples.set_capacity(m_windowSize);
+  m_stages.back().samples.push_back(seconds);
+  m_stages.back().count = 1;
+}
+
+void LatencyStats::toDiagnostics(diagnostic_msgs::DiagnosticArray& msg, const std::string& prefix) const{
+  std::vector<double> sorted;
+  for (unsigned i = 0; i < m_stages.size(); ++i){
+    const Stage& stage = m_stages[i];
+    sorted.assign(stage.samples.begin(), stage.samples.end());
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum = 0.0;
+    for (unsigned j = 0; j < sorted.size(); ++j)
+      sum += sorted[j];
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = prefix + stage.name;
+    status.hardware_id = prefix;
+    char message[64];
+    snprintf(message, sizeof(message), "%.2f ms (p90), last %zu samples", 1000.0 * sorted[sorted.size() * 9 / 10], sorted.size());
+    status.message = message;
+    status.values.push_back(keyValue("count", stage.count, "%.0f"));
+    status.values.push_back(keyValue("mean_ms", 1000.0 * sum / sorted.size(), "%.3f"));
+    status.values.push_back(keyValue("p50_ms", 1000.0 * sorted[sorted.size() / 2], "%.3f"));
+    status.values.push_back(keyValue("p90_ms", 1000.0 * sorted[sorted.size() * 9 / 10], "%.3f"));
+    status.values.push_back(keyValue("p99_ms", 1000.0 * sorted[sorted.size() * 99 / 100], "%.3f"));
+    status.values.push_back(keyValue("max_ms", 1000.0 * sorted.back(), "%.3f"));
+    msg.status.push_back(status);
+  }
+}
+
+}
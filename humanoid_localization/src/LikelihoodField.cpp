@@ -0,0 +1,208 @@
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <humanoid_localization/LikelihoodField.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <ros/ros.h>
+
+namespace humanoid_localization{
+
+namespace {
+
+/// serialized grid parameters, followed by the cells
+struct SerializedHeader{
+  float originX, originY, originZ;
+  float codeToDistance;
+  double resolution;
+  uint32_t sizeX, sizeY, sizeZ;
+  uint32_t bits;
+  uint32_t maxCode;
+  uint32_t cropped;
+};
+
+}
+
+LikelihoodField::LikelihoodField()
+: m_originX(0.0f), m_originY(0.0f), m_originZ(0.0f), m_invResolution(1.0f), m_resolution(1.0), m_cropped(false),
+  m_sizeX(0), m_sizeY(0), m_sizeZ(0), m_numCells(0), m_maxCode(0), m_codeToDistance(0.0f)
+{
+
+}
+
+void LikelihoodField::clear(){
+  m_sizeX = m_sizeY = m_sizeZ = 0;
+  m_numCells = 0;
+  m_cropped = false;
+  std::vector<uint8_t>().swap(m_data8);
+  std::vector<uint16_t>().swap(m_data16);
+}
+
+bool LikelihoodField::build(const DynamicEDTOctomap& distanceMap, const octomap::point3d& min, const octomap::point3d& max,
+                            double resolution, float maxDistance, size_t maxBytes, unsigned bits,
+                            bool obstaclesAsMaxDistance){
+  clear();
+  if (maxBytes == 0 || resolution <= 0.0 || maxDistance <= 0.0f)
+    return false;
+
+  if (bits != 8 && bits != 16){
+    ROS_WARN("Likelihood field: %u bits per cell not supported, using 16", bits);
+    bits = 16;
+  }
+  const size_t bytesPerCell = bits / 8;
+
+  double sizeX = std::max(0.0, std::ceil((max.x() - min.x()) / resolution));
+  double sizeY = std::max(0.0, std::ceil((max.y() - min.y()) / resolution));
+  const double sizeZ = std::max(0.0, std::ceil((max.z() - min.z()) / resolution));
+  double originX = min.x(), originY = min.y();
+
+  const double fullBytes = sizeX * sizeY * sizeZ * bytesPerCell;
+  if (fullBytes > double(maxBytes)){
+    // crop in x and y around the map center (humanoids walk on floors, keep the full height):
+    const double scale = std::sqrt(double(maxBytes) / fullBytes);
+    const double newSizeX = std::floor(sizeX * scale);
+    const double newSizeY = std::floor(sizeY * scale);
+    originX += std::floor((sizeX - newSizeX) / 2.0) * resolution;
+    originY += std::floor((sizeY - newSizeY) / 2.0) * resolution;
+    sizeX = newSizeX;
+    sizeY = newSizeY;
+    m_cropped = true;
+    ROS_INFO("Likelihood field cropped to %.0f x %.0f cells (%.1f%% of the map) to fit into %zu MB, "
+             "using the distance map outside", sizeX, sizeY, 100.0*scale*scale, maxBytes / (1024*1024));
+  }
+
+  if (sizeX < 1.0 || sizeY < 1.0 || sizeZ < 1.0)
+    return false;
+
+  m_originX = originX;
+  m_originY = originY;
+  m_originZ = min.z();
+  m_invResolution = 1.0 / resolution;
+  m_resolution = resolution;
+  m_sizeX = unsigned(sizeX);
+  m_sizeY = unsigned(sizeY);
+  m_sizeZ = unsigned(sizeZ);
+  m_numCells = size_t(m_sizeX) * m_sizeY * m_sizeZ;
+  m_maxCode = (1u << bits) - 1;
+  m_codeToDistance = maxDistance / m_maxCode;
+
+  if (bits == 8)
+    m_data8.resize(m_numCells);
+  else
+    m_data16.resize(m_numCells);
+
+  const float distanceToCode = m_maxCode / maxDistance;
+
+  // sample the distance map at all cell centers:
+#pragma omp parallel for
+  for (int iz = 0; iz < int(m_sizeZ); ++iz){
+    for (unsigned iy = 0; iy < m_sizeY; ++iy){
+      size_t idx = (size_t(iz) * m_sizeY + iy) * m_sizeX;
+      for (unsigned ix = 0; ix < m_sizeX; ++ix, ++idx){
+        octomap::point3d center(m_originX + (ix + 0.5) * resolution,
+                                m_originY + (iy + 0.5) * resolution,
+                                m_originZ + (iz + 0.5) * resolution);
+        float dist = distanceMap.getDistance(center);
+        if (dist == 0.0f) // obstacle
+          dist = obstaclesAsMaxDistance ? maxDistance : 0.0f;
+        else if (!(dist > 0.0f) || dist > maxDistance) // no valid distance => max. distance
+          dist = maxDistance;
+
+        const unsigned code = std::min(m_maxCode, unsigned(dist * distanceToCode + 0.5f));
+        if (bits == 8)
+          m_data8[idx] = uint8_t(code);
+        else
+          m_data16[idx] = uint16_t(code);
+      }
+    }
+  }
+
+  return true;
+}
+
+void LikelihoodField::serialize(std::vector<char>& data) const{
+  SerializedHeader header;
+  header.originX = m_originX;
+  header.originY = m_originY;
+  header.originZ = m_originZ;
+  header.codeToDistance = m_codeToDistance;
+  header.resolution = m_resolution;
+  header.sizeX = m_sizeX;
+  header.sizeY = m_sizeY;
+  header.sizeZ = m_sizeZ;
+  header.bits = bits();
+  header.maxCode = m_maxCode;
+  header.cropped = m_cropped;
+
+  const size_t dataBytes = m_numCells * (header.bits / 8);
+  data.resize(sizeof(header) + dataBytes);
+  memcpy(&data[0], &header, sizeof(header));
+  if (dataBytes > 0)
+    memcpy(&data[sizeof(header)], this->data(), dataBytes);
+}
+
+bool LikelihoodField::deserialize(const char* data, size_t size){
+  clear();
+  SerializedHeader header;
+  if (size < sizeof(header))
+    return false;
+
+  memcpy(&header, data, sizeof(header));
+  const size_t numCells = size_t(header.sizeX) * header.sizeY * header.sizeZ;
+  if ((header.bits != 8 && header.bits != 16) || header.resolution <= 0.0
+      || size != sizeof(header) + numCells * (header.bits / 8))
+    return false;
+
+  if (header.bits == 8)
+    m_data8.assign(reinterpret_cast<const uint8_t*>(data + sizeof(header)),
+                   reinterpret_cast<const uint8_t*>(data + sizeof(header)) + numCells);
+  else {
+    m_data16.resize(numCells);
+    memcpy(&m_data16[0], data + sizeof(header), numCells * sizeof(uint16_t));
+  }
+
+  m_originX = header.originX;
+  m_originY = header.originY;
+  m_originZ = header.originZ;
+  m_codeToDistance = header.codeToDistance;
+  m_resolution = header.resolution;
+  m_invResolution = 1.0 / m_resolution;
+  m_sizeX = header.sizeX;
+  m_sizeY = header.sizeY;
+  m_sizeZ = header.sizeZ;
+  m_numCells = numCells;
+  m_maxCode = header.maxCode;
+  m_cropped = header.cropped != 0;
+  return true;
+}
+
+std::string LikelihoodField::cacheSectionName(const std::string& prefix, double resolution, float maxDistance,
+                                              size_t maxBytes, unsigned bits, bool obstaclesAsMaxDistance){
+  char name[96];
+  snprintf(name, sizeof(name), "%s/%.4f_%.4f_%zu_%u_%d", prefix.c_str(), resolution, maxDistance,
+           maxBytes, bits, int(obstaclesAsMaxDistance));
+  return name;
+}
+
+}
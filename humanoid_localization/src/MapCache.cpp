@@ -0,0 +1,244 @@
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <humanoid_localization/MapCache.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ros/ros.h>
+
+namespace humanoid_localization{
+
+namespace {
+
+const char cacheMagic[8] = {'H', 'L', 'M', 'A', 'P', 'C', 'A', 'C'};
+const uint32_t cacheVersion = 1;
+/// sections start at multiples of this (e.g. for aligned access of grids)
+const size_t sectionAlignment = 64;
+
+struct FileHeader{
+  char magic[8];
+  uint32_t version;
+  uint32_t numSections;
+  uint64_t mapHash;
+};
+
+struct SectionEntry{
+  char name[112];
+  uint64_t offset;
+  uint64_t size;
+};
+
+size_t alignOffset(size_t offset){
+  return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+}
+
+MapCache::MapCache()
+: m_mapHash(0), m_mapping(NULL), m_mappingSize(0)
+{
+
+}
+
+MapCache::~MapCache(){
+  close();
+}
+
+void MapCache::close(){
+  if (m_mapping)
+    munmap(m_mapping, m_mappingSize);
+
+  m_mapping = NULL;
+  m_mappingSize = 0;
+  m_mappedSections.clear();
+}
+
+bool MapCache::open(const std::string& filename){
+  close();
+  m_addedSections.clear();
+  m_filename = filename;
+  m_mapHash = 0;
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || size_t(fileStat.st_size) < sizeof(FileHeader)){
+    ::close(fd);
+    return false;
+  }
+
+  m_mappingSize = fileStat.st_size;
+  m_mapping = mmap(NULL, m_mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); // the mapping stays valid
+  if (m_mapping == MAP_FAILED){
+    m_mapping = NULL;
+    m_mappingSize = 0;
+    return false;
+  }
+
+  const char* data = static_cast<const char*>(m_mapping);
+  FileHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion
+      || sizeof(FileHeader) + size_t(header.numSections) * sizeof(SectionEntry) > m_mappingSize)
+  {
+    ROS_WARN("Map cache %s is invalid or of a different version, ignoring it", filename.c_str());
+    close();
+    return false;
+  }
+
+  for (unsigned i = 0; i < header.numSections; ++i){
+    SectionEntry entry;
+    memcpy(&entry, data + sizeof(FileHeader) + i * sizeof(SectionEntry), sizeof(entry));
+    if (entry.offset > m_mappingSize || entry.size > m_mappingSize - entry.offset){
+      ROS_WARN("Map cache %s is truncated, ignoring it", filename.c_str());
+      close();
+      return false;
+    }
+    entry.name[sizeof(entry.name) - 1] = '\0';
+    m_mappedSections[entry.name] = std::make_pair(size_t(entry.offset), size_t(entry.size));
+  }
+
+  m_mapHash = header.mapHash;
+  return true;
+}
+
+void MapCache::reset(const std::string& filename, uint64_t mapHash){
+  close();
+  m_addedSections.clear();
+  m_filename = filename;
+  m_mapHash = mapHash;
+}
+
+bool MapCache::getSection(const std::string& name, const char*& data, size_t& size) const{
+  std::map<std::string, std::vector<char> >::const_iterator added = m_addedSections.find(name);
+  if (added != m_addedSections.end()){
+    data = added->second.empty() ? NULL : &added->second[0];
+    size = added->second.size();
+    return true;
+  }
+
+  std::map<std::string, std::pair<size_t, size_t> >::const_iterator mapped = m_mappedSections.find(name);
+  if (mapped == m_mappedSections.end())
+    return false;
+
+  data = static_cast<const char*>(m_mapping) + mapped->second.first;
+  size = mapped->second.second;
+  return true;
+}
+
+void MapCache::setSection(const std::string& name, const char* data, size_t size){
+  if (name.size() >= sizeof(SectionEntry().name)){
+    ROS_WARN("Map cache section name \"%s\" too long, not caching it", name.c_str());
+    return;
+  }
+  m_addedSections[name].assign(data, data + size);
+}
+
+bool MapCache::write(){
+  if (m_filename.empty())
+    return false;
+
+  // all sections, added ones replace mapped ones:
+  std::map<std::string, std::pair<const char*, size_t> > sections;
+  for (std::map<std::string, std::pair<size_t, size_t> >::const_iterator it = m_mappedSections.begin();
+       it != m_mappedSections.end(); ++it)
+  {
+    sections[it->first] = std::make_pair(static_cast<const char*>(m_mapping) + it->second.first, it->second.second);
+  }
+  for (std::map<std::string, std::vector<char> >::const_iterator it = m_addedSections.begin();
+       it != m_addedSections.end(); ++it)
+  {
+    sections[it->first] = std::make_pair(it->second.empty() ? NULL : &it->second[0], it->second.size());
+  }
+
+  FileHeader header;
+  memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+  header.version = cacheVersion;
+  header.numSections = sections.size();
+  header.mapHash = m_mapHash;
+
+  std::vector<SectionEntry> entries;
+  size_t offset = alignOffset(sizeof(FileHeader) + sections.size() * sizeof(SectionEntry));
+  for (std::map<std::string, std::pair<const char*, size_t> >::const_iterator it = sections.begin();
+       it != sections.end(); ++it)
+  {
+    SectionEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    strncpy(entry.name, it->first.c_str(), sizeof(entry.name) - 1);
+    entry.offset = offset;
+    entry.size = it->second.second;
+    entries.push_back(entry);
+    offset = alignOffset(offset + entry.size);
+  }
+
+  // write to a temporary file and rename, so that a current mapping stays valid:
+  const std::string tmpFilename = m_filename + ".tmp";
+  std::ofstream file(tmpFilename.c_str(), std::ios_base::binary | std::ios_base::trunc);
+  if (!file.is_open()){
+    ROS_WARN("Could not write the map cache %s", tmpFilename.c_str());
+    return false;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!entries.empty())
+    file.write(reinterpret_cast<const char*>(&entries[0]), entries.size() * sizeof(SectionEntry));
+
+  const std::vector<char> padding(sectionAlignment, 0);
+  unsigned i = 0;
+  for (std::map<std::string, std::pair<const char*, size_t> >::const_iterator it = sections.begin();
+       it != sections.end(); ++it, ++i)
+  {
+    file.write(&padding[0], entries[i].offset - size_t(file.tellp()));
+    if (it->second.second > 0)
+      file.write(it->second.first, it->second.second);
+  }
+  file.close();
+  if (!file || rename(tmpFilename.c_str(), m_filename.c_str()) != 0){
+    ROS_WARN("Could not write the map cache %s", m_filename.c_str());
+    std::remove(tmpFilename.c_str());
+    return false;
+  }
+
+  ROS_INFO("Map cache written to %s (%zu sections, %zu KB)", m_filename.c_str(), sections.size(), offset / 1024);
+  // continue on the new file:
+  return open(m_filename);
+}
+
+uint64_t MapCache::hash(const char* data, size_t size){
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i){
+    hash ^= uint8_t(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+}
@@ -23,11 +23,41 @@
 
 #include <humanoid_localization/MapModel.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdint.h>
+
 namespace humanoid_localization{
+
+namespace {
+
+/// read-only stream buffer over memory (e.g. a map cache section)
+struct MemoryBuffer : public std::streambuf{
+  MemoryBuffer(const char* data, size_t size){
+    char* begin = const_cast<char*>(data);
+    setg(begin, begin, begin + size);
+  }
+};
+
+/// serialized floor index, followed by offsets and heights
+struct FloorIndexHeader{
+  uint32_t minKeyX, minKeyY;
+  uint32_t sizeX, sizeY;
+  uint64_t numHeights;
+};
+
+}
+
 MapModel::MapModel(ros::NodeHandle* nh)
 : m_motionMeanZ(0.0),
   m_motionRangeZ(-1.0), m_motionRangeRoll(-1.0), m_motionRangePitch(-1.0),
-  m_motionObstacleDist(0.2)
+  m_motionObstacleDist(0.2),
+  m_floorIndexClearance(0.6), m_floorIndexMaxMB(128.0),
+  m_floorIndexMinKeyX(0), m_floorIndexMinKeyY(0),
+  m_floorIndexSizeX(0), m_floorIndexSizeY(0),
+  m_voxelCacheMaxSize(1000000)
 {
 
   // motion model max ranges (particles have to stay within range)
@@ -38,6 +68,17 @@ MapModel::MapModel(ros::NodeHandle* nh)
   // this is not correctly used at the moment:
   //nh->param("motion_occupied_radius", m_motionObstacleDist, m_motionObstacleDist);
 
+  int voxelCacheMaxSize = m_voxelCacheMaxSize;
+  nh->param("verify_poses_cache_size", voxelCacheMaxSize, voxelCacheMaxSize);
+  m_voxelCacheMaxSize = std::max(0, voxelCacheMaxSize);
+
+  // 2.5D index of floor heights (for global localization and height checks)
+  nh->param("floor_index_clearance", m_floorIndexClearance, m_floorIndexClearance);
+  nh->param("floor_index_max_mb", m_floorIndexMaxMB, m_floorIndexMaxMB);
+
+  // cache file of the map and everything precomputed from it ("" disables it)
+  nh->param("map_cache_file", m_mapCacheFile, m_mapCacheFile);
+
 }
 
 MapModel::~MapModel(){
@@ -49,18 +90,74 @@ boost::shared_ptr<octomap::OcTree> MapModel::getMap() const{
   return m_map;
 }
 
+boost::shared_ptr<MapCache> MapModel::getMapCache() const{
+  return m_mapCache;
+}
+
+bool MapModel::loadMapFromCache(){
+  if (m_mapCacheFile.empty())
+    return false;
+
+  boost::shared_ptr<MapCache> cache(new MapCache());
+  const char* data;
+  size_t size;
+  if (!cache->open(m_mapCacheFile) || !cache->getSection("octree", data, size))
+    return false;
+
+  MemoryBuffer buffer(data, size);
+  std::istream stream(&buffer);
+  boost::shared_ptr<octomap::OcTree> map(new octomap::OcTree(0.1));
+  if (!map->readBinary(stream) || MapCache::hash(data, size) != cache->mapHash()){
+    ROS_WARN("Octree in the map cache %s is invalid", m_mapCacheFile.c_str());
+    return false;
+  }
+
+  ROS_INFO("Map loaded from the map cache %s", m_mapCacheFile.c_str());
+  m_map = map;
+  m_mapCache = cache;
+  return true;
+}
+
+void MapModel::initMapCache(){
+  if (m_mapCacheFile.empty() || !m_map)
+    return;
+
+  // already opened by loadMapFromCache()
+  if (m_mapCache)
+    return;
+
+  std::stringstream stream;
+  m_map->writeBinary(stream);
+  const std::string binaryMap = stream.str();
+  const uint64_t mapHash = MapCache::hash(binaryMap.data(), binaryMap.size());
+
+  m_mapCache.reset(new MapCache());
+  if (m_mapCache->open(m_mapCacheFile) && m_mapCache->mapHash() == mapHash){
+    ROS_INFO("Using the map cache %s", m_mapCacheFile.c_str());
+  } else {
+    ROS_INFO("Map cache %s missing or of a different map, recomputing", m_mapCacheFile.c_str());
+    m_mapCache->reset(m_mapCacheFile, mapHash);
+    m_mapCache->setSection("octree", binaryMap.data(), binaryMap.size());
+  }
+}
+
+void MapModel::writeMapCache(){
+  if (m_mapCache && m_mapCache->isModified())
+    m_mapCache->write();
+}
+
+void MapModel::clearVoxelCache(){
+  m_voxelIndices.clear();
+  m_voxelStates.clear();
+}
+
 void MapModel::verifyPoses(Particles& particles){
   double minX, minY, minZ, maxX, maxY, maxZ;
   m_map->getMetricMin(minX, minY, minZ);
   m_map->getMetricMax(maxX, maxY, maxZ);
 
   // find min. particle weight:
-  double minWeight = std::numeric_limits<double>::max();
-  for (Particles::iterator it = particles.begin(); it != particles.end(); ++it) {
-    if (it->weight < minWeight)
-      minWeight = it->weight;
-
-  }
+  double minWeight = particles.empty() ? 0.0 : particles.weights().minCoeff();
 
   minWeight -= 200;
 
@@ -68,52 +165,96 @@ void MapModel::verifyPoses(Particles& particles){
   unsigned numOut = 0;
   unsigned numMotion = 0;
 
+  const int numParticles = particles.size();
+  m_particleKeys.resize(numParticles);
+  m_particleVoxels.resize(numParticles);
 
-  // TODO possible speedup: cluster particles by grid voxels first?
-  // iterate over samples, multi-threaded:
+  // 1. voxel key of each particle, -1 if out of map bounds:
 #pragma omp parallel for
-  for (unsigned i = 0; i < particles.size(); ++i){
-
-    octomap::point3d position(particles[i].pose.getOrigin().getX(),
-                              particles[i].pose.getOrigin().getY(),
-                              particles[i].pose.getOrigin().getZ());
+  for (int i = 0; i < numParticles; ++i){
+    octomap::point3d position(particles.x()[i], particles.y()[i], particles.z()[i]);
 
-    // see if outside of map bounds:
     if (position(0) < minX || position(0) > maxX
         ||	position(1) < minY || position(1) > maxY
-        ||	position(2) < minZ || position(2) > maxZ)
+        ||	position(2) < minZ || position(2) > maxZ
+        || !m_map->coordToKeyChecked(position, m_particleKeys[i]))
     {
-      particles[i].weight = minWeight;
-#pragma omp atomic
+      m_particleVoxels[i] = -1;
+    } else{
+      m_particleVoxels[i] = 0;
+    }
+  }
+
+  // 2. cluster particles by voxel (serial hash lookups only):
+  if (m_voxelStates.size() + numParticles > m_voxelCacheMaxSize)
+    clearVoxelCache();
+
+  m_newVoxels.clear();
+  for (int i = 0; i < numParticles; ++i){
+    if (m_particleVoxels[i] < 0)
+      continue;
+
+    std::pair<VoxelIndexMap::iterator, bool> inserted =
+        m_voxelIndices.insert(std::make_pair(m_particleKeys[i], unsigned(m_voxelStates.size())));
+    if (inserted.second){
+      VoxelState state;
+      state.occupied = false;
+      state.floorHeight = 0.0;
+      m_voxelStates.push_back(state);
+      m_newVoxels.push_back(i);
+    }
+    m_particleVoxels[i] = inserted.first->second;
+  }
+
+  // 3. query the map once per unseen voxel. The floor height of all positions
+  // within a voxel is the same, since the ray down stays in its column.
+  const int numNewVoxels = m_newVoxels.size();
+  const bool checkFloorHeight = m_motionRangeZ >= 0.0;
+#pragma omp parallel for schedule(dynamic, 16)
+  for (int v = 0; v < numNewVoxels; ++v){
+    const octomap::OcTreeKey& key = m_particleKeys[m_newVoxels[v]];
+    VoxelState& state = m_voxelStates[m_particleVoxels[m_newVoxels[v]]];
+    octomap::OcTreeNode* mapNode = m_map->search(key);
+    state.occupied = mapNode && this->isOccupied(mapNode);
+    if (checkFloorHeight && !state.occupied){
+      tf::Transform voxelPose(tf::Quaternion::getIdentity(), octomap::pointOctomapToTf(m_map->keyToCoord(key)));
+      state.floorHeight = getFloorHeight(voxelPose);
+    }
+  }
+
+  // 4. evaluate particles, multi-threaded:
+#pragma omp parallel for reduction(+:numOut,numWall,numMotion)
+  for (int i = 0; i < numParticles; ++i){
+    // see if outside of map bounds:
+    if (m_particleVoxels[i] < 0){
+      particles.weight(i) = minWeight;
       numOut++;
-    } else {
+      continue;
+    }
 
-      // see if occupied cell:
-      if (this->isOccupied(position)){
-        particles[i].weight = minWeight;
-#pragma omp atomic
-        numWall++;
-      } else {
-        // see if current pose is has a valid walking height:
-        if (m_motionRangeZ >= 0.0 &&
-            (std::abs(particles[i].pose.getOrigin().getZ() - getFloorHeight(particles[i].pose) - m_motionMeanZ)
-              > m_motionRangeZ))
+    const VoxelState& state = m_voxelStates[m_particleVoxels[i]];
+    // see if occupied cell:
+    if (state.occupied){
+      particles.weight(i) = minWeight;
+      numWall++;
+    } else {
+      // see if current pose is has a valid walking height:
+      if (checkFloorHeight &&
+          (std::abs(particles.z()[i] - state.floorHeight - m_motionMeanZ)
+            > m_motionRangeZ))
+      {
+        particles.weight(i) = minWeight;
+        numMotion++;
+      } else if (m_motionRangePitch >= 0.0 || m_motionRangeRoll >= 0.0){
+
+        double yaw, pitch, roll;
+        particles.getRPY(i, roll, pitch, yaw);
+
+        if ((m_motionRangePitch >= 0.0 && std::abs(pitch) > m_motionRangePitch)
+            || (m_motionRangeRoll >= 0.0 && std::abs(roll) > m_motionRangeRoll))
         {
-          particles[i].weight = minWeight;
-#pragma omp atomic
+          particles.weight(i) = minWeight;
           numMotion++;
-        } else if (m_motionRangePitch >= 0.0 || m_motionRangeRoll >= 0.0){
-
-          double yaw, pitch, roll;
-          particles[i].pose.getBasis().getRPY(roll, pitch, yaw);
-
-          if ((m_motionRangePitch >= 0.0 && std::abs(pitch) > m_motionRangePitch)
-              || (m_motionRangeRoll >= 0.0 && std::abs(roll) > m_motionRangeRoll))
-          {
-            particles[i].weight = minWeight;
-#pragma omp atomic
-            numMotion++;
-          }
         }
       }
     }
@@ -138,9 +279,9 @@ void MapModel::initGlobal(Particles& particles, double z, double roll, double pi
   m_map->getMetricMin(minX, minY, minZ);
 
   double weight = 1.0 / particles.size();
-  Particles::iterator it = particles.begin();
+  unsigned idx = 0;
   while (true){
-    if (it == particles.end())
+    if (idx >= particles.size())
       break;
     // obtain a pose hypothesis:
     double x = minX + sizeX * rngUniform();
@@ -149,7 +290,7 @@ void MapModel::initGlobal(Particles& particles, double z, double roll, double pi
     getHeightlist(x, y, 0.6,z_list);
 
     for (unsigned zIdx = 0; zIdx < z_list.size(); zIdx++){
-      if (it == particles.end())
+      if (idx >= particles.size())
         break;
 
       // not needed => we already know that z contains valid poses
@@ -157,20 +298,186 @@ void MapModel::initGlobal(Particles& particles, double z, double roll, double pi
       //std::abs(node->getLogOdds()) < 0.1){
       //			if (!isOccupied(octomap::point3d(x, y, z[zIdx]))){
 
-      it->pose.getOrigin().setX(x);
-      it->pose.getOrigin().setY(y);
       // TODO: sample z, roll, pitch
-      it->pose.getOrigin().setZ(z_list.at(zIdx) + z + rngNormal() * initNoise(2));
+      particles.setPosition(idx, x, y, z_list.at(zIdx) + z + rngNormal() * initNoise(2));
       double yaw = rngUniform() * 2 * M_PI  -M_PI;
-      it->pose.setRotation(tf::createQuaternionFromRPY(roll, pitch, yaw));
-      it->weight = weight;
-      it++;
+      particles.setRPY(idx, roll, pitch, yaw);
+      particles.weight(idx) = weight;
+      idx++;
     }
   }
 
 }
 
 void MapModel::getHeightlist(double x, double y, double totalHeight, std::vector<double>& heights){
+  if (m_floorIndexOffsets.empty() || totalHeight != m_floorIndexClearance){
+    scanHeightlist(x, y, totalHeight, heights);
+    return;
+  }
+
+  // cells outside of the index are outside of the map (no valid heights):
+  const int ix = int(m_map->coordToKey(x)) - int(m_floorIndexMinKeyX);
+  const int iy = int(m_map->coordToKey(y)) - int(m_floorIndexMinKeyY);
+  if (ix < 0 || iy < 0 || ix >= int(m_floorIndexSizeX) || iy >= int(m_floorIndexSizeY))
+    return;
+
+  const unsigned cell = unsigned(iy) * m_floorIndexSizeX + unsigned(ix);
+  heights.insert(heights.end(), m_floorIndexHeights.begin() + m_floorIndexOffsets[cell],
+                 m_floorIndexHeights.begin() + m_floorIndexOffsets[cell + 1]);
+}
+
+void MapModel::initFloorIndex(){
+  m_floorIndexOffsets.clear();
+  m_floorIndexHeights.clear();
+  if (!m_map || m_floorIndexMaxMB <= 0.0)
+    return;
+
+  ros::WallTime startTime = ros::WallTime::now();
+  const double res = m_map->getResolution();
+  double minX, minY, minZ, maxX, maxY, maxZ;
+  m_map->getMetricMin(minX, minY, minZ);
+  m_map->getMetricMax(maxX, maxY, maxZ);
+
+  m_floorIndexMinKeyX = m_map->coordToKey(minX + res/2.0);
+  m_floorIndexMinKeyY = m_map->coordToKey(minY + res/2.0);
+  const octomap::key_type maxKeyX = m_map->coordToKey(maxX - res/2.0);
+  const octomap::key_type maxKeyY = m_map->coordToKey(maxY - res/2.0);
+  if (maxKeyX < m_floorIndexMinKeyX || maxKeyY < m_floorIndexMinKeyY)
+    return;
+
+  m_floorIndexSizeX = maxKeyX - m_floorIndexMinKeyX + 1;
+  m_floorIndexSizeY = maxKeyY - m_floorIndexMinKeyY + 1;
+  const size_t numCells = size_t(m_floorIndexSizeX) * m_floorIndexSizeY;
+  if ((numCells + 1) * sizeof(unsigned) > m_floorIndexMaxMB * 1024.0 * 1024.0){
+    ROS_WARN("Floor index of %u x %u cells exceeds floor_index_max_mb, scanning the map instead",
+             m_floorIndexSizeX, m_floorIndexSizeY);
+    return;
+  }
+
+  char cacheSection[64];
+  snprintf(cacheSection, sizeof(cacheSection), "floor_index/%.4f", m_floorIndexClearance);
+  if (loadFloorIndex(cacheSection, numCells))
+    return;
+
+  // building needs the offsets, the occupied voxels at max. depth (8 bytes
+  // each) and at most one floor height per voxel; serializing the index for
+  // the map cache copies offsets and heights once more
+  size_t numVoxelsTotal = 0;
+  for (octomap::OcTree::leaf_iterator it = m_map->begin_leafs(), end = m_map->end_leafs(); it != end; ++it){
+    if (isOccupied(&*it)){
+      const size_t numVoxels = std::max(1, int(it.getSize() / res + 0.5));
+      numVoxelsTotal += numVoxels * numVoxels * numVoxels;
+    }
+  }
+  const size_t indexBytes = (numCells + 1) * sizeof(unsigned) + numVoxelsTotal * sizeof(float);
+  const size_t buildBytes = indexBytes + numVoxelsTotal * sizeof(uint64_t);
+  const size_t peakBytes = m_mapCache ? std::max(buildBytes, 2 * indexBytes) : buildBytes;
+  if (peakBytes > m_floorIndexMaxMB * 1024.0 * 1024.0){
+    ROS_WARN("Building the floor index of %u x %u cells (%zu voxels) needs up to %.1f MB, exceeds "
+             "floor_index_max_mb, scanning the map instead",
+             m_floorIndexSizeX, m_floorIndexSizeY, numVoxelsTotal, peakBytes / (1024.0 * 1024.0));
+    return;
+  }
+
+  // all occupied voxels at max. depth as (cell, inverted z key), sorting
+  // yields each column from top to bottom as in scanHeightlist():
+  std::vector<uint64_t> columnVoxels;
+  columnVoxels.reserve(numVoxelsTotal);
+  for (octomap::OcTree::leaf_iterator it = m_map->begin_leafs(), end = m_map->end_leafs(); it != end; ++it){
+    if (!isOccupied(&*it))
+      continue;
+
+    const double size = it.getSize();
+    const int numVoxels = std::max(1, int(size / res + 0.5));
+    const double offset = -size/2.0 + res/2.0;
+    for (int i = 0; i < numVoxels; ++i){
+      const int ix = int(m_map->coordToKey(it.getX() + offset + i*res)) - int(m_floorIndexMinKeyX);
+      if (ix < 0 || ix >= int(m_floorIndexSizeX))
+        continue;
+      for (int j = 0; j < numVoxels; ++j){
+        const int iy = int(m_map->coordToKey(it.getY() + offset + j*res)) - int(m_floorIndexMinKeyY);
+        if (iy < 0 || iy >= int(m_floorIndexSizeY))
+          continue;
+        const uint64_t cell = uint64_t(iy) * m_floorIndexSizeX + ix;
+        for (int k = 0; k < numVoxels; ++k){
+          const octomap::key_type keyZ = m_map->coordToKey(it.getZ() + offset + k*res);
+          columnVoxels.push_back((cell << 16) | (0xFFFF - keyZ));
+        }
+      }
+    }
+  }
+  std::sort(columnVoxels.begin(), columnVoxels.end());
+  columnVoxels.erase(std::unique(columnVoxels.begin(), columnVoxels.end()), columnVoxels.end());
+
+  // free space of at least the clearance above an occupied voxel => valid floor height
+  m_floorIndexOffsets.assign(numCells + 1, 0);
+  const double columnTop = maxZ + res/2.0;
+  size_t v = 0;
+  for (size_t cell = 0; cell < numCells; ++cell){
+    m_floorIndexOffsets[cell] = m_floorIndexHeights.size();
+    double lastZ = columnTop;
+    for (; v < columnVoxels.size() && (columnVoxels[v] >> 16) == cell; ++v){
+      const double z = m_map->keyToCoord(octomap::key_type(0xFFFF - (columnVoxels[v] & 0xFFFF)));
+      if (lastZ - z >= m_floorIndexClearance + res)
+        m_floorIndexHeights.push_back(z + res/2.0);
+
+      lastZ = z;
+    }
+  }
+  m_floorIndexOffsets[numCells] = m_floorIndexHeights.size();
+  std::vector<uint64_t>().swap(columnVoxels);
+
+  ROS_INFO("Floor index of %u x %u cells with %zu floor heights built in %f s",
+           m_floorIndexSizeX, m_floorIndexSizeY, m_floorIndexHeights.size(),
+           (ros::WallTime::now() - startTime).toSec());
+
+  if (m_mapCache){
+    FloorIndexHeader header;
+    header.minKeyX = m_floorIndexMinKeyX;
+    header.minKeyY = m_floorIndexMinKeyY;
+    header.sizeX = m_floorIndexSizeX;
+    header.sizeY = m_floorIndexSizeY;
+    header.numHeights = m_floorIndexHeights.size();
+    const size_t offsetBytes = m_floorIndexOffsets.size() * sizeof(unsigned);
+    const size_t heightBytes = m_floorIndexHeights.size() * sizeof(float);
+    std::vector<char> data(sizeof(header) + offsetBytes + heightBytes);
+    memcpy(&data[0], &header, sizeof(header));
+    memcpy(&data[sizeof(header)], &m_floorIndexOffsets[0], offsetBytes);
+    if (heightBytes > 0)
+      memcpy(&data[sizeof(header) + offsetBytes], &m_floorIndexHeights[0], heightBytes);
+    m_mapCache->setSection(cacheSection, &data[0], data.size());
+  }
+}
+
+bool MapModel::loadFloorIndex(const std::string& cacheSection, size_t numCells){
+  const char* data;
+  size_t size;
+  if (!m_mapCache || !m_mapCache->getSection(cacheSection, data, size) || size < sizeof(FloorIndexHeader))
+    return false;
+
+  FloorIndexHeader header;
+  memcpy(&header, data, sizeof(header));
+  const size_t offsetBytes = (numCells + 1) * sizeof(unsigned);
+  const size_t heightBytes = header.numHeights * sizeof(float);
+  if (header.minKeyX != m_floorIndexMinKeyX || header.minKeyY != m_floorIndexMinKeyY
+      || header.sizeX != m_floorIndexSizeX || header.sizeY != m_floorIndexSizeY
+      || size != sizeof(header) + offsetBytes + heightBytes)
+  {
+    ROS_WARN("Floor index in the map cache does not match the map, recomputing it");
+    return false;
+  }
+
+  m_floorIndexOffsets.resize(numCells + 1);
+  memcpy(&m_floorIndexOffsets[0], data + sizeof(header), offsetBytes);
+  m_floorIndexHeights.resize(header.numHeights);
+  if (heightBytes > 0)
+    memcpy(&m_floorIndexHeights[0], data + sizeof(header) + offsetBytes, heightBytes);
+
+  ROS_INFO("Floor index of %u x %u cells loaded from the map cache", m_floorIndexSizeX, m_floorIndexSizeY);
+  return true;
+}
+
+void MapModel::scanHeightlist(double x, double y, double totalHeight, std::vector<double>& heights) const{
   double minX, minY, minZ, maxX, maxY, maxZ;
   m_map->getMetricMin(minX, minY, minZ);
   m_map->getMetricMax(maxX, maxY, maxZ);
@@ -218,9 +525,14 @@ DistanceMap::DistanceMap(ros::NodeHandle* nh)
 //    //octree = dynamic_cast<OcTree*>(tree);
 //  }
 
-  octomap::OcTree* tree = dynamic_cast<octomap::OcTree*>(octomap::AbstractOcTree::read(mapFileName));
+  octomap::AbstractOcTree* abstractTree = octomap::AbstractOcTree::read(mapFileName);
+  octomap::OcTree* tree = dynamic_cast<octomap::OcTree*>(abstractTree);
   if (tree){
     m_map.reset(tree);
+  } else if (abstractTree){
+    ROS_ERROR("Distance map file \"%s\" contains a %s instead of an OcTree",
+              mapFileName.c_str(), abstractTree->getTreeType().c_str());
+    delete abstractTree;
   }
 
   if (!m_map|| m_map->size() <= 1){
@@ -231,6 +543,8 @@ DistanceMap::DistanceMap(ros::NodeHandle* nh)
   m_map->getMetricSize(x,y,z);
   ROS_INFO("Distance map initialized with %zd nodes (%.2f x %.2f x %.2f m)", m_map->size(), x,y,z);
 
+  initFloorIndex();
+
 }
 
 DistanceMap::~DistanceMap(){
@@ -259,24 +573,55 @@ double DistanceMap::getFloorHeight(const tf::Transform& pose) const{
 OccupancyMap::OccupancyMap(ros::NodeHandle* nh)
 : MapModel(nh)
 {
-  std::string servname = "octomap_binary";
-  ROS_INFO("Requesting the map from %s...", nh->resolveName(servname).c_str());
-  octomap_msgs::GetOctomap::Request req;
-  octomap_msgs::GetOctomap::Response resp;
-  while(nh->ok() && !ros::service::call(servname, req, resp))
-  {
-    ROS_WARN("Request to %s failed; trying again...", nh->resolveName(servname).c_str());
-    usleep(1000000);
-  }
+  // optionally load the map from a file (e.g. for offline replay) instead of the map server:
+  std::string mapFileName;
+  nh->param("map_file", mapFileName, mapFileName);
+  if (!mapFileName.empty()){
+    ROS_INFO("Loading the map from %s...", mapFileName.c_str());
+    if (mapFileName.size() > 3 && mapFileName.compare(mapFileName.size() - 3, 3, ".bt") == 0)
+      m_map.reset(new octomap::OcTree(mapFileName));
+    else {
+      octomap::AbstractOcTree* tree = octomap::AbstractOcTree::read(mapFileName);
+      m_map.reset(dynamic_cast<octomap::OcTree*>(tree));
+      if (!m_map && tree){
+        ROS_ERROR("Map file %s contains a %s instead of an OcTree", mapFileName.c_str(), tree->getTreeType().c_str());
+        delete tree;
+      }
+    }
+  } else {
+    // with a map cache, a map server is only waited for up to
+    // map_cache_server_timeout; if it is available, its map replaces a
+    // stale cache (see initMapCache()), otherwise the cached octree is used
+    std::string servname = "octomap_binary";
+    double serverTimeout = 2.0;
+    nh->param("map_cache_server_timeout", serverTimeout, serverTimeout);
+    const bool serverAvailable = m_mapCacheFile.empty()
+        || ros::service::waitForService(servname, ros::Duration(std::max(serverTimeout, 0.001)));
+    if (serverAvailable || !loadMapFromCache()){
+      ROS_INFO("Requesting the map from %s...", nh->resolveName(servname).c_str());
+      octomap_msgs::GetOctomap::Request req;
+      octomap_msgs::GetOctomap::Response resp;
+      while(nh->ok() && !ros::service::call(servname, req, resp))
+      {
+        ROS_WARN("Request to %s failed; trying again...", nh->resolveName(servname).c_str());
+        usleep(1000000);
+      }
 
 
 // Groovy:
 #if ROS_VERSION_MINIMUM(1, 9, 0)
-  m_map.reset(dynamic_cast<octomap::OcTree*>(octomap_msgs::binaryMsgToMap(resp.map)));
+      m_map.reset(dynamic_cast<octomap::OcTree*>(octomap_msgs::binaryMsgToMap(resp.map)));
 #else  // Fuerte:
-  m_map.reset(octomap_msgs::binaryMsgDataToMap(resp.map.data));
+      m_map.reset(octomap_msgs::binaryMsgDataToMap(resp.map.data));
 #endif
 
+      if (m_map)
+        m_map->writeBinary("/tmp/octomap_loc");
+    } else {
+      ROS_WARN("No map server %s, using the (unverified) octree of the map cache", nh->resolveName(servname).c_str());
+    }
+  }
+
   if (!m_map || m_map->size() <= 1){
     ROS_ERROR("Occupancy map is erroneous, exiting...");
     exit(-1);
@@ -284,9 +629,9 @@ OccupancyMap::OccupancyMap(ros::NodeHandle* nh)
   double x,y,z;
   m_map->getMetricSize(x,y,z);
   ROS_INFO("Occupancy map initialized with %zd nodes (%.2f x %.2f x %.2f m), %f m res.", m_map->size(), x,y,z, m_map->getResolution());
-  
-  m_map->writeBinary("/tmp/octomap_loc");
 
+  initMapCache();
+  initFloorIndex();
 }
 
 OccupancyMap::~OccupancyMap(){
@@ -23,6 +23,8 @@
 
 #include <humanoid_localization/MotionModel.h>
 
+#include <omp.h>
+
 using namespace tf;
 using namespace std;
 
@@ -33,6 +35,7 @@ MotionModel::MotionModel(ros::NodeHandle* nh, EngineT* rngEngine, tf::TransformL
 : m_tfListener(tf),
   m_rngNormal(*rngEngine, NormalDistributionT(0.0, 1.0)),
   m_rngUniform(*rngEngine, UniformDistributionT(0.0, 1.0)),
+  m_threadRngSeed((*rngEngine)()), m_temporalSamplingBins(10),
   m_odomFrameId(odomFrameId), m_baseFrameId(baseFrameId),
   m_firstOdometryReceived(false)
 
@@ -80,6 +83,12 @@ MotionModel::MotionModel(ros::NodeHandle* nh, EngineT* rngEngine, tf::TransformL
   nh->param("motion_calib/ty", m_odomCalibration2D(2,1), 0.0);
   nh->param("motion_calib/tt", m_odomCalibration2D(2,2), 1.0);
 
+  nh->param("temporal_sampling_bins", m_temporalSamplingBins, m_temporalSamplingBins);
+  if (m_temporalSamplingBins < 1){
+    ROS_WARN("temporal_sampling_bins needs to be >= 1, using 1");
+    m_temporalSamplingBins = 1;
+  }
+
 
   reset();
 
@@ -91,6 +100,10 @@ MotionModel::~MotionModel() {
 
 
 tf::Transform MotionModel::odomTransformNoise(const tf::Transform& odomTransform){
+  return odomTransformNoise(odomTransform, m_rngNormal);
+}
+
+tf::Transform MotionModel::odomTransformNoise(const tf::Transform& odomTransform, NormalGeneratorT& rngNormal) const{
   // vectors (x,y,theta) in 2D for squared motion and variance
   Eigen::Vector3d motion2D_sq, motion_variance;
   double yaw = tf::getYaw(odomTransform.getRotation());
@@ -108,13 +121,19 @@ tf::Transform MotionModel::odomTransformNoise(const tf::Transform& odomTransform
   // (about 1-2cm for each update step)
   const double d = odomTransform.getOrigin().length();
   return tf::Transform(tf::createQuaternionFromRPY(
-        m_rngNormal() * d * m_odomNoiseRoll,      // roll
-        m_rngNormal() * d * m_odomNoisePitch,     // pitch
-        m_rngNormal() * sqrt(motion_variance(2))),// yaw
+        rngNormal() * d * m_odomNoiseRoll,      // roll
+        rngNormal() * d * m_odomNoisePitch,     // pitch
+        rngNormal() * sqrt(motion_variance(2))),// yaw
       tf::Vector3(
-        m_rngNormal() * sqrt(motion_variance(0)), // x
-        m_rngNormal() * sqrt(motion_variance(1)), // y
-        m_rngNormal() * d * m_odomNoiseZ));       // z
+        rngNormal() * sqrt(motion_variance(0)), // x
+        rngNormal() * sqrt(motion_variance(1)), // y
+        rngNormal() * d * m_odomNoiseZ));       // z
+}
+
+void MotionModel::initThreadRngEngines(){
+  const unsigned numThreads = omp_get_max_threads();
+  while (m_threadRngEngines.size() < numThreads)
+    m_threadRngEngines.push_back(EngineT(m_threadRngSeed + m_threadRngEngines.size()));
 }
 
 void MotionModel::reset(){
@@ -127,9 +146,15 @@ void MotionModel::applyOdomTransform(tf::Pose& particlePose, const tf::Transform
 
 void MotionModel::applyOdomTransform(Particles& particles, const tf::Transform& odomTransform){
   const tf::Transform calibratedOdomTransform = calibrateOdometry(odomTransform);
+  initThreadRngEngines();
 
-  for (unsigned i=0; i < particles.size(); ++i){
-    particles[i].pose *= calibratedOdomTransform * odomTransformNoise(odomTransform);
+#pragma omp parallel
+  {
+    NormalGeneratorT rngNormal(m_threadRngEngines[omp_get_thread_num()], NormalDistributionT(0.0, 1.0));
+#pragma omp for schedule(static)
+    for (unsigned i=0; i < particles.size(); ++i){
+      particles.setPose(i, particles.getPose(i) * calibratedOdomTransform * odomTransformNoise(odomTransform, rngNormal));
+    }
   }
 }
 
@@ -141,30 +166,43 @@ bool MotionModel::applyOdomTransformTemporal(Particles& particles,const ros::Tim
   if (!lookupOdomTransform(t, odomTransform))
     return false;
 
-  tf::Transform timeSampledTransform;
-  ros::Duration maxDuration;
+  // odometry transforms of the time bins (uncalibrated for the noise, calibrated for the mean):
+  std::vector<tf::Transform> binTransforms(1, odomTransform);
   if (dt > 0.0){
     ros::Time maxTime;
     std::string errorString;
     m_tfListener->getLatestCommonTime(m_odomFrameId, m_baseFrameId, maxTime, &errorString);
-    maxDuration = maxTime - t;
-  }
+    const ros::Duration maxDuration = maxTime - t;
 
-  for (unsigned i=0; i < particles.size(); ++i){
-    if (dt > 0.0){
-      ros::Duration duration(m_rngUniform()*dt -dt/2.0);
+    binTransforms.resize(m_temporalSamplingBins);
+    for (int k = 0; k < m_temporalSamplingBins; ++k){
+      // bin centers in [-dt/2, dt/2]:
+      ros::Duration duration((k + 0.5) * dt / m_temporalSamplingBins - dt/2.0);
       // TODO: time t is time of first measurement in scan!
       if (duration > maxDuration)
         duration = maxDuration;
 
-      if (lookupOdomTransform(t + duration, timeSampledTransform))
-        applyOdomTransform(particles[i].pose, timeSampledTransform);
-      else{
+      if (!lookupOdomTransform(t + duration, binTransforms[k])){
         ROS_WARN("Could not lookup temporal odomTransform");
-        applyOdomTransform(particles[i].pose, odomTransform);
+        binTransforms[k] = odomTransform;
       }
-    } else{
-      applyOdomTransform(particles[i].pose, odomTransform);
+    }
+  }
+
+  std::vector<tf::Transform> calibratedBinTransforms(binTransforms.size());
+  for (unsigned k = 0; k < binTransforms.size(); ++k)
+    calibratedBinTransforms[k] = calibrateOdometry(binTransforms[k]);
+
+  initThreadRngEngines();
+#pragma omp parallel
+  {
+    EngineT& rngEngine = m_threadRngEngines[omp_get_thread_num()];
+    NormalGeneratorT rngNormal(rngEngine, NormalDistributionT(0.0, 1.0));
+    UniformGeneratorT rngUniform(rngEngine, UniformDistributionT(0.0, 1.0));
+#pragma omp for schedule(static)
+    for (unsigned i=0; i < particles.size(); ++i){
+      const unsigned k = std::min(unsigned(rngUniform() * binTransforms.size()), unsigned(binTransforms.size() - 1));
+      particles.setPose(i, particles.getPose(i) * calibratedBinTransforms[k] * odomTransformNoise(binTransforms[k], rngNormal));
     }
   }
 
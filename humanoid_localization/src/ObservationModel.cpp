@@ -64,14 +64,14 @@ void ObservationModel::integratePoseMeasurement(Particles& particles, double pos
   for (unsigned i=0; i < particles.size(); ++i){
     // integrate IMU meas.:
     double roll, pitch, yaw;
-    particles[i].pose.getBasis().getRPY(roll, pitch, yaw);
-    particles[i].weight += m_weightRoll * logLikelihood(poseRoll - roll, m_sigmaRoll);
-    particles[i].weight += m_weightPitch * logLikelihood(posePitch - pitch, m_sigmaPitch);
+    particles.getRPY(i, roll, pitch, yaw);
+    particles.weight(i) += m_weightRoll * logLikelihood(poseRoll - roll, m_sigmaRoll);
+    particles.weight(i) += m_weightPitch * logLikelihood(posePitch - pitch, m_sigmaPitch);
 
     // integrate height measurement (z)
     double heightError;
-    if (getHeightError(particles[i],footprintToTorso, heightError))
-      particles[i].weight += m_weightZ * logLikelihood(heightError, m_sigmaZ);
+    if (getHeightError(particles.getPosition(i),footprintToTorso, heightError))
+      particles.weight(i) += m_weightZ * logLikelihood(heightError, m_sigmaZ);
 
 
   }
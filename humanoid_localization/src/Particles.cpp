@@ -0,0 +1,184 @@
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <humanoid_localization/Particles.h>
+
+#include <cmath>
+
+#include <omp.h>
+#include <stdint.h>
+
+namespace humanoid_localization{
+
+namespace {
+/// Rotation matrix of roll, pitch, yaw (same convention as tf::Matrix3x3::setRPY)
+inline void rotationFromRPY(float roll, float pitch, float yaw, Eigen::Matrix3f& rotation){
+  const float cr = std::cos(roll), sr = std::sin(roll);
+  const float cp = std::cos(pitch), sp = std::sin(pitch);
+  const float cy = std::cos(yaw), sy = std::sin(yaw);
+  rotation << cy*cp, cy*sp*sr - sy*cr, cy*sp*cr + sy*sr,
+              sy*cp, sy*sp*sr + cy*cr, sy*sp*cr - cy*sr,
+              -sp,   cp*sr,            cp*cr;
+}
+}
+
+void SensorPoints::assign(const pcl::PointCloud<pcl::PointXYZ>& pc){
+  resize(pc.size());
+  for (size_t i = 0; i < pc.size(); ++i){
+    x[i] = pc[i].x;
+    y[i] = pc[i].y;
+    z[i] = pc[i].z;
+  }
+}
+
+void SensorPoints::resize(size_t size){
+  x.resize(size);
+  y.resize(size);
+  z.resize(size);
+}
+
+void SensorPoints::transform(const Eigen::Matrix3f& rotation, const Eigen::Vector3f& translation, SensorPoints& out) const{
+  out.resize(size());
+  if (x.empty())
+    return;
+
+  typedef Eigen::Map<const Eigen::ArrayXf> ConstMap;
+  typedef Eigen::Map<Eigen::ArrayXf> Map;
+  const ConstMap px(x.data(), x.size()), py(y.data(), y.size()), pz(z.data(), z.size());
+  Map(out.x.data(), size()) = rotation(0,0) * px + rotation(0,1) * py + rotation(0,2) * pz + translation(0);
+  Map(out.y.data(), size()) = rotation(1,0) * px + rotation(1,1) * py + rotation(1,2) * pz + translation(1);
+  Map(out.z.data(), size()) = rotation(2,0) * px + rotation(2,1) * py + rotation(2,2) * pz + translation(2);
+}
+
+void Particles::resize(size_t size){
+  m_x.resize(size, 0.0f);
+  m_y.resize(size, 0.0f);
+  m_z.resize(size, 0.0f);
+  m_roll.resize(size, 0.0f);
+  m_pitch.resize(size, 0.0f);
+  m_yaw.resize(size, 0.0f);
+  m_weights.resize(size, 0.0);
+}
+
+void Particles::swap(Particles& other){
+  m_x.swap(other.m_x);
+  m_y.swap(other.m_y);
+  m_z.swap(other.m_z);
+  m_roll.swap(other.m_roll);
+  m_pitch.swap(other.m_pitch);
+  m_yaw.swap(other.m_yaw);
+  m_weights.swap(other.m_weights);
+}
+
+tf::Pose Particles::getPose(size_t i) const{
+  tf::Quaternion q;
+  q.setRPY(m_roll[i], m_pitch[i], m_yaw[i]);
+  return tf::Pose(q, tf::Vector3(m_x[i], m_y[i], m_z[i]));
+}
+
+void Particles::setPose(size_t i, const tf::Pose& pose){
+  m_x[i] = pose.getOrigin().getX();
+  m_y[i] = pose.getOrigin().getY();
+  m_z[i] = pose.getOrigin().getZ();
+  double roll, pitch, yaw;
+  pose.getBasis().getRPY(roll, pitch, yaw);
+  m_roll[i] = roll;
+  m_pitch[i] = pitch;
+  m_yaw[i] = yaw;
+}
+
+Particle Particles::getParticle(size_t i) const{
+  Particle particle;
+  particle.weight = m_weights[i];
+  particle.pose = getPose(i);
+  return particle;
+}
+
+void Particles::setParticle(size_t i, const Particle& particle){
+  m_weights[i] = particle.weight;
+  setPose(i, particle.pose);
+}
+
+void Particles::getSensorTransform(size_t i, const tf::Transform& baseToSensor,
+                                   Eigen::Matrix3f& rotation, Eigen::Vector3f& translation) const{
+  Eigen::Matrix3f particleRotation;
+  rotationFromRPY(m_roll[i], m_pitch[i], m_yaw[i], particleRotation);
+
+  Eigen::Matrix3f sensorRotation;
+  const tf::Matrix3x3& basis = baseToSensor.getBasis();
+  for (int r = 0; r < 3; ++r){
+    for (int c = 0; c < 3; ++c)
+      sensorRotation(r, c) = basis[r][c];
+  }
+  const tf::Vector3& origin = baseToSensor.getOrigin();
+
+  rotation = particleRotation * sensorRotation;
+  translation = particleRotation * Eigen::Vector3f(origin.x(), origin.y(), origin.z())
+      + Eigen::Vector3f(m_x[i], m_y[i], m_z[i]);
+}
+
+void Particles::cumulativeWeights(std::vector<double>& cumWeights) const{
+  const int n = m_weights.size();
+  cumWeights.resize(n);
+  std::vector<double> blockOffsets;
+
+  // two passes over contiguous blocks: local scan, then add the sums of all previous blocks
+#pragma omp parallel
+  {
+    const int numThreads = omp_get_num_threads();
+    const int thread = omp_get_thread_num();
+    const int begin = int(int64_t(n) * thread / numThreads);
+    const int end = int(int64_t(n) * (thread + 1) / numThreads);
+
+#pragma omp single
+    blockOffsets.assign(numThreads + 1, 0.0);
+
+    double sum = 0.0;
+    for (int i = begin; i < end; ++i){
+      sum += m_weights[i];
+      cumWeights[i] = sum;
+    }
+    blockOffsets[thread + 1] = sum;
+
+#pragma omp barrier
+#pragma omp single
+    for (int t = 1; t <= numThreads; ++t)
+      blockOffsets[t] += blockOffsets[t - 1];
+
+    const double offset = blockOffsets[thread];
+    if (offset != 0.0){
+      for (int i = begin; i < end; ++i)
+        cumWeights[i] += offset;
+    }
+  }
+}
+
+void Particles::copyParticle(size_t dstIdx, const Particles& src, size_t srcIdx){
+  m_x[dstIdx] = src.m_x[srcIdx];
+  m_y[dstIdx] = src.m_y[srcIdx];
+  m_z[dstIdx] = src.m_z[srcIdx];
+  m_roll[dstIdx] = src.m_roll[srcIdx];
+  m_pitch[dstIdx] = src.m_pitch[srcIdx];
+  m_yaw[dstIdx] = src.m_yaw[srcIdx];
+  m_weights[dstIdx] = src.m_weights[srcIdx];
+}
+
+}
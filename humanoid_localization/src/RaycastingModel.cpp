@@ -65,40 +65,38 @@ void RaycastingModel::integrateMeasurement(Particles& particles, const PointClou
     ROS_ERROR("Map file is not set in raycasting");
     return;
   }
+  const SensorPoints points(pc);
+
   // iterate over samples, multi-threaded:
 #pragma omp parallel for
   for (unsigned i=0; i < particles.size(); ++i){
-    Eigen::Matrix4f globalLaserOrigin;
-    tf::Transform globalLaserOriginTf = particles[i].pose * base_to_laser;
-    pcl_ros::transformAsMatrix(globalLaserOriginTf, globalLaserOrigin);
+    Eigen::Matrix3f rotation;
+    Eigen::Vector3f translation;
+    particles.getSensorTransform(i, base_to_laser, rotation, translation);
 
     // raycasting origin
-    octomap::point3d originP(globalLaserOriginTf.getOrigin().x(),
-                             globalLaserOriginTf.getOrigin().y(),
-                             globalLaserOriginTf.getOrigin().z());
-    PointCloud pc_transformed;
-    pcl::transformPointCloud(pc, pc_transformed, globalLaserOrigin);
+    octomap::point3d originP(translation(0), translation(1), translation(2));
 
+    double weight = 0.0;
     // iterate over beams:
-    PointCloud::const_iterator pc_it = pc_transformed.begin();
     std::vector<float>::const_iterator ranges_it = ranges.begin();
-    for ( ; pc_it != pc_transformed.end(); ++pc_it, ++ranges_it){
+    for (unsigned j = 0; j < points.size(); ++j, ++ranges_it){
 
       double p = 0.0; // probability for weight
 
       if (*ranges_it <= max_range){
 
-        // direction of ray in global (map) coords
-        octomap::point3d direction(pc_it->x , pc_it->y, pc_it->z);
-        direction = direction - originP;
+        // direction of ray in global (map) coords (endpoint - origin, i.e. only rotated):
+        octomap::point3d direction(
+            rotation(0,0) * points.x[j] + rotation(0,1) * points.y[j] + rotation(0,2) * points.z[j],
+            rotation(1,0) * points.x[j] + rotation(1,1) * points.y[j] + rotation(1,2) * points.z[j],
+            rotation(2,0) * points.x[j] + rotation(2,1) * points.y[j] + rotation(2,2) * points.z[j]);
 
         // TODO: check first if endpoint is within map?
-        octomap::point3d end;
+        float raycastRange;
         // raycast in OctoMap, we need to cast a little longer than max_range
         // to correct for particle drifts away from obstacles
-        if(m_map->castRay(originP,direction, end, true, 1.5*max_range)){
-          assert(m_map->isNodeOccupied(m_map->search(end)));
-          float raycastRange = (originP - end).norm();
+        if(castRay(originP, direction, 1.5*max_range, raycastRange)){
           float z = raycastRange - *ranges_it;
           float sigma_scaled = m_sigmaHit;
           if (m_use_squared_error)
@@ -124,19 +122,31 @@ void RaycastingModel::integrateMeasurement(Particles& particles, const PointClou
       // add log-likelihood
       // (note: likelihood can be larger than 1!)
       assert(p > 0.0);
-      particles[i].weight += log(p);
+      weight += log(p);
 
     } // end of loop over scan
+    particles.weight(i) += weight;
 
   } // end of loop over particles
 
 
 }
 
-bool RaycastingModel::getHeightError(const Particle& p, const tf::StampedTransform& footprintToBase, double& heightError) const{
+bool RaycastingModel::castRay(const octomap::point3d& origin, const octomap::point3d& direction,
+                              float maxRange, float& range) const{
+  octomap::point3d end;
+  if (!m_map->castRay(origin, direction, end, true, maxRange))
+    return false;
+
+  assert(m_map->isNodeOccupied(m_map->search(end)));
+  range = (origin - end).norm();
+  return true;
+}
+
+bool RaycastingModel::getHeightError(const tf::Vector3& position, const tf::StampedTransform& footprintToBase, double& heightError) const{
 
   octomap::point3d direction = octomap::pointTfToOctomap(footprintToBase.inverse().getOrigin());
-  octomap::point3d origin = octomap::pointTfToOctomap(p.pose.getOrigin());
+  octomap::point3d origin = octomap::pointTfToOctomap(position);
   octomap::point3d end;
   // cast ray to bottom:
   if (!m_map->castRay(origin, direction, end, true, 2*direction.norm()))
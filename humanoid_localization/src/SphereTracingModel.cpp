@@ -0,0 +1,128 @@
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <humanoid_localization/SphereTracingModel.h>
+
+#include <dynamicEDT3D/dynamicEDTOctomap.h>
+
+namespace humanoid_localization{
+
+SphereTracingModel::SphereTracingModel(ros::NodeHandle* nh, boost::shared_ptr<MapModel> mapModel, EngineT * rngEngine)
+: RaycastingModel(nh, mapModel, rngEngine), m_maxDistance(1.0), m_maxMB(256), m_bits(8)
+{
+  ROS_INFO("Using sphere tracing for raycasting (precomputing...)");
+
+  nh->param("raycasting/sphere_tracing_max_distance", m_maxDistance, m_maxDistance);
+  nh->param("raycasting/sphere_tracing_max_mb", m_maxMB, m_maxMB);
+  nh->param("raycasting/sphere_tracing_bits", m_bits, m_bits);
+
+  initDistanceField();
+}
+
+SphereTracingModel::~SphereTracingModel(){
+
+}
+
+void SphereTracingModel::setMap(boost::shared_ptr<octomap::OcTree> map){
+  m_map = map;
+  initDistanceField();
+}
+
+void SphereTracingModel::initDistanceField(){
+  double x,y,z;
+  m_map->getMetricMin(x,y,z);
+  octomap::point3d min(x,y,z);
+  m_map->getMetricMax(x,y,z);
+  octomap::point3d max(x,y,z);
+
+  const size_t maxBytes = size_t(std::max(0, m_maxMB)) * 1024 * 1024;
+  // map cache only valid for the map it belongs to (not after setMap()):
+  boost::shared_ptr<MapCache> cache;
+  if (m_map == m_mapModel->getMap())
+    cache = m_mapModel->getMapCache();
+  const std::string cacheSection = LikelihoodField::cacheSectionName("sphere_tracing", m_map->getResolution(),
+                                                                     float(m_maxDistance), maxBytes, unsigned(m_bits), false);
+  const char* data;
+  size_t size;
+  if (cache && cache->getSection(cacheSection, data, size) && m_distanceField.deserialize(data, size)){
+    ROS_INFO("Distance field for sphere tracing loaded from the map cache");
+    return;
+  }
+
+  // the distance map is only needed to bake the field:
+  DynamicEDTOctomap distanceMap(float(m_maxDistance), &(*m_map), min, max, false);
+  distanceMap.update();
+
+  if (!m_distanceField.build(distanceMap, min, max, m_map->getResolution(), float(m_maxDistance),
+                             maxBytes, unsigned(m_bits), false))
+  {
+    ROS_WARN("Could not precompute the distance field for sphere tracing, using OctoMap raycasting");
+    return;
+  }
+
+  if (cache){
+    std::vector<char> fieldData;
+    m_distanceField.serialize(fieldData);
+    cache->setSection(cacheSection, &fieldData[0], fieldData.size());
+  }
+
+  ROS_INFO("Distance field for sphere tracing completed (%zu KB)", m_distanceField.bytesAllocated() / 1024);
+}
+
+bool SphereTracingModel::castRay(const octomap::point3d& origin, const octomap::point3d& direction,
+                                 float maxRange, float& range) const{
+  const float norm = direction.norm();
+  if (m_distanceField.empty() || norm <= 0.0f)
+    return RaycastingModel::castRay(origin, direction, maxRange, range);
+
+  const octomap::point3d dir = direction * (1.0f / norm);
+  const float resolution = m_distanceField.resolution();
+  // distances are between cell centers => conservative by one cell diagonal:
+  const float margin = std::sqrt(3.0f) * resolution;
+  const float minStep = 0.5f * resolution;
+
+  float t = 0.0f;
+  while (t <= maxRange){
+    const float px = origin.x() + dir.x() * t;
+    const float py = origin.y() + dir.y() * t;
+    const float pz = origin.z() + dir.z() * t;
+
+    unsigned code;
+    if (!m_distanceField.lookup(px, py, pz, code)){
+      // left the field: this is the end of the map unless the field is cropped
+      if (m_distanceField.isCropped())
+        return RaycastingModel::castRay(origin, direction, maxRange, range);
+      else
+        return false;
+    }
+
+    if (code == 0){ // obstacle cell
+      range = t;
+      return true;
+    }
+
+    t += std::max(m_distanceField.distance(code) - margin, minStep);
+  }
+
+  return false;
+}
+
+}
@@ -0,0 +1,259 @@
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Offline replay of a bag file through HumanoidLocalization as fast as
+ * possible, with a fixed random seed. Reports the time of each filter stage,
+ * particles per second and the pose error against a ground truth topic.
+ *
+ * Usage (parameters as for localization_node, in the private namespace):
+ *   rosrun humanoid_localization localization_replay <bagfile> [seed] _map_file:=<map.bt>
+ *       _replay/truth_topic:=<topic> (geometry_msgs/PoseStamped or PoseWithCovarianceStamped)
+ *
+ * A roscore is needed for the parameters only, no messages are exchanged live.
+ */
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <tf/tfMessage.h>
+#include <humanoid_localization/HumanoidLocalization.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+
+using namespace humanoid_localization;
+
+namespace {
+
+/// HumanoidLocalization with tf fed from the bag instead of the tf topic;
+/// without a spin thread (and without spinning the global callback queue),
+/// live tf published while replaying does not reach m_tfListener
+class ReplayLocalization : public HumanoidLocalization{
+public:
+  ReplayLocalization(unsigned randomSeed)
+  : HumanoidLocalization(randomSeed, false)
+  {
+  }
+
+  void addTransform(const geometry_msgs::TransformStamped& msg, bool isStatic){
+    tf::StampedTransform transform;
+    tf::transformStampedMsgToTF(msg, transform);
+    m_tfListener.setTransform(transform, "replay", isStatic);
+  }
+
+  tf::Pose getPoseEstimate() const{
+    return m_bestParticleAsMean ? getMeanParticlePose() : getBestParticlePose();
+  }
+};
+
+struct StampedPose{
+  ros::Time stamp;
+  tf::Pose pose;
+  bool operator<(const StampedPose& other) const { return stamp < other.stamp; }
+};
+
+/// sensor message waiting until tf is available up to its stamp
+struct PendingMessage{
+  ros::Time stamp;
+  sensor_msgs::LaserScanConstPtr laser;
+  sensor_msgs::PointCloud2::ConstPtr cloud;
+  sensor_msgs::ImuConstPtr imu;
+};
+
+void printStage(const char* name, double time, double totalTime, unsigned numMeasurements){
+  printf("  %-14s %10.3f s %6.1f %%  %8.2f ms/measurement\n", name, time,
+         totalTime > 0.0 ? 100.0 * time / totalTime : 0.0,
+         numMeasurements > 0 ? 1000.0 * time / numMeasurements : 0.0);
+}
+
+}
+
+int
+main(int argc, char** argv)
+{
+  ros::init(argc, argv, "localization_replay", ros::init_options::NoRosout);
+  if (argc < 2){
+    fprintf(stderr, "Usage: %s <bagfile> [seed]\n", argv[0]);
+    return -1;
+  }
+  const std::string bagFileName(argv[1]);
+  const unsigned seed = argc > 2 ? atoi(argv[2]) : 42;
+
+  ros::NodeHandle privateNh("~");
+  std::string scanTopic("scan"), pointCloudTopic("point_cloud"), imuTopic("imu"), truthTopic;
+  double tfLag = 0.1;
+  privateNh.param("replay/scan_topic", scanTopic, scanTopic);
+  privateNh.param("replay/point_cloud_topic", pointCloudTopic, pointCloudTopic);
+  privateNh.param("replay/imu_topic", imuTopic, imuTopic);
+  privateNh.param("replay/truth_topic", truthTopic, truthTopic);
+  // sensor messages are processed once tf is available tfLag after their stamp
+  privateNh.param("replay/tf_lag", tfLag, tfLag);
+  // deterministic, measurements are processed in the order of the bag:
+  privateNh.setParam("async_preprocessing", false);
+
+  rosbag::Bag bag;
+  try{
+    bag.open(bagFileName, rosbag::bagmode::Read);
+  } catch (const rosbag::BagException& e){
+    fprintf(stderr, "Could not open %s: %s\n", bagFileName.c_str(), e.what());
+    return -1;
+  }
+
+  ros::WallTime setupStartTime = ros::WallTime::now();
+  ReplayLocalization localization(seed);
+  const double setupTime = (ros::WallTime::now() - setupStartTime).toSec();
+  localization.resetStageTimings();
+
+  std::vector<std::string> topics;
+  topics.push_back("/tf");
+  topics.push_back("/tf_static");
+  topics.push_back(scanTopic);
+  topics.push_back(pointCloudTopic);
+  topics.push_back(imuTopic);
+  if (!truthTopic.empty())
+    topics.push_back(truthTopic);
+  rosbag::View view(bag, rosbag::TopicQuery(topics));
+
+  std::deque<PendingMessage> pending;
+  std::vector<StampedPose> estimates, truth;
+  unsigned numSensorMessages = 0;
+  double filterTime = 0.0;
+  ros::Time latestTfStamp;
+
+  for (rosbag::View::iterator it = view.begin(); ; ++it){
+    const bool bagDone = (it == view.end());
+    if (!bagDone){
+      const rosbag::MessageInstance& m = *it;
+      tf::tfMessage::ConstPtr tfMsg = m.instantiate<tf::tfMessage>();
+      if (tfMsg){
+        const bool isStatic = m.getTopic() == "/tf_static" || m.getTopic() == "tf_static";
+        for (unsigned i = 0; i < tfMsg->transforms.size(); ++i){
+          localization.addTransform(tfMsg->transforms[i], isStatic);
+          if (!isStatic && latestTfStamp < tfMsg->transforms[i].header.stamp)
+            latestTfStamp = tfMsg->transforms[i].header.stamp;
+        }
+      } else if (m.getTopic() == truthTopic){
+        StampedPose truthPose;
+        geometry_msgs::PoseStamped::ConstPtr poseMsg = m.instantiate<geometry_msgs::PoseStamped>();
+        geometry_msgs::PoseWithCovarianceStamped::ConstPtr poseCovMsg = m.instantiate<geometry_msgs::PoseWithCovarianceStamped>();
+        if (poseMsg){
+          truthPose.stamp = poseMsg->header.stamp;
+          tf::poseMsgToTF(poseMsg->pose, truthPose.pose);
+          truth.push_back(truthPose);
+        } else if (poseCovMsg){
+          truthPose.stamp = poseCovMsg->header.stamp;
+          tf::poseMsgToTF(poseCovMsg->pose.pose, truthPose.pose);
+          truth.push_back(truthPose);
+        }
+      } else {
+        PendingMessage msg;
+        msg.laser = m.instantiate<sensor_msgs::LaserScan>();
+        msg.cloud = m.instantiate<sensor_msgs::PointCloud2>();
+        msg.imu = m.instantiate<sensor_msgs::Imu>();
+        if (msg.laser)
+          msg.stamp = msg.laser->header.stamp;
+        else if (msg.cloud)
+          msg.stamp = msg.cloud->header.stamp;
+        else if (msg.imu)
+          msg.stamp = msg.imu->header.stamp;
+        else
+          continue;
+        pending.push_back(msg);
+      }
+    }
+
+    // process all messages whose tf is complete:
+    while (!pending.empty() && (bagDone || pending.front().stamp + ros::Duration(tfLag) <= latestTfStamp)){
+      const PendingMessage& msg = pending.front();
+      ros::WallTime startTime = ros::WallTime::now();
+      if (msg.imu){
+        localization.imuCallback(msg.imu);
+      } else {
+        if (msg.laser)
+          localization.laserCallback(msg.laser);
+        else
+          localization.pointCloudCallback(msg.cloud);
+
+        filterTime += (ros::WallTime::now() - startTime).toSec();
+        numSensorMessages++;
+        StampedPose estimate;
+        estimate.stamp = msg.stamp;
+        estimate.pose = localization.getPoseEstimate();
+        estimates.push_back(estimate);
+      }
+      pending.pop_front();
+    }
+
+    if (bagDone)
+      break;
+  }
+  bag.close();
+
+  // output summary:
+  const HumanoidLocalization::StageTimings& timings = localization.getStageTimings();
+  printf("%s: seed %u, setup %.2f s, %u sensor messages, %u integrated\n",
+         bagFileName.c_str(), seed, setupTime, numSensorMessages, timings.numMeasurements);
+  printf("filter time %.3f s, %.0f particles/s\n", filterTime,
+         filterTime > 0.0 ? timings.numParticleUpdates / filterTime : 0.0);
+  printStage("motion", timings.motion, filterTime, timings.numMeasurements);
+  printStage("preprocessing", timings.preprocessing, filterTime, timings.numMeasurements);
+  printStage("observation", timings.observation, filterTime, timings.numMeasurements);
+  printStage("verifyPoses", timings.verifyPoses, filterTime, timings.numMeasurements);
+  printStage("resampling", timings.resampling, filterTime, timings.numMeasurements);
+  printStage("publish", timings.publish, filterTime, timings.numMeasurements);
+
+  // pose error against the closest ground truth pose (within 0.1 s):
+  if (!truthTopic.empty()){
+    std::sort(truth.begin(), truth.end());
+    double sumTransError = 0.0, sumYawError = 0.0, maxTransError = 0.0;
+    unsigned numEvaluated = 0;
+    for (unsigned i = 0; i < estimates.size(); ++i){
+      std::vector<StampedPose>::const_iterator next = std::lower_bound(truth.begin(), truth.end(), estimates[i]);
+      std::vector<StampedPose>::const_iterator closest = truth.end();
+      double closestDt = 0.1;
+      if (next != truth.end() && std::abs((next->stamp - estimates[i].stamp).toSec()) <= closestDt){
+        closest = next;
+        closestDt = std::abs((next->stamp - estimates[i].stamp).toSec());
+      }
+      if (next != truth.begin() && std::abs(((next-1)->stamp - estimates[i].stamp).toSec()) <= closestDt)
+        closest = next-1;
+      if (closest == truth.end())
+        continue;
+
+      tf::Pose error = closest->pose.inverseTimes(estimates[i].pose);
+      const double transError = error.getOrigin().length();
+      sumTransError += transError;
+      sumYawError += std::abs(tf::getYaw(error.getRotation()));
+      maxTransError = std::max(maxTransError, transError);
+      numEvaluated++;
+    }
+    if (numEvaluated > 0){
+      printf("pose error (%u poses): translation mean %.3f m, max %.3f m, yaw mean %.2f deg\n",
+             numEvaluated, sumTransError / numEvaluated, maxTransError, sumYawError / numEvaluated * 180.0 / M_PI);
+    } else {
+      printf("pose error: no ground truth within 0.1 s of the estimates on %s\n", truthTopic.c_str());
+    }
+  }
+
+  return 0;
+}
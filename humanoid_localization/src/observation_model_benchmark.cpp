@@ -0,0 +1,208 @@
+/*
+ * 6D localization for humanoid robots
+ *
+ * Copyright 2009-2012 Armin Hornung, University of Freiburg
+ * http://www.ros.org/wiki/humanoid_localization
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Benchmark of the observation models on a synthetic map (a room with
+ * pillars) and a synthetic scan: times integrateMeasurement() of the
+ * EndpointModel on the CPU and on the GPU (if compiled with CUDA), and of
+ * the RaycastingModel with OctoMap and with sphere tracing, and reports the
+ * largest weight difference of each variant to its reference. Usage:
+ *
+ *   observation_model_benchmark [num particles] [num beams] [repetitions]
+ *
+ * Model parameters are read from the private namespace as in the
+ * localization node (if a roscore runs), defaults are used otherwise.
+ */
+
+#include <humanoid_localization/MapModel.h>
+#include <humanoid_localization/RaycastingModel.h>
+#ifndef SKIP_ENDPOINT_MODEL
+  #include <humanoid_localization/EndpointModel.h>
+  #include <humanoid_localization/SphereTracingModel.h>
+#endif
+#ifdef WITH_CUDA_ENDPOINT_MODEL
+  #include <humanoid_localization/EndpointModelGPU.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace humanoid_localization;
+
+namespace {
+
+/// MapModel of a given OcTree (instead of requesting it from the map server)
+class BenchmarkMap : public MapModel{
+public:
+  BenchmarkMap(ros::NodeHandle* nh, boost::shared_ptr<octomap::OcTree> map)
+  : MapModel(nh)
+  {
+    m_map = map;
+    initFloorIndex();
+  }
+
+  virtual bool isOccupied(octomap::OcTreeNode* node) const{
+    return m_map->isNodeOccupied(node);
+  }
+
+  virtual double getFloorHeight(const tf::Transform& pose) const{
+    return 0.0;
+  }
+};
+
+/// 10 x 8 x 2.5 m room with a floor, walls and pillars
+boost::shared_ptr<octomap::OcTree> createMap(double resolution){
+  boost::shared_ptr<octomap::OcTree> map(new octomap::OcTree(resolution));
+  const double sizeX = 10.0, sizeY = 8.0, sizeZ = 2.5;
+
+  for (double x = 0.0; x <= sizeX; x += resolution){
+    for (double y = 0.0; y <= sizeY; y += resolution){
+      map->updateNode(octomap::point3d(x, y, 0.0), true, true);
+
+      const bool wall = x < resolution || y < resolution || x > sizeX - resolution || y > sizeY - resolution;
+      const bool pillar = std::fmod(x, 2.5) < 0.3 && std::fmod(y, 2.0) < 0.3 && x > 1.0 && y > 1.0;
+      if (wall || pillar){
+        for (double z = resolution; z <= sizeZ; z += resolution)
+          map->updateNode(octomap::point3d(x, y, z), true, true);
+      }
+    }
+  }
+  map->updateInnerOccupancy();
+  return map;
+}
+
+/// Particles spread around the room center, weights in log form (0)
+void createParticles(unsigned numParticles, Particles& particles){
+  particles.resize(numParticles);
+  srand(42);
+  for (unsigned i = 0; i < numParticles; ++i){
+    const double x = 4.0 + 2.0 * rand() / RAND_MAX;
+    const double y = 3.0 + 2.0 * rand() / RAND_MAX;
+    const double yaw = 2.0 * M_PI * rand() / RAND_MAX - M_PI;
+    particles.setPosition(i, x, y, 0.3);
+    particles.setRPY(i, 0.0, 0.0, yaw);
+    particles.weight(i) = 0.0;
+  }
+}
+
+/// Scan from a tilted planar laser at 0.5 m height, in the sensor frame
+void createScan(unsigned numBeams, PointCloud& pc, std::vector<float>& ranges){
+  pc.clear();
+  ranges.clear();
+  for (unsigned j = 0; j < numBeams; ++j){
+    const double angle = -2.0 + 4.0 * j / std::max(1u, numBeams - 1);
+    const float range = 1.0f + 3.0f * rand() / RAND_MAX;
+    pcl::PointXYZ p;
+    p.x = range * std::cos(angle);
+    p.y = range * std::sin(angle);
+    p.z = -0.1f * range;
+    pc.push_back(p);
+    ranges.push_back(range);
+  }
+}
+
+/// @return average time of integrateMeasurement in ms, particles are updated
+double timeModel(ObservationModel& model, const Particles& initialParticles, Particles& particles,
+                 const PointCloud& pc, const std::vector<float>& ranges, int repetitions){
+  const tf::Transform baseToSensor(tf::createIdentityQuaternion(), tf::Vector3(0.0, 0.0, 0.2));
+  double time = 0.0;
+  for (int r = 0; r < repetitions; ++r){
+    particles = initialParticles;
+    ros::WallTime start = ros::WallTime::now();
+    model.integrateMeasurement(particles, pc, ranges, 5.0f, baseToSensor);
+    time += (ros::WallTime::now() - start).toSec();
+  }
+  return time / repetitions * 1000.0;
+}
+
+double maxWeightDifference(const Particles& a, const Particles& b){
+  return (a.weights() - b.weights()).abs().maxCoeff();
+}
+
+}
+
+
+int
+main(int argc, char** argv)
+{
+  ros::init(argc, argv, "observation_model_benchmark", ros::init_options::NoRosout);
+  unsigned numParticles = argc > 1 ? atoi(argv[1]) : 500;
+  unsigned numBeams = argc > 2 ? atoi(argv[2]) : 300;
+  int repetitions = argc > 3 ? atoi(argv[3]) : 5;
+
+  ros::NodeHandle nh("~");
+  EngineT rngEngine;
+
+  ros::WallTime start = ros::WallTime::now();
+  boost::shared_ptr<MapModel> mapModel(new BenchmarkMap(&nh, createMap(0.05)));
+  printf("map created in %.2f s, %u particles, %u beams, %d repetitions\n",
+         (ros::WallTime::now() - start).toSec(), numParticles, numBeams, repetitions);
+
+  Particles initialParticles;
+  createParticles(numParticles, initialParticles);
+  PointCloud pc;
+  std::vector<float> ranges;
+  createScan(numBeams, pc, ranges);
+
+  Particles raycastingParticles;
+  RaycastingModel raycastingModel(&nh, mapModel, &rngEngine);
+  printf("raycasting (OctoMap):      %10.2f ms\n",
+         timeModel(raycastingModel, initialParticles, raycastingParticles, pc, ranges, repetitions));
+
+#ifndef SKIP_ENDPOINT_MODEL
+  Particles particles;
+  start = ros::WallTime::now();
+  SphereTracingModel sphereTracingModel(&nh, mapModel, &rngEngine);
+  const double sphereTracingSetup = (ros::WallTime::now() - start).toSec();
+  const double sphereTracingTime = timeModel(sphereTracingModel, initialParticles, particles, pc, ranges, repetitions);
+  printf("raycasting (sphere trac.): %10.2f ms (setup %.2f s), max. weight difference %g\n",
+         sphereTracingTime, sphereTracingSetup, maxWeightDifference(particles, raycastingParticles));
+
+  Particles endpointParticles;
+  start = ros::WallTime::now();
+  EndpointModel endpointModel(&nh, mapModel, &rngEngine);
+  const double endpointSetup = (ros::WallTime::now() - start).toSec();
+  printf("endpoint (CPU):            %10.2f ms (setup %.2f s)\n",
+         timeModel(endpointModel, initialParticles, endpointParticles, pc, ranges, repetitions), endpointSetup);
+
+#ifdef WITH_CUDA_ENDPOINT_MODEL
+  EndpointModelGPU endpointModelGPU(&nh, mapModel, &rngEngine);
+  if (endpointModelGPU.usingGPU()){
+    // first call includes allocating the device buffers:
+    timeModel(endpointModelGPU, initialParticles, particles, pc, ranges, 1);
+    const double gpuTime = timeModel(endpointModelGPU, initialParticles, particles, pc, ranges, repetitions);
+    printf("endpoint (GPU):            %10.2f ms, max. weight difference %g\n",
+           gpuTime, maxWeightDifference(particles, endpointParticles));
+  } else {
+    printf("endpoint (GPU):            not available\n");
+  }
+#else
+  printf("endpoint (GPU):            not compiled (CUDA not found)\n");
+#endif
+
+#else
+  printf("endpoint / sphere tracing: not compiled (dynamicEDT3D not found)\n");
+#endif
+
+  return 0;
+}
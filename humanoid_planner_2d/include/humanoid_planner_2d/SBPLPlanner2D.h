@@ -35,7 +35,13 @@
 #include <sbpl/headers.h>
 #include <visualization_msgs/Marker.h>
 #include <nav_msgs/Path.h>
+#include <gridmap_2d/CostToGo2D.h>
 #include <gridmap_2d/GridMap2D.h>
+#include <humanoid_nav_msgs/PlanPaths2D.h>
+
+#include <list>
+#include <map>
+#include <vector>
 
 
 class SBPLPlanner2D {
@@ -48,7 +54,12 @@ public:
   void startCallback(const geometry_msgs::PoseWithCovarianceStampedConstPtr& start);
   /// calls updateMap()
   void mapCallback(const nav_msgs::OccupancyGridConstPtr& occupancy_map);
-  /// Setup the internal map representation and initialize the SBPL planning environment
+  /**
+   * Setup the internal map representation and initialize the SBPL planning
+   * environment. A map of the same size and origin as the previous one only
+   * updates the cells whose costs changed (at most changed_cells_limit), and
+   * an ADPlanner repairs its search instead of replanning from scratch.
+   */
   bool updateMap(gridmap_2d::GridMap2DPtr map);
 
   gridmap_2d::GridMap2DPtr getMap() const { return map_;};
@@ -71,6 +82,25 @@ public:
    */
   bool plan(double startX, double startY, double goalX, double goalY);
 
+  /**
+   * @brief Plans from start to all goals with a single Dijkstra search on the
+   * inflated map rooted at the start (gridmap_2d::CostToGo2D::shared(),
+   * 8-connected without cutting corners), which stops when all goals are
+   * reached. plan() is independent of it. Results are
+   * kept in an LRU cache of query_cache_size entries per start cell, goal
+   * cell and map revision, repeated queries do not search again.
+   *
+   * @param[out] costs Path length in m per goal, -1 if it is unreachable or invalid.
+   * @param[out] paths If not NULL, the path per goal (empty if unreachable).
+   * @return false if no map is set or the start is invalid.
+   */
+  bool planMultiGoal(const geometry_msgs::Pose& start, const std::vector<geometry_msgs::Pose>& goals,
+                     std::vector<double>& costs, std::vector<nav_msgs::Path>* paths = NULL);
+
+  /// Service handle for planMultiGoal()
+  bool planPathsService(humanoid_nav_msgs::PlanPaths2D::Request& req,
+                        humanoid_nav_msgs::PlanPaths2D::Response& resp);
+
   /// @return costs of the path (=length in m), if planning was successful
   inline double getPathCosts() const{return path_costs_;};
 
@@ -80,12 +110,35 @@ public:
 protected:
   bool plan();
   void setPlanner(); ///< (re)sets the planner
+  /// Costs of all cells of the (inflated) map for EnvironmentNAV2D (index x + y * width)
+  void computeCosts(const gridmap_2d::GridMap2D& map, std::vector<unsigned char>& costs) const;
+  /// Applies the changed cells of costs_ to the environment and notifies the planner
+  void updateCosts(const std::vector<nav2dcell_t>& changed_cells);
+  /// Writes the map pending since mapCallback() to map_cache_file
+  void mapCacheTimerCallback(const ros::WallTimerEvent& event);
+
+  /// Result of planMultiGoal() for one goal
+  struct PathQueryResult {
+    PathQueryResult() : costs(-1) {}
+    int costs; ///< in mm, -1: unreachable
+    std::vector<int> cells; ///< path from start to goal, indices into costs_
+  };
+  /// Key of the query cache: start cell, goal cell, map revision
+  typedef std::pair<std::pair<int, int>, unsigned> PathQueryKey;
+  typedef std::list<std::pair<PathQueryKey, PathQueryResult> > PathQueryList;
+
+  /// Converts cells (indices into costs_) into a path
+  void cellsToPath(const std::vector<int>& cells, nav_msgs::Path& path) const;
+  /// Moves a cached result to the front of the LRU list (NULL if not cached)
+  const PathQueryResult* lookupQuery(const PathQueryKey& key);
+  void insertQuery(const PathQueryKey& key, const PathQueryResult& result);
   ros::NodeHandle nh_;
   ros::Subscriber goal_sub_, start_sub_, map_sub_;
   ros::Publisher path_pub_;
   boost::shared_ptr<SBPLPlanner> planner_;
   boost::shared_ptr<EnvironmentNAV2D> planner_environment_;
   gridmap_2d::GridMap2DPtr map_;
+  gridmap_2d::GridMap2DPtr base_map_; ///< map_ before the inflation (for CostToGo2D)
 
   std::string planner_type_;
   double allocated_time_;
@@ -93,6 +146,20 @@ protected:
   bool search_until_first_solution_;
   bool forward_search_;
   double robot_radius_;
+  std::string map_cache_file_; ///< GridMap2D cache of mapCallback() (empty: none)
+  double map_cache_delay_; ///< time (in s) a new map has to be kept before it is cached
+  ros::WallTimer map_cache_timer_;
+  gridmap_2d::GridMap2DPtr pending_cache_map_; ///< map to write to the cache (NULL: none)
+  boost::uint64_t pending_cache_hash_; ///< hash of the message of pending_cache_map_
+  unsigned long pending_cache_revision_; ///< revision of pending_cache_map_ when created
+  int map_tile_size_; ///< tile size in cells of the GridMap2D of mapCallback() (0: dense)
+  int changed_cells_limit_; ///< more changed cells in updateMap() reset the planner
+  std::vector<unsigned char> costs_; ///< cell costs of planner_environment_ (see computeCosts())
+  unsigned map_revision_; ///< incremented whenever costs_ changes
+
+  int query_cache_size_; ///< maximum number of cached results (0: no cache)
+  PathQueryList query_cache_; ///< most recently used first
+  std::map<PathQueryKey, PathQueryList::iterator> query_cache_index_;
 
   bool start_received_, goal_received_;
   geometry_msgs::Pose start_pose_, goal_pose_;
@@ -28,9 +28,15 @@
 
 #include "humanoid_planner_2d/SBPLPlanner2D.h"
 
+
 SBPLPlanner2D::SBPLPlanner2D()
   : nh_(),
   robot_radius_(0.25),
+  map_cache_delay_(10.0),
+  pending_cache_hash_(0), pending_cache_revision_(0),
+  changed_cells_limit_(20000),
+  map_revision_(0),
+  query_cache_size_(256),
   start_received_(false), goal_received_(false),
   path_costs_(0.0)
 {
@@ -43,6 +49,13 @@ SBPLPlanner2D::SBPLPlanner2D()
   nh_private.param("forward_search", forward_search_, false);
   nh_private.param("initial_epsilon", initial_epsilon_, 3.0);
   nh_private.param("robot_radius", robot_radius_, robot_radius_);
+  nh_private.param("map_cache_file", map_cache_file_, std::string(""));
+  nh_private.param("map_cache_delay", map_cache_delay_, map_cache_delay_);
+  map_cache_timer_ = nh_private.createWallTimer(ros::WallDuration(std::max(map_cache_delay_, 0.001)),
+                                                &SBPLPlanner2D::mapCacheTimerCallback, this, true, false);
+  nh_private.param("map_tile_size", map_tile_size_, 0);
+  nh_private.param("changed_cells_limit", changed_cells_limit_, changed_cells_limit_);
+  nh_private.param("query_cache_size", query_cache_size_, query_cache_size_);
 
   path_pub_ = nh_.advertise<nav_msgs::Path>("path", 0);
 
@@ -190,34 +203,151 @@ bool SBPLPlanner2D::plan(){
 }
 
 void SBPLPlanner2D::mapCallback(const nav_msgs::OccupancyGridConstPtr& occupancy_map){
-  gridmap_2d::GridMap2DPtr map(new gridmap_2d::GridMap2D(occupancy_map));
+  gridmap_2d::GridMap2DPtr map(new gridmap_2d::GridMap2D());
+  if (map_tile_size_ > 0){
+    // distances are only needed for the inflation by the robot radius
+    double halo = robot_radius_ + 2.0 * occupancy_map->info.resolution;
+    map->setMapTiled(occupancy_map, false, map_tile_size_, halo);
+  } else if (!map_cache_file_.empty()){
+    bool cached = map->setMapCached(occupancy_map, false, map_cache_file_);
+    // a new map is only written to the cache once it has not been replaced
+    // for map_cache_delay seconds (instead of for each changing map)
+    map_cache_timer_.stop();
+    pending_cache_map_.reset();
+    if (!cached){
+      pending_cache_map_ = map;
+      pending_cache_hash_ = gridmap_2d::GridMap2D::contentHash(*occupancy_map, false);
+      pending_cache_revision_ = map->revision();
+      map_cache_timer_.start();
+    }
+  } else
+    map->setMap(occupancy_map, false);
   updateMap(map);
 }
 
+void SBPLPlanner2D::mapCacheTimerCallback(const ros::WallTimerEvent& event){
+  gridmap_2d::GridMap2DPtr map;
+  map.swap(pending_cache_map_);
+  // (a map changed in place does not match its message any more)
+  if (!map || map->revision() != pending_cache_revision_)
+    return;
+
+  if (map->saveCache(map_cache_file_, pending_cache_hash_))
+    ROS_INFO("Map written to the cache %s", map_cache_file_.c_str());
+  else
+    ROS_WARN("Could not write the map cache %s", map_cache_file_.c_str());
+}
+
 bool SBPLPlanner2D::updateMap(gridmap_2d::GridMap2DPtr map){
+  // store inflated copy (shared with other users of the same inflation):
+  gridmap_2d::GridMap2DPtr inflated_map = map->inflatedMap(robot_radius_);
+  std::vector<unsigned char> costs;
+  computeCosts(*inflated_map, costs);
+
+  const nav_msgs::MapMetaData& info = inflated_map->getInfo();
+  if (planner_environment_ && map_ && costs.size() == costs_.size() &&
+      map_->getInfo().width == info.width && map_->getInfo().height == info.height &&
+      map_->getInfo().resolution == info.resolution &&
+      map_->getInfo().origin.position.x == info.origin.position.x &&
+      map_->getInfo().origin.position.y == info.origin.position.y &&
+      map_->getFrameID() == inflated_map->getFrameID())
+  {
+    std::vector<nav2dcell_t> changed_cells;
+    for (size_t idx = 0; idx < costs.size(); ++idx){
+      if (costs[idx] != costs_[idx]){
+        nav2dcell_t cell;
+        cell.x = idx % info.width;
+        cell.y = idx / info.width;
+        changed_cells.push_back(cell);
+      }
+    }
+
+    // an identical map keeps the former maps and thereby their revision,
+    // i.e. the cached queries and cost-to-go fields of planMultiGoal() stay valid
+    if (changed_cells.empty()){
+      ROS_DEBUG("Map unchanged");
+      return true;
+    }
+
+    if (int(changed_cells.size()) <= changed_cells_limit_){
+      map_ = inflated_map;
+      base_map_ = map;
+      costs_.swap(costs);
+      ++map_revision_;
+      updateCosts(changed_cells);
+      ROS_DEBUG("Map updated (%zu changed cells)", changed_cells.size());
+      return true;
+    }
+    ROS_DEBUG("%zu changed map cells (limit: %d), resetting the planner", changed_cells.size(), changed_cells_limit_);
+  }
+
+  // hand all costs to a new environment at once
   planner_environment_.reset(new EnvironmentNAV2D());
-  planner_environment_->InitializeEnv(int(map->getInfo().width), int(map->getInfo().height), 0, OBSTACLE_COST);
+  planner_environment_->InitializeEnv(int(info.width), int(info.height),
+                                      costs.empty() ? NULL : &costs[0], OBSTACLE_COST);
   // environment is set up, reset planner:
   setPlanner();
+  map_ = inflated_map;
+  base_map_ = map;
+  costs_.swap(costs);
+  ++map_revision_;
 
-  // store local copy:
-  map_.reset(new gridmap_2d::GridMap2D(*map));
-  map_->inflateMap(robot_radius_);
-
+  ROS_DEBUG("Map set");
 
-  for(unsigned int j = 0; j < map_->getInfo().height; ++j){
-    for(unsigned int i = 0; i < map_->getInfo().width; ++i){
-      if (map_->isOccupiedAtCell(i,j))
-        planner_environment_->UpdateCost(i, j, OBSTACLE_COST);
-      else
-        planner_environment_->UpdateCost(i,j,0);
+  return true;
+}
 
+void SBPLPlanner2D::computeCosts(const gridmap_2d::GridMap2D& map, std::vector<unsigned char>& costs) const{
+  const unsigned width = map.getInfo().width;
+  const unsigned height = map.getInfo().height;
+  costs.resize(size_t(width) * height);
+  if (costs.empty())
+    return;
+
+  // EnvironmentNAV2D keeps dense costs, i.e. tiling only saves the distance
+  // maps here (the inflated cells are read from the binary tiles)
+  if (map.isTiled()){
+    for(unsigned int j = 0; j < height; ++j){
+      for(unsigned int i = 0; i < width; ++i)
+        costs[i + j * width] = map.isOccupiedAtCell(i, j) ? OBSTACLE_COST : 0;
     }
+    return;
   }
 
-  ROS_DEBUG("Map set");
+  // the binary map is transposed (rows: x), EnvironmentNAV2D expects rows of y
+  cv::Mat grid;
+  cv::transpose(map.binaryMap(), grid);
+  cv::Mat occupied;
+  cv::compare(grid, cv::Scalar(gridmap_2d::GridMap2D::FREE), occupied, cv::CMP_NE);
+  cv::Mat cost_map(height, width, CV_8UC1, &costs[0]);
+  cv::bitwise_and(occupied, cv::Scalar(OBSTACLE_COST), cost_map);
+}
 
-  return true;
+void SBPLPlanner2D::updateCosts(const std::vector<nav2dcell_t>& changed_cells){
+  if (changed_cells.empty())
+    return;
+
+  for (size_t i = 0; i < changed_cells.size(); ++i){
+    const nav2dcell_t& cell = changed_cells[i];
+    planner_environment_->UpdateCost(cell.x, cell.y, costs_[cell.x + cell.y * map_->getInfo().width]);
+  }
+
+  boost::shared_ptr<ADPlanner> ad_planner = boost::dynamic_pointer_cast<ADPlanner>(planner_);
+  if (!ad_planner){
+    // ARA* / R* cannot repair their search
+    planner_->force_planning_from_scratch();
+    return;
+  }
+
+  // only the states next to the changed cells are updated for the next replan()
+  std::vector<int> affected_states;
+  if (forward_search_){
+    planner_environment_->GetPredsofChangedEdges(&changed_cells, &affected_states);
+    ad_planner->update_preds_of_changededges(&affected_states);
+  } else {
+    planner_environment_->GetSuccsofChangedEdges(&changed_cells, &affected_states);
+    ad_planner->update_succs_of_changededges(&affected_states);
+  }
 }
 
 void SBPLPlanner2D::setPlanner(){
@@ -230,4 +360,131 @@ void SBPLPlanner2D::setPlanner(){
   }
 }
 
+bool SBPLPlanner2D::planMultiGoal(const geometry_msgs::Pose& start, const std::vector<geometry_msgs::Pose>& goals,
+                                  std::vector<double>& costs, std::vector<nav_msgs::Path>* paths){
+  costs.assign(goals.size(), -1.0);
+  if (paths)
+    paths->assign(goals.size(), nav_msgs::Path());
 
+  if (!map_){
+    ROS_ERROR("Map not set");
+    return false;
+  }
+
+  const unsigned width = map_->getInfo().width;
+  unsigned start_x, start_y;
+  if (!map_->worldToMap(start.position.x, start.position.y, start_x, start_y)){
+    ROS_ERROR("Start coordinates out of map bounds");
+    return false;
+  }
+  const int start_idx = start_x + start_y * width;
+  if (costs_[start_idx] >= OBSTACLE_COST){
+    ROS_ERROR("Start coordinate (%f %f) is occupied in map", start.position.x, start.position.y);
+    return false;
+  }
+
+  // cached results first, the remaining goal cells are searched at once
+  std::vector<PathQueryResult> results(goals.size());
+  std::vector<int> goal_indices(goals.size(), -1);
+  std::vector<bool> cached(goals.size(), false);
+  std::vector<int> search_indices;
+  for (size_t i = 0; i < goals.size(); ++i){
+    unsigned goal_x, goal_y;
+    if (!map_->worldToMap(goals[i].position.x, goals[i].position.y, goal_x, goal_y) ||
+        costs_[goal_x + goal_y * width] >= OBSTACLE_COST)
+      continue;
+    goal_indices[i] = goal_x + goal_y * width;
+    const PathQueryResult* result = lookupQuery(PathQueryKey(std::make_pair(start_idx, goal_indices[i]), map_revision_));
+    if (result){
+      results[i] = *result;
+      cached[i] = true;
+    } else {
+      search_indices.push_back(goal_indices[i]);
+    }
+  }
+
+  if (!search_indices.empty()){
+    // cost-to-go from the start, reused by later queries from the same start on the same map
+    std::vector<cv::Point> stop_cells;
+    for (size_t i = 0; i < search_indices.size(); ++i)
+      stop_cells.push_back(cv::Point(search_indices[i] % width, search_indices[i] / width));
+    gridmap_2d::CostToGoFieldConstPtr field =
+        gridmap_2d::CostToGo2D::shared().get(*base_map_, robot_radius_, start_x, start_y, stop_cells, 0.0);
+
+    std::vector<cv::Point> path_cells;
+    for (size_t i = 0; i < goals.size(); ++i){
+      if (goal_indices[i] < 0 || cached[i])
+        continue;
+      const unsigned goal_x = goal_indices[i] % width;
+      const unsigned goal_y = goal_indices[i] / width;
+      // from the goal to the start
+      if (field->extractPath(goal_x, goal_y, path_cells)){
+        results[i].costs = field->costAt(goal_x, goal_y);
+        results[i].cells.resize(path_cells.size());
+        for (size_t k = 0; k < path_cells.size(); ++k)
+          results[i].cells[path_cells.size() - 1 - k] = path_cells[k].x + path_cells[k].y * width;
+      }
+      insertQuery(PathQueryKey(std::make_pair(start_idx, goal_indices[i]), map_revision_), results[i]);
+    }
+  }
+
+  for (size_t i = 0; i < goals.size(); ++i){
+    if (results[i].costs < 0)
+      continue;
+    // costs of the field are in mm
+    costs[i] = double(results[i].costs) / 1000.0;
+    if (paths)
+      cellsToPath(results[i].cells, (*paths)[i]);
+  }
+  ROS_DEBUG("Planned to %zu goals (%zu searched)", goals.size(), search_indices.size());
+
+  return true;
+}
+
+bool SBPLPlanner2D::planPathsService(humanoid_nav_msgs::PlanPaths2D::Request& req,
+                                     humanoid_nav_msgs::PlanPaths2D::Response& resp){
+  resp.result = planMultiGoal(req.start, req.goals, resp.costs, req.return_paths ? &resp.paths : NULL);
+  return true;
+}
+
+void SBPLPlanner2D::cellsToPath(const std::vector<int>& cells, nav_msgs::Path& path) const{
+  const unsigned width = map_->getInfo().width;
+  path.header.frame_id = map_->getFrameID();
+  path.header.stamp = ros::Time::now();
+  path.poses.resize(cells.size());
+  for (size_t i = 0; i < cells.size(); ++i){
+    double wx, wy;
+    map_->mapToWorld(cells[i] % width, cells[i] / width, wx, wy);
+    path.poses[i].header = path.header;
+    path.poses[i].pose.position.x = wx;
+    path.poses[i].pose.position.y = wy;
+    path.poses[i].pose.position.z = 0.0;
+  }
+}
+
+const SBPLPlanner2D::PathQueryResult* SBPLPlanner2D::lookupQuery(const PathQueryKey& key){
+  std::map<PathQueryKey, PathQueryList::iterator>::iterator it = query_cache_index_.find(key);
+  if (it == query_cache_index_.end())
+    return NULL;
+  query_cache_.splice(query_cache_.begin(), query_cache_, it->second);
+  return &it->second->second;
+}
+
+void SBPLPlanner2D::insertQuery(const PathQueryKey& key, const PathQueryResult& result){
+  if (query_cache_size_ <= 0)
+    return;
+
+  std::map<PathQueryKey, PathQueryList::iterator>::iterator it = query_cache_index_.find(key);
+  if (it != query_cache_index_.end()){
+    it->second->second = result;
+    query_cache_.splice(query_cache_.begin(), query_cache_, it->second);
+    return;
+  }
+
+  query_cache_.push_front(std::make_pair(key, result));
+  query_cache_index_[key] = query_cache_.begin();
+  while (int(query_cache_.size()) > query_cache_size_){
+    query_cache_index_.erase(query_cache_.back().first);
+    query_cache_.pop_back();
+  }
+}
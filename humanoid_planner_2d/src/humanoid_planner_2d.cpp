@@ -37,6 +37,7 @@ public:
     map_sub_ = nh.subscribe<nav_msgs::OccupancyGrid>("map", 1, &SBPLPlanner2D::mapCallback, &planner_);
     goal_sub_ = nh.subscribe<geometry_msgs::PoseStamped>("goal", 1, &SBPLPlanner2D::goalCallback, &planner_);
     start_sub_ = nh.subscribe<geometry_msgs::PoseWithCovarianceStamped>("initialpose", 1, &SBPLPlanner2D::startCallback, &planner_);
+    plan_paths_service_ = nh.advertiseService("plan_paths_2d", &SBPLPlanner2D::planPathsService, &planner_);
 
   }
 
@@ -45,6 +46,7 @@ public:
 protected:
   SBPLPlanner2D planner_;
   ros::Subscriber map_sub_, goal_sub_, start_sub_;
+  ros::ServiceServer plan_paths_service_;
 
 
 };